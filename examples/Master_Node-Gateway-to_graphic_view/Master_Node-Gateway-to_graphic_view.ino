@@ -15,6 +15,7 @@
 #include <LoraWifiMesh.h>
 #include "ArduinoUniqueID.h"
 #define Band    433E6  // LORA Band 433Mhz
+#define RX_INTERRUPT false  // true: the LoRa DIO0 interrupt hands the frames to LWMesh, no LoRa.parsePacket() in loop()
 #define macFormat "%c%c%c%c%c%c"
 
 
@@ -99,8 +100,7 @@ void setup(){
               esp_now_set_self_role(ESP_NOW_ROLE_COMBO);
               esp_now_register_recv_cb([](uint8_t *mac, uint8_t *data, uint8_t len)
               {                
-                memcpy(LWMesh.dataReceived, data, len);   
-                LWMesh.processMsg(len, LWMesh.dataReceived);
+                LWMesh.pushFrame(data, len);         // processed by LWMesh.yield()
               });
               
         #elif defined (_HELTEC_)                  //-------- ESP_NOW for ESP32 based boards
@@ -167,6 +167,20 @@ void setup(){
     nc.keepAlive           = true;
     nc.keepAliveInterval   = LORA_MESH_KEEP_ALIVE_INTERVAL;
     nc.debugLevel          = 0;
+    nc.modem.sf            = 7;               // same as the LoRa settings above, for the airtime
+    nc.modem.bw            = 125E3;
+    nc.modem.cr            = 5;
+    nc.modem.preamble      = 8;
+    nc.modem.crc           = false;
+    nc.dutyCycle           = 0;               // per-mille, 10 for the 1% EU 868 sub-bands
+    nc.dutyCycleWindow     = LORA_MESH_DUTY_WINDOW;
+    nc.txPower             = LORA_MESH_TX_POWER;
+    nc.txPowerMin          = LORA_MESH_TX_POWER_MIN;
+    nc.adr                 = false;           // adaptive SF and power per neighbour, with nc.hopAck
+    nc.adrTarget           = LORA_MESH_ADR_TARGET;
+    nc.rxInterrupt         = RX_INTERRUPT;
+    nc.csma                = false;           // listen before talk, random backoff on a busy channel
+    nc.rreqCounter         = 0;               // RREQ not passed on once that many copies were heard, 0: always
     memcpy(nc.macAddress,_mac,6);
     //        memcpy(nc.pathToMaster,"981",3);
     sprintf((char*)nc.blockNodes,macFormat,0x00, 0x00, 0x00, 0x00, 0x00,0x00, 0x00, 0x00);
@@ -203,7 +217,7 @@ void sendNetInfo(char opt){
                   n.meshNetwork[slotCount].sts = LWMesh.meshNetwork[slot].sts ;
               }
               for(byte i = 0; i<4; i++) {
-                    n.meshNetwork[slotCount].path[i] = LWMesh.meshNetwork[slot].path[i];
+                    n.meshNetwork[slotCount].path[i] = (i < LWMesh.meshNetwork[slot].path.len) ? LWMesh.meshNetwork[slot].path.node[i] : 0x00;
               }           
               slotCount++;
           }
@@ -303,7 +317,7 @@ void loop()
       LWMesh.dumpRTable();    
       //   LWMesh.dumpMSGTable();
     }
-     onReceive(LoRa.parsePacket());
+     if (!RX_INTERRUPT) onReceive(LoRa.parsePacket());
   }
 }
 
@@ -329,8 +343,7 @@ void OnDataSent(const uint8_t *mac_addr, esp_now_send_status_t status) {
 
 void OnDataRecv(const uint8_t * mac, const uint8_t *data, int len)
 {
-  memcpy(LWMesh.dataReceived, data, len);
-  LWMesh.processMsg(len, LWMesh.dataReceived);
+  LWMesh.pushFrame(data, len);         // processed by LWMesh.yield()
 };
 
 #endif
@@ -339,7 +352,7 @@ void OnDataRecv(const uint8_t * mac, const uint8_t *data, int len)
 ///------------------
 
 void execAnySerialCmd() {
-  byte _id;
+  MSG_ID _id;
   byte dest;
   byte cnt;
   char ch;
@@ -369,7 +382,7 @@ void execAnySerialCmd() {
         Serial.print(F("] to : "));
         Serial.println(dest);
         _id = LWMesh.getRREQ(d);
-        if (_id >= 0) {
+        if (!MESH_ID_ERROR(_id)) {
           Serial.print (F("Sent ID: "));
           Serial.print(_id);
           Serial.print(F(" ["));
@@ -378,7 +391,7 @@ void execAnySerialCmd() {
           Serial.print( _p );
           Serial.println(F("\"              "));
         }
-        else LWMesh.stringSts (_id);
+        else LWMesh.stringSts ((STSCODE)_id);
       }
 
       if ((c1 == 0x44) || (c1 == 0x64)) {
@@ -395,7 +408,7 @@ void execAnySerialCmd() {
         Serial.print(F("] using route : "));
         Serial.println(_p);
         _id = LWMesh.sendMsg(d, _m, _p);
-        if (_id >= 0) {
+        if (!MESH_ID_ERROR(_id)) {
           Serial.print (F("Sent ID: "));
           Serial.print(_id);
           Serial.print(F(" ["));
@@ -404,7 +417,7 @@ void execAnySerialCmd() {
           Serial.print( _p );
           Serial.println(F("\"        "));
         }
-        else LWMesh.stringSts (_id);
+        else LWMesh.stringSts ((STSCODE)_id);
       }
       cnt = 0;
       memset(_m, 0, LORA_MESH_MAX_MSG_SIZE);
@@ -19,8 +19,8 @@
 //              while (LWMesh.hasMsg(&rec)) {}
 //
 //      and send messages with :
-//          byte _id = LWMesh.sendMsg(nodeAddress,chars,path);   // when you known the path : example "942" .... this node (9) wants to send a message to node (2) passing by node (4)
-//          byte _id = LWMesh.sendMsg(nodeAddress,chars);        // when you don't know the path... the routing protocol will then try to find a route and if found send the message.
+//          MSG_ID _id = LWMesh.sendMsg(nodeAddress,chars,path);   // when you known the path : example "942" .... this node (9) wants to send a message to node (2) passing by node (4)
+//          MSG_ID _id = LWMesh.sendMsg(nodeAddress,chars);        // when you don't know the path... the routing protocol will then try to find a route and if found send the message.
 //              
 //      all sent and received messages are (non blocking)...and all sent messages will have a ACK ...and retry.
 //      so after calling LWMesh.send@sectionMsg... there's no confirmation yet of the deliver.
@@ -51,6 +51,7 @@
 #include "ArduinoUniqueID.h"
 #define MASTER_NODE 0x39 // 
 #define Band    433E6  // LORA Band 433Mhz
+#define RX_INTERRUPT false  // true: the LoRa DIO0 interrupt hands the frames to LWMesh, no LoRa.parsePacket() in loop()
 #define macFormat "%c%c%c%c%c%c"
 
 void setup(){
@@ -120,8 +121,7 @@ void setup(){
               esp_now_set_self_role(ESP_NOW_ROLE_COMBO);
               esp_now_register_recv_cb([](uint8_t *mac, uint8_t *data, uint8_t len)
               {                
-                memcpy(LWMesh.dataReceived, data, len);   
-                LWMesh.processMsg(len, LWMesh.dataReceived);
+                LWMesh.pushFrame(data, len);         // processed by LWMesh.yield()
               });
               
         #elif defined (_HELTEC_)                  //-------- ESP_NOW for ESP32 based boards
@@ -189,6 +189,20 @@ void setup(){
     nc.keepAlive           = true;
     nc.keepAliveInterval   = LORA_MESH_KEEP_ALIVE_INTERVAL;
     nc.debugLevel          = 0;
+    nc.modem.sf            = 7;               // same as the LoRa settings above, for the airtime
+    nc.modem.bw            = 125E3;
+    nc.modem.cr            = 5;
+    nc.modem.preamble      = 8;
+    nc.modem.crc           = false;
+    nc.dutyCycle           = 0;               // per-mille, 10 for the 1% EU 868 sub-bands
+    nc.dutyCycleWindow     = LORA_MESH_DUTY_WINDOW;
+    nc.txPower             = LORA_MESH_TX_POWER;
+    nc.txPowerMin          = LORA_MESH_TX_POWER_MIN;
+    nc.adr                 = false;           // adaptive SF and power per neighbour, with nc.hopAck
+    nc.adrTarget           = LORA_MESH_ADR_TARGET;
+    nc.rxInterrupt         = RX_INTERRUPT;
+    nc.csma                = false;           // listen before talk, random backoff on a busy channel
+    nc.rreqCounter         = 0;               // RREQ not passed on once that many copies were heard, 0: always
     memcpy(nc.macAddress,_mac,6);
     //        memcpy(nc.pathToMaster,"xyz",3);
     sprintf((char*)nc.blockNodes,macFormat,0x00, 0x00, 0x00, 0x00, 0x00,0x00, 0x00, 0x00);
@@ -240,7 +254,7 @@ void loop()
       LWMesh.dumpNetwork();
       LWMesh.dumpRTable();    
     }
-     onReceive(LoRa.parsePacket());
+     if (!RX_INTERRUPT) onReceive(LoRa.parsePacket());
   }
 }
 
@@ -262,7 +276,6 @@ void onReceive(int packetSize)
       
       void OnDataRecv(const uint8_t * mac, const uint8_t *data, int len)
       {
-        memcpy(LWMesh.dataReceived, data, len);
-        LWMesh.processMsg(len, LWMesh.dataReceived);
+        LWMesh.pushFrame(data, len);         // processed by LWMesh.yield()
       };
 #endif
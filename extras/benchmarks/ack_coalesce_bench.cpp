@@ -0,0 +1,92 @@
+// Copyright © 2020 by antónio montez . All rights reserved.
+// Licensed under the MIT license.
+//
+//   Delayed, cumulative and piggy-backed end to end ACKs on a line sensor -> relay -> gateway.
+//     burst      every <period> ms the sensor sends <burst> readings back to back to the gateway: one cumulative ACK
+//     request    the gateway sends a command, the sensor answers it at once: the ACK of the command rides on the answer
+//                (a command delivered twice is answered twice)
+//   For each ACK delay reports the frames and airtime per acknowledged message, the ACK latency and how many ACKs
+//   were coalesced or piggy-backed.
+//
+//   build (from the library root):
+//        g++ -std=gnu++11 -O2 -DLORA_MESH_HOST -Isrc -Iextras/simulator src/*.cpp extras/simulator/MeshSimulator.cpp extras/benchmarks/ack_coalesce_bench.cpp -o ack_coalesce_bench
+//
+//   usage:
+//        ./ack_coalesce_bench [burst] [rounds] [period_ms] [loss]
+
+#include "MeshSimulator.h"
+
+#include <map>
+
+static void run(const char *name, long ackDelay, bool request, int burst, int rounds, unsigned long period, double loss){
+    MeshSimulator sim(1);
+    sim.defaults.ackDelay = ackDelay;
+    int gw = sim.addNode(0x31, 0x31);
+    sim.addNode(0x32, 0x31);
+    int sensor = sim.addNode(0x33, 0x31);
+    sim.line(loss);
+
+    std::map<int, unsigned long> sentAt[3];
+    unsigned long sent = 0, acked = 0, timeouts = 0, latencySum = 0;
+    char msg[LORA_MESH_MAX_MSG_SIZE];
+
+    sim.onReceive = [&](int node, const RECEIVED_Packet &rec) {
+        if (node == 1) return;
+        if (request && (node == sensor) && (rec._pkt.sts == STS_RECEIVED)) {
+            snprintf(msg, sizeof(msg), "re %d", rec._pkt.msgId);
+            sentAt[sensor][sim.node(sensor).sendMsg(sim.node(gw).LocalAddress, msg)] = sim.now();
+            sent++;
+            return;
+        }
+        if (rec._pkt.sts == STS_TIMEOUT) { timeouts++; sentAt[node].erase(rec._pkt.msgId); }
+        if (rec._pkt.sts != STS_MSG_ACK_REGISTRATION_DONE) return;
+        std::map<int, unsigned long>::iterator it = sentAt[node].find(rec._pkt.msgId);
+        if (it == sentAt[node].end()) return;
+        acked++;
+        latencySum += sim.now() - it->second;
+        sentAt[node].erase(it);
+    };
+
+    // warm-up: routes both ways
+    sim.node(sensor).sendMsg(sim.node(gw).LocalAddress, (char *)"hello");
+    sim.node(gw).sendMsg(sim.node(sensor).LocalAddress, (char *)"hello");
+    sim.run(period);
+    SimStats before = sim.stats;
+    sent = acked = 0;
+    for (int r = 0; r < rounds; r++) {
+        for (int i = 0; i < (request ? 1 : burst); i++) {
+            snprintf(msg, sizeof(msg), "%s %d.%d", request ? "cmd" : "temp", r, i);
+            int from = request ? gw : sensor;
+            int to = request ? sensor : gw;
+            sentAt[from][sim.node(from).sendMsg(sim.node(to).LocalAddress, msg)] = sim.now();
+            sent++;
+        }
+        sim.run(period);
+    }
+
+    unsigned long coalesced = 0, piggybacked = 0;
+    for (int i = 0; i < sim.nodeCount(); i++) {
+        coalesced += sim.node(i).stats.acksCoalesced;
+        piggybacked += sim.node(i).stats.acksPiggybacked;
+    }
+    unsigned long frames = sim.stats.framesSent - before.framesSent;
+    unsigned long airtime = sim.stats.airtime - before.airtime;
+    printf("  %-8s ackDelay=%-4ld acked=%lu/%lu timeouts=%-3lu frames/msg=%5.2f airtime/msg=%5lums ackLatency=%5lums coalesced=%lu piggybacked=%lu\n",
+           name, ackDelay, acked, sent, timeouts, acked ? (double)frames / acked : 0.0, acked ? airtime / acked : 0,
+           acked ? latencySum / acked : 0, coalesced, piggybacked);
+}
+
+int main(int argc, char **argv){
+    int burst = (argc > 1) ? atoi(argv[1]) : 4;
+    int rounds = (argc > 2) ? atoi(argv[2]) : 50;
+    unsigned long period = (argc > 3) ? strtoul(argv[3], 0, 10) : 20000;
+    double loss = (argc > 4) ? atof(argv[4]) : 0.0;
+    const long delays[] = {0, 50, 200};
+
+    if (burst > LORA_MESH_MSG_QUEUE_SIZE / 2) burst = LORA_MESH_MSG_QUEUE_SIZE / 2;
+    Serial.enabled = false;
+    printf("sensor -> relay -> gateway, %d rounds every %lums, loss %.0f%% per link\n", rounds, period, loss * 100);
+    for (int i = 0; i < 3; i++) run("burst", delays[i], false, burst, rounds, period, loss);
+    for (int i = 0; i < 3; i++) run("request", delays[i], true, burst, rounds, period, loss);
+    return 0;
+}
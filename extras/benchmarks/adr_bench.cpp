@@ -0,0 +1,107 @@
+// Copyright © 2020 by antónio montez . All rights reserved.
+// Licensed under the MIT license.
+//
+//   Adaptive data rate on a star: <sensors> nodes around a gateway, their links spread from +10 dB SNR (next to
+//   it) down to -14 dB (at the edge) at 17 dBm. Every sensor sends one reading every <period> ms to the gateway,
+//   hop ACKs on. For each setting reports the readings acknowledged end to end, the airtime and the transmit
+//   energy (dBm converted to mW, times the airtime) per acknowledged reading, then the SF / power each sensor
+//   ended up with towards the gateway.
+//     SF7 / SF12     one fixed modem for everybody, at full power
+//     adr multi-SF   adaptive SF and power, every radio receives SF7..SF12 at once (concentrator like)
+//     adr power      adaptive power only, every radio listens on SF12 alone (SX127x)
+//   The simulated radio loses a frame below the SNR floor of its SF and part of them within 3 dB over it.
+//
+//   build (from the library root):
+//        g++ -std=gnu++11 -O2 -DLORA_MESH_HOST -Isrc -Iextras/simulator src/*.cpp extras/simulator/MeshSimulator.cpp extras/benchmarks/adr_bench.cpp -o adr_bench
+//
+//   usage:
+//        ./adr_bench [sensors] [period_ms] [seconds] [seed]
+
+#include "MeshSimulator.h"
+
+#include <math.h>
+#include <map>
+
+#define ALL_SF 0x7E                        // SF7..SF12
+
+static void run(const char *name, uint8_t sf, bool adr, bool multiSf, int sensors, unsigned long period,
+                unsigned long seconds, uint32_t seed){
+    MeshSimulator sim(seed);
+    LORA_MODEM modem = {sf, 125000, 5, 8, false};
+    sim.defaults.modem = modem;
+    sim.defaults.hopAck = true;
+    sim.defaults.hopAckTimeout = 5000;
+    sim.defaults.adr = adr;
+    sim.setModem(modem);
+    int gw = sim.addNode(0x31, 0x31);
+    for (int i = 0; i < sensors; i++) {
+        int s = sim.addNode((uint8_t)(0x32 + i), 0x31);
+        int8_t snr = (int8_t)(10 - (sensors > 1 ? 24 * i / (sensors - 1) : 0));
+        sim.link(gw, s);
+        sim.signal(gw, s, (int16_t)(-100 + snr), snr);
+    }
+    if (multiSf) {
+        for (int i = 0; i < sim.nodeCount(); i++) sim.setRxSfMask(i, ALL_SF);
+    }
+
+    std::map<int, unsigned long> sentAt[64];
+    unsigned long sent = 0, acked = 0, timeouts = 0;
+    double energy = 0, airtime = 0;
+
+    sim.onTransmit = [&](int /* node */, unsigned long /* at */, const SimFrame &frame) {
+        LORA_MODEM m = modem;
+        m.sf = frame.sf;
+        double ms = meshLoraAirtime(m, (uint16_t)frame.data.size()) / 1000.0;
+        airtime += ms;
+        energy += ms * pow(10.0, frame.power / 10.0) / 1000.0;      // mW * ms = uJ, in mJ
+    };
+    sim.onReceive = [&](int node, const RECEIVED_Packet &rec) {
+        if (node == gw) return;
+        if (rec._pkt.sts == STS_TIMEOUT) { timeouts++; sentAt[node].erase(rec._pkt.msgId); }
+        if (rec._pkt.sts != STS_MSG_ACK_REGISTRATION_DONE) return;
+        std::map<int, unsigned long>::iterator it = sentAt[node].find(rec._pkt.msgId);
+        if (it == sentAt[node].end()) return;
+        acked++;
+        sentAt[node].erase(it);
+    };
+
+    char msg[LORA_MESH_MAX_MSG_SIZE];
+    unsigned long step = period / sensors;
+    for (unsigned long t = 0; t < seconds * 1000; t += period) {
+        for (int i = 1; i <= sensors; i++) {
+            snprintf(msg, sizeof(msg), "temp %d %lu", i, t / period);
+            sentAt[i][sim.node(i).sendMsg(sim.node(gw).LocalAddress, msg)] = sim.now();
+            sent++;
+            sim.run(step);
+        }
+    }
+    sim.run(60000);
+
+    printf("  %-14s acked=%4lu/%-4lu timeouts=%-3lu airtime/msg=%6.1fms energy/msg=%6.2fmJ links:",
+           name, acked, sent, timeouts, acked ? airtime / acked : 0.0, acked ? energy / acked : 0.0);
+    for (int i = 1; i <= sensors; i++) {
+        uint8_t s;
+        int8_t p;
+        if (sim.node(i).linkParams(sim.node(gw).LocalAddress, s, p)) printf(" SF%u/%d", s, p);
+        else printf(" SF%u/%d", sf, LORA_MESH_TX_POWER);
+    }
+    printf("\n");
+}
+
+int main(int argc, char **argv){
+    int sensors = (argc > 1) ? atoi(argv[1]) : 6;
+    unsigned long period = (argc > 2) ? strtoul(argv[2], 0, 10) : 60000;
+    unsigned long seconds = (argc > 3) ? strtoul(argv[3], 0, 10) : 3600;
+    uint32_t seed = (argc > 4) ? strtoul(argv[4], 0, 10) : 1;
+
+    if (sensors < 1) sensors = 1;
+    if (sensors > 32) sensors = 32;
+    Serial.enabled = false;
+    printf("%d sensors -> gateway, SNR +10 .. -14 dB at %d dBm, one reading each every %lums for %lus\n",
+           sensors, LORA_MESH_TX_POWER, period, seconds);
+    run("SF7", 7, false, false, sensors, period, seconds, seed);
+    run("SF12", 12, false, false, sensors, period, seconds, seed);
+    run("adr multi-SF", 12, true, true, sensors, period, seconds, seed);
+    run("adr power", 12, true, false, sensors, period, seconds, seed);
+    return 0;
+}
@@ -0,0 +1,91 @@
+// Copyright © 2020 by antónio montez . All rights reserved.
+// Licensed under the MIT license.
+//
+//   Aggregation at a gateway: the gateway reaches <leaves> nodes through one relay.  Every <period> ms it sends
+//   a short command to each leaf at once, so all of them queue for the same next hop, and so do the ACKs coming
+//   back through the relay.  After a warm-up burst (route requests) reports, for each aggregation delay, the
+//   frames and airtime per burst, the messages acknowledged and how long a burst takes to be fully acknowledged.
+//   The end to end runs turn the next hop watch off: the simulated transmitter queues a whole burst back to back,
+//   past ~20 leaves the relay's frames leave later than the watch timer and every run ends in retries.
+//
+//   build (from the library root, the gateway needs a deeper transmit queue than the default):
+//        g++ -std=gnu++11 -O2 -DLORA_MESH_HOST -DLORA_MESH_MSG_QUEUE_SIZE=64 -Isrc -Iextras/simulator src/*.cpp extras/simulator/MeshSimulator.cpp extras/benchmarks/agg_fanout_bench.cpp -o agg_fanout_bench
+//
+//   usage:
+//        ./agg_fanout_bench [leaves] [bursts] [period_ms] [loss]
+
+#include "MeshSimulator.h"
+
+#include <map>
+
+static void run(long aggDelay, bool hopAck, int leaves, int bursts, unsigned long period, double loss){
+    MeshSimulator sim(1);
+    sim.defaults.aggDelay = aggDelay;
+    sim.defaults.hopAck = hopAck;
+    if (!hopAck) sim.defaults.hopAckTimeout = 0;
+    int gw = sim.addNode(0x31, 0x31);
+    int relay = sim.addNode(0x32, 0x31);
+    for (int i = 0; i < leaves; i++) sim.link(relay, sim.addNode((uint8_t)(0x33 + i), 0x31), loss);
+    sim.link(gw, relay, loss);
+
+    std::map<int, unsigned long> sentAt;
+    unsigned long acked = 0, timeouts = 0, doneAt = 0, burstAt = 0;
+
+    sim.onReceive = [&](int node, const RECEIVED_Packet &rec) {
+        if (node != gw) return;
+        if (rec._pkt.sts == STS_TIMEOUT) { timeouts++; sentAt.erase(rec._pkt.msgId); }
+        if (rec._pkt.sts != STS_MSG_ACK_REGISTRATION_DONE) return;
+        std::map<int, unsigned long>::iterator it = sentAt.find(rec._pkt.msgId);
+        if (it == sentAt.end()) return;
+        acked++;
+        sentAt.erase(it);
+        if (sentAt.empty()) doneAt += sim.now() - burstAt;
+    };
+
+    char msg[LORA_MESH_MAX_MSG_SIZE];
+    SimStats before;
+    for (int b = 0; b <= bursts; b++) {
+        if (b == 1) {
+            // the first burst only learns the routes
+            before = sim.stats;
+            acked = timeouts = doneAt = 0;
+        }
+        sentAt.clear();
+        burstAt = sim.now();
+        for (int i = 0; i < leaves; i++) {
+            snprintf(msg, sizeof(msg), "set %d", b);
+            sentAt[sim.node(gw).sendMsg(sim.node(2 + i).LocalAddress, msg)] = sim.now();
+        }
+        sim.run(period);
+    }
+
+    unsigned long frames = sim.stats.framesSent - before.framesSent;
+    unsigned long airtime = sim.stats.airtime - before.airtime;
+    unsigned long aggFrames = 0, aggDatagrams = 0;
+    for (int i = 0; i < sim.nodeCount(); i++) {
+        aggFrames += sim.node(i).stats.aggFramesSent;
+        aggDatagrams += sim.node(i).stats.aggDatagrams;
+    }
+    printf("  aggDelay=%-4ld frames/burst=%6.1f airtime/burst=%6lums acked=%lu/%lu timeouts=%-3lu burst done in %6lums aggregates=%lu/%lu\n",
+           aggDelay, (double)frames / bursts, airtime / bursts, acked, (unsigned long)bursts * leaves, timeouts,
+           doneAt / bursts, aggFrames, aggDatagrams);
+}
+
+int main(int argc, char **argv){
+    int leaves = (argc > 1) ? atoi(argv[1]) : 16;
+    int bursts = (argc > 2) ? atoi(argv[2]) : 20;
+    unsigned long period = (argc > 3) ? strtoul(argv[3], 0, 10) : 30000;
+    double loss = (argc > 4) ? atof(argv[4]) : 0.0;
+    const long delays[] = {0, 50, 100};
+
+    if (leaves > LORA_MESH_MSG_QUEUE_SIZE / 2) leaves = LORA_MESH_MSG_QUEUE_SIZE / 2;
+    if (bursts < 1) bursts = 1;
+    Serial.enabled = false;
+    printf("gateway -> relay -> %d leaves, %d bursts of one message per leaf every %lums, loss %.0f%% per link\n",
+           leaves, bursts, period, loss * 100);
+    printf("end to end ACKs, no next hop watch\n");
+    for (int i = 0; i < 3; i++) run(delays[i], false, leaves, bursts, period, loss);
+    printf("hop ACKs\n");
+    for (int i = 0; i < 3; i++) run(delays[i], true, leaves, bursts, period, loss);
+    return 0;
+}
@@ -0,0 +1,80 @@
+// Copyright © 2020 by antónio montez . All rights reserved.
+// Licensed under the MIT license.
+//
+//   Micro-benchmark of the CRC engines: the original bit-serial CRC8 against the table driven
+//   CRC8 / CRC16 / CRC32 of LoraWifiMeshCRC.h.  Reports bytes per CPU cycle (rdtsc on x86, otherwise
+//   nanoseconds are used and a 1 GHz clock is assumed) for a datagram sized buffer and a 4KB buffer.
+//
+//   build (from the library root):
+//        g++ -std=gnu++11 -O2 -DLORA_MESH_HOST -Isrc extras/benchmarks/crc_bench.cpp -o crc_bench
+
+#include "LoraWifiMeshCRC.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+static inline uint64_t cycles() { return __rdtsc(); }
+#else
+static inline uint64_t cycles() {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+#endif
+
+// the original LoraWifiMesh::CRC, kept here as the reference
+static uint8_t crc8Bitwise(const uint8_t *data, uint16_t len) {
+  uint8_t crc = 0x00;
+  while (len--) {
+    uint8_t extract = *data++;
+    for (uint8_t tempI = 8; tempI; tempI--) {
+      uint8_t sum = (crc ^ extract) & 0x01;
+      crc >>= 1;
+      if (sum) {
+        crc ^= 0x8C;
+      }
+      extract >>= 1;
+    }
+  }
+  return crc;
+}
+
+static volatile uint32_t sink;
+
+template <typename F>
+static double bytesPerCycle(F f, const uint8_t *buf, uint16_t len, unsigned long iterations) {
+    uint64_t t0 = cycles();
+    for (unsigned long i = 0; i < iterations; i++) {
+        __asm__ __volatile__("" : : "r"(buf) : "memory");    // keep the compiler from hoisting the call
+        sink += f(buf, len);
+    }
+    uint64_t t1 = cycles();
+    return (double)len * iterations / (double)(t1 - t0);
+}
+
+int main(){
+    static uint8_t buf[4096];
+    uint32_t x = 12345;
+    for (size_t i = 0; i < sizeof(buf); i++) { x = x * 1103515245 + 12345; buf[i] = (uint8_t)(x >> 16); }
+
+    const uint8_t *check = (const uint8_t *)"123456789";
+    printf("check values: crc8=%02X (A1) crc16=%04X (2189) crc32=%08X (CBF43926)\n",
+           meshCrc8(check, 9), meshCrc16(check, 9), (unsigned)meshCrc32(check, 9));
+
+    for (uint16_t len = 1; len < 300; len++) {
+        if (crc8Bitwise(buf, len) != meshCrc8(buf, len)) { printf("MISMATCH at len %u\n", len); return 1; }
+    }
+
+    uint16_t sizes[] = { 50, 4096 };
+    for (size_t s = 0; s < 2; s++) {
+        uint16_t len = sizes[s];
+        unsigned long it = 20000000UL / len;
+        printf("buffer %4u bytes: bitwise crc8 %.3f  table crc8 %.3f  crc16 %.3f  crc32 %.3f  bytes/cycle\n", len,
+               bytesPerCycle(crc8Bitwise, buf, len, it),
+               bytesPerCycle(meshCrc8, buf, len, it),
+               bytesPerCycle(meshCrc16, buf, len, it),
+               bytesPerCycle(meshCrc32, buf, len, it));
+    }
+    return 0;
+}
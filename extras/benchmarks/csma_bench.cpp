@@ -0,0 +1,93 @@
+// Copyright © 2020 by antónio montez . All rights reserved.
+// Licensed under the MIT license.
+//
+//   Listen before talk on a shared LoRa channel, with the collision model of the simulator (two frames overlapping
+//   at a receiver are both lost, a node sending hears nothing). Every node but the gateway sends one reading every
+//   <period> ms to the gateway, the first ones flood RREQs through the whole network. Two topologies: a full mesh
+//   (everybody hears everybody, the relays of a flood go at once) and a grid where each node hears its 4 neighbours
+//   (hidden terminals: two nodes two cells apart can't hear each other, the channel check only sees the others).
+//   Without and with nc.csma: readings acknowledged end to end, latency, receptions lost to collisions, backoffs,
+//   frames sent anyway after LORA_MESH_CSMA_MAX_BACKOFFS busy checks, and frames on the air per acknowledged reading.
+//
+//   build (from the library root):
+//        g++ -std=gnu++11 -O2 -DLORA_MESH_HOST -Isrc -Iextras/simulator src/*.cpp extras/simulator/MeshSimulator.cpp extras/benchmarks/csma_bench.cpp -o csma_bench
+//
+//   usage:
+//        ./csma_bench [side] [period_ms] [seconds] [seed]
+//
+//        grid of side x side nodes, full mesh of 2 side + 1 nodes (default 4: 16 and 9)
+
+#include "MeshSimulator.h"
+
+#include <map>
+
+static void run(const char *topology, bool csma, int side, unsigned long period, unsigned long seconds, uint32_t seed){
+    MeshSimulator sim(seed);
+    bool grid = (strcmp(topology, "grid") == 0);
+    int nodes = grid ? side * side : side + 1;
+
+    sim.collisions = true;
+    sim.defaults.csma = csma;
+    sim.defaults.hopAck = false;
+    for (int i = 0; i < nodes; i++) sim.addNode((uint8_t)(0x31 + i), 0x31);
+    if (grid) {
+        for (int r = 0; r < side; r++) {
+            for (int c = 0; c < side; c++) {
+                if (c + 1 < side) sim.link(r * side + c, r * side + c + 1);
+                if (r + 1 < side) sim.link(r * side + c, (r + 1) * side + c);
+            }
+        }
+    }
+    else sim.fullMesh();
+
+    std::map<int, unsigned long> sentAt[64];
+    unsigned long sent = 0, acked = 0, latency = 0;
+
+    sim.onReceive = [&](int node, const RECEIVED_Packet &rec) {
+        if (rec._pkt.sts != STS_MSG_ACK_REGISTRATION_DONE) return;
+        std::map<int, unsigned long>::iterator it = sentAt[node].find(rec._pkt.msgId);
+        if (it == sentAt[node].end()) return;
+        acked++;
+        latency += sim.now() - it->second;
+        sentAt[node].erase(it);
+    };
+
+    char msg[LORA_MESH_MAX_MSG_SIZE];
+    unsigned long step = period / (nodes - 1);
+    for (unsigned long t = 0; t < seconds * 1000; t += period) {
+        for (int s = 1; s < nodes; s++) {
+            snprintf(msg, sizeof(msg), "temp %d %lu", s, t / period);
+            sentAt[s][sim.node(s).sendMsg(sim.node(0).LocalAddress, msg)] = sim.now();
+            sent++;
+            sim.run(step);
+        }
+    }
+    sim.run(60000);
+
+    LORA_MESH_STATS total = {};
+    for (int i = 0; i < sim.nodeCount(); i++) {
+        total.txBackoffs += sim.node(i).stats.txBackoffs;
+        total.csmaForced += sim.node(i).stats.csmaForced;
+        total.rreqRelayed += sim.node(i).stats.rreqRelayed;
+    }
+    printf("  %-4s %-3s nodes=%-3d acked=%4lu/%-4lu latency=%6lums collided=%-6lu backoffs=%-6lu forced=%-4lu rreqRelayed=%-5lu frames/msg=%5.1f\n",
+           topology, csma ? "on" : "off", nodes, acked, sent, acked ? latency / acked : 0, sim.stats.framesCollided,
+           total.txBackoffs, total.csmaForced, total.rreqRelayed, acked ? (double)sim.stats.framesSent / acked : 0.0);
+}
+
+int main(int argc, char **argv){
+    int side = (argc > 1) ? atoi(argv[1]) : 4;
+    unsigned long period = (argc > 2) ? strtoul(argv[2], 0, 10) : 30000;
+    unsigned long seconds = (argc > 3) ? strtoul(argv[3], 0, 10) : 600;
+    uint32_t seed = (argc > 4) ? strtoul(argv[4], 0, 10) : 1;
+
+    if (side < 2) side = 2;
+    if (side > 7) side = 7;
+    Serial.enabled = false;
+    printf("collision model, every node sends one reading to the gateway every %lums for %lus\n", period, seconds);
+    run("full", false, side * 2, period, seconds, seed);
+    run("full", true, side * 2, period, seconds, seed);
+    run("grid", false, side, period, seconds, seed);
+    run("grid", true, side, period, seconds, seed);
+    return 0;
+}
@@ -0,0 +1,117 @@
+// Copyright © 2020 by antónio montez . All rights reserved.
+// Licensed under the MIT license.
+//
+//   Duty cycle governor on a line sensor -> relay -> gateway at SF9 / 125 kHz, window compressed to <window> ms
+//   so an hour of regulation fits in a short run. The sensor sends a reading every <period> ms, more than the
+//   relay may put on the air at the lower limits (sendMsg() is refused while the queue is full). For each limit reports the messages delivered and acknowledged,
+//   the frames deferred, and per node the busiest window: its airtime measured on the simulated radio (every
+//   window of that length, not the node's own buckets) against the budget.
+//   First prints the airtime of a 20 byte frame per spreading factor, to check the formula against the
+//   Semtech calculator (SF7 56.6 ms ... SF12 1318.9 ms with CRC).
+//
+//   build (from the library root):
+//        g++ -std=gnu++11 -O2 -DLORA_MESH_HOST -Isrc -Iextras/simulator src/*.cpp extras/simulator/MeshSimulator.cpp extras/benchmarks/duty_cycle_bench.cpp -o duty_cycle_bench
+//
+//   usage:
+//        ./duty_cycle_bench [period_ms] [seconds] [window_ms]
+
+#include "MeshSimulator.h"
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include <utility>
+
+// largest airtime (us) of the frames starting within any window ms of each other
+static unsigned long peakWindow(const std::vector< std::pair<unsigned long, unsigned long> > &tx, long window){
+    unsigned long sum = 0, peak = 0;
+    size_t first = 0;
+
+    for (size_t i = 0; i < tx.size(); i++) {
+        sum += tx[i].second;
+        while (tx[i].first - tx[first].first >= (unsigned long)window) sum -= tx[first++].second;
+        if (sum > peak) peak = sum;
+    }
+    return peak;
+}
+
+static void run(uint16_t dutyCycle, unsigned long period, unsigned long seconds, long window){
+    MeshSimulator sim(1);
+    LORA_MODEM modem = {9, 125000, 5, 8, false};
+    sim.defaults.modem = modem;
+    sim.defaults.dutyCycle = dutyCycle;
+    sim.defaults.dutyCycleWindow = window;
+    sim.setModem(modem);
+    int gw = sim.addNode(0x31, 0x31);
+    sim.addNode(0x32, 0x31);
+    int sensor = sim.addNode(0x33, 0x31);
+    sim.line();
+
+    std::vector< std::pair<unsigned long, unsigned long> > tx[3];
+    std::map<int, unsigned long> sentAt;
+    std::set<std::string> delivered;
+    unsigned long sent = 0, acked = 0, timeouts = 0, latencySum = 0;
+    char msg[LORA_MESH_MAX_MSG_SIZE];
+
+    sim.onTransmit = [&](int node, unsigned long at, const SimFrame &frame) {
+        tx[node].push_back(std::make_pair(at, meshLoraAirtime(modem, (uint16_t)frame.data.size())));
+    };
+    sim.onReceive = [&](int node, const RECEIVED_Packet &rec) {
+        if ((node == gw) && (rec._pkt.sts == STS_RECEIVED)) delivered.insert(std::string(rec._pkt.msg, rec._pkt.len));
+        if (node != sensor) return;
+        if (rec._pkt.sts == STS_TIMEOUT) { timeouts++; sentAt.erase(rec._pkt.msgId); }
+        if (rec._pkt.sts != STS_MSG_ACK_REGISTRATION_DONE) return;
+        std::map<int, unsigned long>::iterator it = sentAt.find(rec._pkt.msgId);
+        if (it == sentAt.end()) return;
+        acked++;
+        latencySum += sim.now() - it->second;
+        sentAt.erase(it);
+    };
+
+    for (unsigned long t = 0; t < seconds * 1000; t += period) {
+        snprintf(msg, sizeof(msg), "temp %lu", sent);
+        MSG_ID id = sim.node(sensor).sendMsg(sim.node(gw).LocalAddress, msg);
+        if (!MESH_ID_ERROR(id)) {
+            sentAt[id] = sim.now();
+            sent++;
+        }
+        sim.run(period);
+    }
+    sim.run(window);
+
+    unsigned long budget = (unsigned long)window * dutyCycle;
+    unsigned long deferred = 0, dropped = 0;
+    for (int i = 0; i < 3; i++) {
+        deferred += sim.node(i).stats.txDeferred;
+        dropped += sim.node(i).stats.dutyDrops;
+    }
+    printf("  limit=%3u.%u%% sent=%-4lu delivered=%-4lu acked=%-4lu timeouts=%-3lu ackLatency=%6lums deferred=%-5lu dropped=%-4lu",
+           dutyCycle / 10, dutyCycle % 10, sent, (unsigned long)delivered.size(), acked, timeouts, acked ? latencySum / acked : 0, deferred, dropped);
+    for (int i = 0; i < 3; i++) {
+        unsigned long peak = peakWindow(tx[i], window);
+        printf(" %s=%lums%s", (i == gw) ? "gw" : (i == sensor) ? "sensor" : "relay", peak / 1000,
+               (dutyCycle == 0) || (peak <= budget) ? "" : "(over)");
+    }
+    printf(" budget=%lums\n", dutyCycle ? budget / 1000 : 0);
+}
+
+int main(int argc, char **argv){
+    unsigned long period = (argc > 1) ? strtoul(argv[1], 0, 10) : 2000;
+    unsigned long seconds = (argc > 2) ? strtoul(argv[2], 0, 10) : 600;
+    long window = (argc > 3) ? atol(argv[3]) : 60000;
+    const uint16_t limits[] = {0, 100, 50, 10};
+
+    Serial.enabled = false;
+    printf("airtime of 20 bytes, 125 kHz, CR 4/5, preamble 8, CRC on:");
+    for (uint8_t sf = 7; sf <= 12; sf++) {
+        LORA_MODEM m = {sf, 125000, 5, 8, true};
+        printf(" SF%u=%.1fms", sf, meshLoraAirtime(m, 20) / 1000.0);
+    }
+    printf("\n");
+
+    printf("sensor -> relay -> gateway at SF9, one reading every %lums for %lus, window %lums, peak airtime per node\n",
+           period, seconds, window);
+    for (int i = 0; i < 4; i++) run(limits[i], period, seconds, window);
+    return 0;
+}
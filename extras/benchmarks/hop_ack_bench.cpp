@@ -0,0 +1,104 @@
+// Copyright © 2020 by antónio montez . All rights reserved.
+// Licensed under the MIT license.
+//
+//   Hop ACKs on lossy links: on a line of <nodes> the first one sends one message every <interval> ms to the last
+//   one, every link drops 10, 20 then 30% of the frames.  For each reliability scheme reports the messages
+//   acknowledged end to end, the transmissions (frames, airtime) spent per acknowledged message and the latency.
+//     e2e only       no next hop watch, a frame lost anywhere costs a retry from the source after retryInterval
+//     watch          next hop watched by overhearing (route failure detection), one more send when not heard
+//     hop ack        link layer hop ACKs, retransmission timers from the neighbour round trip
+//     hop ack weak   the same with every link reporting a weak signal: more tries, the timer doubled each time
+//
+//   build (from the library root):
+//        g++ -std=gnu++11 -O2 -DLORA_MESH_HOST -Isrc -Iextras/simulator src/*.cpp extras/simulator/MeshSimulator.cpp extras/benchmarks/hop_ack_bench.cpp -o hop_ack_bench
+//
+//   usage:
+//        ./hop_ack_bench [nodes] [source|next] [seconds] [interval_ms] [seed]
+
+#include "MeshSimulator.h"
+
+#include <map>
+#include <string>
+
+#define WEAK_RSSI -105
+#define WEAK_SNR -5
+
+static void run(const char *name, double loss, long hopAckTimeout, bool hopAck, bool weak, int nodes, uint8_t routingMode,
+                unsigned long seconds, unsigned long interval, uint32_t seed){
+    MeshSimulator sim(seed);
+    sim.defaults.routingMode = routingMode;
+    sim.defaults.hopAckTimeout = hopAckTimeout;
+    sim.defaults.hopAck = hopAck;
+    for (int i = 0; i < nodes; i++) sim.addNode((uint8_t)(0x31 + i), 0x31);
+    sim.line(loss);
+    if (weak) {
+        for (int i = 0; i + 1 < nodes; i++) sim.signal(i, i + 1, WEAK_RSSI, WEAK_SNR);
+    }
+
+    int src = 0, dst = nodes - 1;
+    uint8_t dstAddr = sim.node(dst).LocalAddress;
+    std::map<int, unsigned long> sentAt;
+    unsigned long sent = 0, acked = 0, timeouts = 0, latencySum = 0;
+
+    sim.onReceive = [&](int node, const RECEIVED_Packet &rec) {
+        if (node != src) return;
+        if (rec._pkt.sts == STS_TIMEOUT) { timeouts++; sentAt.erase(rec._pkt.msgId); }
+        if (rec._pkt.sts != STS_MSG_ACK_REGISTRATION_DONE) return;
+        std::map<int, unsigned long>::iterator it = sentAt.find(rec._pkt.msgId);
+        if (it == sentAt.end()) return;
+        latencySum += sim.now() - it->second;
+        acked++;
+        sentAt.erase(it);
+    };
+
+    char msg[LORA_MESH_MAX_MSG_SIZE];
+    unsigned long next = 1000;
+    unsigned long end = seconds * 1000UL;
+    while (sim.now() < end) {
+        if (sim.now() >= next) {
+            next += interval;
+            snprintf(msg, sizeof(msg), "msg %lu", sent);
+            sentAt[sim.node(src).sendMsg(dstAddr, msg)] = sim.now();
+            sent++;
+        }
+        sim.step();
+    }
+    sim.run(LORA_MESH_MSG_QUEUE_TIMEOUT * 2);
+
+    LORA_MESH_STATS total = {};
+    for (int i = 0; i < nodes; i++) {
+        const LORA_MESH_STATS &s = sim.node(i).stats;
+        total.hopRetries += s.hopRetries;
+        total.hopAcksSent += s.hopAcksSent;
+        total.linkBreaks += s.linkBreaks;
+    }
+    double perMsg = acked ? (double)sim.stats.framesSent / acked : 0.0;
+    double airPerMsg = acked ? (double)sim.stats.airtime / acked : 0.0;
+
+    printf("  %-13s acked=%3lu/%lu timeouts=%-3lu e2eRetries=%-4d frames/msg=%6.1f airtime/msg=%7.0fms latency=%6lums hopRetries=%-5lu hopAcks=%-5lu breaks=%lu\n",
+           name, acked, sent, timeouts, sim.node(src).totalRetry, perMsg, airPerMsg, acked ? latencySum / acked : 0,
+           total.hopRetries, total.hopAcksSent, total.linkBreaks);
+}
+
+int main(int argc, char **argv){
+    int nodes = (argc > 1) ? atoi(argv[1]) : 6;
+    bool nextHop = (argc > 2) && (std::string(argv[2]) == "next");
+    unsigned long seconds = (argc > 3) ? strtoul(argv[3], 0, 10) : 300;
+    unsigned long interval = (argc > 4) ? strtoul(argv[4], 0, 10) : 3000;
+    uint32_t seed = (argc > 5) ? strtoul(argv[5], 0, 10) : 1;
+    uint8_t routingMode = nextHop ? LORA_MESH_ROUTING_NEXT_HOP : LORA_MESH_ROUTING_SOURCE;
+    const double losses[] = {0.1, 0.2, 0.3};
+
+    if (nodes < 2) nodes = 2;
+    Serial.enabled = false;
+    printf("line of %d nodes (%d hops), %s routing, one message every %lums for %lus\n",
+           nodes, nodes - 1, nextHop ? "next hop" : "source", interval, seconds);
+    for (int i = 0; i < 3; i++) {
+        printf("loss %.0f%% per link\n", losses[i] * 100);
+        run("e2e only", losses[i], 0, false, false, nodes, routingMode, seconds, interval, seed);
+        run("watch", losses[i], LORA_MESH_HOP_ACK_TIMEOUT, false, false, nodes, routingMode, seconds, interval, seed);
+        run("hop ack", losses[i], LORA_MESH_HOP_ACK_TIMEOUT, true, false, nodes, routingMode, seconds, interval, seed);
+        run("hop ack weak", losses[i], LORA_MESH_HOP_ACK_TIMEOUT, true, true, nodes, routingMode, seconds, interval, seed);
+    }
+    return 0;
+}
@@ -0,0 +1,66 @@
+// Copyright © 2020 by antónio montez . All rights reserved.
+// Licensed under the MIT license.
+//
+//   Loop rate under a forwarding load: on a line of nodes the first one keeps sending to the last one,
+//   every node in between relays the datagrams and their ACKs.  Counts how many loop() iterations
+//   (yield() of every node) fit in a second of the virtual clock, with the ESP_NOW transmit jitter
+//     blocking   spent in a delay() inside the transport send(), as the old EspNowTransport did
+//     deferred   given to the transmit scheduler as a deadline, nothing waits
+//   The simulator steps 1 ms at a time so 1000 loops/s is the ceiling.
+//
+//   build (from the library root):
+//        g++ -std=gnu++11 -O2 -DLORA_MESH_HOST -Isrc -Iextras/simulator src/*.cpp extras/simulator/MeshSimulator.cpp extras/benchmarks/loop_rate_bench.cpp -o loop_rate_bench
+//
+//   usage:
+//        ./loop_rate_bench [nodes] [seconds] [interval_ms]
+
+#include "MeshSimulator.h"
+
+#define LORA_MESH_TX_JITTER_BENCH 5        // LORA_MESH_ESPNOW_TX_JITTER, the ESP_NOW transport is not in the host build
+
+static void run(const char *name, bool blocking, int nodes, unsigned long seconds, unsigned long interval){
+    MeshSimulator sim(1);
+    sim.txJitter = LORA_MESH_TX_JITTER_BENCH;
+    sim.blockingJitter = blocking;
+    sim.setBitrate(1000000);           // ESP_NOW like link: the airtime is not what limits the loop
+    sim.setFrameOverhead(1);
+    for (int i = 0; i < nodes; i++) sim.addNode((uint8_t)(0x31 + i), 0x31);
+    sim.line();
+
+    unsigned long acked = 0;
+    sim.onReceive = [&](int node, const RECEIVED_Packet &rec) {
+        if ((node == 0) && (rec._pkt.sts == STS_MSG_ACK_REGISTRATION_DONE)) acked++;
+    };
+
+    uint8_t dst = sim.node(nodes - 1).LocalAddress;
+    char msg[LORA_MESH_MAX_MSG_SIZE] = "load";
+    unsigned long start = sim.now();
+    unsigned long end = start + seconds * 1000UL;
+    unsigned long next = start;
+    unsigned long loops = 0;
+
+    while (sim.now() < end) {
+        if (sim.now() >= next) {
+            next += interval;
+            sim.node(0).sendMsg(dst, msg);
+        }
+        sim.step();
+        loops++;
+    }
+
+    printf("%-9s loops/s=%6.0f  frames=%lu  acked=%lu\n", name,
+           loops * 1000.0 / (sim.now() - start), sim.stats.framesSent, acked);
+}
+
+int main(int argc, char **argv){
+    int nodes = (argc > 1) ? atoi(argv[1]) : 3;
+    unsigned long seconds = (argc > 2) ? strtoul(argv[2], 0, 10) : 60;
+    unsigned long interval = (argc > 3) ? strtoul(argv[3], 0, 10) : 20;
+    if (nodes < 2) nodes = 2;
+
+    Serial.enabled = false;
+    printf("nodes=%d seconds=%lu interval=%lums jitter=1..%dms\n", nodes, seconds, interval, LORA_MESH_TX_JITTER_BENCH);
+    run("blocking", true, nodes, seconds, interval);
+    run("deferred", false, nodes, seconds, interval);
+    return 0;
+}
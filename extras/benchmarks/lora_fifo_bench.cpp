@@ -0,0 +1,184 @@
+// Copyright © 2020 by antónio montez . All rights reserved.
+// Licensed under the MIT license.
+//
+//   SPI traffic of a LoRa datagram between the SX127x FIFO and the node: the byte by byte
+//   LoRa.read() / LoRa.write() loops against the SPI burst of MeshSX127xFifo (LoraWifiMeshSX127x.h),
+//   on the mock radio of extras/simulator/MockSX127x.h.  Per datagram size: SPI transactions and bytes
+//   to receive one datagram (the receive() that takes it and the one that finds nothing left), to write one
+//   in the FIFO, and of one idle receive() while the radio listens.  The time is a model: per transaction
+//   (chip select, beginTransaction) + per single transfer + per burst byte, 8 MHz SPI clock,
+//   AVR 16 MHz 9 + 2 + 1.2 us, ESP32 240 MHz 4 + 3 + 1 us.
+//   Also checks that both paths read the same bytes, that a datagram is returned once, that an oversized
+//   one is skipped (-1) and that nothing is pending after a send or while listening.
+//   Channel activity detection (listen before talk) on a radio whose CAD lasts a few polls: started, then left
+//   to the next round while the sketch's LoRa.parsePacket() runs, the result is wiped (the old two step
+//   channelState()), polled to its end by cad() it is right for a busy and a free channel.
+//
+//   build (from the library root):
+//        g++ -std=gnu++11 -O2 -Isrc -Iextras/simulator extras/benchmarks/lora_fifo_bench.cpp -o lora_fifo_bench
+//
+//   usage:
+//        ./lora_fifo_bench [datagrams per size]
+
+#include "MockSX127x.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define MAX_LEN 200                      // WIFI_MAX_MSG_SIZE
+
+typedef struct PLATFORM {
+      const char *name;
+      double txn, byte, burst;           // us
+      } PLATFORM;
+
+static const PLATFORM platforms[] = { {"AVR", 9, 2, 1.2}, {"ESP32", 4, 3, 1} };
+
+static MockSX127x radio;
+static MockLoRaLibrary LoRa(radio);
+static MeshSX127xFifo<MockSX127x> fifo(radio);
+static int failures = 0;
+
+// LoRaTransport::receive() / send() with LORA_MESH_LORA_SPI_BURST false
+static int receiveBytewise(uint8_t *buff, int maxLen) {
+    int cnt = 0;
+    while (LoRa.available()) {
+        if (cnt >= maxLen) {
+            while (LoRa.available()) LoRa.read();
+            return -1;
+        }
+        buff[cnt++] = (uint8_t)LoRa.read();
+    }
+    return cnt;
+}
+
+static int receive(bool burst, uint8_t *buff, int maxLen) {
+    return burst ? fifo.readPacket(buff, maxLen) : receiveBytewise(buff, maxLen);
+}
+
+static void writePacket(bool burst, const uint8_t *buff, uint8_t len) {
+    if (burst) fifo.writePacket(buff, len);
+    else for (int i = 0; i < len; i++) LoRa.write(buff[i]);
+}
+
+static MOCK_SPI_COUNT since(const MOCK_SPI_COUNT &c0) {
+    MOCK_SPI_COUNT d;
+    d.transactions = radio.count.transactions - c0.transactions;
+    d.bytes = radio.count.bytes - c0.bytes;
+    d.burstBytes = radio.count.burstBytes - c0.burstBytes;
+    return d;
+}
+
+static void add(MOCK_SPI_COUNT &sum, const MOCK_SPI_COUNT &d) {
+    sum.transactions += d.transactions;
+    sum.bytes += d.bytes;
+    sum.burstBytes += d.burstBytes;
+}
+
+static double us(const MOCK_SPI_COUNT &c, const PLATFORM &p, unsigned long n) {
+    return (c.transactions * p.txn + c.bytes * p.byte + c.burstBytes * p.burst) / n;
+}
+
+static void check(bool ok, const char *what, int len) {
+    if (ok) return;
+    if (failures++ < 10) printf("  FAILED: %s (len %d)\n", what, len);
+}
+
+static void makeFrame(uint8_t *f, int len, unsigned long seq) {
+    for (int i = 0; i < len; i++) f[i] = (uint8_t)(seq * 131 + i * 7);
+}
+
+static void print(const char *what, bool burst, int len, const MOCK_SPI_COUNT &c, unsigned long n) {
+    printf("%-5s %-9s %4d %8.1f %8.1f", what, burst ? "burst" : "bytewise", len,
+           (double)c.transactions / n, (double)(c.bytes + c.burstBytes) / n);
+    for (size_t k = 0; k < sizeof(platforms) / sizeof(platforms[0]); k++) printf(" %9.0f", us(c, platforms[k], n));
+    printf("\n");
+}
+
+static void run(bool burst, int len, unsigned long n) {
+    uint8_t f[256], got[256];
+    MOCK_SPI_COUNT rx = {0, 0, 0}, tx = {0, 0, 0}, idle = {0, 0, 0};
+
+    radio.reset();
+    LoRa.begin();
+    for (unsigned long seq = 0; seq < n; seq++) {
+        makeFrame(f, len, seq);
+
+        LoRa.parsePacket();                                         // listening
+        MOCK_SPI_COUNT c0 = radio.count;
+        check(receive(burst, got, MAX_LEN) == 0, "nothing pending while listening", len);
+        add(idle, since(c0));
+
+        radio.air(f, (uint8_t)len);
+        check(LoRa.parsePacket() == len, "parsePacket", len);
+        c0 = radio.count;
+        int cnt = receive(burst, got, MAX_LEN);
+        check(cnt == (len > MAX_LEN ? -1 : len), "datagram size", len);
+        check((cnt < 0) || (memcmp(f, got, len) == 0), "datagram bytes", len);
+        check(receive(burst, got, MAX_LEN) == 0, "datagram returned once", len);
+        add(rx, since(c0));
+
+        if (len > MAX_LEN) continue;
+        LoRa.beginPacket();
+        c0 = radio.count;
+        writePacket(burst, f, (uint8_t)len);
+        add(tx, since(c0));
+        LoRa.endPacket();
+        check((radio.sentLen == len) && (memcmp(radio.sent, f, len) == 0), "datagram sent", len);
+        check(receive(burst, got, MAX_LEN) == 0, "nothing pending after a send", len);
+    }
+
+    print("rx", burst, len, rx, n);
+    if (len <= MAX_LEN) print("tx", burst, len, tx, n);
+    if (len == 16) print("idle", burst, len, idle, n);
+}
+
+// one ms per reading of the clock
+static unsigned long mockMs = 0;
+static unsigned long mockClock() { return mockMs++; }
+
+static void cad() {
+    bool detected = false;
+    unsigned long lost = 0, wrong = 0, timeouts = 0;
+    const unsigned long n = 100;
+
+    radio.reset();
+    LoRa.begin();
+    radio.cadReads = 3;
+    for (unsigned long i = 0; i < n; i++) {
+        radio.busy = true;
+        fifo.cadStart();
+        LoRa.parsePacket();                                         // the sketch loop between two yield()
+        if (!fifo.cadDone(detected)) lost++;
+    }
+    MOCK_SPI_COUNT c0 = radio.count;
+    for (unsigned long i = 0; i < 2 * n; i++) {
+        radio.busy = (i & 1) != 0;
+        if (!fifo.cad(detected, mockClock)) timeouts++;
+        else if (detected != radio.busy) wrong++;
+        LoRa.parsePacket();
+    }
+    MOCK_SPI_COUNT c = since(c0);
+    printf("cad, %d polls long, timeout %lums at SF7 / 125 kHz: started then parsePacket() %lu/%lu results lost, "
+           "cad() %lu wrong %lu timeouts, %.1f spi txn\n", radio.cadReads, fifo.cadTimeout(), lost, n, wrong, timeouts,
+           (double)c.transactions / (2 * n));
+    check(lost == n, "mock CAD wiped by parsePacket", 0);
+    check((wrong == 0) && (timeouts == 0), "cad() polled to its end", 0);
+}
+
+int main(int argc, char **argv) {
+    unsigned long n = (argc > 1) ? strtoul(argv[1], 0, 10) : 1000;
+    const int sizes[] = {16, 64, 128, 200, 240};
+
+    printf("per datagram, %lu datagrams per size (240 > %d: skipped as oversized)\n", n, MAX_LEN);
+    printf("%-5s %-9s %4s %8s %8s", "", "path", "len", "spi txn", "bytes");
+    for (size_t k = 0; k < sizeof(platforms) / sizeof(platforms[0]); k++) printf(" %6s us", platforms[k].name);
+    printf("\n");
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        run(false, sizes[s], n);
+        run(true, sizes[s], n);
+    }
+    cad();
+    printf("%s\n", failures ? "checks FAILED" : "checks ok");
+    return failures ? 1 : 0;
+}
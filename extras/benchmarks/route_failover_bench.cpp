@@ -0,0 +1,127 @@
+// Copyright © 2020 by antónio montez . All rights reserved.
+// Licensed under the MIT license.
+//
+//   Route failover: a ladder of two chains of <relays> nodes between the source and the destination, with rungs
+//   between the chains.  The source sends one message every <interval> ms, after a minute the relay at <where>
+//   on its route (mid or last) is switched off.  For each recovery strategy reports how long the source goes
+//   without an ACK, the messages lost and what the recovery cost on the air.
+//     e2e only       no next hop watch: the source retries the dead route until it ages out (the old behaviour)
+//     rerr           the relay that finds its next hop silent sends a RERR to the source
+//     rerr+repair    next hop routing, the relay first tries a local route request when the destination is at most
+//                    LORA_MESH_LOCAL_REPAIR_MAX_HOPS away (the default: the relay before the destination dies, the one
+//                    before it repairs while a RERR would have to go all the way back to the source)
+//
+//   build (from the library root):
+//        g++ -std=gnu++11 -O2 -DLORA_MESH_HOST -Isrc -Iextras/simulator src/*.cpp extras/simulator/MeshSimulator.cpp extras/benchmarks/route_failover_bench.cpp -o route_failover_bench
+//
+//   usage:
+//        ./route_failover_bench [relays] [mid|last] [interval_ms]
+//
+//        default 5 last
+
+#include "MeshSimulator.h"
+
+#include <map>
+#include <string>
+
+#define KILL_AT 60000UL
+#define AFTER_KILL 300000UL
+
+static void run(const char *name, uint8_t routingMode, long hopAckTimeout, bool localRepair, int relays, bool last, unsigned long interval){
+    MeshSimulator sim(1);
+    sim.defaults.routingMode = routingMode;
+    sim.defaults.hopAckTimeout = hopAckTimeout;
+    sim.defaults.localRepair = localRepair;
+
+    int nodes = 2 * relays + 2;
+    int src = 0, dst = nodes - 1;
+    for (int i = 0; i < nodes; i++) sim.addNode((uint8_t)(0x31 + i), 0x31);
+    for (int c = 0; c < 2; c++) {
+        int first = 1 + c * relays;
+        sim.link(src, first);
+        for (int i = first; i + 1 < first + relays; i++) sim.link(i, i + 1);
+        sim.link(first + relays - 1, dst);
+    }
+    for (int i = 1; i <= relays; i++) sim.link(i, i + relays);
+
+    uint8_t dstAddr = sim.node(dst).LocalAddress;
+    std::map<int, unsigned long> sentAt;
+    unsigned long sent = 0, acked = 0, timeouts = 0, firstAck = 0;
+    bool killed = false;
+
+    sim.onReceive = [&](int node, const RECEIVED_Packet &rec) {
+        if (node != src) return;
+        if (rec._pkt.sts == STS_TIMEOUT) { timeouts++; sentAt.erase(rec._pkt.msgId); }
+        if (rec._pkt.sts != STS_MSG_ACK_REGISTRATION_DONE) return;
+        std::map<int, unsigned long>::iterator it = sentAt.find(rec._pkt.msgId);
+        if (it == sentAt.end()) return;
+        if (killed && (firstAck == 0) && (it->second >= KILL_AT)) firstAck = sim.now();
+        acked++;
+        sentAt.erase(it);
+    };
+
+    char msg[LORA_MESH_MAX_MSG_SIZE];
+    unsigned long next = 1000;
+    unsigned long end = KILL_AT + AFTER_KILL;
+    SimStats before;
+    LORA_MESH_STATS rreqBefore = {};
+
+    while (sim.now() < end) {
+        if (!killed && (sim.now() >= KILL_AT)) {
+            char path[LORA_MESH_MAX_ROUTING_PATH_SIZE];
+            if (!sim.node(src).findRoute(dstAddr, path) || (strlen(path) < 3)) {
+                printf("%-12s no route to break\n", name);
+                return;
+            }
+            size_t len = strlen(path);
+            int victim = sim.indexOf((uint8_t)path[last ? len - 2 : len / 2]);
+            sim.isolate(victim);
+            killed = true;
+            before = sim.stats;
+            for (int i = 0; i < nodes; i++) rreqBefore.rreqSent += sim.node(i).stats.rreqSent;
+        }
+        if (sim.now() >= next) {
+            next += interval;
+            snprintf(msg, sizeof(msg), "msg %lu", sent);
+            sentAt[sim.node(src).sendMsg(dstAddr, msg)] = sim.now();
+            sent++;
+        }
+        sim.step();
+    }
+
+    LORA_MESH_STATS total = {};
+    for (int i = 0; i < nodes; i++) {
+        const LORA_MESH_STATS &s = sim.node(i).stats;
+        total.rreqSent += s.rreqSent;
+        total.rerrSent += s.rerrSent;
+        total.linkBreaks += s.linkBreaks;
+        total.localRepairs += s.localRepairs;
+    }
+    char failover[24];
+    if (firstAck == 0) snprintf(failover, sizeof(failover), "> %lus", AFTER_KILL / 1000);
+    else snprintf(failover, sizeof(failover), "%.1fs", (firstAck - KILL_AT) / 1000.0);
+
+    printf("%-12s failover=%-7s acked=%lu/%lu timeouts=%lu frames=%lu airtime=%lums rreq=%lu rerr=%lu breaks=%lu repairs=%lu\n",
+           name, failover, acked, sent, timeouts, sim.stats.framesSent - before.framesSent, sim.stats.airtime - before.airtime,
+           total.rreqSent - rreqBefore.rreqSent, total.rerrSent, total.linkBreaks, total.localRepairs);
+}
+
+int main(int argc, char **argv){
+    int relays = (argc > 1) ? atoi(argv[1]) : 5;
+    bool last = (argc <= 2) || (std::string(argv[2]) == "last");
+    unsigned long interval = (argc > 3) ? strtoul(argv[3], 0, 10) : 2000;
+    if (relays < 2) relays = 2;
+
+    Serial.enabled = false;
+    printf("ladder 2 x %d relays, relay %s of the route off at %lus, one message every %lums, %lus observed\n",
+           relays, last ? "before the destination" : "in the middle", KILL_AT / 1000, interval, AFTER_KILL / 1000);
+    printf("frames, airtime and rreq counted after the failure\n");
+    printf("source routes\n");
+    run("e2e only", LORA_MESH_ROUTING_SOURCE, 0, false, relays, last, interval);
+    run("rerr", LORA_MESH_ROUTING_SOURCE, LORA_MESH_HOP_ACK_TIMEOUT, false, relays, last, interval);
+    printf("next hop routing\n");
+    run("e2e only", LORA_MESH_ROUTING_NEXT_HOP, 0, false, relays, last, interval);
+    run("rerr", LORA_MESH_ROUTING_NEXT_HOP, LORA_MESH_HOP_ACK_TIMEOUT, false, relays, last, interval);
+    run("rerr+repair", LORA_MESH_ROUTING_NEXT_HOP, LORA_MESH_HOP_ACK_TIMEOUT, true, relays, last, interval);
+    return 0;
+}
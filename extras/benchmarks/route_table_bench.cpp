@@ -0,0 +1,93 @@
+// Copyright © 2020 by antónio montez . All rights reserved.
+// Licensed under the MIT license.
+//
+//   Route churn on the routing table (MeshRoutingTable, LoraWifiMeshRoutes.h): <live> routes to random destinations,
+//   then again and again one of them is removed (aging, a broken link) and a new destination learned, like a node
+//   whose neighbourhood keeps changing. After the churn, per table load: free and deleted slots, and the probes of a
+//   lookup that finds its route and of one that misses (each new destination starts with a miss). Without the
+//   deleted slots going back to FREE a table that saw every slot used has none left and every miss probes all of them.
+//   Also checks every lookup against a reference set.
+//
+//   build (from the library root):
+//        g++ -std=gnu++11 -O2 -DLORA_MESH_HOST -Isrc src/*.cpp extras/benchmarks/route_table_bench.cpp -o route_table_bench
+//
+//   usage:
+//        ./route_table_bench [operations] [seed]
+
+#include "LoraWifiMesh.h"
+
+#include <random>
+#include <set>
+
+#define N 32
+
+static int failures = 0;
+
+static void check(bool ok, const char *what, int live) {
+    if (ok) return;
+    if (failures++ < 10) printf("  FAILED: %s (%d routes)\n", what, live);
+}
+
+// slots a lookup of destNode goes through, the home slot and the free one that stops it included
+static int probes(MeshRoutingTable<N> &t, uint8_t destNode) {
+    uint16_t i = destNode % N;
+    for (int n = 1; n <= N; n++) {
+        if ((t[i].sts == LORA_MESH_QUEUE_FREE) || ((t[i].sts != LORA_MESH_QUEUE_DELETED) && (t[i].destNode == destNode))) return n;
+        i = (i + 1 == N) ? 0 : i + 1;
+    }
+    return N;
+}
+
+static void run(int live, unsigned long operations, uint32_t seed) {
+    static MeshRoutingTable<N> t;
+    std::mt19937 rng(seed);
+    std::set<uint8_t> ref;
+
+    t.clear();
+    while ((int)ref.size() < live) {
+        uint8_t d = (uint8_t)(1 + rng() % 254);
+        if (ref.insert(d).second) check(t.insert(d) != 0, "insert", live);
+    }
+    for (unsigned long k = 0; k < operations; k++) {
+        std::set<uint8_t>::iterator it = ref.begin();
+        std::advance(it, rng() % ref.size());
+        t.remove(t.find(*it));
+        ref.erase(it);
+
+        uint8_t d;
+        do d = (uint8_t)(1 + rng() % 254); while (ref.count(d));
+        check(t.find(d) == 0, "a new destination misses", live);
+        check(t.insert(d) != 0, "insert after a remove", live);
+        ref.insert(d);
+    }
+
+    int freeSlots = 0, deleted = 0;
+    for (uint16_t i = 0; i < t.size(); i++) {
+        if (t[i].sts == LORA_MESH_QUEUE_FREE) freeSlots++;
+        if (t[i].sts == LORA_MESH_QUEUE_DELETED) deleted++;
+    }
+    unsigned long hit = 0, miss = 0, misses = 0;
+    for (int d = 1; d < 255; d++) {
+        ROUTING_TABLE *e = t.find((uint8_t)d);
+        check((e != 0) == (ref.count((uint8_t)d) != 0), "find against the reference", live);
+        if (e != 0) hit += probes(t, (uint8_t)d);
+        else miss += probes(t, (uint8_t)d), misses++;
+    }
+    check((int)t.count() == live, "count", live);
+    check(freeSlots == N - live - deleted, "slots add up", live);
+    check(freeSlots > 0, "free slots left after the churn", live);
+
+    printf("  %3d/%d   %5d %7d %9.2f %9.2f\n", live, N, freeSlots, deleted, (double)hit / live, (double)miss / misses);
+}
+
+int main(int argc, char **argv) {
+    unsigned long operations = (argc > 1) ? strtoul(argv[1], 0, 10) : 100000;
+    uint32_t seed = (argc > 2) ? strtoul(argv[2], 0, 10) : 1;
+    const int loads[] = {4, 8, 16, 24, 28};
+
+    printf("%lu removes + inserts, table of %d\n", operations, N);
+    printf("  %-7s %5s %7s %9s %9s\n", "routes", "free", "deleted", "probes/hit", "probes/miss");
+    for (size_t l = 0; l < sizeof(loads) / sizeof(loads[0]); l++) run(loads[l], operations, seed);
+    printf("%s\n", failures ? "checks FAILED" : "checks ok");
+    return failures ? 1 : 0;
+}
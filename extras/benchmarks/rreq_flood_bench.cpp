@@ -0,0 +1,132 @@
+// Copyright © 2020 by antónio montez . All rights reserved.
+// Licensed under the MIT license.
+//
+//   Cost of a route discovery against the density of the network: <nodes> nodes dropped at random on a 1000 x 1000 m
+//   square, linked when less than <range> m apart (RSSI falling from -40 dBm next to the node to -100 dBm at the
+//   edge of the range), a new topology until it is connected. The same area gets more and more nodes, so each
+//   node has more and more neighbours. Random pairs of nodes, one route discovery each (<discoveries> messages
+//   20 s apart), collision model and listen before talk on, the default flooding against counter based
+//   suppression (nc.rreqCounter), gossip (nc.rreqGossip) and RSSI distance delay (nc.rreqDistance).
+//   Reports the RREQ frames and their airtime per discovery, and the messages acknowledged end to end (a route
+//   found). Flooding costs one frame per node, the suppressed floods should grow slower than the node count.
+//
+//   build (from the library root):
+//        g++ -std=gnu++11 -O2 -DLORA_MESH_HOST -Isrc -Iextras/simulator src/*.cpp extras/simulator/MeshSimulator.cpp extras/benchmarks/rreq_flood_bench.cpp -o rreq_flood_bench
+//
+//   usage:
+//        ./rreq_flood_bench [discoveries] [range_m] [seed]
+
+#include "MeshSimulator.h"
+
+#include <math.h>
+#include <map>
+#include <random>
+
+typedef struct MODE {
+      const char *name;
+      uint8_t counter;
+      uint8_t gossip;
+      bool distance;
+      } MODE;
+
+static const MODE modes[] = { {"flood", 0, 0, false}, {"counter3", 3, 0, false}, {"gossip65", 0, 65, false},
+                              {"dist+c3", 3, 0, true} };
+
+typedef struct POINT { double x, y; } POINT;
+
+static bool connected(const std::vector<POINT> &p, double range){
+    std::vector<bool> seen(p.size(), false);
+    std::vector<size_t> todo(1, 0);
+    size_t count = 1;
+    seen[0] = true;
+    while (!todo.empty()) {
+        size_t a = todo.back();
+        todo.pop_back();
+        for (size_t b = 0; b < p.size(); b++) {
+            if (seen[b] || (hypot(p[a].x - p[b].x, p[a].y - p[b].y) >= range)) continue;
+            seen[b] = true;
+            count++;
+            todo.push_back(b);
+        }
+    }
+    return count == p.size();
+}
+
+static std::vector<POINT> place(int nodes, double range, uint32_t seed){
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> u(0.0, 1000.0);
+    std::vector<POINT> p(nodes);
+    do {
+        for (int i = 0; i < nodes; i++) p[i].x = u(rng), p[i].y = u(rng);
+    } while (!connected(p, range));
+    return p;
+}
+
+static void run(const MODE &mode, const std::vector<POINT> &p, double range, int discoveries, uint32_t seed){
+    MeshSimulator sim(seed);
+    int nodes = (int)p.size();
+
+    sim.collisions = true;
+    sim.defaults.csma = true;
+    sim.defaults.rreqCounter = mode.counter;
+    sim.defaults.rreqGossip = mode.gossip;
+    sim.defaults.rreqDistance = mode.distance;
+    for (int i = 0; i < nodes; i++) sim.addNode((uint8_t)(0x31 + i), 0x31);
+    unsigned long degree = 0;
+    for (int a = 0; a < nodes; a++) {
+        for (int b = a + 1; b < nodes; b++) {
+            double d = hypot(p[a].x - p[b].x, p[a].y - p[b].y);
+            if (d >= range) continue;
+            sim.link(a, b);
+            sim.signal(a, b, (int16_t)(-40 - 60 * d / range), 0);
+            degree += 2;
+        }
+    }
+
+    unsigned long rreqFrames = 0, rreqAirtime = 0;
+    sim.onTransmit = [&](int /* node */, unsigned long /* at */, const SimFrame &frame) {
+        if (((const HDR_MSG *)frame.data.data())->hdrType != LORA_MESH_MSG_RREQ) return;
+        rreqFrames++;
+        rreqAirtime += sim.airtime((uint8_t)frame.data.size());
+    };
+
+    std::map<int, bool> waiting[64];
+    unsigned long sent = 0, acked = 0;
+    sim.onReceive = [&](int node, const RECEIVED_Packet &rec) {
+        if (rec._pkt.sts != STS_MSG_ACK_REGISTRATION_DONE) return;
+        if (waiting[node].erase(rec._pkt.msgId)) acked++;
+    };
+
+    std::mt19937 rng(seed * 7 + 1);
+    for (int k = 0; k < discoveries; k++) {
+        int src = (int)(rng() % nodes);
+        int dst = (int)(rng() % (nodes - 1));
+        if (dst >= src) dst++;
+        waiting[src][sim.node(src).sendMsg(sim.node(dst).LocalAddress, (char *)"where are you")] = true;
+        sent++;
+        sim.run(20000);
+    }
+    sim.run(30000);
+
+    unsigned long rreqSent = 0;
+    for (int i = 0; i < nodes; i++) rreqSent += sim.node(i).stats.rreqSent;
+    if (rreqSent == 0) rreqSent = 1;
+    printf("  %-9s nodes=%-3d degree=%5.1f rreq frames/discovery=%6.1f airtime/discovery=%6lums acked=%3lu/%-3lu collided=%lu\n",
+           mode.name, nodes, (double)degree / nodes, (double)rreqFrames / rreqSent, rreqAirtime / rreqSent, acked, sent,
+           sim.stats.framesCollided);
+}
+
+int main(int argc, char **argv){
+    int discoveries = (argc > 1) ? atoi(argv[1]) : 20;
+    double range = (argc > 2) ? atof(argv[2]) : 400.0;
+    uint32_t seed = (argc > 3) ? strtoul(argv[3], 0, 10) : 1;
+    const int sizes[] = {10, 20, 30, 40};
+
+    Serial.enabled = false;
+    printf("random geometric networks, 1000 x 1000 m, range %.0f m, %d route discoveries\n", range, discoveries);
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        std::vector<POINT> p = place(sizes[s], range, seed + (uint32_t)s);
+        for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++) run(modes[m], p, range, discoveries, seed);
+    }
+    return 0;
+}
@@ -0,0 +1,80 @@
+// Copyright © 2020 by antónio montez . All rights reserved.
+// Licensed under the MIT license.
+//
+//   A relay under load: <sensors> nodes that only hear the relay, the relay next to the gateway, every sensor sends
+//   one reading every <period> ms to the gateway. Every node polls its radio once per sketch loop of <loop> ms
+//   (0: every ms), for each loop time the polled radio with the single FIFO of a SX127x (LoRa.parsePacket(), a frame
+//   arriving before the previous one was read is lost) against the interrupt driven receive (nc.rxInterrupt, DIO0
+//   copies each frame in the receive ring, drained by yield()).
+//   Reports the readings acknowledged end to end, the frames lost in the radio FIFO or the full receive ring,
+//   and the frames put on the air per acknowledged reading.
+//
+//   build (from the library root):
+//        g++ -std=gnu++11 -O2 -DLORA_MESH_HOST -Isrc -Iextras/simulator src/*.cpp extras/simulator/MeshSimulator.cpp extras/benchmarks/rx_interrupt_bench.cpp -o rx_interrupt_bench
+//
+//   usage:
+//        ./rx_interrupt_bench [sensors] [period_ms] [seconds] [seed]
+
+#include "MeshSimulator.h"
+
+#include <map>
+
+static void run(bool interrupt, unsigned long loopTime, int sensors, unsigned long period, unsigned long seconds,
+                uint32_t seed){
+    MeshSimulator sim(seed);
+    sim.defaults.rxInterrupt = interrupt;
+    sim.radioFifo = !interrupt;
+    sim.loopTime = loopTime;
+    int gw = sim.addNode(0x31, 0x31);
+    int relay = sim.addNode(0x32, 0x31);
+    sim.link(gw, relay);
+    for (int i = 0; i < sensors; i++) sim.link(relay, sim.addNode((uint8_t)(0x33 + i), 0x31));
+
+    std::map<int, unsigned long> sentAt[64];
+    unsigned long sent = 0, acked = 0;
+
+    sim.onReceive = [&](int node, const RECEIVED_Packet &rec) {
+        if (rec._pkt.sts != STS_MSG_ACK_REGISTRATION_DONE) return;
+        std::map<int, unsigned long>::iterator it = sentAt[node].find(rec._pkt.msgId);
+        if (it == sentAt[node].end()) return;
+        acked++;
+        sentAt[node].erase(it);
+    };
+
+    char msg[LORA_MESH_MAX_MSG_SIZE];
+    unsigned long step = period / sensors;
+    for (unsigned long t = 0; t < seconds * 1000; t += period) {
+        for (int i = 0; i < sensors; i++) {
+            int s = 2 + i;
+            snprintf(msg, sizeof(msg), "temp %d %lu", i, t / period);
+            sentAt[s][sim.node(s).sendMsg(sim.node(gw).LocalAddress, msg)] = sim.now();
+            sent++;
+            sim.run(step);
+        }
+    }
+    sim.run(60000);
+
+    unsigned long ringDrops = 0;
+    for (int i = 0; i < sim.nodeCount(); i++) ringDrops += sim.node(i).stats.rxDropped;
+    printf("  %-9s loop=%4lums acked=%4lu/%-4lu fifoOverrun=%-5lu ringDrops=%-5lu frames/msg=%5.1f\n",
+           interrupt ? "interrupt" : "polled", loopTime, acked, sent, sim.stats.framesOverrun - ringDrops, ringDrops,
+           acked ? (double)sim.stats.framesSent / acked : 0.0);
+}
+
+int main(int argc, char **argv){
+    int sensors = (argc > 1) ? atoi(argv[1]) : 6;
+    unsigned long period = (argc > 2) ? strtoul(argv[2], 0, 10) : 3000;
+    unsigned long seconds = (argc > 3) ? strtoul(argv[3], 0, 10) : 600;
+    uint32_t seed = (argc > 4) ? strtoul(argv[4], 0, 10) : 1;
+    const unsigned long loops[] = {0, 100, 200, 500};
+
+    if (sensors < 1) sensors = 1;
+    if (sensors > 60) sensors = 60;
+    Serial.enabled = false;
+    printf("%d sensors -> relay -> gateway, one reading each every %lums for %lus\n", sensors, period, seconds);
+    for (size_t l = 0; l < sizeof(loops) / sizeof(loops[0]); l++) {
+        run(false, loops[l], sensors, period, seconds, seed);
+        run(true, loops[l], sensors, period, seconds, seed);
+    }
+    return 0;
+}
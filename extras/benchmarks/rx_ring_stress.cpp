@@ -0,0 +1,98 @@
+// Copyright © 2020 by antónio montez . All rights reserved.
+// Licensed under the MIT license.
+//
+//   Stress test of the receive ring (LoraWifiMeshRing.h): a producer thread plays the esp_now receive
+//   callback and pushes bursts of numbered frames of random size back to back, the main thread plays yield()
+//   and drains them in batches.  Every frame must come out whole, in order, and
+//   received + dropped must equal pushed (modulo 65536, dropped() is a 16 bit counter).  Also reports the average and worst push() time (the callback
+//   latency, the worst one includes the producer being preempted).
+//
+//   build (from the library root):
+//        g++ -std=gnu++11 -O2 -pthread -Isrc extras/benchmarks/rx_ring_stress.cpp -o rx_ring_stress
+//
+//   usage:
+//        ./rx_ring_stress [frames] [consumer batch] [producer burst]
+
+#include "LoraWifiMeshRing.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <thread>
+
+#define SLOT 203
+
+typedef std::chrono::steady_clock Clock;
+
+static MeshRxRing<8, SLOT> ring;
+static volatile bool producerDone = false;
+static unsigned long pushed = 0;
+static unsigned long pushedOk = 0;
+static long long worstPushNs = 0;
+static long long totalPushNs = 0;
+
+// frame: 4 byte sequence number, then bytes derived from it
+static int makeFrame(uint32_t seq, uint8_t *f) {
+    int len = 8 + (int)(seq * 2654435761u >> 24) % (SLOT - 8);
+    memcpy(f, &seq, 4);
+    for (int i = 4; i < len; i++) f[i] = (uint8_t)(seq * 31 + i);
+    return len;
+}
+
+static void producer(unsigned long frames, int burst) {
+    uint8_t f[SLOT];
+    for (uint32_t seq = 0; seq < frames; seq++) {
+        int len = makeFrame(seq, f);
+        Clock::time_point t0 = Clock::now();
+        bool ok = ring.push(f, len);
+        long long ns = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - t0).count();
+        if (ns > worstPushNs) worstPushNs = ns;
+        totalPushNs += ns;
+        pushed++;
+        if (ok) pushedOk++;
+        if ((seq + 1) % burst == 0) std::this_thread::yield();
+    }
+    __atomic_store_n(&producerDone, true, __ATOMIC_RELEASE);
+}
+
+int main(int argc, char **argv){
+    unsigned long frames = (argc > 1) ? strtoul(argv[1], 0, 10) : 1000000UL;
+    int batch = (argc > 2) ? atoi(argv[2]) : 4;
+    int burst = (argc > 3) ? atoi(argv[3]) : 16;
+    uint8_t expect[SLOT];
+    unsigned long received = 0, errors = 0;
+    long long lastSeq = -1;
+
+    Clock::time_point t0 = Clock::now();
+    std::thread p(producer, frames, burst);
+
+    for (;;) {
+        bool done = __atomic_load_n(&producerDone, __ATOMIC_ACQUIRE);
+        int n = 0;
+        int len;
+        uint8_t *f;
+        while ((n < batch) && ((f = ring.front(len)) != 0)) {
+            uint32_t seq;
+            memcpy(&seq, f, 4);
+            if (((long long)seq <= lastSeq) || (makeFrame(seq, expect) != len) || (memcmp(expect, f, len) != 0)) errors++;
+            lastSeq = seq;
+            received++;
+            ring.pop();
+            n++;
+        }
+        if (done && (ring.count() == 0)) break;
+        if (n == 0) std::this_thread::yield();
+    }
+    p.join();
+    double secs = std::chrono::duration_cast<std::chrono::duration<double> >(Clock::now() - t0).count();
+
+    printf("pushed=%lu received=%lu dropped=%lu errors=%d\n", pushed, received, pushed - received, (int)errors);
+    printf("%.2f Mframes/s  push avg %lld ns worst %lld ns\n", received / secs / 1e6, totalPushNs / (long long)pushed, worstPushNs);
+
+    if ((errors != 0) || (received != pushedOk) || ((uint16_t)(pushed - received) != ring.dropped())) {
+        printf("FAILED\n");
+        return 1;
+    }
+    printf("OK\n");
+    return 0;
+}
@@ -0,0 +1,90 @@
+// Copyright © 2020 by antónio montez . All rights reserved.
+// Licensed under the MIT license.
+//
+//   Micro-benchmark of the transmit scheduler (LoraWifiMeshScheduler.h) against the linear scan of
+//   the old sentQueue: with <depth> messages waiting for their retry, cost of one yield() looking for
+//   the next datagram to send.  Reports CPU cycles per call (rdtsc on x86, otherwise nanoseconds).
+//
+//   build (from the library root):
+//        g++ -std=gnu++11 -O2 -DLORA_MESH_HOST -Isrc extras/benchmarks/tx_sched_bench.cpp -o tx_sched_bench
+
+#include "LoraWifiMesh.h"
+
+#include <stdio.h>
+#include <chrono>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+static inline uint64_t cycles() { return __rdtsc(); }
+#else
+static inline uint64_t cycles() {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+#endif
+
+#define RETRY 10000L
+#define CALLS 200000L
+
+static volatile uint32_t sink;
+
+// the old yield(): every slot is visited on every call to find the expired ones
+template <uint8_t N>
+static double linearScan(uint8_t depth) {
+    static TX_ENTRY q[N];
+    for (uint8_t i = 0; i < N; i++) {
+        q[i].sts = (i < depth) ? LORA_MESH_QUEUE_USED : LORA_MESH_QUEUE_FREE;
+        q[i].timeStamp = (long)i * RETRY / depth;
+        q[i].retryCount = 0;
+    }
+
+    uint64_t t0 = cycles();
+    for (long now = 0; now < CALLS; now++) {
+        for (uint8_t i = 0; i < N; i++) {
+            if ((q[i].sts == LORA_MESH_QUEUE_USED) && (now - q[i].timeStamp > RETRY)) {
+                q[i].timeStamp = now;
+                q[i].retryCount++;
+                sink += i;
+            }
+        }
+    }
+    return (double)(cycles() - t0) / CALLS;
+}
+
+template <uint8_t N>
+static double wheel(uint8_t depth) {
+    static MeshTxScheduler<N> s;
+    s.clear();
+    for (uint8_t i = 0; i < depth; i++) {
+        TX_ENTRY *e = s.alloc();
+        e->uniqueId = i;
+        e->priority = i % LORA_MESH_PRIO_CLASSES;
+        s.track(e);
+        s.schedule(e, (long)i * RETRY / depth + 1, 0);
+    }
+
+    uint64_t t0 = cycles();
+    for (long now = 0; now < CALLS; now++) {
+        TX_ENTRY *e = s.nextReady(now);
+        if (e != 0) {
+            e->retryCount++;
+            sink += e->uniqueId;
+            s.schedule(e, now + RETRY, now);
+        }
+    }
+    return (double)(cycles() - t0) / CALLS;
+}
+
+template <uint8_t N>
+static void row() {
+    printf("depth %3u:  linear scan %8.1f   wheel %6.1f   cycles/yield\n", N, linearScan<N>(N), wheel<N>(N));
+}
+
+int main(){
+    row<8>();
+    row<16>();
+    row<32>();
+    row<64>();
+    row<128>();
+    row<250>();
+    return 0;
+}
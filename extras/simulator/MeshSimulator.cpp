@@ -0,0 +1,262 @@
+// Copyright © 2020 by antónio montez . All rights reserved.
+// Licensed under the MIT license.
+
+#include "MeshSimulator.h"
+
+bool SimTransport::send(const uint8_t *buff, uint8_t len){
+    if (_sim->blockingJitter && (_sim->txJitter > 0)) delay(random(1, _sim->txJitter));
+    _sim->transmit(_index, buff, len);
+    return true;
+}
+
+uint8_t SimTransport::txJitter(){
+    return _sim->blockingJitter ? 0 : _sim->txJitter;
+}
+
+int SimTransport::receive(uint8_t *buff, int maxLen){
+    if (_inbox.empty()) return 0;
+
+    SimFrame frame = _inbox.front();
+    _inbox.pop_front();
+    if ((int)frame.data.size() > maxLen) return -1;
+    memcpy(buff, frame.data.data(), frame.data.size());
+    _lastRssi = frame.rssi;
+    _lastSnr = frame.snr;
+    return (int)frame.data.size();
+}
+
+uint8_t SimTransport::channelState(){
+    return _sim->channelBusy(_index) ? LORA_MESH_CHANNEL_BUSY : LORA_MESH_CHANNEL_FREE;
+}
+
+// false when the frame found no room: radio FIFO still holding the previous one, receive ring full
+bool SimTransport::deliver(const SimFrame &frame){
+    if (_mesh != 0) return _mesh->pushFrame(frame.data.data(), (int)frame.data.size(), frame.rssi, frame.snr);
+    if (_sim->radioFifo && !_inbox.empty()) return false;
+    _inbox.push_back(frame);
+    return true;
+}
+
+MeshSimulator::MeshSimulator(uint32_t seed) : _rng(seed) {
+    memset(defaults.pathToMaster, 0x00, LORA_MESH_MAX_ROUTING_PATH_SIZE);
+    defaults.protocol = MESH_PROTOCOL_LORA;
+    defaults.debugLevel = 0;
+    meshHostSetClock(0);
+    randomSeed(seed);
+}
+
+int MeshSimulator::addNode(uint8_t address, uint8_t masterNode, bool keepAlive){
+    int index = (int)_nodes.size();
+    NODE_CONFIGURATION nc = defaults;
+    char mac[6] = {0x02, 0x00, 0x00, 0x00, 0x00, (char)address};
+
+    _nodes.push_back(std::unique_ptr<LoraWifiMesh>(new LoraWifiMesh()));
+    _transports.push_back(std::unique_ptr<SimTransport>(new SimTransport(this, index)));
+    _txBusyUntil.push_back(0);
+    _nextPoll.push_back(0);
+    for (size_t i = 0; i < _links.size(); i++) _links[i].push_back(SimLink());
+    _links.push_back(std::vector<SimLink>(_nodes.size()));
+
+    LoraWifiMesh &n = *_nodes[index];
+    n.setTransport(_transports[index].get());
+    n.initAddress(address);
+
+    nc.nodeId            = address;
+    nc.masterNode        = masterNode;
+    nc.keepAlive         = keepAlive;
+    memcpy(nc.macAddress, mac, 6);
+    n.setConfig(nc);
+
+    return index;
+}
+
+int MeshSimulator::indexOf(uint8_t address) const {
+    for (size_t i = 0; i < _nodes.size(); i++) {
+        if (_nodes[i]->LocalAddress == address) return (int)i;
+    }
+    return -1;
+}
+
+void MeshSimulator::link(int a, int b, double loss, unsigned long delay){
+    SimLink l;
+    l.connected = true;
+    l.loss = loss;
+    l.delay = delay;
+    _links[a][b] = l;
+    _links[b][a] = l;
+}
+
+void MeshSimulator::unlink(int a, int b){
+    _links[a][b].connected = false;
+    _links[b][a].connected = false;
+}
+
+void MeshSimulator::isolate(int a){
+    for (int i = 0; i < nodeCount(); i++) unlink(a, i);
+}
+
+void MeshSimulator::signal(int a, int b, int16_t rssi, int8_t snr){
+    _links[a][b].rssi = _links[b][a].rssi = rssi;
+    _links[a][b].snr = _links[b][a].snr = snr;
+}
+
+void MeshSimulator::line(double loss, unsigned long delay){
+    for (int i = 0; i + 1 < nodeCount(); i++) link(i, i + 1, loss, delay);
+}
+
+void MeshSimulator::fullMesh(double loss, unsigned long delay){
+    for (int i = 0; i < nodeCount(); i++)
+        for (int j = i + 1; j < nodeCount(); j++) link(i, j, loss, delay);
+}
+
+unsigned long MeshSimulator::airtime(uint8_t len, uint8_t sf) const {
+    if (_useModem) {
+        LORA_MODEM m = _modem;
+        if (sf != 0) m.sf = sf;
+        return (meshLoraAirtime(m, len) + 999) / 1000;
+    }
+    return _overhead + ((unsigned long)len * 8 * 1000 + _bitrate - 1) / _bitrate;
+}
+
+bool MeshSimulator::hears(int to, uint8_t sf) const {
+    uint8_t mask = _transports[to]->rxSfMask();
+    return (mask == 0) ? (sf == _modem.sf) : ((mask & (1 << (sf - 6))) != 0);
+}
+
+bool MeshSimulator::lost(double p){
+    if (p <= 0.0) return false;
+    return std::uniform_real_distribution<double>(0.0, 1.0)(_rng) < p;
+}
+
+/*!
+    @brief  With setModem() a frame goes at the SF and power its transport was given (txParams), is only heard by
+            the nodes listening on that SF and, when the link has a SNR, lost below the floor of the SF, with
+            a loss probability falling from 45% to 0 over the first 3 dB above it (fading).
+*/
+
+void MeshSimulator::transmit(int from, const uint8_t *buff, uint8_t len){
+    unsigned long t = now();
+    SimFrame frame;
+
+    frame.data.assign(buff, buff + len);
+    frame.sf = (_useModem && (_transports[from]->txSf() != 0)) ? _transports[from]->txSf() : _modem.sf;
+    frame.power = (_useModem && (_transports[from]->txSf() != 0)) ? _transports[from]->txPower() : refPower;
+    unsigned long air = airtime(len, _useModem ? frame.sf : 0);
+
+    if (_txBusyUntil[from] > t) t = _txBusyUntil[from];
+    _txBusyUntil[from] = t + air;
+
+    stats.framesSent++;
+    stats.bytesSent += len;
+    stats.airtime += air;
+    if (onTransmit) onTransmit(from, t, frame);
+
+    Airing a;
+    a.from = from;
+    a.start = t;
+    a.end = t + air;
+    a.sf = frame.sf;
+    _onAir.push_back(a);
+    //--- half duplex: what the sender was receiving meanwhile is gone
+    if (collisions) {
+        for (size_t i = 0; i < _inFlight.size(); i++) {
+            Pending &q = _inFlight[i];
+            if ((q.to == from) && (q.start < a.end) && (q.at > a.start)) q.collided = true;
+        }
+    }
+
+    for (int to = 0; to < nodeCount(); to++) {
+        const SimLink &l = _links[from][to];
+        if (!l.connected) continue;
+
+        Pending p;
+        p.frame = frame;
+        p.frame.rssi = l.rssi;
+        p.frame.snr = l.snr;
+        if (_useModem) {
+            if (!hears(to, frame.sf)) continue;
+            if (l.snr != 0) {
+                int delta = frame.power - refPower;
+                int margin = l.snr + delta - meshLoraSnrFloor(frame.sf);
+                if ((margin < 0) || ((margin < 3) && lost(0.15 * (3 - margin)))) { stats.framesLost++; continue; }
+                p.frame.snr = (int8_t)(l.snr + delta);
+                if (l.rssi != 0) p.frame.rssi = (int16_t)(l.rssi + delta);
+            }
+        }
+        if (lost(l.loss)) { stats.framesLost++; continue; }
+
+        p.start = t + l.delay;
+        p.at = t + air + l.delay;
+        p.to = to;
+        p.collided = false;
+        if (collisions) {
+            for (size_t i = 0; i < _inFlight.size(); i++) {
+                Pending &q = _inFlight[i];
+                if ((q.to != to) || (q.frame.sf != frame.sf) || (q.start >= p.at) || (q.at <= p.start)) continue;
+                q.collided = true;
+                p.collided = true;
+            }
+            for (size_t i = 0; i < _onAir.size(); i++) {
+                if ((_onAir[i].from == to) && (_onAir[i].start < p.at) && (_onAir[i].end > p.start)) p.collided = true;
+            }
+        }
+        _inFlight.push_back(p);
+    }
+}
+
+bool MeshSimulator::channelBusy(int a) const {
+    unsigned long t = now();
+
+    for (size_t i = 0; i < _onAir.size(); i++) {
+        const Airing &o = _onAir[i];
+        if ((o.from == a) || (o.start > t) || (o.end <= t) || !_links[o.from][a].connected) continue;
+        if (_useModem && !hears(a, o.sf)) continue;
+        return true;
+    }
+    return false;
+}
+
+void MeshSimulator::step(){
+    RECEIVED_Packet rec;
+    unsigned long t = now();
+
+    for (size_t i = 0; i < _inFlight.size(); ) {
+        if (_inFlight[i].at <= t) {
+            if (_inFlight[i].collided) stats.framesCollided++;
+            else if (_transports[_inFlight[i].to]->deliver(_inFlight[i].frame)) stats.framesDelivered++;
+            else stats.framesOverrun++;
+            _inFlight.erase(_inFlight.begin() + i);
+        } else {
+            i++;
+        }
+    }
+
+    for (size_t i = 0; i < _onAir.size(); ) {
+        if (_onAir[i].end <= t) _onAir.erase(_onAir.begin() + i);
+        else i++;
+    }
+
+    for (int i = 0; i < nodeCount(); i++) {
+        LoraWifiMesh &n = *_nodes[i];
+        if (loopTime > 0) {
+            if (t < _nextPoll[i]) continue;
+            _nextPoll[i] = t + loopTime;
+        }
+        n.yield();
+        do {
+            memset(rec._bmsg, 0, sizeof(RECEIVED_Packet));
+            while (n.hasMsg(&rec)) {
+                if (onReceive) onReceive(i, rec);
+                memset(rec._bmsg, 0, sizeof(RECEIVED_Packet));
+            }
+        } while (_transports[i]->pending() > 0);
+    }
+
+    // the whole network shares one clock; delay() calls inside the nodes also move it
+    if (now() == t) meshHostAdvance(1);
+}
+
+void MeshSimulator::run(unsigned long ms){
+    unsigned long end = now() + ms;
+    while (now() < end) step();
+}
@@ -0,0 +1,170 @@
+// Copyright © 2020 by antónio montez . All rights reserved.
+// Licensed under the MIT license.
+
+#ifndef _MESH_SIMULATOR_H_
+#define _MESH_SIMULATOR_H_
+
+/*!
+    @brief  In-process simulator running N LoraWifiMesh nodes on the host (LORA_MESH_HOST build).
+
+            Every node gets a SimTransport. A frame sent by one node is delivered to every node
+            linked with it (radio broadcast medium), after the sender airtime plus the link delay,
+            unless it is dropped by the link loss probability.
+            Time is the virtual clock of LoraWifiMeshHost: one step() is one millisecond.
+            By default a node takes its frames from an unbounded inbox every millisecond. loopTime spaces the
+            polls of every node like a busy sketch loop and radioFifo gives the polled radio the single FIFO of a
+            SX127x: a frame arriving before the previous one was read is lost (framesOverrun). A node with
+            nc.rxInterrupt gets each frame in its receive ring as it arrives (pushFrame), as from DIO0.
+            With collisions two frames on the same SF overlapping at a receiver are both lost (no capture), and
+            so is a frame arriving while the receiver transmits (half duplex): framesCollided. channelState() of
+            a node (nc.csma) is busy while a frame it can hear is on the air, an instant and perfect CAD.
+*/
+
+#include "LoraWifiMesh.h"
+
+#include <stdint.h>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <random>
+#include <functional>
+
+class MeshSimulator;
+
+typedef struct SimLink {
+      bool connected = false;
+      double loss = 0.0;                 // probability of dropping a frame [0..1]
+      unsigned long delay = 0;           // extra propagation / processing delay (ms)
+      int16_t rssi = 0;                  // reported by the receiver's transport (lastRssi / lastSnr), 0 = unknown
+      int8_t snr = 0;                    // with setModem() the SNR at refPower, below the floor of the SF the frame is lost
+      };
+
+typedef struct SimFrame {
+      std::vector<uint8_t> data;
+      int16_t rssi;
+      int8_t snr;
+      uint8_t sf;                        // spreading factor and power (dBm) it was sent with, setModem() only
+      int8_t power;
+      };
+
+typedef struct SimStats {
+      unsigned long framesSent = 0;
+      unsigned long bytesSent = 0;
+      unsigned long framesDelivered = 0;
+      unsigned long framesLost = 0;
+      unsigned long framesOverrun = 0;   // arrived while the radio FIFO (radioFifo) or the receive ring was full
+      unsigned long framesCollided = 0;  // receptions lost to an overlapping frame or the receiver's own send (collisions)
+      unsigned long airtime = 0;         // sum of all transmissions (ms)
+      };
+
+class SimTransport : public LoraWifiMeshTransport {
+  public:
+    SimTransport(MeshSimulator *sim, int index) : _sim(sim), _index(index) {};
+
+    bool send(const uint8_t *buff, uint8_t len);
+    int receive(uint8_t *buff, int maxLen);
+    uint8_t txJitter();
+    int16_t lastRssi() { return _lastRssi; };
+    int8_t lastSnr() { return _lastSnr; };
+    void txParams(uint8_t sf, int8_t power, uint8_t /* listenSf */) { _txSf = sf; _txPower = power; };
+    uint8_t rxSfMask() { return _rxSfMask; };
+    bool receiveInterrupt(LoraWifiMesh *mesh) { _mesh = mesh; return true; };
+    uint8_t channelState();
+
+    uint8_t txSf() const { return _txSf; };
+    int8_t txPower() const { return _txPower; };
+    void setRxSfMask(uint8_t mask) { _rxSfMask = mask; };
+
+    bool deliver(const SimFrame &frame);
+    size_t pending() const { return _inbox.size(); };
+
+  private:
+    MeshSimulator *_sim;
+    int _index;
+    int16_t _lastRssi = 0;
+    int8_t _lastSnr = 0;
+    uint8_t _txSf = 0;                 // 0: the simulator's modem, refPower
+    int8_t _txPower = 0;
+    uint8_t _rxSfMask = 0;
+    LoraWifiMesh *_mesh = 0;           // receiving by interrupt
+    std::deque<SimFrame> _inbox;
+};
+
+class MeshSimulator {
+  public:
+    SimStats stats;
+    NODE_CONFIGURATION defaults;         // template for the configuration of the nodes added after this point
+    uint8_t txJitter = 0;                // transport jitter (ms) like the ESP_NOW transport, 0 for none
+    int8_t refPower = LORA_MESH_TX_POWER;  // dBm the link rssi / snr are given for
+    bool blockingJitter = false;         // spend the jitter in a delay() inside send() (the old ESP_NOW transport)
+    unsigned long loopTime = 0;          // ms between two yield() / hasMsg() of a node, 0: every step
+    bool radioFifo = false;              // a polled radio holds one frame until it is read
+    bool collisions = false;             // overlapping receptions are lost
+
+    // called for every message a node gets from hasMsg()
+    std::function<void(int node, const RECEIVED_Packet &rec)> onReceive;
+    // called for every frame a node puts on the air, when it starts (ms)
+    std::function<void(int node, unsigned long at, const SimFrame &frame)> onTransmit;
+
+    MeshSimulator(uint32_t seed = 1);
+
+    int addNode(uint8_t address, uint8_t masterNode, bool keepAlive = false);
+    LoraWifiMesh &node(int index) { return *_nodes[index]; };
+    int nodeCount() const { return (int)_nodes.size(); };
+    int indexOf(uint8_t address) const;
+
+    void link(int a, int b, double loss = 0.0, unsigned long delay = 0);
+    void unlink(int a, int b);
+    void isolate(int a);                 // node a stops hearing and being heard (switched off, out of range)
+    void signal(int a, int b, int16_t rssi, int8_t snr);   // what a and b report for each other's frames
+    void line(double loss = 0.0, unsigned long delay = 0);
+    void fullMesh(double loss = 0.0, unsigned long delay = 0);
+
+    void setBitrate(unsigned long bps) { _bitrate = bps; };
+    void setFrameOverhead(unsigned long ms) { _overhead = ms; };
+    void setModem(const LORA_MODEM &m) { _modem = m; _useModem = true; };   // airtime and SNR floor of the LoRa modem
+    // spreading factors node a receives on at once (bit sf - 6), 0: only the one of setModem() (a SX127x)
+    void setRxSfMask(int a, uint8_t mask) { _transports[a]->setRxSfMask(mask); };
+    unsigned long airtime(uint8_t len, uint8_t sf = 0) const;
+
+    void step();
+    void run(unsigned long ms);
+    unsigned long now() const { return millis(); };
+
+    void transmit(int from, const uint8_t *buff, uint8_t len);
+    bool channelBusy(int a) const;       // a frame node a hears is on the air now
+
+  private:
+    typedef struct Pending {
+          unsigned long start;           // reception, start .. at
+          unsigned long at;
+          int to;
+          bool collided;
+          SimFrame frame;
+          };
+
+    typedef struct Airing {
+          int from;
+          unsigned long start;
+          unsigned long end;
+          uint8_t sf;
+          };
+
+    std::vector< std::unique_ptr<LoraWifiMesh> > _nodes;
+    std::vector< std::unique_ptr<SimTransport> > _transports;
+    std::vector< std::vector<SimLink> > _links;
+    std::vector<unsigned long> _txBusyUntil;
+    std::vector<unsigned long> _nextPoll;
+    std::deque<Pending> _inFlight;
+    std::deque<Airing> _onAir;         // transmissions not over yet
+    std::mt19937 _rng;
+    unsigned long _bitrate = 5470;     // LoRa SF7 / 125kHz / CR4:5
+    unsigned long _overhead = 13;      // preamble + PHY header at SF7 (ms)
+    LORA_MODEM _modem;
+    bool _useModem = false;
+
+    bool lost(double p);
+    bool hears(int to, uint8_t sf) const;
+};
+
+#endif
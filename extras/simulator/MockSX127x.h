@@ -0,0 +1,257 @@
+// Copyright © 2020 by antónio montez . All rights reserved.
+// Licensed under the MIT license.
+
+#ifndef _MOCK_SX127X_H_
+#define _MOCK_SX127X_H_
+
+/*!
+    @brief  SX127x seen from its SPI bus, for the host (LORA_MESH_HOST build, benchmarks).
+
+            MockSX127x is a BUS for MeshSX127xFifo: a register file, the 256 bytes FIFO behind register 0x00
+            (FIFO_ADDR_PTR auto-increments, other registers auto-increment the address in a burst) and the
+            LoRa modes the mesh uses: a datagram given to air() lands at FIFO_RX_BASE_ADDR while receiving,
+            TX sends PAYLOAD_LENGTH bytes from FIFO_TX_BASE_ADDR at once, CAD ends after cadReads reads of
+            IRQ_FLAGS (at once when 0) and detects a preamble while busy is set, another mode ends it without
+            a result. It counts transactions and bytes.
+
+            MockLoRaLibrary does the same register accesses as the LoRa library (one transaction per register),
+            for the byte by byte path: parsePacket(), available(), read(), beginPacket(), write(), endPacket().
+*/
+
+#include "LoraWifiMeshSX127x.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#define SX127X_REG_FIFO_TX_BASE_ADDR    0x0E
+#define SX127X_REG_FIFO_RX_BASE_ADDR    0x0F
+
+#define SX127X_MODE_SLEEP               0x00
+#define SX127X_MODE_TX                  0x03
+#define SX127X_MODE_RX_CONTINUOUS       0x05
+#define SX127X_MODE_RX_SINGLE           0x06
+
+#define SX127X_IRQ_TX_DONE              0x08
+#define SX127X_IRQ_CRC_ERROR            0x20
+#define SX127X_IRQ_RX_DONE              0x40
+
+typedef struct MOCK_SPI_COUNT {
+      unsigned long transactions;
+      unsigned long bytes;               // single transfers, address bytes included
+      unsigned long burstBytes;          // read() / write() bursts
+      };
+
+class MockSX127x {
+  public:
+    MOCK_SPI_COUNT count;
+    uint8_t reg[0x80];
+    uint8_t fifo[256];
+    uint8_t sent[256];                   // last datagram transmitted
+    uint8_t sentLen = 0;
+    unsigned long packetsSent = 0;
+    bool busy = false;                   // somebody is on the air, for CAD
+    uint8_t cadReads = 0;                // how long a CAD lasts: reads of IRQ_FLAGS, 0: it ends at once
+
+    MockSX127x() { reset(); };
+
+    void reset() {
+        memset(reg, 0, sizeof(reg));
+        memset(fifo, 0, sizeof(fifo));
+        reg[SX127X_REG_OP_MODE] = SX127X_MODE_LONG_RANGE | SX127X_MODE_STDBY;
+        reg[SX127X_REG_MODEM_CONFIG_1] = 0x72;                     // reset values: 125 kHz, SF7
+        reg[SX127X_REG_MODEM_CONFIG_2] = 0x70;
+        memset(&count, 0, sizeof(count));
+    };
+
+    //--- radio side
+
+    // a datagram on the air, received when the radio listens: false when it was not
+    bool air(const uint8_t *buff, uint8_t len) {
+        uint8_t mode = reg[SX127X_REG_OP_MODE] & SX127X_MODE_MASK;
+        if ((mode != SX127X_MODE_RX_SINGLE) && (mode != SX127X_MODE_RX_CONTINUOUS)) return false;
+
+        uint8_t base = reg[SX127X_REG_FIFO_RX_BASE_ADDR];
+        for (uint16_t i = 0; i < len; i++) fifo[(uint8_t)(base + i)] = buff[i];
+        reg[SX127X_REG_FIFO_RX_CURRENT_ADDR] = base;
+        reg[SX127X_REG_RX_NB_BYTES] = len;
+        reg[SX127X_REG_IRQ_FLAGS] |= SX127X_IRQ_RX_DONE;
+        if (mode == SX127X_MODE_RX_SINGLE) setMode(SX127X_MODE_STDBY);
+        return true;
+    };
+
+    uint8_t mode() { return reg[SX127X_REG_OP_MODE] & SX127X_MODE_MASK; };
+
+    //--- BUS of MeshSX127xFifo
+
+    void select() {
+        count.transactions++;
+        _addr = -1;
+    };
+
+    void deselect() {};
+
+    uint8_t transfer(uint8_t b) {
+        count.bytes++;
+        if (_addr < 0) {
+            _write = (b & SX127X_SPI_WRITE) != 0;
+            _addr = b & 0x7F;
+            return 0;
+        }
+        return access(b);
+    };
+
+    void read(uint8_t *buff, uint8_t len) {
+        count.burstBytes += len;
+        for (uint8_t i = 0; i < len; i++) buff[i] = access(0);
+    };
+
+    void write(const uint8_t *buff, uint8_t len) {
+        count.burstBytes += len;
+        for (uint8_t i = 0; i < len; i++) access(buff[i]);
+    };
+
+  private:
+    int _addr = -1;
+    bool _write = false;
+    uint8_t _cadLeft = 0;
+
+    uint8_t access(uint8_t b) {
+        uint8_t a = (uint8_t)_addr;
+        uint8_t v = 0;
+
+        if (a == SX127X_REG_FIFO) {
+            uint8_t &ptr = reg[SX127X_REG_FIFO_ADDR_PTR];
+            if (_write) fifo[ptr] = b;
+            else v = fifo[ptr];
+            ptr++;
+            return v;
+        }
+        if (!_write) {
+            if ((a == SX127X_REG_IRQ_FLAGS) && (_cadLeft > 0) && (--_cadLeft == 0)) cadEnd();
+            v = reg[a];
+        }
+        else if (a == SX127X_REG_IRQ_FLAGS) reg[a] &= ~b;                   // flags clear on 1
+        else if (a == SX127X_REG_OP_MODE) setMode(b & SX127X_MODE_MASK);
+        else if (a != SX127X_REG_FIFO_RX_CURRENT_ADDR && a != SX127X_REG_RX_NB_BYTES) reg[a] = b;
+        _addr = (a + 1) & 0x7F;
+        return v;
+    };
+
+    void cadEnd() {
+        reg[SX127X_REG_IRQ_FLAGS] |= SX127X_IRQ_CAD_DONE | (busy ? SX127X_IRQ_CAD_DETECTED : 0);
+        reg[SX127X_REG_OP_MODE] = SX127X_MODE_LONG_RANGE | SX127X_MODE_STDBY;
+    };
+
+    void setMode(uint8_t m) {
+        reg[SX127X_REG_OP_MODE] = SX127X_MODE_LONG_RANGE | m;
+        _cadLeft = 0;                                               // a detection still running is lost
+        if (m == SX127X_MODE_CAD) {
+            if (cadReads == 0) cadEnd();
+            else _cadLeft = cadReads;
+            return;
+        }
+        if (m != SX127X_MODE_TX) return;
+
+        //--- the datagram leaves at once, then the radio is back in standby
+        sentLen = reg[SX127X_REG_PAYLOAD_LENGTH];
+        uint8_t base = reg[SX127X_REG_FIFO_TX_BASE_ADDR];
+        for (uint16_t i = 0; i < sentLen; i++) sent[i] = fifo[(uint8_t)(base + i)];
+        packetsSent++;
+        reg[SX127X_REG_IRQ_FLAGS] |= SX127X_IRQ_TX_DONE;
+        reg[SX127X_REG_OP_MODE] = SX127X_MODE_LONG_RANGE | SX127X_MODE_STDBY;
+    };
+};
+
+class MockLoRaLibrary {
+  public:
+    MockLoRaLibrary(MockSX127x &radio) : _radio(radio) {};
+
+    void begin() {
+        writeRegister(SX127X_REG_OP_MODE, SX127X_MODE_LONG_RANGE | SX127X_MODE_SLEEP);
+        writeRegister(SX127X_REG_FIFO_TX_BASE_ADDR, 0);
+        writeRegister(SX127X_REG_FIFO_RX_BASE_ADDR, 0);
+        idle();
+    };
+
+    void idle() { writeRegister(SX127X_REG_OP_MODE, SX127X_MODE_LONG_RANGE | SX127X_MODE_STDBY); };
+
+    int parsePacket() {
+        int packetLength = 0;
+        uint8_t irqFlags = readRegister(SX127X_REG_IRQ_FLAGS);
+
+        writeRegister(SX127X_REG_MODEM_CONFIG_1, readRegister(SX127X_REG_MODEM_CONFIG_1) & 0xFE);
+        writeRegister(SX127X_REG_IRQ_FLAGS, irqFlags);
+        if ((irqFlags & SX127X_IRQ_RX_DONE) && !(irqFlags & SX127X_IRQ_CRC_ERROR)) {
+            _packetIndex = 0;
+            packetLength = readRegister(SX127X_REG_RX_NB_BYTES);
+            writeRegister(SX127X_REG_FIFO_ADDR_PTR, readRegister(SX127X_REG_FIFO_RX_CURRENT_ADDR));
+            idle();
+        }
+        else if (readRegister(SX127X_REG_OP_MODE) != (SX127X_MODE_LONG_RANGE | SX127X_MODE_RX_SINGLE)) {
+            writeRegister(SX127X_REG_FIFO_ADDR_PTR, 0);
+            writeRegister(SX127X_REG_OP_MODE, SX127X_MODE_LONG_RANGE | SX127X_MODE_RX_SINGLE);
+        }
+        return packetLength;
+    };
+
+    int available() { return readRegister(SX127X_REG_RX_NB_BYTES) - _packetIndex; };
+
+    int read() {
+        if (!available()) return -1;
+        _packetIndex++;
+        return readRegister(SX127X_REG_FIFO);
+    };
+
+    int beginPacket() {
+        if (isTransmitting()) return 0;
+        idle();
+        writeRegister(SX127X_REG_MODEM_CONFIG_1, readRegister(SX127X_REG_MODEM_CONFIG_1) & 0xFE);
+        writeRegister(SX127X_REG_FIFO_ADDR_PTR, 0);
+        writeRegister(SX127X_REG_PAYLOAD_LENGTH, 0);
+        return 1;
+    };
+
+    size_t write(const uint8_t *buffer, size_t size) {
+        int currentLength = readRegister(SX127X_REG_PAYLOAD_LENGTH);
+        if ((currentLength + size) > 255) size = 255 - currentLength;
+        for (size_t i = 0; i < size; i++) writeRegister(SX127X_REG_FIFO, buffer[i]);
+        writeRegister(SX127X_REG_PAYLOAD_LENGTH, currentLength + size);
+        return size;
+    };
+
+    size_t write(uint8_t b) { return write(&b, 1); };
+
+    int endPacket() {
+        writeRegister(SX127X_REG_OP_MODE, SX127X_MODE_LONG_RANGE | SX127X_MODE_TX);
+        while ((readRegister(SX127X_REG_IRQ_FLAGS) & SX127X_IRQ_TX_DONE) == 0) {}
+        writeRegister(SX127X_REG_IRQ_FLAGS, SX127X_IRQ_TX_DONE);
+        return 1;
+    };
+
+  private:
+    MockSX127x &_radio;
+    int _packetIndex = 0;
+
+    bool isTransmitting() {
+        if ((readRegister(SX127X_REG_OP_MODE) & SX127X_MODE_TX) == SX127X_MODE_TX) return true;
+        if (readRegister(SX127X_REG_IRQ_FLAGS) & SX127X_IRQ_TX_DONE) writeRegister(SX127X_REG_IRQ_FLAGS, SX127X_IRQ_TX_DONE);
+        return false;
+    };
+
+    uint8_t readRegister(uint8_t a) {
+        _radio.select();
+        _radio.transfer(a & 0x7F);
+        uint8_t v = _radio.transfer(0x00);
+        _radio.deselect();
+        return v;
+    };
+
+    void writeRegister(uint8_t a, uint8_t v) {
+        _radio.select();
+        _radio.transfer(a | SX127X_SPI_WRITE);
+        _radio.transfer(v);
+        _radio.deselect();
+    };
+};
+
+#endif
@@ -0,0 +1,285 @@
+// Copyright © 2020 by antónio montez . All rights reserved.
+// Licensed under the MIT license.
+//
+//   Scenarios run on the simulator whose outcome is known: each prints its result and the program exits with 1
+//   as soon as one of them is wrong.
+//     binary         a payload full of zeros across a line of nodes, its first copy lost on the last hop: the same
+//                    bytes and length at the destination after the retry, from the source (end to end) and from
+//                    the relay (hop watch, next hop routing)
+//     registration   the nodes register with the master (keep alive), binary payloads to the master starting with
+//                    LORA_MESH_MSG_REGISTRATION or LORA_MESH_MSG_USER are delivered as they are and register nobody
+//     wraparound     the message ids of a node run up to LORA_MESH_ID_LAST and start again from 0 with a burst of
+//                    messages in flight: each one ACKed once, with its own id. Its route request ids (and the
+//                    sequence numbers in the replies) run over the whole id space across a diamond: past the wrap
+//                    the second copy of each RREQ is still the only one dropped as a duplicate and every reply is
+//                    still taken as fresher (MESH_ID_NEWER)
+//     seen set       two nodes flooding their first RREQ (the same id) at once through a common relay: both relayed,
+//                    both answered. A second copy of a RREQ coming through a slow link is a duplicate before
+//                    LORA_MESH_RREQ_SEEN_TIMEOUT and relayed again after it (the entry expired)
+//     long chain     LORA_MESH_MAX_HOPS hops (15 on the host, the old wire format stopped at 7) between nodes whose
+//                    ids are control characters (0x01, 0x02 ...): the route found holds every node, the messages
+//                    are delivered and ACKed, with source routes and with next hop routing
+//
+//   build (from the library root):
+//        g++ -std=gnu++11 -O2 -DLORA_MESH_HOST -Isrc -Iextras/simulator src/*.cpp extras/simulator/MeshSimulator.cpp extras/simulator/mesh_check.cpp -o mesh_check
+//
+//   usage:
+//        ./mesh_check
+
+#include "MeshSimulator.h"
+
+#include <map>
+
+static int failures = 0;
+
+static void check(bool ok, const char *what){
+    printf("  %-60s %s\n", what, ok ? "ok" : "FAILED");
+    if (!ok) failures++;
+}
+
+// nodes in a line, the first copy of the datagram sent by the last relay doesn't reach the destination
+static void binary(const char *name, uint8_t routingMode, long hopAckTimeout){
+    const int nodes = 5;
+    MeshSimulator sim(1);
+    sim.defaults.routingMode = routingMode;
+    sim.defaults.hopAckTimeout = hopAckTimeout;
+    for (int i = 0; i < nodes; i++) sim.addNode((uint8_t)(0x31 + i), 0x31);
+    sim.line();
+
+    int src = 0, dst = nodes - 1;
+    uint8_t payload[LORA_MESH_MAX_MSG_SIZE];
+    for (size_t i = 0; i < sizeof(payload); i++) payload[i] = (i % 3) ? (uint8_t)i : 0;
+    payload[sizeof(payload) - 1] = 0;
+
+    bool dropped = false;
+    unsigned long cutAt = 0;
+    sim.onTransmit = [&](int node, unsigned long at, const SimFrame &frame) {
+        if (dropped || (node != dst - 1) || (((const HDR_MSG *)frame.data.data())->hdrType != LORA_MESH_MSG_SENDTO)) return;
+        sim.unlink(dst - 1, dst);
+        dropped = true;
+        cutAt = at;
+    };
+
+    int received = 0, intact = 0, acked = 0;
+    unsigned long ackAt = 0;
+    MSG_ID id = 0;
+    sim.onReceive = [&](int node, const RECEIVED_Packet &rec) {
+        if ((node == dst) && (rec._pkt.sts == STS_RECEIVED)) {
+            received++;
+            if ((rec._pkt.len == sizeof(payload)) && (memcmp(rec._pkt.msg, payload, sizeof(payload)) == 0)) intact++;
+        }
+        if ((node == src) && (rec._pkt.sts == STS_MSG_ACK_REGISTRATION_DONE) && (rec._pkt.msgId == id)) {
+            acked++;
+            ackAt = sim.now();
+        }
+    };
+
+    id = sim.node(src).sendMsg(sim.node(dst).LocalAddress, payload, sizeof(payload));
+    while (!dropped && (sim.now() < 30000)) sim.step();
+    sim.run(200);
+    sim.link(dst - 1, dst);
+    while ((acked == 0) && (sim.now() < 120000)) sim.step();
+    sim.run(LORA_MESH_MSG_QUEUE_TIMEOUT);
+
+    printf("%s: %d bytes, %d hops, first copy lost at %lums, acknowledged at %lums\n", name, (int)sizeof(payload),
+           nodes - 1, cutAt, ackAt);
+    check(dropped && (received == 1), "delivered once after the retry");
+    check(intact == 1, "same length and bytes, zeros included");
+    check(acked == 1, "acknowledged to the source");
+}
+
+static bool registered(LoraWifiMesh &m, uint8_t node){
+    for (int slot = 0; slot < LORA_MESH_MAX_NETWORK_SIZE; slot++) {
+        if ((m.meshNetwork[slot].nodeId == node) && (m.meshNetwork[slot].sts == LORA_MESH_NODE_REGISTERED)) return true;
+    }
+    return false;
+}
+
+static void registration(){
+    MeshSimulator sim(1);
+    sim.addNode(0x31, 0x31);
+    for (int i = 1; i < 3; i++) sim.addNode((uint8_t)(0x31 + i), 0x31, true);
+    sim.line();
+
+    //--- what a registration looks like: type, node id, mac
+    const uint8_t payloads[2][8] = { {LORA_MESH_MSG_REGISTRATION, 0x77, 0xDE, 0xAD, 0, 0xEF, 0, 0x01},
+                                     {LORA_MESH_MSG_USER, 0x78, 0, 0, 0, 0, 0, 0} };
+    int intact = 0;
+    sim.onReceive = [&](int node, const RECEIVED_Packet &rec) {
+        if ((node != 0) || (rec._pkt.sts != STS_RECEIVED) || (rec._pkt.len != sizeof(payloads[0]))) return;
+        for (int k = 0; k < 2; k++) if (memcmp(rec._pkt.msg, payloads[k], sizeof(payloads[k])) == 0) intact++;
+    };
+
+    sim.run(5000);
+    for (int k = 0; k < 2; k++) {
+        sim.node(2).sendMsg(0x31, payloads[k], sizeof(payloads[k]));
+        sim.run(10000);
+    }
+    sim.run(LORA_MESH_KEEP_ALIVE_INTERVAL * 3);                    // the first keep alive finds the route
+
+    LoraWifiMesh &master = sim.node(0);
+    printf("registration: master 0x31, nodes 0x32 0x33 with keep alive, payloads 0x01 0x77 ... and 0x02 0x78 ...\n");
+    check(registered(master, 0x32) && registered(master, 0x33), "the nodes registered with the master");
+    check(intact == 2, "the payloads delivered as they are");
+    check(!registered(master, 0x77) && !registered(master, 0x78), "no node registered from a payload");
+}
+
+static void wraparound(){
+    const unsigned long idSpace = (unsigned long)(MSG_ID)~0 + 1;
+    const int burst = 6;
+
+    //--- message ids, two nodes
+    {
+        MeshSimulator sim(1);
+        sim.defaults.keepAlive = false;
+        for (int i = 0; i < 2; i++) sim.addNode((uint8_t)(0x31 + i), 0x31);
+        sim.line();
+
+        std::map<MSG_ID, int> ackedIds;
+        int delivered = 0, timeouts = 0;
+        sim.onReceive = [&](int node, const RECEIVED_Packet &rec) {
+            if ((node == 1) && (rec._pkt.sts == STS_RECEIVED)) delivered++;
+            if ((node == 0) && (rec._pkt.sts == STS_MSG_ACK_REGISTRATION_DONE)) ackedIds[rec._pkt.msgId]++;
+            if ((node == 0) && (rec._pkt.sts == STS_TIMEOUT)) timeouts++;
+        };
+
+        MSG_ID id = 0;
+        while (id != (MSG_ID)(LORA_MESH_ID_LAST - burst / 2)) {
+            id = sim.node(0).sendMsg(0x32, (char *)"count");
+            while (ackedIds.count(id) == 0) sim.step();
+        }
+        ackedIds.clear();
+        delivered = 0;
+
+        MSG_ID ids[burst];
+        for (int i = 0; i < burst; i++) ids[i] = sim.node(0).sendMsg(0x32, (char *)"across the wrap");
+        sim.run(LORA_MESH_MSG_QUEUE_TIMEOUT * 3);
+
+        bool once = (ackedIds.size() == (size_t)burst);
+        for (int i = 0; i < burst; i++) once = once && (ackedIds[ids[i]] == 1);
+        printf("wraparound, message ids %u..%u in flight together\n", ids[0], ids[burst - 1]);
+        check((ids[0] == LORA_MESH_ID_LAST - burst / 2 + 1) && (ids[burst - 1] == burst / 2 - 1), "ids wrap from LORA_MESH_ID_LAST to 0");
+        check(once && (timeouts == 0), "each message ACKed once with its own id");
+        check(delivered == burst, "each message delivered once");
+    }
+
+    //--- route request ids, a diamond: 0 - 1 - 3 and 0 - 2 - 3, node 0 looks for node 3 again and again
+    {
+        MeshSimulator sim(1);
+        sim.defaults.keepAlive = false;
+        sim.defaults.routingMode = LORA_MESH_ROUTING_NEXT_HOP;     // routes carry sequence numbers
+        for (int i = 0; i < 4; i++) sim.addNode((uint8_t)(0x31 + i), 0x31);
+        sim.link(0, 1);
+        sim.link(0, 2);
+        sim.link(1, 3);
+        sim.link(2, 3);
+
+        LoraWifiMesh &src = sim.node(0), &dst = sim.node(3);
+        const unsigned long window = 32;
+        unsigned long rounds = idSpace + window / 2;
+        unsigned long learned = 0, duplicates = 0, first = src.stats.rreqSent;
+        for (unsigned long k = 0; k < rounds; k++) {
+            if (k == rounds - window) {
+                learned = src.stats.routesLearned;
+                duplicates = dst.stats.rreqDuplicates;
+            }
+            src.getRREQ(dst.LocalAddress);
+            sim.run(250);
+        }
+        learned = src.stats.routesLearned - learned;
+        duplicates = dst.stats.rreqDuplicates - duplicates;
+
+        printf("wraparound, %lu route requests, ids %lu..%lu checked\n", rounds, (first + rounds - window) % idSpace,
+               (first + rounds - 1) % idSpace);
+        check(duplicates == window, "one duplicate dropped per RREQ across the wrap");
+        check(learned == window, "every RREP taken as fresher across the wrap");
+    }
+}
+
+static void seenSet(){
+    //--- 0 and 1 both look for 3 through 2 with RREQ id 0
+    {
+        MeshSimulator sim(1);
+        sim.defaults.keepAlive = false;
+        for (int i = 0; i < 4; i++) sim.addNode((uint8_t)(0x31 + i), 0x31);
+        sim.link(0, 2);
+        sim.link(1, 2);
+        sim.link(2, 3);
+
+        int routes[2] = {0, 0};
+        sim.onReceive = [&](int node, const RECEIVED_Packet &rec) {
+            if ((node < 2) && (rec._pkt.sts == STS_ROUTE_RETURNED)) routes[node]++;
+        };
+        sim.node(0).getRREQ(sim.node(3).LocalAddress);
+        sim.node(1).getRREQ(sim.node(3).LocalAddress);
+        sim.run(LORA_MESH_RREQ_SEEN_TIMEOUT);
+
+        printf("seen set, two originators, the same RREQ id\n");
+        check(sim.node(2).stats.rreqRelayed >= 2, "the common relay relays both");
+        check((routes[0] == 1) && (routes[1] == 1), "both answered");
+    }
+
+    //--- 1 hears the RREQ of 0 right away, and again through 2 after delay ms
+    const unsigned long delays[] = {LORA_MESH_RREQ_SEEN_TIMEOUT / 2, LORA_MESH_RREQ_SEEN_TIMEOUT + 1000};
+    for (int d = 0; d < 2; d++) {
+        MeshSimulator sim(1);
+        sim.defaults.keepAlive = false;
+        for (int i = 0; i < 3; i++) sim.addNode((uint8_t)(0x31 + i), 0x31);
+        sim.link(0, 1);
+        sim.link(0, 2);
+        sim.link(1, 2, 0.0, delays[d]);
+
+        sim.node(0).getRREQ(0x50);
+        sim.run(delays[d] * 2);
+
+        const LORA_MESH_STATS &s = sim.node(1).stats;
+        printf("seen set, second copy %lums later: relayed=%lu duplicates=%lu\n", delays[d], s.rreqRelayed, s.rreqDuplicates);
+        if (d == 0) check((s.rreqRelayed == 1) && (s.rreqDuplicates == 1), "dropped as a duplicate");
+        else check((s.rreqRelayed == 2) && (s.rreqDuplicates == 0), "expired, relayed again");
+    }
+}
+
+static void longChain(const char *name, uint8_t routingMode){
+    const int nodes = LORA_MESH_MAX_HOPS + 1;
+    MeshSimulator sim(1);
+    sim.defaults.keepAlive = false;
+    sim.defaults.routingMode = routingMode;
+    for (int i = 0; i < nodes; i++) sim.addNode((uint8_t)(0x01 + i), 0x01);
+    sim.line();
+
+    int src = 0, dst = nodes - 1;
+    int delivered = 0, acked = 0;
+    sim.onReceive = [&](int node, const RECEIVED_Packet &rec) {
+        if ((node == dst) && (rec._pkt.sts == STS_RECEIVED) && (rec._pkt.len == 5) && (memcmp(rec._pkt.msg, "hello", 5) == 0)) delivered++;
+        if ((node == src) && (rec._pkt.sts == STS_MSG_ACK_REGISTRATION_DONE)) acked++;
+    };
+
+    const int messages = 3;
+    for (int k = 0; k < messages; k++) {
+        sim.node(src).sendMsg(sim.node(dst).LocalAddress, (char *)"hello");
+        sim.run(20000);
+    }
+
+    char path[LORA_MESH_MAX_ROUTING_PATH_SIZE] = "";
+    bool found = sim.node(src).findRoute(sim.node(dst).LocalAddress, path);
+    bool whole = found && (strlen(path) == (size_t)nodes);
+    for (int i = 0; whole && (i < nodes); i++) whole = ((uint8_t)path[i] == sim.node(i).LocalAddress);
+
+    printf("%s: %d hops, node ids 0x%02x..0x%02x, route of %d nodes\n", name, nodes - 1, sim.node(src).LocalAddress,
+           sim.node(dst).LocalAddress, found ? (int)strlen(path) : 0);
+    check(whole, "the route holds every node of the chain, in order");
+    check((delivered == messages) && (acked == messages), "every message delivered and ACKed");
+}
+
+int main(){
+    Serial.enabled = false;
+    binary("binary, source routes, end to end retry", LORA_MESH_ROUTING_SOURCE, 0);
+    binary("binary, next hop routing, hop retry", LORA_MESH_ROUTING_NEXT_HOP, LORA_MESH_HOP_ACK_TIMEOUT);
+    registration();
+    wraparound();
+    seenSet();
+    longChain("long chain, source routes", LORA_MESH_ROUTING_SOURCE);
+    longChain("long chain, next hop routing", LORA_MESH_ROUTING_NEXT_HOP);
+    printf("%s\n", failures ? "FAILED" : "all ok");
+    return failures ? 1 : 0;
+}
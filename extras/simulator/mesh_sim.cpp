@@ -0,0 +1,229 @@
+// Copyright © 2020 by antónio montez . All rights reserved.
+// Licensed under the MIT license.
+//
+//   Host load generator for LoraWifiMesh on top of MeshSimulator.
+//   Node 0 sends one message every <interval> ms to the last node and the tool reports
+//   delivery ratio, ACK latency, retries and radio usage.
+//
+//   build (from the library root):
+//        g++ -std=gnu++11 -O2 -DLORA_MESH_HOST -Isrc -Iextras/simulator src/*.cpp extras/simulator/MeshSimulator.cpp extras/simulator/mesh_sim.cpp -o mesh_sim
+//
+//   usage:
+//        ./mesh_sim [-n nodes] [-t line|full] [-l loss] [-d delay_ms] [-s seconds] [-i interval_ms] [-r seed] [-c 1|2|4] [-b bytes] [-m source|next] [-a] [-g ms] [-k ms] [-f sf] [-D permille] [-W ms] [-A] [-R] [-F] [-P ms] [-C] [-L] [-Q copies] [-G percent] [-X] [-v]
+//
+//        -c  CRC width in bytes (LORA_MESH_CRC8, LORA_MESH_CRC16, LORA_MESH_CRC32)
+//        -b  send binary messages of that size with sendLongMsg (fragmented), checked byte for byte at the destination
+//        -m  routing mode: source routes (default) or next hop routing tables
+//        -a  link layer hop ACKs
+//        -g  aggregation delay: frames for the same next hop within that many ms share one radio frame
+//        -k  ACK delay: end to end ACKs wait that many ms for more ACKs or data going back
+//        -f  LoRa spreading factor (125 kHz, CR 4/5): the nodes and the simulated radio use the modem airtime formula
+//        -D  duty cycle limit per-mille (10 = 1%) over a window of -W ms (default one hour)
+//        -A  adaptive data rate (SF and power per neighbour), turns hop ACKs on
+//        -R  interrupt driven receive: each frame goes to the receive ring as it arrives
+//        -F  polled radio with the single FIFO of a SX127x: a frame arriving before the previous one was read is lost
+//        -P  ms between two polls (yield / hasMsg) of a node, like a busy sketch loop
+//        -C  collision model: frames overlapping at a receiver are lost, so is what a node hears while it sends
+//        -L  listen before talk: channel check and random backoff before each frame, spread out floods
+//        -Q  RREQ relays dropped once that many copies were heard while they waited (counter based flooding)
+//        -G  RREQs relayed by that percentage of the nodes past the first hop (gossip)
+//        -X  RREQ relays wait longer the stronger the signal, far nodes first
+
+#include "MeshSimulator.h"
+
+#include <map>
+#include <string>
+
+int main(int argc, char **argv){
+    int nodes = 4;
+    std::string topology = "line";
+    double loss = 0.0;
+    unsigned long linkDelay = 0;
+    unsigned long seconds = 300;
+    unsigned long interval = 5000;
+    uint32_t seed = 1;
+    bool verbose = false;
+    int crcMode = LORA_MESH_CRC8;
+    int longBytes = 0;
+    std::string routing = "source";
+    bool hopAck = false;
+    long aggDelay = 0;
+    long ackDelay = 0;
+    int sf = 0;
+    int dutyCycle = 0;
+    long dutyWindow = LORA_MESH_DUTY_WINDOW;
+    bool adr = false;
+    bool rxInterrupt = false;
+    bool radioFifo = false;
+    unsigned long loopTime = 0;
+    bool collisions = false;
+    bool csma = false;
+    int rreqCounter = 0;
+    int rreqGossip = 0;
+    bool rreqDistance = false;
+
+    for (int i = 1; i < argc; i++) {
+        std::string a = argv[i];
+        const char *v = (i + 1 < argc) ? argv[i + 1] : "0";
+        if (a == "-n") { nodes = atoi(v); i++; }
+        else if (a == "-t") { topology = v; i++; }
+        else if (a == "-l") { loss = atof(v); i++; }
+        else if (a == "-d") { linkDelay = strtoul(v, 0, 10); i++; }
+        else if (a == "-s") { seconds = strtoul(v, 0, 10); i++; }
+        else if (a == "-i") { interval = strtoul(v, 0, 10); i++; }
+        else if (a == "-r") { seed = strtoul(v, 0, 10); i++; }
+        else if (a == "-c") { crcMode = atoi(v); i++; }
+        else if (a == "-b") { longBytes = atoi(v); i++; }
+        else if (a == "-m") { routing = v; i++; }
+        else if (a == "-a") { hopAck = true; }
+        else if (a == "-g") { aggDelay = atol(v); i++; }
+        else if (a == "-k") { ackDelay = atol(v); i++; }
+        else if (a == "-f") { sf = atoi(v); i++; }
+        else if (a == "-D") { dutyCycle = atoi(v); i++; }
+        else if (a == "-W") { dutyWindow = atol(v); i++; }
+        else if (a == "-A") { adr = true; hopAck = true; }
+        else if (a == "-R") { rxInterrupt = true; }
+        else if (a == "-F") { radioFifo = true; }
+        else if (a == "-P") { loopTime = strtoul(v, 0, 10); i++; }
+        else if (a == "-C") { collisions = true; }
+        else if (a == "-L") { csma = true; }
+        else if (a == "-Q") { rreqCounter = atoi(v); i++; }
+        else if (a == "-G") { rreqGossip = atoi(v); i++; }
+        else if (a == "-X") { rreqDistance = true; }
+        else if (a == "-v") { verbose = true; }
+        else { fprintf(stderr, "unknown option %s\n", a.c_str()); return 1; }
+    }
+    if (nodes < 2) nodes = 2;
+
+    Serial.enabled = verbose;
+
+    MeshSimulator sim(seed);
+    sim.defaults.crcMode = crcMode;
+    sim.defaults.routingMode = (routing == "next") ? LORA_MESH_ROUTING_NEXT_HOP : LORA_MESH_ROUTING_SOURCE;
+    sim.defaults.hopAck = hopAck;
+    sim.defaults.aggDelay = aggDelay;
+    sim.defaults.ackDelay = ackDelay;
+    if (sf > 0) {
+        sim.defaults.modem.sf = (uint8_t)sf;
+        sim.setModem(sim.defaults.modem);
+    }
+    sim.defaults.dutyCycle = (uint16_t)dutyCycle;
+    sim.defaults.dutyCycleWindow = dutyWindow;
+    sim.defaults.adr = adr;
+    sim.defaults.rxInterrupt = rxInterrupt;
+    sim.radioFifo = radioFifo;
+    sim.loopTime = loopTime;
+    sim.collisions = collisions;
+    sim.defaults.csma = csma;
+    sim.defaults.rreqCounter = (uint8_t)rreqCounter;
+    sim.defaults.rreqGossip = (uint8_t)rreqGossip;
+    sim.defaults.rreqDistance = rreqDistance;
+    for (int i = 0; i < nodes; i++) sim.addNode((uint8_t)(0x31 + i), 0x31);
+    if (topology == "full") sim.fullMesh(loss, linkDelay);
+    else sim.line(loss, linkDelay);
+
+    int src = 0;
+    int dst = nodes - 1;
+    uint8_t dstAddr = sim.node(dst).LocalAddress;
+
+    std::map<int, unsigned long> sentAt;
+    unsigned long sent = 0, received = 0, acked = 0, timeouts = 0;
+    unsigned long latencySum = 0, latencyMax = 0, corrupted = 0;
+    std::vector<uint8_t> longMsg(longBytes > 0 ? longBytes : 1), longIn(longMsg.size());
+    for (size_t i = 0; i < longMsg.size(); i++) longMsg[i] = (uint8_t)((i * 7) % 251);    // binary, with zeros
+
+    sim.onReceive = [&](int node, const RECEIVED_Packet &rec) {
+        if (node == dst && rec._pkt.sts == STS_RECEIVED) received++;
+        if (node == dst && rec._pkt.sts == STS_LONG_MSG_RECEIVED) {
+            RECEIVED_Packet r = rec;
+            uint16_t n = sim.node(dst).readLongMsg(&r, longIn.data(), (uint16_t)longIn.size());
+            if ((n != longMsg.size()) || (memcmp(longIn.data(), longMsg.data(), n) != 0)) corrupted++;
+            received++;
+        }
+        if (node != src) return;
+        if (rec._pkt.sts == STS_TIMEOUT) { timeouts++; sentAt.erase(rec._pkt.msgId); }
+        if ((rec._pkt.sts == STS_MSG_ACK_REGISTRATION_DONE) || (rec._pkt.sts == STS_DELIVERED)) {
+            std::map<int, unsigned long>::iterator it = sentAt.find(rec._pkt.msgId);
+            if (it == sentAt.end()) return;
+            unsigned long l = sim.now() - it->second;
+            latencySum += l;
+            if (l > latencyMax) latencyMax = l;
+            acked++;
+            sentAt.erase(it);
+        }
+    };
+
+    unsigned long end = seconds * 1000UL;
+    unsigned long next = 1000;
+    char msg[LORA_MESH_MAX_MSG_SIZE];
+
+    while (sim.now() < end) {
+        if (sim.now() >= next) {
+            next += interval;
+            snprintf(msg, sizeof(msg), "msg %lu", sent);
+            MSG_ID id = (longBytes > 0) ? sim.node(src).sendLongMsg(dstAddr, longMsg.data(), (uint16_t)longBytes)
+                                      : sim.node(src).sendMsg(dstAddr, msg);
+            sentAt[id] = sim.now();
+            sent++;
+        }
+        sim.step();
+    }
+    // let the last messages settle
+    sim.run(LORA_MESH_MSG_QUEUE_TIMEOUT * 2);
+
+    printf("nodes=%d topology=%s loss=%.2f delay=%lums seconds=%lu interval=%lums\n",
+           nodes, topology.c_str(), loss, linkDelay, seconds, interval);
+    printf("sent=%lu received=%lu acked=%lu timeouts=%lu retries=%d crcErrors=%d",
+           sent, received, acked, timeouts, sim.node(src).totalRetry, sim.node(src).totalCRC);
+    if (longBytes > 0) printf(" corrupted=%lu", corrupted);
+    printf("\n");
+    printf("ackLatencyAvg=%lums ackLatencyMax=%lums\n", acked ? latencySum / acked : 0, latencyMax);
+    printf("frames=%lu bytes=%lu airtime=%lums delivered=%lu lost=%lu\n",
+           sim.stats.framesSent, sim.stats.bytesSent, sim.stats.airtime,
+           sim.stats.framesDelivered, sim.stats.framesLost);
+
+    LORA_MESH_STATS total = {};
+    for (int i = 0; i < nodes; i++) {
+        const LORA_MESH_STATS &s = sim.node(i).stats;
+        total.rreqSent += s.rreqSent;
+        total.rreqRelayed += s.rreqRelayed;
+        total.rreqDuplicates += s.rreqDuplicates;
+        total.routesLearned += s.routesLearned;
+        total.routesRefreshed += s.routesRefreshed;
+        total.routesExpired += s.routesExpired;
+        total.probesSent += s.probesSent;
+        total.probesAcked += s.probesAcked;
+        total.forwardDrops += s.forwardDrops;
+        total.hopRetries += s.hopRetries;
+        total.linkBreaks += s.linkBreaks;
+        total.rerrSent += s.rerrSent;
+        total.localRepairs += s.localRepairs;
+        total.hopAcksSent += s.hopAcksSent;
+        total.hopDuplicates += s.hopDuplicates;
+        total.aggFramesSent += s.aggFramesSent;
+        total.aggDatagrams += s.aggDatagrams;
+        total.acksCoalesced += s.acksCoalesced;
+        total.acksPiggybacked += s.acksPiggybacked;
+        total.txDeferred += s.txDeferred;
+        total.adrFrames += s.adrFrames;
+        total.adrReports += s.adrReports;
+        total.rxDropped += s.rxDropped;
+        total.txBackoffs += s.txBackoffs;
+        total.csmaForced += s.csmaForced;
+        total.rreqSuppressed += s.rreqSuppressed;
+        if (s.airtime > total.airtime) total.airtime = s.airtime;
+    }
+    printf("rreqSent=%lu rreqRelayed=%lu rreqDuplicates=%lu routesLearned=%lu routesRefreshed=%lu routesExpired=%lu probes=%lu/%lu forwardDrops=%lu\n",
+           total.rreqSent, total.rreqRelayed, total.rreqDuplicates, total.routesLearned, total.routesRefreshed,
+           total.routesExpired, total.probesAcked, total.probesSent, total.forwardDrops);
+    printf("hopRetries=%lu linkBreaks=%lu rerrSent=%lu localRepairs=%lu hopAcks=%lu hopDuplicates=%lu aggregates=%lu/%lu\n",
+           total.hopRetries, total.linkBreaks, total.rerrSent, total.localRepairs, total.hopAcksSent, total.hopDuplicates,
+           total.aggFramesSent, total.aggDatagrams);
+    printf("acksCoalesced=%lu acksPiggybacked=%lu\n", total.acksCoalesced, total.acksPiggybacked);
+    printf("nodeAirtimeMax=%lums txDeferred=%lu adrFrames=%lu adrReports=%lu\n", total.airtime, total.txDeferred,
+           total.adrFrames, total.adrReports);
+    printf("rxOverrun=%lu rxDropped=%lu collided=%lu txBackoffs=%lu csmaForced=%lu rreqSuppressed=%lu\n",
+           sim.stats.framesOverrun, total.rxDropped, sim.stats.framesCollided, total.txBackoffs, total.csmaForced,
+           total.rreqSuppressed);
+    return 0;
+}
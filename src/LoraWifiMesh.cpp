@@ -58,8 +58,6 @@
 #include <stddef.h>
 #include <stdint.h>
 
-Global_Packet pkt;
-
 LoraWifiMesh::LoraWifiMesh(){
 };
 
@@ -99,13 +97,39 @@ STSCODE LoraWifiMesh::setConfig(NODE_CONFIGURATION nc){
     Band = nc.band ;
     MaxMsgRetry = nc.maxMsgRetry;
     RetryInterval =nc.retryInterval ;
+    BackoffShiftMax = nc.backoffShiftMax;
+    RetryJitter = nc.retryJitter;
     KeepAlive = nc.keepAlive ;
     KeepAliveInterval = nc.keepAliveInterval;
     DebugLevel = nc.debugLevel;
     memcpy(Mac,nc.macAddress,6);
     memcpy(BlockNodes,nc.blockNodes,LORA_MESH_MAX_BLOCK_NODES);
     memcpy(BlockBroadcast, nc.blockBroadcast,LORA_MESH_MAX_BLOCK_NODES); 
-    _lastReset = millis();
+    CrcMode = ((nc.crcMode == LORA_MESH_CRC16) || (nc.crcMode == LORA_MESH_CRC32)) ? nc.crcMode : LORA_MESH_CRC8;
+    RoutingMode = (nc.routingMode == LORA_MESH_ROUTING_NEXT_HOP) ? LORA_MESH_ROUTING_NEXT_HOP : LORA_MESH_ROUTING_SOURCE;
+    HopAckTimeout = nc.hopAckTimeout;
+    LocalRepair = nc.localRepair;
+    HopAck = nc.hopAck && (HopAckTimeout > 0);
+    AggDelay = nc.aggDelay;
+    AckDelay = nc.ackDelay;
+    if (nc.modem.sf != 0) Modem = nc.modem;
+    DutyCycle = (nc.dutyCycle > 1000) ? 1000 : nc.dutyCycle;
+    if ((nc.dutyCycleWindow > 0) && (nc.dutyCycleWindow != DutyCycleWindow)) {
+        DutyCycleWindow = nc.dutyCycleWindow;
+        dutyWindow.setWindow(DutyCycleWindow);
+    }
+    Adr = nc.adr && HopAck;
+    TxPower = (nc.txPower > 0) ? nc.txPower : LORA_MESH_TX_POWER;
+    TxPowerMin = ((nc.txPowerMin > 0) && (nc.txPowerMin <= TxPower)) ? nc.txPowerMin : TxPower;
+    AdrTarget = (nc.adrTarget > 0) ? nc.adrTarget : LORA_MESH_ADR_TARGET;
+    RxInterrupt = nc.rxInterrupt;
+    setRxInterrupt(getTransport(), RxInterrupt);
+    Csma = nc.csma;
+    CsmaSlot = (nc.csmaSlot > 0) ? nc.csmaSlot : 0;
+    RreqCounter = nc.rreqCounter;
+    RreqGossip = (nc.rreqGossip < 100) ? nc.rreqGossip : 0;
+    RreqDistance = nc.rreqDistance;
+    RreqWindow = (nc.rreqWindow > 0) ? nc.rreqWindow : 0;
     addStaticRoute(MasterNode,nc.pathToMaster);
   
     return STS_OK;
@@ -131,40 +155,234 @@ STSCODE LoraWifiMesh::setConfig(NODE_CONFIGURATION nc){
     return STS_OK;
  };
  
-STSCODE LoraWifiMesh::_send(char *_bmsg, byte len){
-    byte result;
-    String ss;
+/*!
+    @brief  Install the radio transport used to send and receive datagrams.
+            When no transport is installed the built-in one for the selected protocol is used
+            (LoRa or ESP_NOW). The host simulator uses this to plug its own radio model.
+            With nc.rxInterrupt the interrupt driven receive moves to the new transport.
     
-    switch (Protocol) {
-      case MESH_PROTOCOL_LORA :
-         #if !defined(ESP32) || defined(_HELTEC_)
-                LoRa.beginPacket();   
-                for (int i = 0;i<len;i++){
-                  LoRa.write(_bmsg[i]);
-                }
-                LoRa.endPacket();
-          #endif
-                break;
-            #if defined(ESP8266) ||  defined(ESP32)
-                case MESH_PROTOCOL_WIFI:
-                        memcpy(dataToSend2,_bmsg,len);
+    @param  LoraWifiMeshTransport *transport
     
-                        byte tt = (byte) random(1,5);
-                        delay(tt);            
-                        result = esp_now_send(broadcastAddress, dataToSend2, len); 
-                        if (result == 0 /*ESP_OK*/) {
-                        }
-                        else {
-                            Serial.println("Error sending the data");
-                        }
-       
-                          break;
-            #endif
+    @return STS_OK status code.
+
+    @note   
+*/
+
+STSCODE LoraWifiMesh::setTransport(LoraWifiMeshTransport *transport) {
+    if (_rxInterrupt) setRxInterrupt(getTransport(), false);
+    Transport = transport;
+    if (RxInterrupt) setRxInterrupt(getTransport(), true);
+    return STS_OK;
+}
+
+// hand the received datagrams over from the radio interrupt (pushFrame) or back to polling with receive()
+void LoraWifiMesh::setRxInterrupt(LoraWifiMeshTransport *transport, bool on){
+    if (transport == 0) return;
+    if (on) _rxInterrupt = transport->receiveInterrupt(this);
+    else if (_rxInterrupt) {
+        transport->receiveInterrupt(0);
+        _rxInterrupt = false;
+    }
+}
+
+LoraWifiMeshTransport *LoraWifiMesh::getTransport(){
+    if (Transport != 0) return Transport;
+
+    switch (Protocol) {
+      #if defined(LORA_MESH_HAS_LORA)
+          case MESH_PROTOCOL_LORA : {
+                static LoRaTransport _loraTransport;
+                return &_loraTransport;
+          }
+      #endif
+      #if defined(LORA_MESH_HAS_ESPNOW)
+          case MESH_PROTOCOL_WIFI: {
+                static EspNowTransport _espNowTransport;
+                return &_espNowTransport;
+          }
+      #endif
+    }
+    return 0;
+}
+
+/*!
+    @brief  Seal a datagram with its CRC and hand it to the transport.
+            CRC8 goes in the header _crc byte (compatible with older nodes),
+            CRC16/CRC32 are appended after the datagram (little endian) and the header byte is left as the mask 0xAA.
+            Over LoRa the time on air of the frame is added to the duty cycle window and stats.airtime,
+            with adaptive data rate the frame goes at the SF and power chosen for its next hop (txModem()).
+*/
+
+STSCODE LoraWifiMesh::_send(char *_bmsg, byte len){
+    LoraWifiMeshTransport *transport = getTransport();
+    HDR_MSG *hdr = (HDR_MSG *)_bmsg;
+    uint32_t _crc;
+    uint16_t wireLen = len;
+
+    if (transport == 0) return STS_UNKNOWN;
+
+    _crc = getCRC(_bmsg, len);
+    if (CrcMode == LORA_MESH_CRC8) {
+        hdr->_crc = (byte)_crc;
+    }
+    else {
+        hdr->_crc = 0xAA;
+        for (byte i = 0; i < CrcMode; i++) {
+            _bmsg[len + i] = (char)(_crc >> (8 * i));
+        }
+        wireLen += CrcMode;
+    }
+    int8_t power;
+    LORA_MODEM m = txModem(hdr->destinationNode, power, _txRobust);
+    _txRobust = false;
+    if (Adr && (Protocol == MESH_PROTOCOL_LORA)) {
+        NEIGHBOUR *n = findNeighbour(hdr->destinationNode);
+        if (n != 0) {
+            n->txSf = m.sf;
+            n->txPower = power;
+        }
+        if ((m.sf < Modem.sf) || (power < TxPower)) stats.adrFrames++;
+        transport->txParams(m.sf, power, Modem.sf);
+    }
+    transport->send((const uint8_t *)_bmsg, wireLen);
+
+    if (Protocol == MESH_PROTOCOL_LORA) {
+        unsigned long us = meshLoraAirtime(m, wireLen);
+        dutyWindow.add(millis(), us);
+        _airtimeUs += us;
+        stats.airtime += _airtimeUs / 1000;
+        _airtimeUs %= 1000;
     }
     
   return STS_OK;
 }
 
+/*!
+    @brief  Airtime (ms) spent over the last dutyCycleWindow, and the budget of that window (0: no duty cycle).
+            For monitoring, together with stats.airtime and stats.txDeferred.
+*/
+
+unsigned long LoraWifiMesh::airtimeUsed(){
+    return dutyWindow.used(millis()) / 1000;
+}
+
+unsigned long LoraWifiMesh::airtimeBudget(){
+    return (unsigned long)DutyCycleWindow * DutyCycle / 1000;
+}
+
+/*!
+    @brief  Transmit governor: ms before a frame of len bytes (CRC not included) fits in the duty cycle budget
+            of its priority class, 0 when it can go on the air now. Control frames may use the whole budget,
+            the others LORA_MESH_DUTY_LOW_SHARE percent of it.
+*/
+
+long LoraWifiMesh::dutyWait(uint16_t len, uint8_t priority, long now, uint8_t hop){
+    int8_t power;
+    if ((DutyCycle == 0) || (Protocol != MESH_PROTOCOL_LORA)) return 0;
+
+    unsigned long budget = (unsigned long)DutyCycleWindow * DutyCycle;
+    if (priority != LORA_MESH_PRIO_CONTROL) budget = budget / 100 * LORA_MESH_DUTY_LOW_SHARE;
+    if (CrcMode != LORA_MESH_CRC8) len += CrcMode;
+
+    long at = dutyWindow.freeAt(now, meshLoraAirtime(txModem(hop, power), len), budget);
+    return (at - now > 0) ? at - now : 0;
+}
+
+// a due entry that doesn't fit in the budget goes back in the wheel until it does
+bool LoraWifiMesh::dutyDefer(TX_ENTRY *e, long now){
+    long wait = dutyWait(entryWireSize(e), e->priority, now, entryHop(e));
+    if (wait <= 0) return false;
+
+    stats.txDeferred++;
+    txQueue.schedule(e, now + wait, now);
+    return true;
+}
+
+/*!
+    @brief  Listen before talk: 0 when a frame may go on the air now, otherwise ms to wait (1 while the transport
+            is still checking). A busy channel draws 1..window slots, the window LORA_MESH_CSMA_CW_MIN slots per
+            neighbour doubled by each busy check of the frame (backoffs) up to LORA_MESH_CSMA_CW_MAX.
+            After LORA_MESH_CSMA_MAX_BACKOFFS busy checks the frame goes anyway.
+*/
+
+long LoraWifiMesh::channelWait(uint8_t &backoffs){
+    LoraWifiMeshTransport *transport = getTransport();
+    if (!Csma || (transport == 0)) return 0;
+
+    uint8_t state = transport->channelState();
+    if (state == LORA_MESH_CHANNEL_CHECKING) return 1;
+    if ((state == LORA_MESH_CHANNEL_FREE) || (backoffs >= LORA_MESH_CSMA_MAX_BACKOFFS)) {
+        if (state != LORA_MESH_CHANNEL_FREE) stats.csmaForced++;
+        backoffs = 0;
+        return 0;
+    }
+
+    long cw = ((long)LORA_MESH_CSMA_CW_MIN * neighbourCount()) << backoffs;
+    if (cw > LORA_MESH_CSMA_CW_MAX) cw = LORA_MESH_CSMA_CW_MAX;
+    backoffs++;
+    stats.txBackoffs++;
+    return random(1, cw + 1) * csmaSlot();
+}
+
+// a due entry meeting a busy channel goes back in the wheel for its backoff
+bool LoraWifiMesh::channelDefer(TX_ENTRY *e, long now){
+    long wait = channelWait(e->backoffs);
+    if (wait <= 0) return false;
+
+    txQueue.schedule(e, now + wait, now);
+    return true;
+}
+
+// backoff slot (ms): csmaSlot, or the airtime of a frame without payload on LoRa
+long LoraWifiMesh::csmaSlot(){
+    if (CsmaSlot > 0) return CsmaSlot;
+    if (Protocol != MESH_PROTOCOL_LORA) return 1;
+    return meshLoraAirtime(Modem, LORA_MESH_WIRE_FIXED_SIZE + CrcMode) / 1000 + 1;
+}
+
+// neighbours heard in the last LORA_MESH_CSMA_NEIGHBOUR_AGE ms, at least 1: the contention windows scale with it
+uint8_t LoraWifiMesh::neighbourCount(){
+    long _now = millis();
+    uint8_t n = 0;
+
+    for (byte i = 0; i < LORA_MESH_NEIGHBOUR_TABLE_SIZE; i++) {
+        if ((neighbours[i].sts == LORA_MESH_QUEUE_USED) && (_now - neighbours[i].lastHeard < LORA_MESH_CSMA_NEIGHBOUR_AGE)) n++;
+    }
+    return (n > 0) ? n : 1;
+}
+
+// a broadcast waits 0..LORA_MESH_CSMA_FLOOD_SLOTS slots per neighbour: the nodes relaying the same flood spread out
+long LoraWifiMesh::floodWait(uint8_t destination){
+    if (!Csma || (destination != LORA_MESH_BROADCAST_ADDRESS)) return 0;
+    return random(0, (long)LORA_MESH_CSMA_FLOOD_SLOTS * neighbourCount() + 1) * csmaSlot();
+}
+
+// assessment delay of a relayed RREQ (rreqCounter, rreqDistance), the RSSI of the copy being processed
+long LoraWifiMesh::rreqWait(){
+    if ((RreqCounter == 0) && !RreqDistance) return 0;
+
+    long window = (RreqWindow > 0) ? RreqWindow : (long)LORA_MESH_RREQ_WINDOW_SLOTS * csmaSlot();
+    if (!RreqDistance || (_rxRssi == 0)) return random(0, window + 1);
+
+    long above = (long)_rxRssi - LORA_MESH_ROUTE_COST_RSSI_FLOOR;
+    if (above < 0) above = 0;
+    if (above > LORA_MESH_RREQ_RSSI_SPAN) above = LORA_MESH_RREQ_RSSI_SPAN;
+    return window * above / LORA_MESH_RREQ_RSSI_SPAN + random(0, csmaSlot() + 1);
+}
+
+// size of the wire frame of an entry (without CRC) before encodeEntry(), the route it would take
+uint16_t LoraWifiMesh::entryWireSize(TX_ENTRY *e){
+    if (e->flags & LORA_MESH_TX_RAW) return e->len;
+    if ((RoutingMode == LORA_MESH_ROUTING_NEXT_HOP) && !(e->flags & LORA_MESH_TX_SOURCE_ROUTE)) return LORA_MESH_WIRE_FIXED_SIZE + e->len + e->ackLen;
+
+    const MESH_PATH *path = &e->_pkt._msg._send.path;
+    if (path->len == 0) {
+        ROUTING_TABLE *r = routingTable.find(e->_pkt._msg._send.destinationNode);
+        if ((r != 0) && (r->sts == LORA_MESH_QUEUE_USED)) path = &r->path;
+    }
+    return LORA_MESH_WIRE_FIXED_SIZE + path->len + e->len + e->ackLen;
+}
+
 /*!
     @brief  Main processing Function 
             
@@ -199,79 +417,63 @@ STSCODE LoraWifiMesh::_send(char *_bmsg, byte len){
 
  
 STSCODE LoraWifiMesh::processMsg(int packetSize, uint8_t *msg){
-  Global_Packet pkt;
-  RR_Packet rr;
-  char node11=0;
-  char node22=0;
-  byte cnt;
-  char c;
-  byte _crc0;
-  byte _crc1;
+  char *frame;
+  int cnt;
   bool _checkCrc;
   byte _len;
   byte _hdrType;
   byte _size;
+  byte _trailer = (CrcMode == LORA_MESH_CRC8) ? 0 : CrcMode;
+  MSG_VIEW v;
 
-  
-  memset(&pkt, 0, sizeof(Global_Packet));
-  cnt = 0;
+  //--- the datagram is parsed where it was received: caller buffer (ESP_NOW) or dataReceived (transport)
 
-  if (LWMesh.Protocol == MESH_PROTOCOL_WIFI){
+  if (msg != 0x00){
+          frame = (char *)msg;
           cnt = packetSize;
-          memcpy (pkt._bmsg,msg,packetSize);
-          switch (pkt._send._hdr.hdrType) {
-            case  LORA_MESH_MSG_RREQ :_size = sizeof(RREQ_DATAGRAM); break;
-            case  LORA_MESH_MSG_RREP :_size = sizeof(RREP_DATAGRAM); break;
-            case  LORA_MESH_MSG_SENDTO :_size = sizeof(SEND_DATAGRAM); break;
-            case  LORA_MESH_MSG_ACK :_size = sizeof(RREP_DATAGRAM); break;
-          }
-          if ((cnt > _size)) {
-                if ((DebugLevel <=  2) && (DebugLevel >0)) {
-                  Serial.print(F("Msg to big:"));
-                  Serial.println(cnt);
-                }
-                return ERR_NO_MSG;
+  }
+  else {
+          LoraWifiMeshTransport *transport = getTransport();
+          frame = (char *)dataReceived;
+          cnt = ((transport == 0) || _rxInterrupt) ? 0 : transport->receive(dataReceived, WIFI_MAX_MSG_SIZE);
+          if (cnt > 0) {
+                _rxRssi = transport->lastRssi();
+                _rxSnr = transport->lastSnr();
           }
-          if (packetSize == 0 ) return ERR_NO_MSG;
-      }
- else {
-        
- #if !defined(ESP32) || defined(_HELTEC_)
-     
-      while (LoRa.available())
-        {
-             c = (char)LoRa.read();
-             if (cnt == 0 ) {
-               _hdrType = c;
-             }
-             if (cnt == 1) {
-               _len = c;
-             }
-             
-             if (cnt == 2 ) {
-                  switch (_hdrType) {
-                    case  LORA_MESH_MSG_RREQ :_size = sizeof(RREQ_DATAGRAM); break;
-                    case  LORA_MESH_MSG_RREP :_size = sizeof(RREP_DATAGRAM); break;
-                    case  LORA_MESH_MSG_SENDTO :_size = sizeof(SEND_DATAGRAM); break;
-                    case  LORA_MESH_MSG_ACK :_size = sizeof(RREP_DATAGRAM); break;
-                  }
-       
-             }
-             pkt._bmsg[cnt++] = c;
-      
-             if ((cnt > _size)) {
-                if ((DebugLevel <=  2) && (DebugLevel >0)) {
-                  Serial.print(F("Msg to big:"));
-                  Serial.println(cnt);
-                }
-                return ERR_NO_MSG;
-             }
-        };
-    #endif
- }
+  }
+
+  if (cnt == 0 ) return ERR_NO_MSG;
+  if ((cnt < 0) || (cnt > WIFI_MAX_MSG_SIZE)) {
+        if ((DebugLevel <=  2) && (DebugLevel >0)) {
+          Serial.print(F("Msg to big:"));
+          Serial.println(cnt);
+        }
+        return ERR_NO_MSG;
+  }
+  if (cnt < (int)(LORA_MESH_WIRE_FIXED_SIZE + _trailer)) {
+        if ((DebugLevel <=  2) && (DebugLevel >0)) {
+          Serial.print(F("Msg to short:"));
+          Serial.println(cnt);
+        }
+        return ERR_NO_MSG;
+  }
 
-if (cnt == 0 ) return ERR_NO_MSG;
-                  
+  HDR_MSG *hdr = (HDR_MSG *)frame;
+
+  //--- HDR_MSG.len is the datagram without the CRC trailer, it must match what was received
+  
+  _hdrType = hdr->hdrType;
+  _len = hdr->len;
+  _size = _len + _trailer;
+  if ((cnt != _size) || ((_hdrType != LORA_MESH_MSG_AGGREGATE) && !parseView(frame, _len, v))) {
+        if ((DebugLevel <=  2) && (DebugLevel >0)) {
+          Serial.print(F("Bad msg len:"));
+          Serial.print(_len);
+          Serial.print(F(" received:"));
+          Serial.println(cnt);
+        }
+        return ERR_NO_MSG;
+  }
 
 if ((DebugLevel <=  1) && (DebugLevel >0)) {
       Serial.print( F("Message type :" ));        
@@ -285,36 +487,10 @@ if ((DebugLevel <=  1) && (DebugLevel >0)) {
       Serial.println();
  }
   
-  byte destinationNode = pkt._send._hdr.destinationNode;
-  byte sourceNode = pkt._send._hdr.sourceNode;
-  byte hdrType = pkt._send._hdr.hdrType;
-  byte destNode = pkt._send._send.destinationNode;
-  byte sourcNode = pkt._send._send.sourceNode;
-  byte type = pkt._send._send.type;
-  byte uniq = pkt._send._send.uniqueId;
-
-/*
-  Serial.println("----------------RECEIVING-------------");
-  Serial.print(F("Source: "));
-  Serial.print((char)sourceNode);
-  Serial.print(F(" dest: "));
-  Serial.print((char)destinationNode);
-  Serial.print(F(" type: "));
-  Serial.println(hdrType);
- 
-  Serial.print(F("Source: "));
-  Serial.print((char)sourcNode);
-  Serial.print(F(" dest: "));
-  Serial.print((char)destNode);
-  Serial.print(F(" type: "));
-  Serial.print(type);
-  Serial.print(F(" uniq: "));
-  Serial.println(uniq);
-      
-  */
-  
+  byte destinationNode = hdr->destinationNode;
+  byte sourceNode = hdr->sourceNode;
        
-  _checkCrc = checkCRC(pkt._bmsg,sizeof(RREQ_Packet),"END RREQ");
+  _checkCrc = checkCRC(frame,cnt,"RECEIVE");
   if (!_checkCrc) { 
 
        totalCRC++;
@@ -334,17 +510,32 @@ if ((DebugLevel <=  1) && (DebugLevel >0)) {
         Serial.print(F(" dest: "));
         Serial.print(destinationNode);
         Serial.print(F(" type: "));
-        Serial.println(hdrType);
+        Serial.println(_hdrType);
        
-        Serial.print(F("Source: "));
-        Serial.print((char)sourcNode);
-        Serial.print(F(" dest: "));
-        Serial.print(destNode);
-        Serial.print(F(" type: "));
-        Serial.print(type);
-        Serial.print(F(" uniq: "));
-        Serial.println(uniq);
+        if (_hdrType != LORA_MESH_MSG_AGGREGATE) dumpView(v);
+  }
+
+  if (_hdrType == LORA_MESH_MSG_AGGREGATE) {
+        if (destinationNode == LocalAddress) stats.aggReceived++;
+        return onAggregate(frame, _len);
   }
+  return dispatchMsg(v);
+}
+
+/*!
+    @brief  A checked datagram, received alone or split from an aggregate: overheard by the next hop watch,
+            then handled by type when it is for this node.
+*/
+
+STSCODE LoraWifiMesh::dispatchMsg(MSG_VIEW &v){
+  byte _hdrType = v.hdr->hdrType;
+  byte destinationNode = v.hdr->destinationNode;
+  byte sourceNode = v.hdr->sourceNode;
+
+  //--- every frame heard, for us or not, tells the next hops we watch are alive
+  if (HopAck || Csma) hearNeighbour(sourceNode);
+  if (HopAck && (_hdrType == LORA_MESH_MSG_HOP_ACK) && (destinationNode == LocalAddress)) adrReport(v);
+  if (HopAckTimeout > 0) hearHop(v);
  
   if ((destinationNode != LocalAddress) && (destinationNode != 0xFF) ) {
     if ((DebugLevel <=  1 ) && (DebugLevel >0)) {
@@ -441,346 +632,25 @@ if ((DebugLevel <=  1) && (DebugLevel >0)) {
   }
  
 
-
-  switch (pkt._send._hdr.hdrType) {
+  switch (_hdrType) {
   
-        case (char) LORA_MESH_MSG_RREQ :
-        
-               RREQ_Packet rreq;
-               memset(&rreq, 0, sizeof(RREQ_Packet));
-               memcpy((char*)rreq._bmsg,(char*)pkt._bmsg,sizeof(RREQ_Packet));
-
-               if ((DebugLevel <=  2 )  && (DebugLevel >0)){
-                  LWMesh.dumpHDR(rreq._msg._hdr);
-                  LWMesh.dumpRREQ(rreq._msg._rreq);
-               }
-
-               if (findRREQ(rreq._msg._rreq.uniqueId)) {
-                  if ((DebugLevel <=  1 )  && (DebugLevel >0)){
-                        Serial.println(F("Drop message.Duplicated RREQ"));
-                   }
-                  return ERR_DUP_RREQ;
-               }
-
-
-              for ( byte k=0; k <LORA_MESH_MAX_ROUTING_PATH_SIZE; k++) {
-                if ( rreq._msg._rreq.path[k] ==  LocalAddress ) {
-                  return ERR_DUP_RREQ;
-                }
-              }
-               if (rreq._msg._rreq.destinationNode == LocalAddress) {
-                    RREP_Packet rrep;
-                    memset(&rrep, 0, sizeof(RREP_Packet));
-                    memcpy((char*)rrep._bmsg,(char*)pkt._bmsg,sizeof(RREP_Packet));
-      
-                    _checkCrc = checkCRC(rrep._bmsg,sizeof(RREQ_Packet),"END RREQ");
-                    if (!_checkCrc) { return ERR_RREQ_CRC_ERR;}
-                    
-                         if ((DebugLevel <=  2 )  && (DebugLevel >0)){
-                               Serial.print(F("Receiving RREQ from :["));
-                               Serial.print(rrep._msg._rrep.path);
-                               Serial.println(F("]"));
-                         }
-                        rrep._msg._hdr.sourceNode = LocalAddress;
-                        rrep._msg._hdr.destinationNode =  pkt._rrep._hdr.sourceNode;
-                        rrep._msg._hdr.hdrType = LORA_MESH_MSG_RREP; 
-                        
-                        rrep._msg._rrep.type  = LORA_MESH_MSG_RREP;
-                        rrep._msg._rrep.sourceNode  = pkt._rrep._rrep.sourceNode;
-                        rrep._msg._rrep.destinationNode  = pkt._rrep._rrep.destinationNode;
-                        rrep._msg._rrep.uniqueId  =  pkt._rrep._rrep.uniqueId;
-                        sprintf(rrep._msg._rrep.path,"%s%c\0",rrep._msg._rrep.path,LocalAddress);                        
-                        rrep._msg._hdr.len = sizeof(RREP_DATAGRAM);
-                        rrep._msg._hdr._crc = getCRC(rrep._bmsg,sizeof(RREP_DATAGRAM));  // GET CRC
-                        
-                        if ((DebugLevel <=  4 ) && (DebugLevel >0)){
-                            memcpy(rr._bmsg,rrep._bmsg,sizeof(RREP_Packet));
-                            addRRToQueue(rr, rrep._msg._rrep.uniqueId);
-                        }
-                        else {
-                            delay(2);
-                            _send (rrep._bmsg, sizeof(RREP_DATAGRAM));                       
-                        }
-                        
-                        if (( DebugLevel <=  1 )  && (DebugLevel >0)){
-                           Serial.println(F("Sending RouteReply (RREP)"));
-                        }
-
-                        if ((DebugLevel <=  2 )  && (DebugLevel >0)){
-                            LWMesh.dumpHDR(rrep._msg._hdr);
-                            LWMesh.dumpRREP(rrep._msg._rrep);
-                        }
-                   
-       
-                  }    //------------  RE-REROUTE RREQ Request
-                  else {
-      
-                      _checkCrc = checkCRC(rreq._bmsg,sizeof(RREQ_Packet),"RE-ROUTE RREQ");
-                      if (!_checkCrc) { return ERR_RREQ_CRC_ERR;}
-                    
-                      addRREQToQueue (rreq._msg._rreq.uniqueId);
-                      if ((DebugLevel <=  3 ) && (DebugLevel >0)){
-                         dumpRREQTable();
-                      }
-
-                      if (DebugLevel <=  2) {
-                          Serial.print(F("RE-Broadcast RREQ :"));
-                          Serial.print((char)pkt._rreq._rreq.uniqueId);
-                          Serial.print(F(" path:["));
-                          Serial.print(pkt._rreq._rreq.path);
-                          Serial.println(F("]"));
-                      }                  
-
-           
-                      rreq._msg._hdr.sourceNode = LocalAddress;
-                      rreq._msg._hdr.destinationNode = LORA_MESH_BROADCAST_ADDRESS;
-                      rreq._msg._hdr.hdrType = LORA_MESH_MSG_RREQ; 
-
-                      sprintf(rreq._msg._rreq.path,"%s%c\0",rreq._msg._rreq.path,LocalAddress);
-     
-                      rreq._msg._hdr.len = sizeof(RREQ_Packet);
-                      rreq._msg._hdr._crc = getCRC(rreq._bmsg,sizeof(RREQ_Packet));  // GET CRC
-
-                      if ((DebugLevel <=  4 ) && (DebugLevel >0)) {
-                            memcpy(rr._bmsg,rreq._bmsg,sizeof(RREQ_Packet));
-                            addRRToQueue(rr, rreq._msg._rreq.uniqueId);
-                      }
-                      else {
-                           _send (rreq._bmsg, sizeof(RREQ_Packet));
-                       } 
-                      if ( (DebugLevel <=  2) && (DebugLevel >0)){
-                          LWMesh.dumpHDR(rreq._msg._hdr);
-                          LWMesh.dumpRREQ(rreq._msg._rreq);
-                      }
-                  }
-          
-              break;
-       
+        case LORA_MESH_MSG_RREQ : 
+              return onRREQ(v);
         case LORA_MESH_MSG_RREP :
-      
-                   RREP_Packet rrep;
-                   char ss[LORA_MESH_MAX_ROUTING_PATH_SIZE];
-                   memset(&rrep, 0, sizeof(RREQ_Packet));
-                   memset(&ss, 0, LORA_MESH_MAX_ROUTING_PATH_SIZE);
-              
-                   memcpy(ss,rrep._msg._rrep.path,LORA_MESH_MAX_ROUTING_PATH_SIZE);
-                   memcpy((char*)rrep._bmsg,(char*)pkt._bmsg,sizeof(RREP_Packet));
-              
-                   _checkCrc = checkCRC(rrep._bmsg,sizeof(RREP_Packet),"REROUTE-RREP");
-                   if (!_checkCrc) { return ERR_RREQ_CRC_ERR;}
-                 
-                   if ((DebugLevel <=  3) && (DebugLevel >0)) {
-                      LWMesh.dumpHDR(pkt._send._hdr);
-                      LWMesh.dumpRREP(pkt._rrep._rrep);
-                   }
-  
-                   char node1;
-                   char node2;
-                   for (char i = 0; i < LORA_MESH_MAX_ROUTING_PATH_SIZE-1; i++) {
-                       node1 = pkt._rrep._rrep.path[i];
-                       node2 = pkt._rrep._rrep.path[i+1];
-                       if (rrep._msg._hdr.destinationNode == LocalAddress) break;
-                   }
-              
-                  if (rrep._msg._rrep.sourceNode == LocalAddress) {
-                  
-                        for(byte slot0 = 0; slot0<LORA_MESH_RECEIVED_QUEUE_SIZE; slot0++) {
-                             if (receivedQueue[slot0].sts == LORA_MESH_QUEUE_FREE) {
-                                receivedQueue[slot0].sts = LORA_MESH_QUEUE_USED;
-                                receivedQueue[slot0]._pkt._pkt.msgId = rrep._msg._hdr.msgId;
-                                receivedQueue[slot0]._pkt._pkt.sts = STS_ROUTE_RETURNED;
-                                memcpy(receivedQueue[slot0]._pkt._pkt.msg,rrep._msg._rrep.path,LORA_MESH_MAX_ROUTING_PATH_SIZE);
-                                break;
-                             }
-                        }
-                        
-                        rrep._msg._hdr.len = sizeof(RREP_Packet);
-                        addRoute(rrep._msg._rrep.destinationNode,rrep._msg._rrep.path);
-                        
-                        if ((DebugLevel <=  1 ) && (DebugLevel >0)) {
-                             dumpRTable();
-                             dumpMSGTable();
-                        }
-                        return STS_ROUTE_RETURNED;
-                  }
-
-                  rrep._msg._hdr.sourceNode = node2;
-                  rrep._msg._hdr.destinationNode = node1;
-                  rrep._msg._rrep.type  = LORA_MESH_MSG_RREP;
-
-                  rrep._msg._hdr.len = sizeof(RREP_Packet);
-                  rrep._msg._hdr._crc = getCRC(rrep._bmsg,sizeof(RREP_Packet));  // GET CRC
-
-                  if ((DebugLevel <=  2 ) && (DebugLevel >0)){
-                      Serial.print(F("RE-Broadcast RREP :"));
-                      Serial.print(rrep._msg._rrep.uniqueId);
-                      Serial.print(F(" to node:"));
-                      Serial.print((char)node1);
-                      Serial.print(F(" path:["));
-                      Serial.print(pkt._rrep._rrep.path);
-                      Serial.println(F("]"));
-                  }
-
-                  if ( (DebugLevel <=  4 ) && (DebugLevel >0)){
-                        memcpy(rr._bmsg,rrep._bmsg,sizeof(RREP_Packet));
-                        addRRToQueue(rr, rrep._msg._rrep.uniqueId);
-                  }
-                  else {
-                          _send (rrep._bmsg, sizeof(RREP_DATAGRAM));
-                  }
-                        
-                  if ((DebugLevel <=  2) && (DebugLevel >0)){
-                          LWMesh.dumpHDR(rrep._msg._hdr);
-                          LWMesh.dumpRREP(rrep._msg._rrep);
-                  } 
-                    
-             break;
-         
-         case LORA_MESH_MSG_ACK:
-      
-                 RREP_Packet _rrep;   
-                 memset(&_rrep, 0, sizeof(RREP_Packet));
-                 memcpy((char*)_rrep._bmsg,(char*)pkt._bmsg,sizeof(RREP_Packet));
-            
-                 _checkCrc = checkCRC(_rrep._bmsg,sizeof(RREP_Packet),"RE-ACK");
-                 if (!_checkCrc) { return ERR_RREQ_CRC_ERR;}
-            
-                 char _node0;
-                 char _node1;
-                 for (char i = 0; i < LORA_MESH_MAX_ROUTING_PATH_SIZE-1; i++) {
-                     _node0 = pkt._rrep._rrep.path[i];
-                     _node1 = pkt._rrep._rrep.path[i+1];
-                     if (_rrep._msg._hdr.destinationNode == LocalAddress) break;
-                 }
-            
-                    if (_rrep._msg._rrep.sourceNode == LocalAddress) {    
-                          removeMSGfromQueue(_rrep._msg._rrep.uniqueId, _rrep._msg._rrep.msg);
-    
-                          if ((DebugLevel <=  1) && (DebugLevel >0)){
-                            Serial.print(F(" ACK received: "));
-                            Serial.println((char)_node0);
-                          }
-    
-                          return STS_MSG_ACK_RECEIVED;
-                      }
-                       
-                      _rrep._msg._hdr.hdrType = LORA_MESH_MSG_ACK; 
-                      _rrep._msg._hdr.sourceNode = _node1;
-                      _rrep._msg._hdr.destinationNode = _node0;
-                      _rrep._msg._rrep.type  = LORA_MESH_MSG_ACK;
-              
-                      _rrep._msg._hdr.len = sizeof(RREP_Packet);
-                      _rrep._msg._hdr._crc = getCRC(_rrep._bmsg,sizeof(RREP_Packet));  // GET CRC
-     
-                     if ( (DebugLevel <=  4 ) && (DebugLevel >0)){
-                            memcpy(rr._bmsg,_rrep._bmsg,sizeof(RREP_Packet));
-                            addRRToQueue(rr, _rrep._msg._rrep.uniqueId);
-                      }
-                      else {
-                            _send (_rrep._bmsg, sizeof(RREP_Packet));
-                      }
-
-                      if ((DebugLevel <=  1) && (DebugLevel >0)){
-                          Serial.print(F(" RE-ACK to: "));
-                          Serial.println((char)_node0);
-                      }
-
-             break;
-             
+              return onRREP(v);
+        case LORA_MESH_MSG_ACK:
+              return onACK(v);
         case LORA_MESH_MSG_RERR :
-              break;
+              return onRERR(v);
         case LORA_MESH_MSG_SENDTO:
-      
-                    RREP_Packet ack;   
-                    memset(&ack, 0, sizeof(RREP_Packet));
-                    memcpy((char*)ack._bmsg,(char*)pkt._bmsg,sizeof(RREP_Packet));
-                  
-                    _checkCrc = checkCRC(pkt._bmsg,sizeof(SEND_DATAGRAM),"SENDTO");
-                    if (!_checkCrc) { return ERR_RREQ_CRC_ERR;}
-              
-                    for (int i = 0; i < LORA_MESH_MAX_ROUTING_PATH_SIZE; i++) {
-                         if (pkt._send._send.path[i] == '\0') break;
-                         node11 = pkt._send._send.path[i];
-                    }
-                
-                    if (destinationNode != LocalAddress) {
-                        return ERR_DROP_ROUTING;
-                    }
-                
-                    if (node11 == LocalAddress){                 
-                         char _nod0;
-                         char _nod1;
-                         for (char i = 0; i < LORA_MESH_MAX_ROUTING_PATH_SIZE-1; i++) {
-                             _nod0 = pkt._send._send.path[i];
-                             _nod1 = pkt._send._send.path[i+1];
-                             if (pkt._send._hdr.destinationNode == LocalAddress) break;
-                         }
-                               
-                          ack._msg._hdr.hdrType = LORA_MESH_MSG_ACK; 
-                          ack._msg._hdr.sourceNode = _nod1;
-                          ack._msg._hdr.destinationNode = _nod0;
-                          ack._msg._rrep.type  = LORA_MESH_MSG_ACK;
-
-                          byte retSts = doMsg(&ack);
-                      
-                          ack._msg._hdr.len = sizeof(RREP_Packet);
-                          ack._msg._hdr._crc = getCRC(ack._bmsg,sizeof(RREP_Packet));  // GET CRC
-                          
-                          if ((DebugLevel <=  4 ) && (DebugLevel >0)) {
-                                memcpy(rr._bmsg,ack._bmsg,sizeof(RREP_Packet));
-                                addRRToQueue(rr, ack._msg._rrep.uniqueId);
-                          }
-                          else {
-                              delay(1);
-                              _send (ack._bmsg, sizeof(RREP_Packet));
-                              delay(2);
-                              _send (ack._bmsg, sizeof(RREP_Packet));
-                          }
-
-                          for(byte slot0 = 0; slot0<LORA_MESH_RECEIVED_QUEUE_SIZE; slot0++) {
-                               if (receivedQueue[slot0].sts == LORA_MESH_QUEUE_FREE) {
-                                  receivedQueue[slot0].sts = LORA_MESH_QUEUE_USED;
-                                  receivedQueue[slot0]._pkt._pkt.msgId = pkt._send._hdr.msgId;
-                                  receivedQueue[slot0]._pkt._pkt.sts = STS_RECEIVED;
-                                  memcpy(receivedQueue[slot0]._pkt._pkt.msg,pkt._send._send.msg,LORA_MESH_MAX_MSG_SIZE);
-                                  break;
-                               }
-                          }
-
-                          return STS_MSG_REACH_DESTINATION;
-                    }
-                  
-                    for (int i = 0; i < LORA_MESH_MAX_ROUTING_PATH_SIZE-1; i++) {
-                         node11 = pkt._send._send.path[i];
-                         node22 = pkt._send._send.path[i+1];
-                         if (node11 == LocalAddress) break;
-                    }
-
-                    if ((DebugLevel <=  2) && (DebugLevel >0)){
-                        Serial.print (F("RE-ROUTE MSG to Node : "));
-                        Serial.print((char)node22);
-                        Serial.print(F(" path:["));
-                        Serial.print( pkt._send._send.path );
-                        Serial.print(F("] msg:["));
-                        Serial.print(pkt._send._send.msg);
-                        Serial.println(F("]"));
-                    }
-                    
-                    pkt._send._hdr.sourceNode = LocalAddress;
-                    pkt._send._hdr.destinationNode = node22;
-                
-                    pkt._send._hdr.len = sizeof(SEND_DATAGRAM);
-                    pkt._send._hdr._crc = getCRC(pkt._bmsg,sizeof(SEND_DATAGRAM));  // GET CRC
-                    
-                    _send (pkt._bmsg, sizeof(SEND_DATAGRAM));
- 
-            break;
-                           
-      
+        case LORA_MESH_MSG_PROBE:
+              return onSENDTO(v);
+        case LORA_MESH_MSG_HOP_ACK:
+              return STS_OK;                    // taken by hearHop()
         default : 
                     if ((DebugLevel <=  2 ) && (DebugLevel >0)){
                           Serial.print(F("Wrong hdrType:")); 
-                          Serial.print(pkt._send._hdr.hdrType); 
+                          Serial.print(_hdrType); 
                     }
                     break;
         
@@ -789,727 +659,2721 @@ if ((DebugLevel <=  1) && (DebugLevel >0)) {
        return STS_OK;
 }
 
-STSCODE LoraWifiMesh::doMsg(RREP_Packet *ack){
+/*!
+    @brief  Aggregate: the datagrams it carries are handled one by one as if received alone, each one copied
+            out first (handlers rewrite their datagram in place and may make it longer).
+            The datagrams are checked by the CRC of the aggregate, their own _crc byte is not used.
+*/
 
-  USER_PACKET up;
-  byte retSts;
- 
-  memcpy(up._b, ack->_msg._rrep.msg ,sizeof(NODE_REGISTRATION));
-  memcpy(up._reg.path, ack->_msg._rrep.path ,LORA_MESH_MAX_ROUTING_PATH_SIZE);
+STSCODE LoraWifiMesh::onAggregate(char *frame, byte len){
+  char sub[LORA_MESH_RX_SLOT_SIZE + 1 + LORA_MESH_CRC_MAX_SIZE];
+  MSG_VIEW v;
+  uint16_t at = sizeof(HDR_MSG);
 
-  switch (up._reg.userMsgType) {
-    case LORA_MESH_MSG_REGISTRATION : 
-                retSts = STS_MSG_ACK_REGISTRATION_DONE; 
-                registerNode(up);
-                break;
-    case LORA_MESH_MSG_USER :  break;
-    default : retSts = STS_DELIVERED; break;
-  }
+  while (at + LORA_MESH_WIRE_FIXED_SIZE <= len) {
+        byte n = ((HDR_MSG *)(frame + at))->len;
+        if ((n < LORA_MESH_WIRE_FIXED_SIZE) || (at + n > len) || (n > LORA_MESH_RX_SLOT_SIZE)) break;
 
-  up._reg.userMsgType = STS_MSG_ACK_REGISTRATION_DONE;
-  memcpy(ack->_msg._rrep.msg ,up._b, sizeof(NODE_REGISTRATION));
-  
-  return retSts;
+        memcpy(sub, frame + at, n);
+        at += n;
+        if ((((HDR_MSG *)sub)->hdrType == LORA_MESH_MSG_AGGREGATE) || !parseView(sub, n, v)) continue;
+        dispatchMsg(v);
+  }
+  return STS_OK;
 }
 
+/*!
+    @brief  Route request handler. The view points inside the receive buffer:
+            when the request is for this node it is turned into the RREP in place,
+            otherwise this node is appended to the path and the same bytes are re-broadcast.
+*/
 
-bool LoraWifiMesh::setMac(char *_mac){
-  memcpy(Mac,_mac,6);
-}
+STSCODE LoraWifiMesh::onRREQ(MSG_VIEW &v){
 
+  if ((DebugLevel <=  2 )  && (DebugLevel >0)){
+      dumpHDR(*v.hdr);
+      dumpView(v);
+  }
 
-STSCODE LoraWifiMesh::registerNode(USER_PACKET up){
+  if (checkSeenRREQ(v.body->sourceNode, v.body->uniqueId)) {
+      stats.rreqDuplicates++;
+      if (RreqCounter > 0) countRREQCopy(v.body->sourceNode, v.body->uniqueId);
+      if ((DebugLevel <=  1 )  && (DebugLevel >0)){
+            Serial.println(F("Drop message.Duplicated RREQ"));
+      }
+      return ERR_DUP_RREQ;
+  }
 
-    byte _nodeId = up._reg.nodeId;
-    byte slot;
+  for ( byte k=0; k < v.pathLen; k++) {
+    if ( v.path[k] ==  LocalAddress ) {
+      return ERR_DUP_RREQ;
+    }
+  }
 
-    //--- Found registration, update it -----
-    
-    for(slot = 0; slot<LORA_MESH_MAX_NETWORK_SIZE; slot++) {
-        if (meshNetwork[slot].nodeId == _nodeId){
-            memcpy(meshNetwork[slot].path,up._reg.path,LORA_MESH_MAX_ROUTING_PATH_SIZE);
-            meshNetwork[slot].sts = LORA_MESH_NODE_REGISTERED;
-            memcpy(meshNetwork[slot].macAddress,up._reg.macAddress,6);
-            meshNetwork[slot].lastKeepAlive = millis();
-            #if defined(ESP8266) || defined (ESP32)
-                  meshNetwork[slot].RSSI = WiFi.RSSI();
-            #endif
+  //--- next hop routing: the path walked so far, reversed, is a route back to the originator
+  if ((RoutingMode == LORA_MESH_ROUTING_NEXT_HOP) && (v.pathLen > 0) && (v.pathLen < LORA_MESH_MAX_PATH_NODES)) {
+        MESH_PATH back;
+        MSG_ID seq = v.body->uniqueId;
+        back.len = v.pathLen + 1;
+        back.node[0] = LocalAddress;
+        for (byte k = 0; k < v.pathLen; k++) back.node[k + 1] = v.path[v.pathLen - 1 - k];
+        addRoute(v.body->sourceNode, back, ROUTE_DYNAMIC, &seq);
+  }
 
-            netUpdate = true;
-            
-            return STS_OK;
+  if (v.body->destinationNode == LocalAddress) {
+
+        if ((DebugLevel <=  2 )  && (DebugLevel >0)){
+              Serial.print(F("Receiving RREQ from :"));
+              dumpView(v);
+        }
+        if (!appendHop(v)) return ERR_DROP_ROUTING;
+
+        v.hdr->destinationNode = v.hdr->sourceNode;
+        v.hdr->sourceNode = LocalAddress;
+        v.hdr->hdrType = LORA_MESH_MSG_RREP; 
+        v.body->type  = LORA_MESH_MSG_RREP;
+        v.body->uniqueId = _uniqRReqId++;           // the RREP carries the sequence number of this node
+        setPayload(v, 0, 0);
+        
+        if (!(HopAck && queueWatched(v, LORA_MESH_PRIO_CONTROL, LORA_MESH_RREP_DELAY))) {
+            queueFrame((char *)v.hdr, v.hdr->len, LORA_MESH_PRIO_CONTROL, LORA_MESH_RREP_DELAY);
+        }
+        
+        if (( DebugLevel <=  1 )  && (DebugLevel >0)){
+           Serial.println(F("Sending RouteReply (RREP)"));
         }
-    }
-    
-    //--- Not Found registration, create it -----
 
-    for(slot = 0; slot<LORA_MESH_MAX_NETWORK_SIZE; slot++) {
-        if (meshNetwork[slot].sts == 0x00){
-            meshNetwork[slot].nodeId = _nodeId;
-            memcpy(meshNetwork[slot].path,up._reg.path,LORA_MESH_MAX_ROUTING_PATH_SIZE);
-            meshNetwork[slot].sts = LORA_MESH_NODE_REGISTERED;
-            memcpy(meshNetwork[slot].macAddress,up._reg.macAddress,6);
-            meshNetwork[slot].lastKeepAlive = millis();
-            #if defined(ESP8266) || defined (ESP32)
-                  meshNetwork[slot].RSSI = WiFi.RSSI();
-            #endif
-            
-            netUpdate = true; 
-            return STS_OK;
+        if ((DebugLevel <=  2 )  && (DebugLevel >0)){
+            dumpHDR(*v.hdr);
+            dumpView(v);
         }
-    }
+        return STS_OK;
+  }
 
-    if (slot >= LORA_MESH_MAX_NETWORK_SIZE) return NETWORK_QUEUE_FULL;
+  //------------  RE-REROUTE RREQ Request
 
+  if ((DebugLevel <=  3 ) && (DebugLevel >0)){
+     dumpRREQTable();
+  }
+
+  if (DebugLevel <=  2) {
+      Serial.print(F("RE-Broadcast RREQ :"));
+      dumpView(v);
+  }                  
+
+  //--- gossip: past the first hops only rreqGossip % of the nodes pass it on
+  if ((RreqGossip > 0) && (v.pathLen >= LORA_MESH_RREQ_GOSSIP_HOPS) && (random(0, 100) >= RreqGossip)) {
+      stats.rreqSuppressed++;
+      return STS_OK;
+  }
+
+  if (!appendHop(v)) return ERR_DROP_ROUTING;
+  stats.rreqRelayed++;
+
+  v.hdr->sourceNode = LocalAddress;
+  v.hdr->destinationNode = LORA_MESH_BROADCAST_ADDRESS;
+  v.hdr->hdrType = LORA_MESH_MSG_RREQ; 
+
+  queueFrame((char *)v.hdr, v.hdr->len, LORA_MESH_PRIO_CONTROL, rreqWait());
+  if ( (DebugLevel <=  2) && (DebugLevel >0)){
+      dumpHDR(*v.hdr);
+      dumpView(v);
+  }
+  return STS_OK;
 }
 
 /*!
-    @brief  Defines the debug level returned.
-   
-            Values from 0 to 3.
-            1 to 3 will print several debug messages in the Serial
-            
-    @param  byte debugLevel
-    
-    @return STS_OK status code.
-
-    @note   
+    @brief  Route reply handler. The originator stores the route, relays patch the header
+            towards the previous hop of the path and send the same bytes.
 */
 
-STSCODE LoraWifiMesh::setDebugLevel(byte debugLevel){
-    DebugLevel = debugLevel; 
-    if (( DebugLevel <=  1 )  && (DebugLevel >0)){ Serial.print("Debug Level: "); Serial.println(DebugLevel); }
-    return STS_OK;
-}
+STSCODE LoraWifiMesh::onRREP(MSG_VIEW &v){
+  MESH_PATH path;
 
+  if ((DebugLevel <=  3) && (DebugLevel >0)) {
+      dumpHDR(*v.hdr);
+      dumpView(v);
+  }
 
-/*!
-    @brief   LoraWifiMesh::stringSts(uint8_t sts)
-    
-             Helpful function to print a descriprion of the error messages
-             
-    
-    @param  uint8_t sts
-            
-            Successul messages have values > 0 
-            Error messages hace values < 0
-            
-            //------- success codes 
-      
-            #define      STS_UNKNOWN  0
-            #define      STS_OK  1
-            #define      STS_DELIVERED  2
-            #define      STS_RECEIVED  4
-            #define      STS_TIMEOUT  8
-            #define      STS_CRC_ERR   16
-            #define      STS_ROUTE_RETURNED  32
-                
-            #define      STS_MSG_REACH_DESTINATION  40
-            #define      STS_MSG_ACK_RECEIVED  41
+  //--- hop ACKs: answer the previous hop, a copy of a RREP already handled is dropped
+  if (HopAck) {
+        sendHopAck(v);
+        if (checkSeenHop(v)) {
+            stats.hopDuplicates++;
+            return ERR_DUP_MSG;
+        }
+  }
 
-            #define      STS_MSG_ACK_REGISTRATION_DONE 42
+  if (v.body->sourceNode == LocalAddress) {
+        MSG_ID seq = v.body->uniqueId;
+        copyPath(v, path);
+        queueReceived(v.hdr->msgId, STS_ROUTE_RETURNED, path.node, path.len);
+        
+        addRoute(v.body->destinationNode, path, ROUTE_DYNAMIC, (RoutingMode == LORA_MESH_ROUTING_NEXT_HOP) ? &seq : 0);
+        
+        if ((DebugLevel <=  1 ) && (DebugLevel >0)) {
+             dumpRTable();
+             dumpMSGTable();
+        }
+        return STS_ROUTE_RETURNED;
+  }
 
-            //------- error codes      
-               
-            #define      CRC_ERR  -1
-            #define      ROUTING_QUEUE_FULL  -50
-            #define      DROPNODES_QUEUE_FULL  -51
-            #define      RREQ_QUEUE_FULL  -52
-            #define      MSG_QUEUE_FULL  -53
-            #define      NETWORK_QUEUE_FULL -54
+  char node1 = prevHop(v);
+  if (node1 == 0x00) return ERR_DROP_ROUTING;
 
-            #define      ERR_NO_MSG  -70
-            #define      ERR_MSG_NOT_FOR_ME  -71
-            #define      ERR_DROP_DUE_TO_RULES  -72
-            #define      ERR_DUP_RREQ  -73
-            #define      ERR_DROP_ROUTING  -74
-            #define      ERR_RREQ_CRC_ERR  -75
+  //--- next hop routing: the rest of the path is this node's route to the destination
+  if (RoutingMode == LORA_MESH_ROUTING_NEXT_HOP) {
+        MSG_ID seq = v.body->uniqueId;
+        path.len = 0;
+        for (byte k = 0; k < v.pathLen; k++) {
+             if (v.path[k] == (char)LocalAddress) path.len = 0;
+             path.node[path.len++] = v.path[k];
+        }
+        if ((path.len > 1) && (path.node[0] == (char)LocalAddress)) addRoute(v.body->destinationNode, path, ROUTE_DYNAMIC, &seq);
+  }
 
-            #define      DROP_MSG_DUE_TO_FILTER_RULES  -90
+  v.hdr->sourceNode = LocalAddress;
+  v.hdr->destinationNode = node1;
+  v.body->type  = LORA_MESH_MSG_RREP;
 
-            #define      ERR_CANNOT_SEND_TO_SELF  -100
-            #define      ERR_CANNOT_ROUTE_TO_SELF  -101
+  if ((DebugLevel <=  2 ) && (DebugLevel >0)){
+      Serial.print(F("RE-Broadcast RREP to node:"));
+      Serial.print((char)node1);
+      Serial.print(F(" "));
+      dumpView(v);
+  }
 
-    @return STS_OK status code.
+  if (!(HopAck && queueWatched(v, LORA_MESH_PRIO_CONTROL, 0))) queueFrame((char *)v.hdr, v.hdr->len, LORA_MESH_PRIO_CONTROL);
+        
+  if ((DebugLevel <=  2) && (DebugLevel >0)){
+        dumpHDR(*v.hdr);
+        dumpView(v);
+  } 
+  return STS_OK;
+}
 
-    @note   
+/*!
+    @brief  ACK handler. The originator completes the message in the sent queue,
+            relays patch the header towards the previous hop of the path and send the same bytes.
 */
 
+STSCODE LoraWifiMesh::onACK(MSG_VIEW &v){
+  char ackMsg[LORA_MESH_MAX_MSG_SIZE];
 
-void LoraWifiMesh::stringSts(uint8_t sts){
-    switch (sts){
+  if ((v.body->sourceNode == LocalAddress) && (v.body->type == LORA_MESH_MSG_PROBE)) {
+        ROUTING_TABLE *r = routingTable.find(v.body->destinationNode);
+        if ((r != 0) && (r->sts == LORA_MESH_QUEUE_USED)) {
+            r->timeStamp = millis();
+            stats.routesRefreshed++;
+        }
+        stats.probesAcked++;
+        return STS_OK;
+  }
 
-      // sucess codes 
+  if ((v.body->sourceNode == LocalAddress) && (v.body->type == LORA_MESH_MSG_FRAG)) return onFragAck(v);
 
-      case 0 : Serial.print(F("UNKNOWN"));break;
-      case 1 : Serial.print(F("OK"));break;
-      case 2 :  if (VT200)
-                  Serial.print(F("\u001b[32mDELIVERED\u001b[37m"));
-                else    Serial.print(F("DELIVERED"));
-                  break;
-      
-      case 4 :  if (VT200)
-                Serial.print(F("\u001b[34mRECEIVED\u001b[37m"));
-              else Serial.print(F("RECEIVED")); break;
-      
-      case 8 :  if (VT200) Serial.print(F("\u001b[31mTIMEOUT\u001b[37m"));
-                else Serial.print(F("TIMEOUT"));break;
+  //--- hop ACKs: answer the previous hop, a copy of an ACK already relayed goes no further
+  if (HopAck && (v.body->type != LORA_MESH_MSG_FRAG)) {
+        sendHopAck(v);
+        if ((v.body->sourceNode != LocalAddress) && checkSeenHop(v)) {
+            stats.hopDuplicates++;
+            return ERR_DUP_MSG;
+        }
+  }
 
-       case 16 :  if (VT200) Serial.print(F("\u001b[31mCRC_ERR\u001b[37m"));
-                  else Serial.print(F("CRC_ERR")); break;
-       case 32 :  if (VT200) Serial.print(F("\u001b[35mROUTE_RETURNED\u001b[37m"));
-                  else Serial.print(F("ROUTE_RETURNED"));break;
-      
-       case 40 :  Serial.print(F("MSG_REACH_DESTINATION"));break;
-       case 41 :  Serial.print(F("MSG_ACK_RECEIVED"));break;
+  if (v.body->sourceNode == LocalAddress) {    
+        if (v.body->type == LORA_MESH_MSG_ACK_LIST) takeAckList(v, v.body->destinationNode);
+        memset(ackMsg, 0, LORA_MESH_MAX_MSG_SIZE);
+        memcpy(ackMsg, v.msg, v.msgLen);
+        if (removeMSGfromQueue(v.body->uniqueId, ackMsg, v.msgLen) == STS_OK) updateRouteLink(v.body->destinationNode, true);
 
-       case 42 : Serial.print(F("REGISTRATION_DONE")); break;
-       
-      // error codes     
-       case -1 :  Serial.print(F("\u001b[31mCRC_ERR\u001b[37m"));break;
-       case -50 :  Serial.print(F("ROUTING_QUEUE_FULL"));break;
-       case -51 :  Serial.print(F("DROPNODES_QUEUE_FULL"));break;
-       case -52 :  Serial.print(F("RREQ_QUEUE_FULL"));break;
-       case -53 :  Serial.print(F("MSG_QUEUE_FULL"));break;
+        if ((DebugLevel <=  1) && (DebugLevel >0)){
+          Serial.print(F(" ACK received: "));
+          Serial.println((char)v.hdr->sourceNode);
+        }
+        return STS_MSG_ACK_RECEIVED;
+  }
 
-       case -70 :  Serial.print(F("NO_MSG"));break;
-       case -71 :  Serial.print(F("MSG_NOT_FOR_ME"));break;
-       case -72 :  Serial.print(F("DROP_DUE_TO_RULES"));break;
-       case -73 :  Serial.print(F("DUP_RREQ"));break;
-       case -74 :  Serial.print(F("DROP_ROUTING"));break;
-       case -75 :  Serial.print(F("RREQ_CRC_ERR"));break;
-       case -90 :  Serial.print(F("DROP_MSG_DUE_TO_FILTER_RULES"));break;
+  learnRoute(v, v.body->destinationNode);
+  char _node0 = prevHop(v);
+  if (_node0 == 0x00) {
+      if (*v.route & LORA_MESH_ROUTE_NEXT_HOP) stats.forwardDrops++;
+      return ERR_DROP_ROUTING;
+  }
+  if (!spendTtl(v)) return ERR_DROP_ROUTING;
+   
+  v.hdr->hdrType = LORA_MESH_MSG_ACK; 
+  v.hdr->sourceNode = LocalAddress;
+  v.hdr->destinationNode = _node0;
 
-       case -100 :  Serial.print(F("ERR_CANNOT_SEND_TO_SELF"));break;
-       case -101 :  Serial.print(F("ERR_CANNOT_ROUTE_TO_SELF"));break;
+  if (!(HopAck && queueWatched(v, LORA_MESH_PRIO_CONTROL, 0))) queueFrame((char *)v.hdr, v.hdr->len, LORA_MESH_PRIO_CONTROL);
 
-    }
+  if ((DebugLevel <=  1) && (DebugLevel >0)){
+      Serial.print(F(" RE-ACK to: "));
+      Serial.println((char)_node0);
+  }
+  return STS_OK;
 }
 
+/*!
+    @brief  Route error handler. The RERR is the datagram a relay couldn't deliver, turned around in place:
+            body source / destination are the originator and the destination it was going to, the payload is
+            the broken link (the relay, its silent next hop or 0x00 when it had no route at all).
+            Every node on the way back drops its routes through that link, or to that destination through
+            the neighbour the RERR came from, the originator looks for a new route to the destination right away.
+*/
+
+STSCODE LoraWifiMesh::onRERR(MSG_VIEW &v){
+  uint8_t from = (v.msgLen > 0) ? (uint8_t)v.msg[0] : v.hdr->sourceNode;
+  uint8_t to = (v.msgLen > 1) ? (uint8_t)v.msg[1] : 0x00;
+  uint8_t dest = v.body->destinationNode;
+
+  if ((DebugLevel <=  2) && (DebugLevel >0)) {
+      Serial.print(F("RERR link: "));
+      Serial.print((char)from);
+      Serial.print((char)to);
+      Serial.print(F(" dest: "));
+      Serial.println((char)dest);
+  }
+
+  if (v.body->sourceNode == LocalAddress) {
+        stats.rerrReceived++;
+        breakRoutes(from, to, dest, v.hdr->sourceNode, true);
+        rerouteMsgs(dest);
+        return STS_OK;
+  }
+  breakRoutes(from, to, dest, v.hdr->sourceNode, false);
+
+  char _node0 = prevHop(v);
+  if (_node0 == 0x00) return ERR_DROP_ROUTING;
+  if (!spendTtl(v)) return ERR_DROP_ROUTING;
+
+  v.hdr->sourceNode = LocalAddress;
+  v.hdr->destinationNode = _node0;
+  queueFrame((char *)v.hdr, v.hdr->len, LORA_MESH_PRIO_CONTROL);
+  return STS_OK;
+}
 
 /*!
-    @brief  LoraWifiMesh::hasMsg( RECEIVED_Packet *rec, int packetSize)
+    @brief  SENDTO handler. At the destination the payload is the only thing copied (to the received queue)
+            and the datagram is turned into the ACK in place. Relays patch the header towards the next hop.
+*/
+
+STSCODE LoraWifiMesh::onSENDTO(MSG_VIEW &v){
+  char ackMsg[LORA_MESH_MAX_MSG_SIZE];
+  MESH_PATH path;
+  char node11 = 0;
+  char node22 = 0;
+
+  if (v.pathLen > 0) node11 = v.path[v.pathLen - 1];
+  else if (*v.route & LORA_MESH_ROUTE_NEXT_HOP) node11 = v.body->destinationNode;
+
+  if (v.hdr->destinationNode != LocalAddress) {
+      return ERR_DROP_ROUTING;
+  }
+
+  //--- hop ACKs: a relay answers right away (the destination's ACK does it there), a copy heard again
+  //--- because that answer got lost is answered again but neither relayed nor delivered twice
+  bool dup = false;
+  if (HopAck && (v.body->type != LORA_MESH_MSG_FRAG)) {
+      dup = checkSeenHop(v);
+      if (dup) stats.hopDuplicates++;
+      if (node11 != LocalAddress) {
+          sendHopAck(v);
+          if (dup) return ERR_DUP_MSG;
+      }
+      else if (AckDelay > 0) sendHopAck(v);     // the end to end ACK is held, the previous hop gets its answer now
+      else if (adrReportDue(v.hdr->sourceNode)) sendHopAck(v);
+  }
+  learnRoute(v, v.body->sourceNode);
+
+  if ((node11 == LocalAddress) && (v.hdr->hdrType == LORA_MESH_MSG_PROBE)) {
+        v.hdr->hdrType = LORA_MESH_MSG_ACK; 
+        v.hdr->destinationNode = prevHop(v);
+        v.hdr->sourceNode = LocalAddress;
+        resetTtl(v);
+        setPayload(v, 0, 0);
+        queueFrame((char *)v.hdr, v.hdr->len, LORA_MESH_PRIO_CONTROL);
+        return STS_OK;
+  }
+
+  if ((node11 == LocalAddress) && (v.body->type == LORA_MESH_MSG_FRAG)) return onFragment(v);
+
+  if (node11 == LocalAddress){                 
+        if (v.body->type == LORA_MESH_MSG_ACK_LIST) takeAckList(v, v.body->sourceNode);
+        if (!dup) queueReceived(v.hdr->msgId, STS_RECEIVED, v.msg, v.msgLen);
+
+        char _nod0 = prevHop(v);
+
+        memset(ackMsg, 0, LORA_MESH_MAX_MSG_SIZE);
+        memcpy(ackMsg, v.msg, v.msgLen);
+        //--- only a registration is looked into, user payloads are binary whatever their first byte
+        if (v.body->type == LORA_MESH_MSG_REGISTRATION) {
+            copyPath(v, path);
+            doMsg(ackMsg, path);
+        }
+        else ackMsg[0] = STS_MSG_ACK_REGISTRATION_DONE;
+
+        v.hdr->hdrType = LORA_MESH_MSG_ACK; 
+        v.hdr->sourceNode = LocalAddress;
+        v.hdr->destinationNode = _nod0;
+        v.body->type  = LORA_MESH_MSG_ACK;
+        resetTtl(v);
+        //--- the echo of the message, its first byte now the status: only the bytes the originator sent
+        setPayload(v, ackMsg, (v.msgLen > 0) ? v.msgLen : 1);
         
-            Main function to receive messages
-            Either "normal" received messages, either ACK and TIMEOUT messages
-            
-         
-            
-    @param  RECEIVED_Packet *rec
-    
-            typedef struct RECEIVED_MSG {
-                uint8_t msgId;
-                STSCODE sts;
-                char msg[LORA_MESH_MAX_MSG_SIZE];
-            };
+        //--- the ACK goes twice, the second copy a little later in case the first one collides,
+        //--- with hop ACKs once, sent again until the previous hop answers it.
+        //--- With delayed ACKs it goes with what is already waiting for the originator when it can (holdAck())
+        long ackDelay = LORA_MESH_ACK_DELAY + AckDelay;
+        if (dup) queueFrame((char *)v.hdr, v.hdr->len, LORA_MESH_PRIO_CONTROL, LORA_MESH_ACK_DELAY);
+        else if (!holdAck(v, (uint8_t)ackMsg[0]) && !(HopAck && queueWatched(v, LORA_MESH_PRIO_CONTROL, ackDelay))) {
+            queueFrame((char *)v.hdr, v.hdr->len, LORA_MESH_PRIO_CONTROL, ackDelay);
+            queueFrame((char *)v.hdr, v.hdr->len, LORA_MESH_PRIO_CONTROL, ackDelay + LORA_MESH_ACK_REPEAT_DELAY);
+        }
 
-            typedef union RECEIVED_Packet{
-                    struct RECEIVED_MSG _pkt;
-                    char _bmsg[sizeof(RECEIVED_MSG)];
-            };
-            
-    @param  int packetSize
+        return STS_MSG_REACH_DESTINATION;
+  }
 
-            
-            Bytes received
-            
-    @return STS_OK status code.
+  node22 = nextHop(v);
+  if (node22 == 0x00) {
+      if (!(*v.route & LORA_MESH_ROUTE_NEXT_HOP)) return ERR_DROP_ROUTING;
+      if (!spendTtl(v)) return ERR_DROP_ROUTING;
+      if (holdForRepair(v)) return STS_OK;
+      stats.forwardDrops++;
+      sendRERR((char *)v.hdr, v.hdr->len, 0x00);
+      return ERR_DROP_ROUTING;
+  }
+  if (!spendTtl(v)) return ERR_DROP_ROUTING;
 
-    @note   
+  if ((DebugLevel <=  2) && (DebugLevel >0)){
+      Serial.print (F("RE-ROUTE MSG to Node : "));
+      Serial.print((char)node22);
+      Serial.print(F(" "));
+      dumpView(v);
+  }
+  
+  v.hdr->sourceNode = LocalAddress;
+  v.hdr->destinationNode = node22;
+  
+  return queueRelay(v);
+}
+
+/*!
+    @brief  Fragment handler, at the destination of a long message.
+            The data is copied at its place in the reassembly buffer of (originator, uniqueId),
+            the completed message is announced once in hasMsg() as STS_LONG_MSG_RECEIVED.
+            When the fragment asks for it, or the message is complete, the datagram is turned in place
+            into the selective ACK: bitmap of the fragments received, relayed back like an ACK.
 */
 
+STSCODE LoraWifiMesh::onFragment(MSG_VIEW &v){
+  FRAG_HDR fh;
+  FRAG_RX *rx = 0;
+  FRAG_RX *hole = 0;
+  long _now = millis();
+
+  if (v.msgLen < LORA_MESH_FRAG_HDR_SIZE) return ERR_DROP_ROUTING;
+  memcpy(&fh, v.msg, LORA_MESH_FRAG_HDR_SIZE);
+
+  uint16_t dataLen = v.msgLen - LORA_MESH_FRAG_HDR_SIZE;
+  uint16_t offset = (uint16_t)fh.index * fh.fragSize;
+  if ((fh.count == 0) || (fh.count > LORA_MESH_FRAG_MAX) || (fh.index >= fh.count) || (fh.totalLen > LORA_MESH_FRAG_BUF_SIZE)
+      || (offset + dataLen > fh.totalLen)) {
+        if ((DebugLevel <=  2) && (DebugLevel >0)) {
+            Serial.print(F("Bad fragment:"));
+            Serial.println(fh.index);
+        }
+        return ERR_DROP_ROUTING;
+  }
 
-bool LoraWifiMesh::hasMsg( RECEIVED_Packet *rec, int packetSize){
-  bool retSts = false;
-  
-  if (LWMesh.processMsg(packetSize,0x00) < 0 ) return retSts;
- 
-  for(byte slot = 0; slot<LORA_MESH_RECEIVED_QUEUE_SIZE; slot++) {
-         if (receivedQueue[slot].sts == LORA_MESH_QUEUE_USED ) {
-            receivedQueue[slot].sts = LORA_MESH_QUEUE_FREE;
-            rec->_pkt.msgId = receivedQueue[slot]._pkt._pkt.msgId;
-            rec->_pkt.sts = receivedQueue[slot]._pkt._pkt.sts;
-            memcpy(rec->_pkt.msg,receivedQueue[slot]._pkt._pkt.msg,LORA_MESH_MAX_MSG_SIZE);
-            retSts = true;
+  for (byte slot = 0; slot < LORA_MESH_FRAG_RX_SIZE; slot++) {
+        FRAG_RX &r = fragRx[slot];
+        if (r.sts != LORA_MESH_QUEUE_USED) {
+            if (hole == 0) hole = &r;
+        }
+        else if ((r.sourceNode == v.body->sourceNode) && (r.uniqueId == v.body->uniqueId)) {
+            rx = &r;
             break;
-         }
-   }  
+        }
+        // a stalled, incomplete transfer that the same originator has given up for a newer one
+        else if ((hole == 0) && !r.done && (r.sourceNode == v.body->sourceNode) && MESH_ID_NEWER(v.body->uniqueId, r.uniqueId)
+                 && (_now - r.timeStamp > LORA_MESH_FRAG_RX_STALE)) {
+            hole = &r;
+        }
+  }
+  if (rx == 0) {
+        if (hole == 0) return MSG_QUEUE_FULL;       // no buffer, the originator will try again
+        rx = hole;
+        rx->sts = LORA_MESH_QUEUE_USED;
+        rx->sourceNode = v.body->sourceNode;
+        rx->uniqueId = v.body->uniqueId;
+        rx->len = fh.totalLen;
+        rx->count = fh.count;
+        rx->received = 0;
+        rx->done = false;
+  }
+  rx->timeStamp = _now;
+
+  if (!rx->done) {
+        memcpy(rx->buf + offset, v.msg + LORA_MESH_FRAG_HDR_SIZE, dataLen);
+        rx->received |= (uint32_t)1 << fh.index;
+
+        if (rx->received == (((uint32_t)1 << (rx->count - 1)) * 2 - 1)) {
+            char ev[3];
+            rx->done = true;
+            ev[0] = rx->sourceNode;
+            ev[1] = (char)(rx->len & 0xFF);
+            ev[2] = (char)(rx->len >> 8);
+            queueReceived(rx->uniqueId, STS_LONG_MSG_RECEIVED, ev, 3);
+            fh.flags |= LORA_MESH_FRAG_ACK_REQ;
+        }
+  }
 
-  return retSts;
-};
+  if (!(fh.flags & LORA_MESH_FRAG_ACK_REQ)) return STS_OK;
 
+  char _nod0 = prevHop(v);
+  if (_nod0 == 0x00) return ERR_DROP_ROUTING;
 
-byte LoraWifiMesh::CRC(const char *data, byte len) {
-  byte crc = 0x00;
-  while (len--) {
-    byte extract = *data++;
-    for (byte tempI = 8; tempI; tempI--) {
-      byte sum = (crc ^ extract) & 0x01;
-      crc >>= 1;
-      if (sum) {
-        crc ^= 0x8C;
-      }
-      extract >>= 1;
-    }
-  }
-  return crc;
-}
+  v.hdr->hdrType = LORA_MESH_MSG_ACK; 
+  v.hdr->sourceNode = LocalAddress;
+  v.hdr->destinationNode = _nod0;
+  resetTtl(v);
+  setPayload(v, (const char *)&rx->received, sizeof(rx->received));
+  queueFrame((char *)v.hdr, v.hdr->len, LORA_MESH_PRIO_CONTROL, LORA_MESH_ACK_DELAY);
 
-bool LoraWifiMesh::findRoute(uint8_t destNode,char *path){
-     bool retSts = false;
-     byte slot = 0;
-     for(slot = 0; slot<LORA_MESH_MAX_ROUTING_TABLE_SIZE; slot++) {
-            if (( routingTable[slot].sts == LORA_MESH_QUEUE_USED ) && (routingTable[slot].destNode == destNode)){
-              strncpy(path,routingTable[slot].path,LORA_MESH_MAX_ROUTING_PATH_SIZE);
-              retSts = true;
-              break;
-            }
-     }
-     return retSts;
+  return rx->done ? STS_MSG_REACH_DESTINATION : STS_OK;
 }
 
-STSCODE LoraWifiMesh::dropSourceNode (uint8_t _sourceAddr){
-    return dropBroadcastNode (_sourceAddr,0x00);
-}
+/*!
+    @brief  Selective ACK of a long message, at its originator: the confirmed fragments are not sent again,
+            the next round starts right away with the missing ones.
+*/
 
-STSCODE LoraWifiMesh::dropBroadcastNode (uint8_t _sourceAddr, uint8_t _destAddr){
-   byte slot = 0;
-   for(slot = 0; slot<LORA_MESH_MAX_DROPNODES_TABLE_SIZE; slot++) {
-        if (( dropNodes[slot]._sts == LORA_MESH_QUEUE_FREE )){
-              dropNodes[slot]._sts = LORA_MESH_QUEUE_USED;
-              dropNodes[slot]._sourceAddr = _sourceAddr;
-              dropNodes[slot]._destAddr = _destAddr;
-              return STS_OK;
-         }
-   }
-   if (slot >= LORA_MESH_MAX_DROPNODES_TABLE_SIZE) return DROPNODES_QUEUE_FULL;
-}
+STSCODE LoraWifiMesh::onFragAck(MSG_VIEW &v){
+  uint32_t bitmap;
 
+  if (v.msgLen < sizeof(bitmap)) return ERR_DROP_ROUTING;
+  memcpy(&bitmap, v.msg, sizeof(bitmap));
+
+  for (byte slot = 0; slot < LORA_MESH_FRAG_TX_SIZE; slot++) {
+        FRAG_TX &t = fragTx[slot];
+        if ((t.sts != LORA_MESH_QUEUE_USED) || (t.uniqueId != v.body->uniqueId) || (t.destNode != v.body->destinationNode)) continue;
+
+        uint32_t all = ((uint32_t)1 << (t.count - 1)) * 2 - 1;
+        bool progress = (bitmap & ~t.acked & all) != 0;
+        t.acked |= bitmap & all;
+        updateRouteLink(t.destNode, true);
+
+        if (t.acked == all) {
+            queueReceived(t.uniqueId, STS_DELIVERED, 0, 0);
+            t.sts = LORA_MESH_QUEUE_FREE;
+            return STS_MSG_ACK_RECEIVED;
+        }
+        if (progress) t.retryCount = 0;
+        if (t.next >= t.count) t.next = 0;
+        return STS_MSG_ACK_RECEIVED;
+  }
+  return ERR_NO_MSG;
+}
 
 /*!
-    @brief  LoraWifiMesh::addNodeToNetwork(uint8_t nodeAddr, char *mac,  byte protocol)
-    
-            Main function to registered a node and add it to the mesh Network
-            This isn't mandatory per see. Nodes can see send and receive messages... but to be visible in the network they need to be registered with the MASTER node.
-            
-            
-    @param  uint8_t nodeAddr
-    
-    @param  char *mac
-    
-            device mac Address
+    @brief  Compact wire encoding.
 
-    @param  byte protocol
+            HDR_MSG | BODY_MSG | route | path[pathLen] | msg[]
             
-            #define MESH_PROTOCOL_LORA 1
-            #define MESH_PROTOCOL_WIFI 2
+            The path is the MESH_PATH hop list as is and the payload is whatever is left up to HDR_MSG.len,
+            so only the used bytes go on the air.
+            encodeDatagram packs a datagram built in the fixed structs (RREQ/RREP/SEND_DATAGRAM)
+            and returns its wire size, with ttl > 0 as a next hop datagram (the path stays out),
+            parseView maps the views on a received frame of len bytes.
+*/
 
-    @return STS_OK status code.
+byte LoraWifiMesh::encodeDatagram(const char *datagram, byte msgLen, char *wire, uint8_t ttl){
+  const SEND_DATAGRAM *d = (const SEND_DATAGRAM *)datagram;
+  byte pathLen = (ttl > 0) ? 0 : d->_send.path.len;
+  byte len;
 
-    @note   
+  if (msgLen > LORA_MESH_MAX_MSG_SIZE) msgLen = LORA_MESH_MAX_MSG_SIZE;
+  if (pathLen > LORA_MESH_MAX_PATH_NODES) pathLen = LORA_MESH_MAX_PATH_NODES;
+
+  memcpy(wire, &d->_hdr, sizeof(HDR_MSG));
+  memcpy(wire + sizeof(HDR_MSG), &d->_send, sizeof(BODY_MSG));
+  wire[LORA_MESH_WIRE_FIXED_SIZE - 1] = (ttl > 0) ? (LORA_MESH_ROUTE_NEXT_HOP | (ttl & LORA_MESH_ROUTE_TTL_MASK)) : pathLen;
+  memcpy(wire + LORA_MESH_WIRE_FIXED_SIZE, d->_send.path.node, pathLen);
+  memcpy(wire + LORA_MESH_WIRE_FIXED_SIZE + pathLen, d->_send.msg, msgLen);
+
+  len = LORA_MESH_WIRE_FIXED_SIZE + pathLen + msgLen;
+  ((HDR_MSG *)wire)->len = len;
+  return len;
+}
+
+bool LoraWifiMesh::parseView(char *frame, byte len, MSG_VIEW &v){
+  if (len < LORA_MESH_WIRE_FIXED_SIZE) return false;
+
+  v.hdr = (HDR_MSG *)frame;
+  v.body = (BODY_MSG *)(frame + sizeof(HDR_MSG));
+  v.route = (uint8_t *)(frame + LORA_MESH_WIRE_FIXED_SIZE - 1);
+  v.path = frame + LORA_MESH_WIRE_FIXED_SIZE;
+  v.pathLen = (*v.route & LORA_MESH_ROUTE_NEXT_HOP) ? 0 : *v.route;
+
+  if (v.pathLen > LORA_MESH_MAX_PATH_NODES) return false;
+  if (LORA_MESH_WIRE_FIXED_SIZE + v.pathLen > len) return false;
+
+  v.msg = v.path + v.pathLen;
+  v.msgLen = len - LORA_MESH_WIRE_FIXED_SIZE - v.pathLen;
+  if ((v.msgLen > LORA_MESH_MAX_MSG_SIZE) && (v.body->type != LORA_MESH_MSG_FRAG)) return false;
+  return true;
+}
+
+/*!
+    @brief  In place edits of a view. The frame grows or shrinks inside the receive buffer
+            (room for a full datagram + CRC trailer) and HDR_MSG.len follows.
 */
 
+void LoraWifiMesh::setPayload(MSG_VIEW &v, const char *data, byte len){
+  if (len > LORA_MESH_MAX_MSG_SIZE) len = LORA_MESH_MAX_MSG_SIZE;
+  if (len > 0) memcpy(v.msg, data, len);
+  v.msgLen = len;
+  v.hdr->len = LORA_MESH_WIRE_FIXED_SIZE + v.pathLen + len;
+}
 
-STSCODE LoraWifiMesh::addNodeToNetwork(uint8_t nodeAddr, char *mac,  byte protocol){
-    USER_PACKET up;
-    NODE_REGISTRATION nr;
-    char _p[LORA_MESH_MAX_ROUTING_PATH_SIZE];
+/*!
+    @brief  Path helpers. A path is the list of node ids from the originator to the destination.
+            prevHop / nextHop return the neighbour of this node towards the originator / the destination
+            (0x00 when there's none): from the path, or from the routing table for a next hop datagram.
+            appendHop adds this node at the end (false when the path is full),
+            copyPath copies the path of the view into a MESH_PATH.
+            pathFromString / pathToString convert from / to the user form, a string of node ids ("942").
+*/
 
-    initAddress(nodeAddr);
-    setMac(mac);
-    setProtocol(protocol);
-  
-    memset(&up, 0x00, sizeof(USER_PACKET));
-    memset(&nr, 0x00, sizeof(NODE_REGISTRATION));
-    
-    nr.userMsgType = LORA_MESH_MSG_REGISTRATION;
-    nr.nodeId = nodeAddr;  
-    memcpy(nr.macAddress, mac, 6);
-    memcpy(&up._b, &nr , sizeof(NODE_REGISTRATION));
-    
+char LoraWifiMesh::prevHop(const MSG_VIEW &v){
+  MESH_PATH p;
 
-  bool found = LWMesh.findRoute(MasterNode, _p);
-  if (found) {
-    byte _id = LWMesh.sendMsg(MasterNode, up._b,_p);
-    if (_id < 0) LWMesh.stringSts (_id);
-  } else {
-    LWMesh.getRREQ(MasterNode);
+  if (*v.route & LORA_MESH_ROUTE_NEXT_HOP) {
+       return findRoute(v.body->sourceNode, p) ? nextHop(p) : 0x00;
+  }
+  for (byte i = 1; i < v.pathLen; i++) {
+       if (v.path[i] == (char)LocalAddress) return v.path[i-1];
   }
+  return 0x00;
+}
 
-  return STS_OK; 
+char LoraWifiMesh::nextHop(const MSG_VIEW &v){
+  MESH_PATH p;
+
+  if (*v.route & LORA_MESH_ROUTE_NEXT_HOP) {
+       return findRoute(v.body->destinationNode, p) ? nextHop(p) : 0x00;
+  }
+  for (byte i = 0; i + 1 < v.pathLen; i++) {
+       if (v.path[i] == (char)LocalAddress) return v.path[i+1];
+  }
+  return 0x00;
 }
 
+bool LoraWifiMesh::appendHop(MSG_VIEW &v){
+  if ((*v.route & LORA_MESH_ROUTE_NEXT_HOP) || (v.pathLen >= LORA_MESH_MAX_PATH_NODES)) return false;
 
-/*!
-    @brief  LoraWifiMesh::addStaticRoute (uint8_t _destAddr, char * _path )
+  memmove(v.msg + 1, v.msg, v.msgLen);
+  v.path[v.pathLen] = LocalAddress;
+  v.pathLen++;
+  (*v.route)++;
+  v.msg++;
+  v.hdr->len++;
+  return true;
+}
+
+void LoraWifiMesh::copyPath(const MSG_VIEW &v, MESH_PATH &path){
+  path.len = v.pathLen;
+  memcpy(path.node, v.path, v.pathLen);
+}
+
+/*!
+    @brief  TTL of a next hop datagram: spendTtl takes one hop before a relay forwards it (false when it
+            ran out, the datagram is dropped), resetTtl gives a full one to the ACK built in place.
+            Source routed datagrams have no TTL, their path bounds them.
+*/
+
+bool LoraWifiMesh::spendTtl(MSG_VIEW &v){
+  if (!(*v.route & LORA_MESH_ROUTE_NEXT_HOP)) return true;
+  if ((*v.route & LORA_MESH_ROUTE_TTL_MASK) <= 1) {
+       stats.forwardDrops++;
+       return false;
+  }
+  (*v.route)--;
+  return true;
+}
+
+void LoraWifiMesh::resetTtl(MSG_VIEW &v){
+  if (*v.route & LORA_MESH_ROUTE_NEXT_HOP) *v.route = LORA_MESH_ROUTE_NEXT_HOP | LORA_MESH_NEXT_HOP_TTL;
+}
+
+/*!
+    @brief  Next hop routing: a next hop datagram received from the neighbour hdr->sourceNode tells that
+            node (the originator of a datagram, the destination of an ACK) is reachable through it.
+            An unknown node gets that route (hops from the TTL spent so far), a known one is refreshed,
+            and moved to that neighbour when the traffic now comes another way (the route it had may be broken).
+*/
+
+void LoraWifiMesh::learnRoute(const MSG_VIEW &v, uint8_t node){
+  uint8_t neighbour = v.hdr->sourceNode;
+  uint8_t ttl = *v.route & LORA_MESH_ROUTE_TTL_MASK;
+  MESH_PATH p;
+
+  if ((RoutingMode != LORA_MESH_ROUTING_NEXT_HOP) || !(*v.route & LORA_MESH_ROUTE_NEXT_HOP)) return;
+  if ((node == LocalAddress) || (neighbour == LocalAddress)) return;
+
+  p.len = 2;
+  p.node[0] = LocalAddress;
+  p.node[1] = neighbour;
+
+  ROUTING_TABLE *r = routingTable.find(node);
+  if ((r != 0) && (r->sts == LORA_MESH_QUEUE_USED)) {
+       if ((nextHop(r->path) != (char)neighbour) && (r->type == ROUTE_DYNAMIC)) {
+            r->path = p;
+            r->ackSent = 0;
+            r->ackOk = 0;
+            if (ttl <= LORA_MESH_NEXT_HOP_TTL) r->hops = LORA_MESH_NEXT_HOP_TTL - ttl + 1;
+       }
+       if (nextHop(r->path) == (char)neighbour) r->timeStamp = millis();
+       return;
+  }
+
+  if (addRoute(node, p) != STS_OK) return;
+
+  r = routingTable.find(node);
+  if ((r != 0) && (ttl <= LORA_MESH_NEXT_HOP_TTL)) r->hops = LORA_MESH_NEXT_HOP_TTL - ttl + 1;
+}
+
+char LoraWifiMesh::nextHop(const MESH_PATH &path){
+  for (byte i = 0; i + 1 < path.len; i++) {
+       if (path.node[i] == (char)LocalAddress) return path.node[i+1];
+  }
+  return 0x00;
+}
+
+void LoraWifiMesh::pathFromString(MESH_PATH &path, const char *str){
+  path.len = 0;
+  if (str == 0) return;
+  while ((path.len < LORA_MESH_MAX_PATH_NODES) && (str[path.len] != 0x00)) {
+       path.node[path.len] = str[path.len];
+       path.len++;
+  }
+}
+
+// str: LORA_MESH_MAX_ROUTING_PATH_SIZE bytes
+void LoraWifiMesh::pathToString(const MESH_PATH &path, char *str){
+  memset(str, 0, LORA_MESH_MAX_ROUTING_PATH_SIZE);
+  memcpy(str, path.node, path.len);
+}
+
+STSCODE LoraWifiMesh::doMsg(char *msg, const MESH_PATH &path){
+
+  USER_PACKET up;
+  byte retSts = STS_DELIVERED;
+ 
+  memcpy(up._b, msg ,sizeof(NODE_REGISTRATION));
+
+  switch (up._reg.userMsgType) {
+    case LORA_MESH_MSG_REGISTRATION : 
+                retSts = STS_MSG_ACK_REGISTRATION_DONE; 
+                registerNode(up, path);
+                break;
+    default : break;
+  }
+
+  up._reg.userMsgType = STS_MSG_ACK_REGISTRATION_DONE;
+  memcpy(msg ,up._b, sizeof(NODE_REGISTRATION));
+  
+  return retSts;
+}
+
+
+bool LoraWifiMesh::setMac(char *_mac){
+  memcpy(Mac,_mac,6);
+  return true;
+}
+
+
+STSCODE LoraWifiMesh::registerNode(USER_PACKET up, const MESH_PATH &path){
+
+    byte _nodeId = up._reg.nodeId;
+    byte slot;
+
+    //--- Found registration, update it -----
     
-            In order to speedup the process of sending a message and therefore avoid the delaty of finding a route,
-            Static routes can be defned.
-            Note however that static route take precedent and therefore no dynamic routes will be tried.
-            Dynamic route , wiil also be periodically refreshed.
-            So use static route at your own descrition :-) 
+    for(slot = 0; slot<LORA_MESH_MAX_NETWORK_SIZE; slot++) {
+        if (meshNetwork[slot].nodeId == _nodeId){
+            meshNetwork[slot].path = path;
+            meshNetwork[slot].sts = LORA_MESH_NODE_REGISTERED;
+            memcpy(meshNetwork[slot].macAddress,up._reg.macAddress,6);
+            meshNetwork[slot].lastKeepAlive = millis();
+            #if defined(ESP8266) || defined (ESP32)
+                  meshNetwork[slot].RSSI = WiFi.RSSI();
+            #endif
+
+            netUpdate = true;
             
-    @param  uint8_t _destAddr
+            return STS_OK;
+        }
+    }
     
-            Destination node address 
-    @param  char * _path 
+    //--- Not Found registration, create it -----
+
+    for(slot = 0; slot<LORA_MESH_MAX_NETWORK_SIZE; slot++) {
+        if (meshNetwork[slot].sts == 0x00){
+            meshNetwork[slot].nodeId = _nodeId;
+            meshNetwork[slot].path = path;
+            meshNetwork[slot].sts = LORA_MESH_NODE_REGISTERED;
+            memcpy(meshNetwork[slot].macAddress,up._reg.macAddress,6);
+            meshNetwork[slot].lastKeepAlive = millis();
+            #if defined(ESP8266) || defined (ESP32)
+                  meshNetwork[slot].RSSI = WiFi.RSSI();
+            #endif
+            
+            netUpdate = true; 
+            return STS_OK;
+        }
+    }
+
+    if (slot >= LORA_MESH_MAX_NETWORK_SIZE) return NETWORK_QUEUE_FULL;
+
+}
+
+/*!
+    @brief  Defines the debug level returned.
+   
+            Values from 0 to 3.
+            1 to 3 will print several debug messages in the Serial
+            
+    @param  byte debugLevel
     
-            Path to destination node address.
-            Example:
-                source node (this one) 'A'
-                Destination node 'D'
-                Assuming nodes 'B' and 'C' exist and can route messages.
-                
-                possible paths : 'ABD' 'ACD' 'ABCD'
+    @return STS_OK status code.
+
+    @note   
+*/
+
+STSCODE LoraWifiMesh::setDebugLevel(byte debugLevel){
+    DebugLevel = debugLevel; 
+    if (( DebugLevel <=  1 )  && (DebugLevel >0)){ Serial.print("Debug Level: "); Serial.println(DebugLevel); }
+    return STS_OK;
+}
+
+
+/*!
+    @brief   LoraWifiMesh::stringSts(uint8_t sts)
+    
+             Helpful function to print a descriprion of the error messages
+             
+    
+    @param  uint8_t sts
+            
+            Successul messages have values > 0 
+            Error messages hace values < 0
+            
+            //------- success codes 
+      
+            #define      STS_UNKNOWN  0
+            #define      STS_OK  1
+            #define      STS_DELIVERED  2
+            #define      STS_RECEIVED  4
+            #define      STS_TIMEOUT  8
+            #define      STS_CRC_ERR   16
+            #define      STS_ROUTE_RETURNED  32
                 
+            #define      STS_MSG_REACH_DESTINATION  40
+            #define      STS_MSG_ACK_RECEIVED  41
+
+            #define      STS_MSG_ACK_REGISTRATION_DONE 42
+
+            //------- error codes      
+               
+            #define      CRC_ERR  -1
+            #define      ROUTING_QUEUE_FULL  -50
+            #define      DROPNODES_QUEUE_FULL  -51
+            #define      RREQ_QUEUE_FULL  -52
+            #define      MSG_QUEUE_FULL  -53
+            #define      NETWORK_QUEUE_FULL -54
+
+            #define      ERR_NO_MSG  -70
+            #define      ERR_MSG_NOT_FOR_ME  -71
+            #define      ERR_DROP_DUE_TO_RULES  -72
+            #define      ERR_DUP_RREQ  -73
+            #define      ERR_DROP_ROUTING  -74
+            #define      ERR_RREQ_CRC_ERR  -75
+
+            #define      DROP_MSG_DUE_TO_FILTER_RULES  -90
+
+            #define      ERR_CANNOT_SEND_TO_SELF  -100
+            #define      ERR_CANNOT_ROUTE_TO_SELF  -101
+
+    @return STS_OK status code.
+
+    @note   
+*/
+
+
+void LoraWifiMesh::stringSts(uint8_t sts){
+    switch (sts){
+
+      // sucess codes 
+
+      case 0 : Serial.print(F("UNKNOWN"));break;
+      case 1 : Serial.print(F("OK"));break;
+      case 2 :  if (VT200)
+                  Serial.print(F("\u001b[32mDELIVERED\u001b[37m"));
+                else    Serial.print(F("DELIVERED"));
+                  break;
+      
+      case 4 :  if (VT200)
+                Serial.print(F("\u001b[34mRECEIVED\u001b[37m"));
+              else Serial.print(F("RECEIVED")); break;
+      
+      case 8 :  if (VT200) Serial.print(F("\u001b[31mTIMEOUT\u001b[37m"));
+                else Serial.print(F("TIMEOUT"));break;
+
+       case 16 :  if (VT200) Serial.print(F("\u001b[31mCRC_ERR\u001b[37m"));
+                  else Serial.print(F("CRC_ERR")); break;
+       case 32 :  if (VT200) Serial.print(F("\u001b[35mROUTE_RETURNED\u001b[37m"));
+                  else Serial.print(F("ROUTE_RETURNED"));break;
+      
+       case 40 :  Serial.print(F("MSG_REACH_DESTINATION"));break;
+       case 41 :  Serial.print(F("MSG_ACK_RECEIVED"));break;
+
+       case 42 : Serial.print(F("REGISTRATION_DONE")); break;
+       
+      // error codes     
+       case -1 :  Serial.print(F("\u001b[31mCRC_ERR\u001b[37m"));break;
+       case -50 :  Serial.print(F("ROUTING_QUEUE_FULL"));break;
+       case -51 :  Serial.print(F("DROPNODES_QUEUE_FULL"));break;
+       case -52 :  Serial.print(F("RREQ_QUEUE_FULL"));break;
+       case -53 :  Serial.print(F("MSG_QUEUE_FULL"));break;
+
+       case -70 :  Serial.print(F("NO_MSG"));break;
+       case -71 :  Serial.print(F("MSG_NOT_FOR_ME"));break;
+       case -72 :  Serial.print(F("DROP_DUE_TO_RULES"));break;
+       case -73 :  Serial.print(F("DUP_RREQ"));break;
+       case -74 :  Serial.print(F("DROP_ROUTING"));break;
+       case -75 :  Serial.print(F("RREQ_CRC_ERR"));break;
+       case -90 :  Serial.print(F("DROP_MSG_DUE_TO_FILTER_RULES"));break;
+
+       case -100 :  Serial.print(F("ERR_CANNOT_SEND_TO_SELF"));break;
+       case -101 :  Serial.print(F("ERR_CANNOT_ROUTE_TO_SELF"));break;
+
+    }
+}
+
+
+/*!
+    @brief  LoraWifiMesh::hasMsg( RECEIVED_Packet *rec, int packetSize)
+        
+            Main function to receive messages
+            Either "normal" received messages, either ACK and TIMEOUT messages
+            
+         
+            
+    @param  RECEIVED_Packet *rec
     
+            typedef struct RECEIVED_MSG {
+                MSG_ID msgId;
+                STSCODE sts;
+                uint8_t len;
+                char msg[LORA_MESH_MAX_MSG_SIZE];
+            };
+
+            typedef union RECEIVED_Packet{
+                    struct RECEIVED_MSG _pkt;
+                    char _bmsg[sizeof(RECEIVED_MSG)];
+            };
+            
+    @param  int packetSize
+
+            
+            Bytes received
+            
+    @return STS_OK status code.
+
+    @note   
+*/
+
+
+bool LoraWifiMesh::hasMsg( RECEIVED_Packet *rec, int packetSize){
+  bool retSts = false;
+  bool pushed = _rxInterrupt || (Protocol == MESH_PROTOCOL_WIFI);
+
+  //--- pushed frames (interrupt, esp_now callback) were processed by yield(), what they queued is returned anyway
+  if ((processMsg(packetSize,0x00) < 0) && !pushed) return retSts;
+ 
+  for(byte slot = 0; slot<LORA_MESH_RECEIVED_QUEUE_SIZE; slot++) {
+         if (receivedQueue[slot].sts == LORA_MESH_QUEUE_USED ) {
+            receivedQueue[slot].sts = LORA_MESH_QUEUE_FREE;
+            rec->_pkt.msgId = receivedQueue[slot]._pkt._pkt.msgId;
+            rec->_pkt.sts = receivedQueue[slot]._pkt._pkt.sts;
+            rec->_pkt.len = receivedQueue[slot]._pkt._pkt.len;
+            memcpy(rec->_pkt.msg,receivedQueue[slot]._pkt._pkt.msg,LORA_MESH_MAX_MSG_SIZE);
+            retSts = true;
+            break;
+         }
+   }  
+
+  return retSts;
+};
+
+
+uint32_t LoraWifiMesh::CRC(const char *data, byte len) {
+  return meshCrc(CrcMode, (const uint8_t *)data, len);
+}
+
+bool LoraWifiMesh::findRoute(uint8_t destNode,char *path){
+     MESH_PATH p;
+     if (!findRoute(destNode, p)) return false;
+
+     pathToString(p, path);
+     return true;
+}
+
+bool LoraWifiMesh::findRoute(uint8_t destNode, MESH_PATH &path){
+     ROUTING_TABLE *r = routingTable.find(destNode);
+     if ((r == 0) || ( r->sts != LORA_MESH_QUEUE_USED )) return false;
+
+     path = r->path;
+     r->lastUsed = millis();
+     return true;
+}
+
+/*!
+    @brief  Composite route cost, lower is better.
+            Every hop costs LORA_MESH_ROUTE_COST_HOP, a next hop heard below the RSSI / SNR floors adds
+            one point per dB under the floor and the share of unacknowledged messages adds up to
+            LORA_MESH_ROUTE_COST_LOSS. Unknown metrics (rssi 0, no messages sent) cost nothing.
+*/
+
+uint16_t LoraWifiMesh::routeCost(uint8_t hops, int16_t rssi, int8_t snr, uint8_t ackSent, uint8_t ackOk){
+     uint16_t cost = hops * LORA_MESH_ROUTE_COST_HOP;
+
+     if (rssi != 0) {
+         if (rssi < LORA_MESH_ROUTE_COST_RSSI_FLOOR) cost += LORA_MESH_ROUTE_COST_RSSI_FLOOR - rssi;
+         if (snr < LORA_MESH_ROUTE_COST_SNR_FLOOR) cost += LORA_MESH_ROUTE_COST_SNR_FLOOR - snr;
+     }
+     if (ackSent > 0) cost += (uint16_t)(ackSent - ackOk) * LORA_MESH_ROUTE_COST_LOSS / ackSent;
+     return cost;
+}
+
+/*!
+    @brief  Account a message sent over the route to destNode (acked = false) or its ACK (acked = true)
+            and keep the link quality heard with the ACK.
+*/
+
+void LoraWifiMesh::updateRouteLink(uint8_t destNode, bool acked){
+     ROUTING_TABLE *r = routingTable.find(destNode);
+     if ((r == 0) || ( r->sts != LORA_MESH_QUEUE_USED )) return;
+
+     if (!acked) {
+         if (r->ackSent == 0xFF) {
+             r->ackSent >>= 1;
+             r->ackOk >>= 1;
+         }
+         r->ackSent++;
+         r->lastUsed = millis();
+         return;
+     }
+     if (r->ackOk < r->ackSent) r->ackOk++;
+     r->timeStamp = millis();
+     stats.routesRefreshed++;
+     r->rssi = _rxRssi;
+     r->snr = _rxSnr;
+}
+
+/*!
+    @brief  Incremental route aging, LORA_MESH_ROUTE_AGING_STEP entries per call.
+
+            A learned route is good for RouteTtl after its last confirmation (RREP, ACK or probe ACK).
+            When it's in use and LORA_MESH_ROUTE_REFRESH from expiring a probe is sent along it,
+            so busy routes are refreshed by their own ACKs and quiet ones by the probe.
+            A stale route is evicted when nobody used it for RouteTtl, otherwise only that
+            destination goes back to route discovery. Static routes never age.
+*/
+
+void LoraWifiMesh::ageRoutes(){
+     long _now = millis();
+     uint16_t n = (routingTable.size() < LORA_MESH_ROUTE_AGING_STEP) ? routingTable.size() : LORA_MESH_ROUTE_AGING_STEP;
+
+     for (uint16_t k = 0; k < n; k++) {
+          if (_agingCursor >= routingTable.size()) _agingCursor = 0;
+          ROUTING_TABLE *r = &routingTable[_agingCursor++];
+
+          if ((r->sts == LORA_MESH_QUEUE_FREE) || (r->sts == LORA_MESH_QUEUE_DELETED) || (r->type == ROUTE_STATIC)) continue;
+
+          long age = _now - r->timeStamp;
+          bool inUse = (_now - r->lastUsed < RouteTtl);
+
+          if (r->sts != LORA_MESH_QUEUE_USED) {
+              if (age >= RouteTtl) routingTable.remove(r);         // discovery never answered
+              continue;
+          }
+
+          if (age >= RouteTtl) {
+              stats.routesExpired++;
+              if (!inUse) {
+                  routingTable.remove(r);
+              }
+              else {
+                  routingTable.setSts(r, STS_ROUTE_MISSING);
+                  r->timeStamp = _now;
+              }
+              continue;
+          }
+
+          if (inUse && (age >= RouteTtl - LORA_MESH_ROUTE_REFRESH) && (r->probeAt <= r->timeStamp)) {
+              sendProbe(r);
+          }
+     }
+}
+
+/*!
+    @brief  Send a probe along the route. It is relayed like a SENDTO and the destination answers with
+            an ACK (body type LORA_MESH_MSG_PROBE) that refreshes the route, nothing is delivered to the user.
+*/
+
+STSCODE LoraWifiMesh::sendProbe(ROUTING_TABLE *r){
+    SEND_Packet pkt;
+    SEND_Packet wire;
+
+    if ((r->path.len < 2) || (r->path.node[0] != (char)LocalAddress)) return ERR_DROP_ROUTING;
+
+    memset(&pkt, 0, sizeof(SEND_Packet));
+    pkt._msg._send.path = r->path;
+
+    pkt._msg._hdr.sourceNode = LocalAddress;
+    pkt._msg._hdr.destinationNode = r->path.node[1];
+    pkt._msg._hdr.hdrType = LORA_MESH_MSG_PROBE;
+    pkt._msg._hdr.msgId = nextMsgId();
+    pkt._msg._send.sourceNode = LocalAddress;
+    pkt._msg._send.destinationNode = r->destNode;
+    pkt._msg._send.type = LORA_MESH_MSG_PROBE;
+    pkt._msg._send.uniqueId = pkt._msg._hdr.msgId;
+
+    r->probeAt = millis();
+    stats.probesSent++;
+
+    if (( DebugLevel <=  2) && (DebugLevel >0)) {
+        Serial.print(F("PROBE route to: "));
+        Serial.println((char)r->destNode);
+    }
+    uint8_t ttl = (RoutingMode == LORA_MESH_ROUTING_NEXT_HOP) ? LORA_MESH_NEXT_HOP_TTL : 0;
+    return queueFrame(wire._bmsg, encodeDatagram(pkt._bmsg, 0, wire._bmsg, ttl), LORA_MESH_PRIO_CONTROL);
+}
+
+STSCODE LoraWifiMesh::dropSourceNode (uint8_t _sourceAddr){
+    return dropBroadcastNode (_sourceAddr,0x00);
+}
+
+STSCODE LoraWifiMesh::dropBroadcastNode (uint8_t _sourceAddr, uint8_t _destAddr){
+   byte slot = 0;
+   for(slot = 0; slot<LORA_MESH_MAX_DROPNODES_TABLE_SIZE; slot++) {
+        if (( dropNodes[slot]._sts == LORA_MESH_QUEUE_FREE )){
+              dropNodes[slot]._sts = LORA_MESH_QUEUE_USED;
+              dropNodes[slot]._sourceAddr = _sourceAddr;
+              dropNodes[slot]._destAddr = _destAddr;
+              return STS_OK;
+         }
+   }
+   if (slot >= LORA_MESH_MAX_DROPNODES_TABLE_SIZE) return DROPNODES_QUEUE_FULL;
+}
+
+
+/*!
+    @brief  LoraWifiMesh::addNodeToNetwork(uint8_t nodeAddr, char *mac,  byte protocol)
+    
+            Main function to registered a node and add it to the mesh Network
+            This isn't mandatory per see. Nodes can see send and receive messages... but to be visible in the network they need to be registered with the MASTER node.
+            
+            
+    @param  uint8_t nodeAddr
+    
+    @param  char *mac
+    
+            device mac Address
+
+    @param  byte protocol
+            
+            #define MESH_PROTOCOL_LORA 1
+            #define MESH_PROTOCOL_WIFI 2
+
+    @return STS_OK status code.
+
+    @note   
+*/
+
+
+STSCODE LoraWifiMesh::addNodeToNetwork(uint8_t nodeAddr, char *mac,  byte protocol){
+    USER_PACKET up;
+    NODE_REGISTRATION nr;
+    MESH_PATH _p;
+
+    initAddress(nodeAddr);
+    setMac(mac);
+    setProtocol(protocol);
+  
+    memset(&up, 0x00, sizeof(USER_PACKET));
+    memset(&nr, 0x00, sizeof(NODE_REGISTRATION));
+    
+    nr.userMsgType = LORA_MESH_MSG_REGISTRATION;
+    nr.nodeId = nodeAddr;  
+    memcpy(nr.macAddress, mac, 6);
+    memcpy(&up._b, &nr , sizeof(NODE_REGISTRATION));
+    
+
+  bool found = findRoute(MasterNode, _p);
+  if (found) {
+    MSG_ID _id = queueMsg(MasterNode, up._b, sizeof(NODE_REGISTRATION), 0, LORA_MESH_PRIO_REGISTRATION);
+    if (MESH_ID_ERROR(_id)) stringSts ((STSCODE)_id);
+  } else {
+    getRREQ(MasterNode);
+  }
+
+  return STS_OK; 
+}
+
+
+/*!
+    @brief  LoraWifiMesh::addStaticRoute (uint8_t _destAddr, char * _path )
+    
+            In order to speedup the process of sending a message and therefore avoid the delaty of finding a route,
+            Static routes can be defned.
+            Note however that static route take precedent and therefore no dynamic routes will be tried.
+            Dynamic route , wiil also be periodically refreshed.
+            So use static route at your own descrition :-) 
+            
+    @param  uint8_t _destAddr
+    
+            Destination node address 
+    @param  char * _path 
+    
+            Path to destination node address.
+            Example:
+                source node (this one) 'A'
+                Destination node 'D'
+                Assuming nodes 'B' and 'C' exist and can route messages.
+                
+                possible paths : 'ABD' 'ACD' 'ABCD'
+                
+    
+
+    @return 
+            STS_OK 
+            ROUTING_QUEUE_FULL
+
+    @note   
+*/
+
+
+STSCODE LoraWifiMesh::addStaticRoute (uint8_t _destAddr, char * _path ){
+   MESH_PATH p;
+   pathFromString(p, _path);
+   return addRoute(_destAddr, p, ROUTE_STATIC);
+}
+
+/*!
+    @brief  Learn (ROUTE_DYNAMIC, from a RREP) or set (ROUTE_STATIC) the route to destNode.
+            A static route always replaces the entry and is never replaced by a learned one,
+            a learned route replaces the current one when its cost is lower. With seqNo (next hop routing)
+            a newer sequence number of destNode always wins and an older one is ignored.
+            The RSSI / SNR of the datagram being processed are taken as the quality of the new next hop.
+*/
+
+STSCODE LoraWifiMesh::addRoute(uint8_t destNode, const MESH_PATH &path, ROUTE_TYPE type, const MSG_ID *seqNo){
+      int16_t rssi = 0;
+      int8_t snr = 0;
+      byte len = path.len;
+      byte hops = (len > 0) ? len - 1 : 0;
+
+      if (len == 0) return STS_OK;
+      ROUTING_TABLE *r = routingTable.insert(destNode);
+      if (r == 0) return ROUTING_QUEUE_FULL;
+
+      if (type == ROUTE_DYNAMIC) {
+          rssi = _rxRssi;
+          snr = _rxSnr;
+      }
+
+      if ((r->sts == LORA_MESH_QUEUE_USED) && (r->path.len > 0)) {
+          if ((r->type == ROUTE_STATIC) && (type == ROUTE_DYNAMIC)) return STS_OK;
+          bool fresher = (seqNo != 0) && r->seqValid && MESH_ID_NEWER(*seqNo, r->seqNo);
+          bool staler = (seqNo != 0) && r->seqValid && MESH_ID_NEWER(r->seqNo, *seqNo);
+          if ((type == ROUTE_DYNAMIC) && staler) return STS_OK;
+          if ((type == ROUTE_DYNAMIC) && !fresher &&
+              (routeCost(hops, rssi, snr, 0, 0) >= routeCost(r->hops, r->rssi, r->snr, r->ackSent, r->ackOk))) {
+              if ((r->path.len == len) && (memcmp(r->path.node, path.node, len) == 0)) r->timeStamp = millis();   // same route answered again
+              return STS_OK;
+          }
+      }
+      if (type == ROUTE_DYNAMIC) stats.routesLearned++;
+
+      routingTable.setSts(r, LORA_MESH_QUEUE_USED);
+      r->path = path;
+      r->type = type;
+      r->hops = hops;
+      r->rssi = rssi;
+      r->snr = snr;
+      r->ackSent = 0;
+      r->ackOk = 0;
+      r->seqValid = (seqNo != 0);
+      if (seqNo != 0) r->seqNo = *seqNo;
+      r->timeStamp = millis();
+      kickMsgs(destNode);
+      return STS_OK;
+}
+
+
+/*!
+    @brief  LoraWifiMesh::yield()
+    
+            Main function to process asynchronous work
+            It should be called in the loop function
+            It process all pending tasks
+                1) check for messages delivered and not ACK received and retry them
+                2) check for messages received and put the on the received queue to be exposed to the user
+                3) do some cleanup
+                    1) refresh routing tables
+                    2) refresh network topology
+                    3) refresh node status
+            
+  
+
+    @return STS_OK status code.
+
+    @note   
+*/
+
+STSCODE LoraWifiMesh::yield(){
+
+    USER_PACKET up;
+    NODE_REGISTRATION nr;
+    MESH_PATH _p;
+  
+    serviceRxRing();
+    cleanQueues();
+
+    // ---- retry Route Reuquest--
+    ROUTING_TABLE *missing = routingTable.nextMissing();
+    if (missing != 0) {
+           routingTable.setSts(missing, STS_ROUTE_WAITING);
+           getRREQ(missing->destNode);
+    }
+
+    //---- keep Alive Node Registration
+
+
+    
+    if (KeepAlive) {
+          if ((millis() - _lastKeepAlive > KeepAliveInterval))
+          {
+            _lastKeepAlive = millis();   
+          
+    
+            memset(&up, 0x00, sizeof(USER_PACKET));
+            memset(&nr, 0x00, sizeof(NODE_REGISTRATION));
+      
+            nr.userMsgType = LORA_MESH_MSG_REGISTRATION;
+            nr.nodeId = LocalAddress;
+      
+            memcpy(nr.macAddress, Mac, 6);
+            memcpy(&up._b, &nr , sizeof(NODE_REGISTRATION));
+            
+            bool found = findRoute(MasterNode, _p);
+            if (found) {
+              MSG_ID _id = queueMsg(MasterNode, up._b, sizeof(NODE_REGISTRATION), 0, LORA_MESH_PRIO_REGISTRATION);
+              if (MESH_ID_ERROR(_id)) stringSts ((STSCODE)_id);
+            } else {
+              getRREQ(MasterNode);
+            }
+        }
+    }    
+
+    //---- transmit what is due, control traffic first
+    
+    serviceTxQueue();
+    serviceFragments();
+    return STS_OK;
+}
+
+/*!
+    @brief  LoraWifiMesh::initAddress(uint8_t locAdd)
+    
+            Initial setup function. Initiates node with localAddress
+            Init and clean queues;
+            
+    @param  uint8_t locAdd
+    
+            Node local Address
+    
+
+    @return STS_OK status code.
+
+    @note   
+*/
+
+
+STSCODE  LoraWifiMesh::initAddress(uint8_t locAdd){
+    LocalAddress = locAdd;
+
+    routingTable.clear();
+    txQueue.clear();
+    rxRing.clear();
+    _rxDropped = 0;
+    for (byte slot = 0; slot < LORA_MESH_FRAG_TX_SIZE; slot++) fragTx[slot].sts = LORA_MESH_QUEUE_FREE;
+    for (byte slot = 0; slot < LORA_MESH_FRAG_RX_SIZE; slot++) fragRx[slot].sts = LORA_MESH_QUEUE_FREE;
+
+    for(byte slot = 0; slot<LORA_MESH_RECEIVED_QUEUE_SIZE; slot++) {
+         receivedQueue[slot].sts = LORA_MESH_QUEUE_FREE;
+    }    
+
+    for(byte slot = 0; slot<LORA_MESH_RREQ_SEEN_SIZE; slot++) {
+         seenRREQ[slot].sts = LORA_MESH_QUEUE_FREE;
+    }    
+
+    return STS_OK;
+ }
+
+ STSCODE LoraWifiMesh::removeMSGfromQueue(MSG_ID uniqueId, char *_msg, byte len){
+    TX_ENTRY *e = txQueue.find(uniqueId);
+    if ((e == 0) || !(e->flags & LORA_MESH_TX_AWAIT_ACK)) return ERR_NO_MSG;
+
+    queueReceived(uniqueId, _msg[0], _msg, len);
+    txQueue.release(e);
+    return STS_OK;
+ }
+
+
+/*!
+    @brief  Hand a received frame over from the radio callback (esp_now receive callback, interrupt).
+            The frame is only copied in the receive ring, with the rssi / snr the radio gave it (0: unknown),
+            it's processed by the next yield(): safe to call from another task or an interrupt, never blocks.
+            With nc.rxInterrupt the LoRa transport calls it from the DIO0 interrupt.
+
+            esp_now_register_recv_cb([](uint8_t *mac, uint8_t *data, uint8_t len) {
+                LWMesh.pushFrame(data, len);
+            });
+
+    @return false when the frame was dropped (ring full or frame too big)
+*/
+
+bool LoraWifiMesh::pushFrame(const uint8_t *data, int len, int16_t rssi, int8_t snr){
+    if (len > (int)LORA_MESH_RX_SLOT_SIZE) return rxRing.push(data, -1);    // counted as dropped
+    return rxRing.push(data, len, rssi, snr);
+}
+
+// process up to LORA_MESH_RX_PER_YIELD frames of the receive ring, in place in their slot
+void LoraWifiMesh::serviceRxRing(){
+    int len;
+    uint8_t *frame;
+
+    for (byte n = 0; n < LORA_MESH_RX_PER_YIELD; n++) {
+        frame = rxRing.front(len, _rxRssi, _rxSnr);
+        if (frame == 0) break;
+        processMsg(len, frame);
+        rxRing.pop();
+    }
+    // the ring counter is 16 bit and wraps, the stats keep the total
+    uint16_t dropped = rxRing.dropped();
+    stats.rxDropped += (uint16_t)(dropped - _rxDropped);
+    _rxDropped = dropped;
+}
+
+
+/*!
+    @brief  Send len bytes (binary, up to LORA_MESH_FRAG_MAX * LORA_MESH_FRAG_SIZE) to destination as one message.
+            The data is cut in fragments that share one route lookup and are confirmed by selective ACKs,
+            only the missing ones are sent again. data is not copied: it must stay valid until hasMsg()
+            returns the message id with STS_DELIVERED or STS_TIMEOUT.
+            At the destination hasMsg() returns STS_LONG_MSG_RECEIVED once, then readLongMsg() gets the data.
+
+    @return the message id, MSG_QUEUE_FULL or MSG_TOO_BIG
+*/
+
+MSG_ID LoraWifiMesh::sendLongMsg(uint8_t destination, const uint8_t *data, uint16_t len, const char *path){
+    if ( destination == LocalAddress ) return (MSG_ID)ERR_CANNOT_SEND_TO_SELF;
+    if ((len == 0) || ((len + LORA_MESH_FRAG_SIZE - 1) / LORA_MESH_FRAG_SIZE > LORA_MESH_FRAG_MAX)) return (MSG_ID)MSG_TOO_BIG;
+
+    for (byte slot = 0; slot < LORA_MESH_FRAG_TX_SIZE; slot++) {
+        FRAG_TX &t = fragTx[slot];
+        if (t.sts == LORA_MESH_QUEUE_USED) continue;
+
+        pathFromString(t.path, path);
+        t.sourceRoute = (t.path.len > 0);
+        t.data = data;
+        t.len = len;
+        t.destNode = destination;
+        t.uniqueId = nextMsgId();
+        t.count = (len + LORA_MESH_FRAG_SIZE - 1) / LORA_MESH_FRAG_SIZE;
+        t.acked = 0;
+        t.next = 0;
+        t.retryCount = 0;
+        t.deadline = millis();
+        t.sts = LORA_MESH_QUEUE_USED;
+        return t.uniqueId;
+    }
+    return (MSG_ID)MSG_QUEUE_FULL;
+}
+
+/*!
+    @brief  Copy the long message announced by rec (STS_LONG_MSG_RECEIVED) into buf and free its reassembly buffer.
+
+    @return bytes copied, 0 when the message is unknown or expired
+*/
+
+uint16_t LoraWifiMesh::readLongMsg(RECEIVED_Packet *rec, uint8_t *buf, uint16_t maxLen){
+    uint8_t source = (uint8_t)rec->_pkt.msg[0];
+
+    for (byte slot = 0; slot < LORA_MESH_FRAG_RX_SIZE; slot++) {
+        FRAG_RX &r = fragRx[slot];
+        if ((r.sts != LORA_MESH_QUEUE_USED) || !r.done || (r.sourceNode != source) || (r.uniqueId != rec->_pkt.msgId)) continue;
+
+        uint16_t n = (r.len < maxLen) ? r.len : maxLen;
+        memcpy(buf, r.buf, n);
+        r.sts = LORA_MESH_QUEUE_FREE;
+        return n;
+    }
+    return 0;
+}
+
+/*!
+    @brief  Send up to LORA_MESH_FRAG_PER_YIELD fragments of the long messages in progress.
+            A round sends every fragment not yet confirmed, its last one asks for the selective ACK.
+            A round without answer is repeated after the retry backoff, up to MaxMsgRetry times.
+            Over the duty cycle budget, or on a busy channel for its backoff, the round just stops where it is
+            until a later yield().
+*/
+
+void LoraWifiMesh::serviceFragments(){
+    long _now = millis();
+    byte sent = 0;
+
+    for (byte slot = 0; slot < LORA_MESH_FRAG_TX_SIZE; slot++) {
+        FRAG_TX &t = fragTx[slot];
+        if (t.sts != LORA_MESH_QUEUE_USED) continue;
+
+        if (t.next >= t.count) {
+            if (_now - t.deadline < 0) continue;
+            if (++t.retryCount > MaxMsgRetry) {
+                queueReceived(t.uniqueId, STS_TIMEOUT, 0, 0);
+                t.sts = LORA_MESH_QUEUE_FREE;
+                continue;
+            }
+            totalRetry++;
+            t.next = 0;
+        }
+
+        if ((t.next == 0) && (t.path.len == 0)) {
+            if (!resolveRoute(t.destNode, t.path)) {
+                t.next = t.count;
+                t.deadline = _now + retryDelay(t.retryCount + 1);
+                continue;
+            }
+        }
+
+        while ((sent < LORA_MESH_FRAG_PER_YIELD) && (t.next < t.count)) {
+            uint8_t i = t.next;
+            while ((i < t.count) && (t.acked & ((uint32_t)1 << i))) i++;
+            if (i >= t.count) {
+                t.next = t.count;
+                break;
+            }
+            uint8_t last = i + 1;
+            while ((last < t.count) && (t.acked & ((uint32_t)1 << last))) last++;
+
+            uint16_t dataLen = (t.len - i * LORA_MESH_FRAG_SIZE < LORA_MESH_FRAG_SIZE) ? t.len - i * LORA_MESH_FRAG_SIZE : LORA_MESH_FRAG_SIZE;
+            uint8_t hop = nextHop(t.path);
+            if (dutyWait(LORA_MESH_WIRE_FIXED_SIZE + t.path.len + LORA_MESH_FRAG_HDR_SIZE + dataLen, LORA_MESH_PRIO_DATA, _now,
+                         (hop == 0x00) ? LORA_MESH_BROADCAST_ADDRESS : hop) > 0) return;
+            if (_now - _fragHold < 0) return;
+            long busy = channelWait(_fragBackoffs);
+            if (busy > 0) {
+                _fragHold = _now + busy;
+                return;
+            }
+
+            if (t.next == 0) updateRouteLink(t.destNode, false);
+            sendFragment(t, i, last >= t.count);
+            sent++;
+            t.next = i + 1;
+            if (last >= t.count) {
+                t.next = t.count;
+                t.deadline = _now + retryDelay(t.retryCount + 1);
+            }
+        }
+        if (sent >= LORA_MESH_FRAG_PER_YIELD) return;
+    }
+}
+
+// build fragment index of t on the wire, HDR_MSG | BODY_MSG | route | path | FRAG_HDR | data
+void LoraWifiMesh::sendFragment(FRAG_TX &t, uint8_t index, bool ackReq){
+    char wire[LORA_MESH_WIRE_FIXED_SIZE + LORA_MESH_MAX_PATH_NODES + LORA_MESH_FRAG_HDR_SIZE + LORA_MESH_FRAG_SIZE + LORA_MESH_CRC_MAX_SIZE];
+    HDR_MSG *hdr = (HDR_MSG *)wire;
+    BODY_MSG *body = (BODY_MSG *)(wire + sizeof(HDR_MSG));
+    bool nextHopRouting = (RoutingMode == LORA_MESH_ROUTING_NEXT_HOP) && !t.sourceRoute;
+    byte pathLen = nextHopRouting ? 0 : t.path.len;
+    uint16_t offset = (uint16_t)index * LORA_MESH_FRAG_SIZE;
+    uint16_t dataLen = (t.len - offset < LORA_MESH_FRAG_SIZE) ? t.len - offset : LORA_MESH_FRAG_SIZE;
+    FRAG_HDR fh;
+
+    hdr->hdrType = LORA_MESH_MSG_SENDTO;
+    hdr->sourceNode = LocalAddress;
+    hdr->destinationNode = nextHop(t.path);
+    if (hdr->destinationNode == 0x00) hdr->destinationNode = LORA_MESH_BROADCAST_ADDRESS;
+    hdr->msgId = t.uniqueId;
+    body->sourceNode = LocalAddress;
+    body->destinationNode = t.destNode;
+    body->uniqueId = t.uniqueId;
+    body->type = LORA_MESH_MSG_FRAG;
+    wire[LORA_MESH_WIRE_FIXED_SIZE - 1] = nextHopRouting ? (LORA_MESH_ROUTE_NEXT_HOP | LORA_MESH_NEXT_HOP_TTL) : pathLen;
+    memcpy(wire + LORA_MESH_WIRE_FIXED_SIZE, t.path.node, pathLen);
+
+    fh.index = index;
+    fh.count = t.count;
+    fh.fragSize = LORA_MESH_FRAG_SIZE;
+    fh.flags = ackReq ? LORA_MESH_FRAG_ACK_REQ : 0;
+    fh.totalLen = t.len;
+    memcpy(wire + LORA_MESH_WIRE_FIXED_SIZE + pathLen, &fh, LORA_MESH_FRAG_HDR_SIZE);
+    memcpy(wire + LORA_MESH_WIRE_FIXED_SIZE + pathLen + LORA_MESH_FRAG_HDR_SIZE, t.data + offset, dataLen);
+    hdr->len = LORA_MESH_WIRE_FIXED_SIZE + pathLen + LORA_MESH_FRAG_HDR_SIZE + dataLen;
+
+    _send (wire, hdr->len);
+}
+
+// free the reassembly buffers of messages that stopped arriving, or were never read
+void LoraWifiMesh::ageFragments(){
+    long _now = millis();
+
+    for (byte slot = 0; slot < LORA_MESH_FRAG_RX_SIZE; slot++) {
+        if ((fragRx[slot].sts == LORA_MESH_QUEUE_USED) && (_now - fragRx[slot].timeStamp > LORA_MESH_FRAG_RX_TIMEOUT)) {
+            fragRx[slot].sts = LORA_MESH_QUEUE_FREE;
+        }
+    }
+}
+
+// event for hasMsg()
+void LoraWifiMesh::queueReceived(MSG_ID msgId, STSCODE sts, const char *msg, byte len){
+    for(byte slot0 = 0; slot0<LORA_MESH_RECEIVED_QUEUE_SIZE; slot0++) {
+        if (receivedQueue[slot0].sts == LORA_MESH_QUEUE_FREE) {
+           receivedQueue[slot0].sts = LORA_MESH_QUEUE_USED;
+           receivedQueue[slot0]._pkt._pkt.msgId = msgId;
+           receivedQueue[slot0]._pkt._pkt.sts = sts;
+           if (len > LORA_MESH_MAX_MSG_SIZE) len = LORA_MESH_MAX_MSG_SIZE;
+           receivedQueue[slot0]._pkt._pkt.len = len;
+           memset(receivedQueue[slot0]._pkt._pkt.msg, 0, LORA_MESH_MAX_MSG_SIZE);
+           if (len > 0) memcpy(receivedQueue[slot0]._pkt._pkt.msg, msg, len);
+           return;
+        }
+    }
+}
+
+
+/*!
+    @brief  Put a user message in the transmit scheduler, due now.
+            uniqueId LORA_MESH_ID_NEW takes a new id and the message is retried (exponential backoff) until its ACK,
+            otherwise it is sent once with the id given. No path (0 or empty) is resolved at transmission time.
+
+    @return the message id or MSG_QUEUE_FULL
+*/
+
+MSG_ID LoraWifiMesh::queueMsg(uint8_t destination, const char *msg, byte msgLen, const MESH_PATH *path, uint8_t priority, MSG_ID uniqueId){
+    long _now = millis();
+    TX_ENTRY *e = txQueue.alloc();
+
+    if (e == 0) {
+        if ((DebugLevel <=  1) && (DebugLevel >0)) {
+            Serial.print(F("SENT queue is full"));
+        }
+        return (MSG_ID)MSG_QUEUE_FULL;
+    }
+    if (msgLen > LORA_MESH_MAX_MSG_SIZE) msgLen = LORA_MESH_MAX_MSG_SIZE;
+
+    memset(&e->_pkt, 0, sizeof(SEND_Packet));
+    SEND_DATAGRAM &d = e->_pkt._msg;
+    if (path != 0) d._send.path = *path;
+    memcpy(d._send.msg, msg, msgLen);
+
+    e->flags = ((path != 0) && (path->len > 0)) ? LORA_MESH_TX_SOURCE_ROUTE : 0;
+    if (uniqueId == LORA_MESH_ID_NEW) {
+        uniqueId = nextMsgId();
+        e->flags |= LORA_MESH_TX_AWAIT_ACK;
+    }
+
+    d._hdr.sourceNode = LocalAddress;
+    d._hdr.hdrType = LORA_MESH_MSG_SENDTO; 
+    d._hdr.msgId = uniqueId;
+    d._send.sourceNode = LocalAddress;
+    d._send.destinationNode = destination;
+    d._send.type = (priority == LORA_MESH_PRIO_REGISTRATION) ? LORA_MESH_MSG_REGISTRATION : LORA_MESH_MSG_SENDTO;
+    d._send.uniqueId = uniqueId;
+
+    e->uniqueId = uniqueId;
+    e->len = msgLen;
+    e->ackLen = 0;
+    e->priority = priority;
+    e->retryCount = 0;
+    e->timeStamp = _now;
+    if (e->flags & LORA_MESH_TX_AWAIT_ACK) txQueue.track(e);
+    if (AckDelay > 0) piggybackAcks(e);
+    txQueue.schedule(e, _now + txJitter() + aggWait(destination), _now);
+
+    return uniqueId;
+}
+
+/*!
+    @brief  Next message id: wraps before LORA_MESH_ID_LAST (the ids above are error codes) and skips
+            the ids still in use by a message waiting for its ACK or a long message, so a late ACK
+            can't confirm the wrong message after a wraparound.
+*/
+
+MSG_ID LoraWifiMesh::nextMsgId(){
+    for (;;) {
+        MSG_ID id = _uniqMsgId;
+        _uniqMsgId = (id >= LORA_MESH_ID_LAST) ? 0 : id + 1;
+        if (txQueue.find(id) != 0) continue;
+
+        byte slot = 0;
+        while ((slot < LORA_MESH_FRAG_TX_SIZE) && ((fragTx[slot].sts != LORA_MESH_QUEUE_USED) || (fragTx[slot].uniqueId != id))) slot++;
+        if (slot == LORA_MESH_FRAG_TX_SIZE) return id;
+    }
+}
+
+/*!
+    @brief  Put an encoded frame (relay, RREP, ACK...) in the transmit scheduler, sent once after delay ms
+            plus the transport jitter (plus aggWait()). Nothing here waits: the frame goes on the air from yield().
+            When the pool is exhausted, or the frame is bigger than an entry (relayed fragment),
+            it is sent right away rather than lost, unless that would break the duty cycle.
+*/
+
+STSCODE LoraWifiMesh::queueFrame(const char *frame, byte len, uint8_t priority, long delay){
+    long _now = millis();
+    TX_ENTRY *e = ((size_t)(len + LORA_MESH_CRC_MAX_SIZE) <= sizeof(SEND_Packet)) ? txQueue.alloc() : 0;
+
+    if (e == 0) {
+        char wire[LORA_MESH_RX_SLOT_SIZE + 1 + LORA_MESH_CRC_MAX_SIZE];
+        if (len > LORA_MESH_RX_SLOT_SIZE + 1) return MSG_TOO_BIG;
+        if ((DebugLevel <=  1) && (DebugLevel >0)) {
+            Serial.println(F("SENT queue is full, sending now"));
+        }
+        if (dutyWait(len, priority, _now, ((HDR_MSG *)frame)->destinationNode) > 0) {
+            stats.dutyDrops++;
+            return MSG_QUEUE_FULL;
+        }
+        memcpy(wire, frame, len);
+        return _send (wire, len);
+    }
+
+    memcpy(e->_pkt._bmsg, frame, len);
+    e->len = len;
+    e->uniqueId = 0;
+    e->priority = priority;
+    e->flags = LORA_MESH_TX_RAW;
+    e->retryCount = 0;
+    e->timeStamp = _now;
+    txQueue.schedule(e, _now + delay + txJitter() + aggWait(((HDR_MSG *)frame)->destinationNode)
+                        + floodWait(((HDR_MSG *)frame)->destinationNode), _now);
+    return STS_OK;
+}
+
+// random 1..transport txJitter() ms before a frame goes on the air, 0 when the transport asks for none
+long LoraWifiMesh::txJitter(){
+    LoraWifiMeshTransport *transport = getTransport();
+    if ((transport == 0) || (transport->txJitter() == 0)) return 0;
+    return random(1, transport->txJitter());
+}
+
+/*!
+    @brief  Transmit up to LORA_MESH_TX_PER_YIELD due entries, highest priority first.
+            A user message goes back in the wheel for its next retry, or is reported STS_TIMEOUT
+            once MaxMsgRetry transmissions went unanswered.
+            A watched datagram (relayed, or user message) comes back after HopAckTimeout when its next hop
+            wasn't heard passing it on, a held one when its local repair is over.
+            With aggregation a due entry takes the others for its next hop along (sendAggregate()).
+            An entry over the duty cycle budget waits in the wheel (dutyDefer()), its retries untouched,
+            so does one meeting a busy channel (channelDefer()).
+*/
+
+void LoraWifiMesh::serviceTxQueue(){
+    long _now = millis();
+
+    for (byte n = 0; n < LORA_MESH_TX_PER_YIELD; n++) {
+        TX_ENTRY *e = txQueue.nextReady(_now);
+        if (e == 0) return;
+
+        if (e->flags & LORA_MESH_TX_REPAIR) {
+            serviceRepair(e);
+            continue;
+        }
+        if ((e->flags & LORA_MESH_TX_HOP_WATCH) && (e->hopTries > 0)) {
+            hopExpired(e);
+            continue;
+        }
+
+        if (!(e->flags & LORA_MESH_TX_AWAIT_ACK)) {
+            if (dutyDefer(e, _now) || channelDefer(e, _now)) continue;
+            if (!sendAggregate(e, _now)) {
+                transmit(e);
+                afterSend(e, _now);
+            }
+            continue;
+        }
+
+        if (e->retryCount >= MaxMsgRetry) {
+            queueReceived(e->uniqueId, STS_TIMEOUT, e->_pkt._msg._send.msg, e->len);
+            txQueue.release(e);
+            continue;
+        }
+        if (dutyDefer(e, _now) || channelDefer(e, _now)) continue;
+
+        if (e->retryCount > 0) {
+            totalRetry++;
+            if ((DebugLevel <=  1 ) && (DebugLevel >0)) { 
+                  Serial.print (F("RETRY MSG Id : "));
+                  Serial.print(e->uniqueId);
+                  Serial.print(F(" \""));
+                  Serial.print(e->_pkt._msg._send.msg);
+                  Serial.print(F("\" using PATH: \""));
+                  for (byte i = 0; i < e->_pkt._msg._send.path.len; i++) Serial.print(e->_pkt._msg._send.path.node[i]);
+                  Serial.print(F("\" retryCount: "));
+                  Serial.println(e->retryCount);
+            }
+        }
+
+        if (!sendAggregate(e, _now)) {
+            transmit(e);
+            afterSend(e, _now);
+        }
+    }
+}
+
+// account = false: the same datagram sent again to its next hop, not a new end to end try
+void LoraWifiMesh::transmit(TX_ENTRY *e, bool account){
+    SEND_Packet wire;
+    byte len = encodeEntry(e, wire._bmsg);
+
+    if (account && !(e->flags & LORA_MESH_TX_RAW)) updateRouteLink(e->_pkt._msg._send.destinationNode, false);
+    _send (wire._bmsg, len);
+}
+
+// the wire frame of an entry (without CRC), a user message gets its route and next hop here
+byte LoraWifiMesh::encodeEntry(TX_ENTRY *e, char *wire){
+    if (e->flags & LORA_MESH_TX_RAW) {
+        memcpy(wire, e->_pkt._bmsg, e->len);
+        return e->len;
+    }
+
+    SEND_DATAGRAM &d = e->_pkt._msg;
+    if (d._send.path.len == 0) resolveRoute(d._send.destinationNode, d._send.path);
+
+    d._hdr.destinationNode = nextHop(d._send.path);
+    if (d._hdr.destinationNode == 0x00) d._hdr.destinationNode = LORA_MESH_BROADCAST_ADDRESS;
+
+    if (( DebugLevel <=  1) && (DebugLevel >0)) dumpHDR(d._hdr);
+
+    bool nextHopRouting = (RoutingMode == LORA_MESH_ROUTING_NEXT_HOP) && !(e->flags & LORA_MESH_TX_SOURCE_ROUTE);
+    return encodeDatagram(e->_pkt._bmsg, e->len + e->ackLen, wire, nextHopRouting ? LORA_MESH_NEXT_HOP_TTL : 0);
+}
+
+// an entry just went on the air: a one shot frame is done or watched, a user message waits for its ACK
+void LoraWifiMesh::afterSend(TX_ENTRY *e, long now){
+    if (!(e->flags & LORA_MESH_TX_AWAIT_ACK)) {
+        if (e->flags & LORA_MESH_TX_HOP_WATCH) {
+            e->hopTries = 1;
+            e->hopAt = now;
+            txQueue.schedule(e, now + hopTimeout(e->hopNode, 1), now);
+        }
+        else txQueue.release(e);
+        return;
+    }
+    e->retryCount++;
+    e->retryAt = now + retryDelay(e->retryCount);
+    if (watchHop(e, e->_pkt._msg._hdr.destinationNode)) txQueue.schedule(e, now + hopTimeout(e->hopNode, 1), now);
+    else txQueue.schedule(e, e->retryAt, now);
+}
+
+/*!
+    @brief  Aggregation (AggDelay > 0): first is due, every other entry due for the same next hop within AggDelay
+            that fits goes with it in one LORA_MESH_MSG_AGGREGATE frame. Entries waiting for their next hop, for a
+            local repair or out of retries are left alone, so is a second copy of a datagram already in the frame
+            (the repeated ACK is there in case the first one is lost). False when first goes alone (nothing sent).
+*/
+
+bool LoraWifiMesh::sendAggregate(TX_ENTRY *first, long now){
+    char agg[LORA_MESH_AGG_MAX_SIZE + LORA_MESH_CRC_MAX_SIZE];
+    SEND_Packet wire;
+    TX_ENTRY *batch[LORA_MESH_MSG_QUEUE_SIZE];
+    uint8_t count = 0;
+    uint16_t len = sizeof(HDR_MSG);
+
+    if (AggDelay <= 0) return false;
+    uint8_t hop = entryHop(first);
+    if (hop == LORA_MESH_BROADCAST_ADDRESS) return false;
+
+    byte n = encodeEntry(first, wire._bmsg);
+    memcpy(agg + len, wire._bmsg, n);
+    len += n;
+    batch[count++] = first;
+
+    for (uint8_t i = 0; i < txQueue.size(); i++) {
+        TX_ENTRY *e = &txQueue[i];
+        if ((e == first) || (e->sts != LORA_MESH_QUEUE_USED) || (e->flags & LORA_MESH_TX_REPAIR)) continue;
+        if ((e->flags & LORA_MESH_TX_HOP_WATCH) && (e->hopTries > 0)) continue;
+        if ((e->flags & LORA_MESH_TX_AWAIT_ACK) && (e->retryCount >= MaxMsgRetry)) continue;
+        if ((e->deadline - now > AggDelay) || (entryHop(e) != hop)) continue;
+
+        n = encodeEntry(e, wire._bmsg);
+        if ((len + n > LORA_MESH_AGG_MAX_SIZE) || aggCopy(agg, len, wire._bmsg)) continue;
+        if (dutyWait(len + n, (e->priority > first->priority) ? e->priority : first->priority, now, hop) > 0) continue;
+        memcpy(agg + len, wire._bmsg, n);
+        len += n;
+        batch[count++] = e;
+    }
+    if (count < 2) return false;
+
+    HDR_MSG *hdr = (HDR_MSG *)agg;
+    memset(hdr, 0, sizeof(HDR_MSG));
+    hdr->hdrType = LORA_MESH_MSG_AGGREGATE;
+    hdr->len = (uint8_t)len;
+    hdr->sourceNode = LocalAddress;
+    hdr->destinationNode = hop;
+    _send(agg, (byte)len);
+    stats.aggFramesSent++;
+    stats.aggDatagrams += count;
+
+    for (uint8_t i = 0; i < count; i++) {
+        TX_ENTRY *e = batch[i];
+        if (!(e->flags & LORA_MESH_TX_RAW)) updateRouteLink(e->_pkt._msg._send.destinationNode, false);
+        if ((e != first) && (e->flags & LORA_MESH_TX_AWAIT_ACK) && (e->retryCount > 0)) totalRetry++;
+        afterSend(e, now);
+    }
+    return true;
+}
+
+// true when the aggregate (len bytes so far) already carries the datagram of frame (same type, originator and id)
+bool LoraWifiMesh::aggCopy(const char *agg, uint16_t len, const char *frame){
+    const HDR_MSG *h = (const HDR_MSG *)frame;
+    const BODY_MSG *b = (const BODY_MSG *)(frame + sizeof(HDR_MSG));
+
+    for (uint16_t at = sizeof(HDR_MSG); at < len; at += ((const HDR_MSG *)(agg + at))->len) {
+        const HDR_MSG *ah = (const HDR_MSG *)(agg + at);
+        const BODY_MSG *ab = (const BODY_MSG *)(agg + at + sizeof(HDR_MSG));
+        if ((ah->hdrType == h->hdrType) && (ab->sourceNode == b->sourceNode) && (ab->uniqueId == b->uniqueId) && (ab->type == b->type)) return true;
+    }
+    return false;
+}
+
+// next hop an entry would be sent to, LORA_MESH_BROADCAST_ADDRESS when it has none (no route yet, broadcast)
+uint8_t LoraWifiMesh::entryHop(TX_ENTRY *e){
+    if (e->flags & LORA_MESH_TX_RAW) return ((HDR_MSG *)e->_pkt._bmsg)->destinationNode;
+
+    const MESH_PATH *path = &e->_pkt._msg._send.path;
+    if (path->len == 0) {
+        ROUTING_TABLE *r = routingTable.find(e->_pkt._msg._send.destinationNode);
+        if ((r == 0) || (r->sts != LORA_MESH_QUEUE_USED)) return LORA_MESH_BROADCAST_ADDRESS;
+        path = &r->path;
+    }
+    uint8_t hop = nextHop(*path);
+    return (hop == 0x00) ? LORA_MESH_BROADCAST_ADDRESS : hop;
+}
+
+// first send of a frame: with aggregation a unicast frame waits AggDelay for others to the same next hop
+long LoraWifiMesh::aggWait(uint8_t destination){
+    return ((AggDelay > 0) && (destination != LORA_MESH_BROADCAST_ADDRESS)) ? AggDelay : 0;
+}
+
+/*!
+    @brief  Delayed ACKs (AckDelay > 0): the ACK of v, already turned around in place, goes with a message of this
+            node waiting for its originator, or else in the ACKs to it still waiting (every copy).
+            False when there is none: the ACK is queued as usual, AckDelay later.
+*/
+
+bool LoraWifiMesh::holdAck(const MSG_VIEW &v, uint8_t sts){
+    if (AckDelay <= 0) return false;
+
+    for (uint8_t i = 0; i < txQueue.size(); i++) {
+        TX_ENTRY *e = &txQueue[i];
+        if ((e->flags & LORA_MESH_TX_RAW) || !pendingAck(e, v.body->sourceNode)) continue;
+        if (addAckId(e, v.body->uniqueId, sts)) {
+            stats.acksPiggybacked++;
+            return true;
+        }
+    }
+
+    bool held = false;
+    for (uint8_t i = 0; i < txQueue.size(); i++) {
+        TX_ENTRY *e = &txQueue[i];
+        if ((e->flags & LORA_MESH_TX_RAW) && pendingAck(e, v.body->sourceNode) && addAckId(e, v.body->uniqueId, sts)) held = true;
+    }
+    if (held) stats.acksCoalesced++;
+    return held;
+}
+
+// a new message to a node takes along the ACKs waiting for it, their frames are dropped when all of them fit
+void LoraWifiMesh::piggybackAcks(TX_ENTRY *data){
+    uint8_t originator = data->_pkt._msg._send.destinationNode;
+    MSG_VIEW v;
+
+    if (data->_pkt._msg._send.type != LORA_MESH_MSG_SENDTO) return;     // a registration keeps its body type
+
+    for (uint8_t i = 0; i < txQueue.size(); i++) {
+        TX_ENTRY *e = &txQueue[i];
+        if ((e == data) || !(e->flags & LORA_MESH_TX_RAW) || !pendingAck(e, originator)) continue;
+        if (!parseView(e->_pkt._bmsg, e->len, v) || (v.msgLen == 0)) continue;
+
+        bool list = (v.body->type == LORA_MESH_MSG_ACK_LIST);
+        byte n = list ? (byte)v.msg[v.msgLen - 1] : 0;
+        uint8_t sts = list ? (uint8_t)v.msg[v.msgLen - 2] : (uint8_t)v.msg[0];
+        if (list && (n * sizeof(MSG_ID) + 2 > v.msgLen)) continue;
+
+        bool all = addAckId(data, v.body->uniqueId, sts);
+        for (byte k = 0; all && (k < n); k++) {
+            MSG_ID id;
+            memcpy(&id, v.msg + v.msgLen - 2 - (n - k) * sizeof(MSG_ID), sizeof(MSG_ID));
+            all = addAckId(data, id, sts);
+        }
+        if (!all) continue;
+        stats.acksPiggybacked += n + 1;
+        txQueue.release(e);
+    }
+}
+
+// e still waits for its first transmission and can carry ACKs to originator: an end to end ACK of this node
+// (RAW) or a message to that node
+bool LoraWifiMesh::pendingAck(TX_ENTRY *e, uint8_t originator){
+    if ((e->sts != LORA_MESH_QUEUE_USED) || (e->flags & LORA_MESH_TX_REPAIR)) return false;
+    if ((e->flags & LORA_MESH_TX_HOP_WATCH) && (e->hopTries > 0)) return false;
+
+    if (!(e->flags & LORA_MESH_TX_RAW)) {
+        const SEND_DATAGRAM &d = e->_pkt._msg;
+        return (e->retryCount == 0) && (d._hdr.hdrType == LORA_MESH_MSG_SENDTO) && (d._send.destinationNode == originator) &&
+               ((d._send.type == LORA_MESH_MSG_SENDTO) || (d._send.type == LORA_MESH_MSG_ACK_LIST));
+    }
+    const HDR_MSG *hdr = (const HDR_MSG *)e->_pkt._bmsg;
+    const BODY_MSG *body = (const BODY_MSG *)(e->_pkt._bmsg + sizeof(HDR_MSG));
+    return (hdr->hdrType == LORA_MESH_MSG_ACK) && (body->sourceNode == originator) && (body->destinationNode == LocalAddress) &&
+           ((body->type == LORA_MESH_MSG_ACK) || (body->type == LORA_MESH_MSG_ACK_LIST));
+}
+
+/*!
+    @brief  Add uniqueId to the ACK list of e: an ACK frame turns into a cumulative ACK (its payload becomes the
+            status of its own message), a message keeps the list after its payload (ackLen).
+            True when the id is in, false when there is no room left.
+*/
+
+bool LoraWifiMesh::addAckId(TX_ENTRY *e, MSG_ID uniqueId, uint8_t sts){
+    char *ids;
+    byte n;
+
+    if (e->flags & LORA_MESH_TX_RAW) {
+        char payload[LORA_MESH_MAX_MSG_SIZE];
+        MSG_VIEW v;
+        if (!parseView(e->_pkt._bmsg, e->len, v) || (v.msgLen == 0)) return false;
+        if (v.body->uniqueId == uniqueId) return true;
+
+        bool list = (v.body->type == LORA_MESH_MSG_ACK_LIST);
+        n = list ? (byte)v.msg[v.msgLen - 1] : 0;
+        if (list && (1 + n * sizeof(MSG_ID) + 2 != v.msgLen)) return false;
+        ids = v.msg + 1;
+        for (byte k = 0; k < n; k++) if (memcmp(ids + k * sizeof(MSG_ID), &uniqueId, sizeof(MSG_ID)) == 0) return true;
+        if (n >= LORA_MESH_ACK_LIST_MAX) return false;
+
+        payload[0] = v.msg[0];
+        memcpy(payload + 1, ids, n * sizeof(MSG_ID));
+        memcpy(payload + 1 + n * sizeof(MSG_ID), &uniqueId, sizeof(MSG_ID));
+        payload[1 + (n + 1) * sizeof(MSG_ID)] = sts;
+        payload[2 + (n + 1) * sizeof(MSG_ID)] = n + 1;
+        setPayload(v, payload, 3 + (n + 1) * sizeof(MSG_ID));
+        v.body->type = LORA_MESH_MSG_ACK_LIST;
+        e->len = v.hdr->len;
+        return true;
+    }
+
+    SEND_DATAGRAM &d = e->_pkt._msg;
+    ids = d._send.msg + e->len;
+    n = (e->ackLen > 0) ? (byte)ids[e->ackLen - 1] : 0;
+    for (byte k = 0; k < n; k++) if (memcmp(ids + k * sizeof(MSG_ID), &uniqueId, sizeof(MSG_ID)) == 0) return true;
+    if (e->len + (n + 1) * sizeof(MSG_ID) + 2 > LORA_MESH_MAX_MSG_SIZE) return false;
+
+    memcpy(ids + n * sizeof(MSG_ID), &uniqueId, sizeof(MSG_ID));
+    ids[(n + 1) * sizeof(MSG_ID)] = sts;
+    ids[(n + 1) * sizeof(MSG_ID) + 1] = n + 1;
+    e->ackLen = (n + 1) * sizeof(MSG_ID) + 2;
+    d._send.type = LORA_MESH_MSG_ACK_LIST;
+    return true;
+}
+
+// v carries in its ACK list the ACK of the message uniqueId of originator (a delayed ACK answers the next hop watch too)
+bool LoraWifiMesh::inAckList(const MSG_VIEW &v, uint8_t originator, MSG_ID uniqueId){
+    if ((v.body->type != LORA_MESH_MSG_ACK_LIST) || (v.msgLen < 2)) return false;
+    uint8_t owner = (v.hdr->hdrType == LORA_MESH_MSG_ACK) ? v.body->sourceNode : v.body->destinationNode;
+    byte n = (byte)v.msg[v.msgLen - 1];
+    if ((owner != originator) || (n * sizeof(MSG_ID) + 2 > v.msgLen)) return false;
+
+    const char *ids = v.msg + v.msgLen - 2 - n * sizeof(MSG_ID);
+    for (byte k = 0; k < n; k++) if (memcmp(ids + k * sizeof(MSG_ID), &uniqueId, sizeof(MSG_ID)) == 0) return true;
+    return false;
+}
+
+/*!
+    @brief  A LORA_MESH_MSG_ACK_LIST datagram at its destination: the messages listed at the end of the payload
+            (sent to peer) are complete, the list is cut off and the datagram handled as a plain ACK or SENDTO.
+*/
+
+void LoraWifiMesh::takeAckList(MSG_VIEW &v, uint8_t peer){
+    if (v.msgLen < 2) return;
+    byte n = (byte)v.msg[v.msgLen - 1];
+    char sts = v.msg[v.msgLen - 2];
+    byte listLen = n * sizeof(MSG_ID) + 2;
+    if (listLen > v.msgLen) return;
+
+    char *ids = v.msg + v.msgLen - listLen;
+    for (byte k = 0; k < n; k++) {
+        MSG_ID id;
+        memcpy(&id, ids + k * sizeof(MSG_ID), sizeof(MSG_ID));
+        if (removeMSGfromQueue(id, &sts, 1) == STS_OK) updateRouteLink(peer, true);
+    }
+    v.msgLen -= listLen;
+    v.hdr->len -= listLen;
+    v.body->type = (v.hdr->hdrType == LORA_MESH_MSG_ACK) ? LORA_MESH_MSG_ACK : LORA_MESH_MSG_SENDTO;
+}
+
+// delay before retry n (n >= 1): RetryInterval doubled per retry up to BackoffShiftMax times, plus jitter
+long LoraWifiMesh::retryDelay(uint8_t retryCount){
+    uint8_t shift = (retryCount > 0) ? retryCount - 1 : 0;
+    if (shift > BackoffShiftMax) shift = BackoffShiftMax;
+
+    long d = RetryInterval << shift;
+    if (RetryJitter > 0) d += random(0, RetryJitter);
+    return d;
+}
+
+/*!
+    @brief  Route of a message: the routing table entry, or a route request is scheduled for destination.
+*/
+
+bool LoraWifiMesh::resolveRoute(uint8_t destination, MESH_PATH &path){
+    if (findRoute(destination,path)) return true;
+
+    ROUTING_TABLE *r = routingTable.find(destination);
+    if (r == 0) {
+        r = routingTable.insert(destination);
+        if (r != 0) routingTable.setSts(r, STS_ROUTE_MISSING);
+    }
+    else if (r->sts == STS_ROUTE_WAITING) {
+        routingTable.setSts(r, STS_ROUTE_MISSING);
+    }
+    return false;
+}
+
+
+/*!
+    @brief  Route failure detection. A datagram sent to a next hop stays in the scheduler (LORA_MESH_TX_HOP_WATCH)
+            until hearHop() sees that node pass it on: relay it (same originator and id) or answer it with the ACK.
+            Radios are broadcast media, so this costs no extra frame. hopExpired() sends it again up to
+            LORA_MESH_HOP_RETRIES times, then, when nothing at all was heard from the next hop, the link is broken.
+            A relay only keeps a copy when two entries are left free for the node's own traffic,
+            otherwise the datagram is relayed unwatched as before. Fragments are never watched: the destination
+            only answers the last one of a round.
+            With hop ACKs the next hop also answers with a LORA_MESH_MSG_HOP_ACK, and the end to end ACKs and the
+            RREPs are watched the same way.
+*/
+
+STSCODE LoraWifiMesh::queueRelay(MSG_VIEW &v){
+    if (queueWatched(v, LORA_MESH_PRIO_DATA, 0)) return STS_OK;
+    return queueFrame((char *)v.hdr, v.hdr->len, LORA_MESH_PRIO_DATA);
+}
+
+bool LoraWifiMesh::queueWatched(MSG_VIEW &v, uint8_t priority, long delay){
+    if ((HopAckTimeout <= 0) || (v.body->type == LORA_MESH_MSG_FRAG)) return false;
+    TX_ENTRY *e = holdFrame(v, LORA_MESH_TX_RAW | LORA_MESH_TX_HOP_WATCH);
+    if (e == 0) return false;
+
+    long _now = millis();
+    e->priority = priority;
+    txQueue.schedule(e, _now + delay + txJitter() + aggWait(v.hdr->destinationNode), _now);
+    return true;
+}
+
+TX_ENTRY *LoraWifiMesh::holdFrame(const MSG_VIEW &v, uint8_t flags){
+    if (((size_t)(v.hdr->len + LORA_MESH_CRC_MAX_SIZE) > sizeof(SEND_Packet)) || (txQueue.count() + 2 > txQueue.size())) return 0;
+    TX_ENTRY *e = txQueue.alloc();
+    if (e == 0) return 0;
+
+    memcpy(e->_pkt._bmsg, v.hdr, v.hdr->len);
+    e->len = v.hdr->len;
+    e->uniqueId = v.body->uniqueId;
+    e->priority = LORA_MESH_PRIO_DATA;
+    e->flags = flags;
+    e->retryCount = 0;
+    e->hopNode = v.hdr->destinationNode;
+    e->hopTries = 0;
+    e->timeStamp = millis();
+    return e;
+}
+
+bool LoraWifiMesh::watchHop(TX_ENTRY *e, uint8_t node){
+    if ((HopAckTimeout <= 0) || (node == 0x00) || (node == LORA_MESH_BROADCAST_ADDRESS)) return false;
+    e->flags = (e->flags | LORA_MESH_TX_HOP_WATCH) & ~LORA_MESH_TX_HOP_HEARD;
+    e->hopNode = node;
+    e->hopTries = 1;
+    e->hopAt = millis();
+    return true;
+}
+
+void LoraWifiMesh::hearHop(const MSG_VIEW &v){
+    uint8_t from = v.hdr->sourceNode;
+    bool toMe = (v.hdr->destinationNode == LocalAddress);
+    bool hopAck = (v.hdr->hdrType == LORA_MESH_MSG_HOP_ACK) && toMe;
+    bool answer = hopAck || ((v.hdr->hdrType == LORA_MESH_MSG_ACK) && toMe);
+    bool passedOn = hopAck || (v.hdr->hdrType == LORA_MESH_MSG_SENDTO) || (v.hdr->hdrType == LORA_MESH_MSG_ACK);
+
+    for (uint8_t i = 0; i < txQueue.size(); i++) {
+        TX_ENTRY &e = txQueue[i];
+        if ((e.sts != LORA_MESH_QUEUE_USED) || !(e.flags & LORA_MESH_TX_HOP_WATCH) || (e.hopTries == 0) || (e.hopNode != from)) continue;
+
+        e.flags |= LORA_MESH_TX_HOP_HEARD;
+        uint8_t source = (e.flags & LORA_MESH_TX_RAW) ? ((BODY_MSG *)(e._pkt._bmsg + sizeof(HDR_MSG)))->sourceNode : LocalAddress;
+        if (!passedOn || (!((v.body->sourceNode == source) && (v.body->uniqueId == e.uniqueId)) && !inAckList(v, source, e.uniqueId))) continue;
+
+        //--- round trip of an answer to the first send only, a retransmission's is ambiguous
+        if (HopAck && answer && (e.hopTries == 1)) sampleHopRtt(from, millis() - e.hopAt);
+        if (hopAck) {
+            stats.hopAcksReceived++;
+            adrResult(from, true);
+        }
+        e.flags &= ~(LORA_MESH_TX_HOP_WATCH | LORA_MESH_TX_HOP_HEARD);
+        if (e.flags & LORA_MESH_TX_RAW) txQueue.release(&e);
+        else txQueue.schedule(&e, e.retryAt, millis());
+    }
+}
+
+void LoraWifiMesh::hopExpired(TX_ENTRY *e){
+    long _now = millis();
+    uint8_t dead = e->hopNode;
+
+    if (e->hopTries <= hopRetries(dead)) {
+        if (dutyDefer(e, _now) || channelDefer(e, _now)) return;
+        adrResult(dead, false);
+        stats.hopRetries++;
+        e->hopTries++;
+        e->hopAt = _now;
+        _txRobust = true;
+        transmit(e, false);
+        txQueue.schedule(e, _now + hopTimeout(dead, e->hopTries), _now);
+        return;
+    }
+    adrResult(dead, false);
+    e->flags &= ~LORA_MESH_TX_HOP_WATCH;
+
+    //--- the next hop is alive, only this datagram got lost: the end to end retry takes over
+    if (e->flags & LORA_MESH_TX_HOP_HEARD) {
+        if (e->flags & LORA_MESH_TX_RAW) txQueue.release(e);
+        else txQueue.schedule(e, e->retryAt, _now);
+        return;
+    }
+
+    stats.linkBreaks++;
+    if ((DebugLevel <=  2) && (DebugLevel >0)) {
+        Serial.print(F("Link broken to: "));
+        Serial.println((char)dead);
+    }
+
+    if (!(e->flags & LORA_MESH_TX_RAW)) {
+        uint8_t dest = e->_pkt._msg._send.destinationNode;
+        breakRoutes(LocalAddress, dead, dest, dead, true);
+        rerouteMsgs(dest);
+        txQueue.schedule(e, e->retryAt, _now);
+        return;
+    }
+
+    HDR_MSG *hdr = (HDR_MSG *)e->_pkt._bmsg;
+    BODY_MSG *body = (BODY_MSG *)(e->_pkt._bmsg + sizeof(HDR_MSG));
+
+    //--- an ACK or a RREP (hop ACKs) was going back to the originator: nothing to repair or report
+    if ((hdr->hdrType != LORA_MESH_MSG_SENDTO) && (hdr->hdrType != LORA_MESH_MSG_PROBE)) {
+        breakRoutes(LocalAddress, dead, body->sourceNode, dead, false);
+        txQueue.release(e);
+        return;
+    }
+
+    uint8_t dest = body->destinationNode;
+    bool held = startRepair(e);
+    breakRoutes(LocalAddress, dead, dest, dead, false);
+    if (held) return;
+    sendRERR(e->_pkt._bmsg, e->len, dead);
+    txQueue.release(e);
+}
 
-    @return 
-            STS_OK 
-            ROUTING_QUEUE_FULL
+/*!
+    @brief  Hop ACK: the header and body of the datagram (or ACK) being answered, no route, no payload
+            but the link report of adaptive data rate: SNR the datagram was received with, SFs this node listens on.
+*/
 
-    @note   
+void LoraWifiMesh::sendHopAck(const MSG_VIEW &v){
+    char frame[LORA_MESH_WIRE_FIXED_SIZE + LORA_MESH_ADR_REPORT_SIZE];
+    HDR_MSG *hdr = (HDR_MSG *)frame;
+    byte len = LORA_MESH_WIRE_FIXED_SIZE;
+
+    memcpy(frame, v.hdr, sizeof(HDR_MSG) + sizeof(BODY_MSG));
+    hdr->hdrType = LORA_MESH_MSG_HOP_ACK;
+    hdr->destinationNode = v.hdr->sourceNode;
+    hdr->sourceNode = LocalAddress;
+    frame[LORA_MESH_WIRE_FIXED_SIZE - 1] = 0;
+    if (Adr) {
+        LoraWifiMeshTransport *transport = getTransport();
+        NEIGHBOUR *n = findNeighbour(v.hdr->sourceNode);
+        uint8_t mask = (transport == 0) ? 0 : transport->rxSfMask();
+        int8_t snr = _rxSnr;
+        frame[len++] = (char)snr;
+        frame[len++] = (char)((mask != 0) ? mask : (1 << (Modem.sf - 6)));
+        if (n != 0) {
+            n->reported = true;
+            n->reportAt = millis();
+            n->reportSnr = snr;
+        }
+    }
+    hdr->len = len;
+    stats.hopAcksSent++;
+    queueFrame(frame, len, LORA_MESH_PRIO_CONTROL);
+}
+
+/*!
+    @brief  Adaptive data rate: modem and power (dBm) of a frame for hop. The lowest SF hop listens on whose
+            floor plus the link margin is reached at or under TxPower, given the SNR hop reported for a frame of
+            known SF and power (SNR doesn't depend on the SF, it follows the power dB for dB), at the lowest
+            such power. The configured modem (or the highest SF hop listens on) at TxPower for a broadcast,
+            a retransmission (robust) or a neighbour without report.
 */
 
+LORA_MODEM LoraWifiMesh::txModem(uint8_t hop, int8_t &power, bool robust){
+    LORA_MODEM m = Modem;
+    power = TxPower;
 
-STSCODE LoraWifiMesh::addStaticRoute (uint8_t _destAddr, char * _path ){
+    if (!Adr || (Protocol != MESH_PROTOCOL_LORA) || (hop == LORA_MESH_BROADCAST_ADDRESS)) return m;
+    NEIGHBOUR *n = findNeighbour(hop);
+    if (n == 0) return m;
 
-   byte slot = 0;
-   for(slot = 0; slot<LORA_MESH_MAX_ROUTING_TABLE_SIZE; slot++) {
-        if (( routingTable[slot].sts == LORA_MESH_QUEUE_FREE )){
-              routingTable[slot].sts = LORA_MESH_QUEUE_USED;
-              routingTable[slot].type = ROUTE_DYNAMIC;
-              strncpy(routingTable[slot].path,_path,LORA_MESH_MAX_ROUTING_PATH_SIZE);
-              routingTable[slot].destNode = _destAddr;
-              routingTable[slot].timeStamp = millis();
-              return STS_OK;
-         }
-   }
-   if (slot >= LORA_MESH_MAX_ROUTING_TABLE_SIZE) return ROUTING_QUEUE_FULL;
+    uint8_t mask = listenMask(n);
+    if (!(mask & (1 << (m.sf - 6)))) {
+        for (uint8_t sf = 12; sf >= 7; sf--) {
+            if (mask & (1 << (sf - 6))) {
+                m.sf = sf;
+                break;
+            }
+        }
+    }
+    if (robust || (n->rptSf == 0)) return m;
+
+    int need = LORA_MESH_ADR_MARGIN + n->adrMargin - n->rptSnr + n->rptPower;
+    for (uint8_t sf = 7; sf <= 12; sf++) {
+        if (!(mask & (1 << (sf - 6)))) continue;
+        int p = meshLoraSnrFloor(sf) + need;
+        if (p > TxPower) continue;
+        m.sf = sf;
+        power = (p < TxPowerMin) ? TxPowerMin : (int8_t)p;
+        return m;
+    }
+    return m;
 }
 
-STSCODE LoraWifiMesh::addRoute(uint8_t destNode,char *path){
-      byte slot = 0;
-      byte cnt1 = 0;
-      byte cnt2 = 0;
-      
-      for(slot = 0; slot<LORA_MESH_MAX_ROUTING_TABLE_SIZE; slot++) {
-            if ((( routingTable[slot].sts == LORA_MESH_QUEUE_USED) || (routingTable[slot].sts == STS_ROUTE_MISSING ) || (routingTable[slot].sts == STS_ROUTE_WAITING)) && (routingTable[slot].destNode == destNode)){
-                for (byte c = 0; c < LORA_MESH_MAX_ROUTING_PATH_SIZE; c++) {
-                  if (routingTable[slot].path[c] == 0x00) break;
-                  cnt1++;
-                }
+// spreading factors a neighbour listens on, the one of our modem until it reported its own
+uint8_t LoraWifiMesh::listenMask(const NEIGHBOUR *n){
+    return ((n != 0) && (n->rxSfMask != 0)) ? n->rxSfMask : (uint8_t)(1 << (Modem.sf - 6));
+}
 
-                if (cnt1 == 0 ) cnt1 = LORA_MESH_MAX_ROUTING_PATH_SIZE;
+// link report at the end of a hop ACK to this node, about the last frame sent to its source
+void LoraWifiMesh::adrReport(const MSG_VIEW &v){
+    NEIGHBOUR *n = findNeighbour(v.hdr->sourceNode);
+    if ((n == 0) || (v.msgLen < LORA_MESH_ADR_REPORT_SIZE)) return;
 
-                for (byte c = 0; c < LORA_MESH_MAX_ROUTING_PATH_SIZE; c++) {
-                  if (path[c] == 0x00) break;
-                  cnt2++;
-                }
-           
-                if (cnt2 < cnt1) {
-                    routingTable[slot].timeStamp = millis();
-                    routingTable[slot].sts = LORA_MESH_QUEUE_USED;
-                    routingTable[slot].type = ROUTE_STATIC;
-                    strncpy(routingTable[slot].path,path,LORA_MESH_MAX_ROUTING_PATH_SIZE);
-                }
-                return STS_OK;
-            } 
-            if (( routingTable[slot].sts == LORA_MESH_QUEUE_FREE )){
-              routingTable[slot].sts = LORA_MESH_QUEUE_USED;
-              strncpy(routingTable[slot].path,path,LORA_MESH_MAX_ROUTING_PATH_SIZE);
-              routingTable[slot].destNode = destNode;
-              routingTable[slot].type = ROUTE_STATIC;
-              routingTable[slot].timeStamp = millis();
-              return STS_OK;
-            }
-      }      
-      if (slot >= LORA_MESH_MAX_ROUTING_TABLE_SIZE) return ROUTING_QUEUE_FULL; 
+    n->rptSnr = (int8_t)v.msg[0];
+    n->rxSfMask = (uint8_t)v.msg[1] & 0x7F;
+    n->rptSf = (n->txSf != 0) ? n->txSf : Modem.sf;
+    n->rptPower = (n->txSf != 0) ? n->txPower : TxPower;
+    stats.adrReports++;
+}
+
+// hop ACK received (acked) or missing from node: delivery ratio and extra margin of the link
+void LoraWifiMesh::adrResult(uint8_t node, bool acked){
+    NEIGHBOUR *n = findNeighbour(node);
+    if (!Adr || (n == 0)) return;
+
+    n->pdr = (uint8_t)((7 * (uint16_t)n->pdr + (acked ? 100 : 0)) / 8);
+    if (!acked) {
+        n->goodRun = 0;
+        if ((n->pdr < AdrTarget) && (n->adrMargin + LORA_MESH_ADR_STEP <= LORA_MESH_ADR_MARGIN_MAX)) n->adrMargin += LORA_MESH_ADR_STEP;
+        return;
+    }
+    if (++n->goodRun < LORA_MESH_ADR_GOOD_RUN) return;
+    n->goodRun = 0;
+    if ((n->pdr >= AdrTarget) && (n->adrMargin > 0)) n->adrMargin--;
 }
 
+// the destination answers with its end to end ACK, a hop ACK only when node needs a fresh report
+bool LoraWifiMesh::adrReportDue(uint8_t node){
+    NEIGHBOUR *n = findNeighbour(node);
+    if (!Adr || (n == 0)) return false;
+    if (!n->reported || (millis() - n->reportAt >= LORA_MESH_ADR_REPORT_INTERVAL)) return true;
+    return (n->snr - n->reportSnr >= LORA_MESH_ADR_REPORT_DELTA) || (n->reportSnr - n->snr >= LORA_MESH_ADR_REPORT_DELTA);
+}
 
 /*!
-    @brief  LoraWifiMesh::yield()
-    
-            Main function to process asynchronous work
-            It should be called in the loop function
-            It process all pending tasks
-                1) check for messages delivered and not ACK received and retry them
-                2) check for messages received and put the on the received queue to be exposed to the user
-                3) do some cleanup
-                    1) refresh routing tables
-                    2) refresh network topology
-                    3) refresh node status
-            
-  
+    @brief  SF and power (dBm) the next unicast frame to node would get, false when adaptive data rate has
+            no report for it yet (configured modem, txPower).
+*/
 
-    @return STS_OK status code.
+bool LoraWifiMesh::linkParams(uint8_t node, uint8_t &sf, int8_t &power){
+    NEIGHBOUR *n = findNeighbour(node);
+    sf = txModem(node, power).sf;
+    return Adr && (n != 0) && (n->rptSf != 0);
+}
 
-    @note   
+/*!
+    @brief  Hop ACK duplicate detection, the same ring as checkSeenRREQ() keyed on (originator, uniqueId, hdrType),
+            the originator of a RREP is the node that answered (its sequence number is the uniqueId).
+            The window is half the end to end retry interval: a retransmission of the previous hop falls in it,
+            the originator's next try doesn't.
 */
 
-STSCODE LoraWifiMesh::yield(){
+bool LoraWifiMesh::checkSeenHop(const MSG_VIEW &v){
+    long _now = millis();
+    uint8_t originator = (v.hdr->hdrType == LORA_MESH_MSG_RREP) ? v.body->destinationNode : v.body->sourceNode;
+
+    for (byte slot = 0; slot < LORA_MESH_HOP_SEEN_SIZE; slot++) {
+       HOP_SEEN &e = seenHop[slot];
+       if ((e.sts == LORA_MESH_QUEUE_USED) && (e.originator == originator) && (e.uniqueId == v.body->uniqueId) &&
+           (e.hdrType == v.hdr->hdrType)) {
+           if (_now - e.timeStamp < RetryInterval / 2) return true;
+           e.timeStamp = _now;
+           return false;
+       }
+    }
 
-    USER_PACKET up;
-    NODE_REGISTRATION nr;
-    char _p[LORA_MESH_MAX_ROUTING_PATH_SIZE];
-  
-    cleanQueues();
+    HOP_SEEN &e = seenHop[_seenHopHead];
+    e.originator = originator;
+    e.uniqueId = v.body->uniqueId;
+    e.hdrType = v.hdr->hdrType;
+    e.timeStamp = _now;
+    e.sts = LORA_MESH_QUEUE_USED;
+    _seenHopHead = (_seenHopHead + 1 == LORA_MESH_HOP_SEEN_SIZE) ? 0 : _seenHopHead + 1;
+    return false;
+}
 
-    // ---- retry Route Reuquest--
-    for(byte slot = 0; slot<LORA_MESH_MAX_ROUTING_TABLE_SIZE; slot++) {
-        if (( routingTable[slot].sts == STS_ROUTE_MISSING )){
-               routingTable[slot].sts = STS_ROUTE_WAITING;
-               getRREQ(routingTable[slot].destNode);
-               break;
-        }
-    }         
+/*!
+    @brief  Neighbour table: every node heard directly, its last RSSI / SNR and the round trip of its hop ACKs.
+            A new neighbour takes a free entry or the one heard the longest time ago.
+*/
 
-    //---- keep Alive Node Registration
+NEIGHBOUR *LoraWifiMesh::findNeighbour(uint8_t node){
+    for (byte i = 0; i < LORA_MESH_NEIGHBOUR_TABLE_SIZE; i++) {
+        if ((neighbours[i].sts == LORA_MESH_QUEUE_USED) && (neighbours[i].node == node)) return &neighbours[i];
+    }
+    return 0;
+}
 
+void LoraWifiMesh::hearNeighbour(uint8_t node){
+    long _now = millis();
+    NEIGHBOUR *n = findNeighbour(node);
 
-    
-    if (KeepAlive) {
-          if ((millis() - _lastKeepAlive > KeepAliveInterval))
-          {
-            _lastKeepAlive = millis();   
-          
-    
-            memset(&up, 0x00, sizeof(USER_PACKET));
-            memset(&nr, 0x00, sizeof(NODE_REGISTRATION));
-      
-            nr.userMsgType = LORA_MESH_MSG_REGISTRATION;
-            nr.nodeId = LocalAddress;
-      
-            memcpy(nr.macAddress, LWMesh.Mac, 6);
-            memcpy(&up._b, &nr , sizeof(NODE_REGISTRATION));
-            
-            bool found = LWMesh.findRoute(MasterNode, _p);
-            if (found) {
-              byte _id = LWMesh.sendMsg(MasterNode, up._b, _p);
-              if (_id < 0) LWMesh.stringSts (_id);
-            } else {
-              LWMesh.getRREQ(MasterNode);
+    if (n == 0) {
+        n = &neighbours[0];
+        for (byte i = 0; i < LORA_MESH_NEIGHBOUR_TABLE_SIZE; i++) {
+            if (neighbours[i].sts != LORA_MESH_QUEUE_USED) {
+                n = &neighbours[i];
+                break;
             }
+            if (neighbours[i].lastHeard - n->lastHeard < 0) n = &neighbours[i];
         }
-    }    
+        n->node = node;
+        n->srtt = 0;
+        n->rttvar = 0;
+        n->txSf = 0;
+        n->rptSf = 0;
+        n->rxSfMask = 0;
+        n->pdr = 100;
+        n->adrMargin = 0;
+        n->goodRun = 0;
+        n->reported = false;
+        n->sts = LORA_MESH_QUEUE_USED;
+    }
+    n->lastHeard = _now;
+    n->rssi = _rxRssi;
+    n->snr = _rxSnr;
+}
 
-    if (( DebugLevel <=  4 )  && (DebugLevel >0)){
-        byte slot = 0;
-        for ( slot=0; slot < LORA_MESH_RREQ_QUEUE_SIZE; slot++) {
-            if ((sentRREQ[slot].sts == LORA_MESH_QUEUE_USED ) && ( sentRREQ[slot]._deliveredStatus== STS_RR_TO_BE_SENT)) {
-                  _send (sentRREQ[slot]._rr._bmsg, sizeof(RREP_DATAGRAM));
-                  sentRREQ[slot]._deliveredStatus== STS_RR_SENT;
-          }
-        }
-    }    
-    return STS_OK;
+// Jacobson / Karels: srtt += (rtt - srtt) / 8, rttvar += (|rtt - srtt| - rttvar) / 4
+void LoraWifiMesh::sampleHopRtt(uint8_t node, long rtt){
+    NEIGHBOUR *n = findNeighbour(node);
+    if ((n == 0) || (rtt < 0)) return;
+    if (rtt > HopAckTimeout) rtt = HopAckTimeout;
+    if (rtt < 1) rtt = 1;
+
+    if (n->srtt == 0) {
+        n->srtt = rtt;
+        n->rttvar = rtt / 2;
+        return;
+    }
+    long err = rtt - n->srtt;
+    if (err < 0) err = -err;
+    n->rttvar = (3 * (long)n->rttvar + err) / 4;
+    n->srtt = (7 * (long)n->srtt + rtt) / 8;
 }
 
-/*!
-    @brief  LoraWifiMesh::initAddress(uint8_t locAdd)
-    
-            Initial setup function. Initiates node with localAddress
-            Init and clean queues;
-            
-    @param  uint8_t locAdd
-    
-            Node local Address
-    
+bool LoraWifiMesh::weakNeighbour(const NEIGHBOUR *n){
+    if ((n == 0) || (n->rssi == 0)) return false;
+    return (n->rssi < LORA_MESH_ROUTE_COST_RSSI_FLOOR + LORA_MESH_HOP_WEAK_MARGIN) ||
+           (n->snr < LORA_MESH_ROUTE_COST_SNR_FLOOR + LORA_MESH_HOP_WEAK_MARGIN);
+}
 
-    @return STS_OK status code.
+// wait for the answer of send number tries to node
+long LoraWifiMesh::hopTimeout(uint8_t node, uint8_t tries){
+    NEIGHBOUR *n = HopAck ? findNeighbour(node) : 0;
+    if ((n == 0) || (n->srtt == 0)) return HopAckTimeout;
+
+    long margin = 4 * (long)n->rttvar;
+    if (margin < LORA_MESH_HOP_RTO_MIN) margin = LORA_MESH_HOP_RTO_MIN;
+    long rto = n->srtt + margin;
+    if (weakNeighbour(n) && (tries > 1)) rto <<= (tries - 1);
+    if (rto > HopAckTimeout) rto = HopAckTimeout;
+    return rto;
+}
 
-    @note   
+// sends after the first one before the link to node is given up
+uint8_t LoraWifiMesh::hopRetries(uint8_t node){
+    if (!HopAck) return LORA_MESH_HOP_RETRIES;
+    return weakNeighbour(findNeighbour(node)) ? LORA_MESH_HOP_ACK_RETRIES_WEAK : LORA_MESH_HOP_ACK_RETRIES;
+}
+
+/*!
+    @brief  Local repair, next hop routing only: a relay that lost its next hop keeps the datagram and sends its own
+            route request when the destination was at most LORA_MESH_LOCAL_REPAIR_MAX_HOPS away on the broken route
+            (further, the originator's rediscovery is cheaper). One request per destination per LORA_MESH_LOCAL_REPAIR_TIMEOUT,
+            the datagrams for that destination arriving meanwhile are held too. kickMsgs() releases them as soon as
+            a route is learned, serviceRepair() forwards them or gives up with a RERR when the time is over.
 */
 
+bool LoraWifiMesh::startRepair(TX_ENTRY *e){
+    MSG_VIEW v;
+    long _now = millis();
 
-STSCODE  LoraWifiMesh::initAddress(uint8_t locAdd){
-    LocalAddress = locAdd;
+    if (!LocalRepair || (RoutingMode != LORA_MESH_ROUTING_NEXT_HOP) || !parseView(e->_pkt._bmsg, e->len, v)) return false;
+    if (!(*v.route & LORA_MESH_ROUTE_NEXT_HOP)) return false;
 
-    for(byte slot = 0; slot<LORA_MESH_MAX_ROUTING_TABLE_SIZE; slot++) {
-         routingTable[slot].sts = LORA_MESH_QUEUE_FREE;
-    }    
-    for(byte slot = 0; slot<LORA_MESH_MSG_QUEUE_SIZE; slot++) {
-         sentQueue[slot].sts = LORA_MESH_QUEUE_FREE;
-    }    
+    ROUTING_TABLE *r = routingTable.find(v.body->destinationNode);
+    if ((r == 0) || (r->type == ROUTE_STATIC) || (r->hops > LORA_MESH_LOCAL_REPAIR_MAX_HOPS)) return false;
 
-    for(byte slot = 0; slot<LORA_MESH_RREQ_QUEUE_SIZE; slot++) {
-         sentRREQ[slot].sts = LORA_MESH_QUEUE_FREE;
-    }    
+    if ((r->sts != STS_ROUTE_WAITING) || (_now - r->timeStamp >= LORA_MESH_LOCAL_REPAIR_TIMEOUT)) {
+        routingTable.setSts(r, STS_ROUTE_WAITING);
+        r->timeStamp = _now;
+        getRREQ(r->destNode);
+    }
+    e->flags = LORA_MESH_TX_RAW | LORA_MESH_TX_REPAIR;
+    txQueue.schedule(e, r->timeStamp + LORA_MESH_LOCAL_REPAIR_TIMEOUT, _now);
+    return true;
+}
 
-    for(byte slot = 0; slot<LORA_MESH_RECEIVED_QUEUE_SIZE; slot++) {
-         receivedQueue[slot].sts = LORA_MESH_QUEUE_FREE;
-    }    
+bool LoraWifiMesh::holdForRepair(MSG_VIEW &v){
+    ROUTING_TABLE *r = routingTable.find(v.body->destinationNode);
+    long _now = millis();
 
-    return STS_OK;
- }
+    if (!LocalRepair || (r == 0) || (r->sts != STS_ROUTE_WAITING) || (_now - r->timeStamp >= LORA_MESH_LOCAL_REPAIR_TIMEOUT)) return false;
 
- STSCODE  LoraWifiMesh::addRREQToQueue(uint8_t uniqueId){   
-   byte slot = 0;
-   for ( slot=0; slot < LORA_MESH_RREQ_QUEUE_SIZE; slot++) {
-       if (sentRREQ[slot].sts == LORA_MESH_QUEUE_FREE) break;
-   }
-   
-   if (slot >= LORA_MESH_RREQ_QUEUE_SIZE){
-       if ((DebugLevel <=  1) && (DebugLevel >0)) {
-           Serial.print(F("RREQ queue is full"));
-       }
-       return RREQ_QUEUE_FULL;
-   }
-           
-   sentRREQ[slot].sts = LORA_MESH_QUEUE_USED;
-   sentRREQ[slot].timeStamp = millis();
-   sentRREQ[slot].uniqueId = uniqueId;
+    v.hdr->sourceNode = LocalAddress;
+    v.hdr->destinationNode = 0x00;
+    TX_ENTRY *e = holdFrame(v, LORA_MESH_TX_RAW | LORA_MESH_TX_REPAIR);
+    if (e == 0) return false;
+    txQueue.schedule(e, r->timeStamp + LORA_MESH_LOCAL_REPAIR_TIMEOUT, _now);
+    return true;
+}
 
-   return STS_OK;
- }
+void LoraWifiMesh::serviceRepair(TX_ENTRY *e){
+    MSG_VIEW v;
+    MESH_PATH p;
+    long _now = millis();
+    char hop = 0x00;
 
- STSCODE LoraWifiMesh::removeMSGfromQueue(uint8_t uniqueId, char *_msg){
-    byte slot;
-    for (slot=0; slot < LORA_MESH_MSG_QUEUE_SIZE; slot++) {
-       if ((sentQueue[slot].sts == LORA_MESH_QUEUE_USED) && (sentQueue[slot]._pkt._msg._send.uniqueId == uniqueId)){
-             for(byte slot0 = 0; slot0<LORA_MESH_RECEIVED_QUEUE_SIZE; slot0++) {
-                 if (receivedQueue[slot0].sts == LORA_MESH_QUEUE_FREE) {
-                    receivedQueue[slot0].sts = LORA_MESH_QUEUE_USED;
-                    receivedQueue[slot0]._pkt._pkt.msgId = sentQueue[slot]._pkt._msg._send.uniqueId;
-                    receivedQueue[slot0]._pkt._pkt.sts = _msg[0];
-                    memcpy(receivedQueue[slot0]._pkt._pkt.msg,_msg,LORA_MESH_MAX_MSG_SIZE);
-                    break;
-                 }
-             }
-            sentQueue[slot].sts = LORA_MESH_QUEUE_FREE;
-            break;
-       }
-   }  
-   return STS_OK;
- }
+    if (!parseView(e->_pkt._bmsg, e->len, v)) {
+        txQueue.release(e);
+        return;
+    }
+    if (findRoute(v.body->destinationNode, p)) hop = nextHop(p);
+    if (hop == 0x00) {
+        sendRERR(e->_pkt._bmsg, e->len, e->hopNode);
+        txQueue.release(e);
+        return;
+    }
 
+    stats.localRepairs++;
+    v.hdr->destinationNode = hop;
+    e->flags = LORA_MESH_TX_RAW | ((HopAckTimeout > 0) ? LORA_MESH_TX_HOP_WATCH : 0);
+    e->hopNode = hop;
+    e->hopTries = 0;
+    txQueue.schedule(e, _now, _now);
+}
 
- STSCODE  LoraWifiMesh::addRRToQueue(RR_Packet _rr, uint8_t _uniqueId){   
-   byte slot = 0;
-  
-   for (slot=0; slot < LORA_MESH_RREQ_QUEUE_SIZE; slot++) {
-       if (sentRREQ[slot].sts == LORA_MESH_QUEUE_FREE) break;
-   }
+/*!
+    @brief  Turn a datagram that can't go further into the RERR for its originator, in place, and send it back
+            the way the datagram came (path, or route to the originator). Rate limited per (originator, destination)
+            so a burst of datagrams over a dead link sends one RERR.
+*/
 
-   if (slot >= LORA_MESH_RREQ_QUEUE_SIZE){
-       if ((DebugLevel <=  1) && (DebugLevel >0)){
-           Serial.print(F("RRTABLE queue is full"));
-       }
-       return RREQ_QUEUE_FULL;
-   }
-  
-   memcpy(sentRREQ[slot]._rr._bmsg,_rr._bmsg,sizeof(RR_Packet)); 
-   sentRREQ[slot].uniqueId = _uniqueId;
-   sentRREQ[slot].sts = LORA_MESH_QUEUE_USED;
-   sentRREQ[slot].retryCount = 1;
-   sentRREQ[slot]._deliveredStatus = STS_RR_TO_BE_SENT;
-   sentRREQ[slot].timeStamp = millis();
-
-   return STS_OK;
- }
+void LoraWifiMesh::sendRERR(char *frame, byte len, uint8_t deadHop){
+    MSG_VIEW v;
+    char link[2];
+    long _now = millis();
+
+    if (!parseView(frame, len, v) || (v.body->sourceNode == LocalAddress)) return;
+    if ((v.body->sourceNode == _rerrSource) && (v.body->destinationNode == _rerrDest) && (_now - _rerrAt < LORA_MESH_RERR_INTERVAL)) return;
+
+    char prev = prevHop(v);
+    if (prev == 0x00) return;
+
+    _rerrSource = v.body->sourceNode;
+    _rerrDest = v.body->destinationNode;
+    _rerrAt = _now;
+    stats.rerrSent++;
+
+    link[0] = LocalAddress;
+    link[1] = deadHop;
+    v.hdr->hdrType = LORA_MESH_MSG_RERR;
+    v.hdr->sourceNode = LocalAddress;
+    v.hdr->destinationNode = prev;
+    resetTtl(v);
+    setPayload(v, link, 2);
+
+    if ((DebugLevel <=  2) && (DebugLevel >0)) {
+        Serial.print(F("Sending RERR to: "));
+        Serial.println((char)v.body->sourceNode);
+    }
+    queueFrame((char *)v.hdr, v.hdr->len, LORA_MESH_PRIO_CONTROL);
+}
 
+/*!
+    @brief  Drop the dynamic routes using the link from -> to, and the route to dest whose next hop is via.
+            rediscover (originator): a route in use goes back to route discovery at once instead of being removed.
+*/
 
- 
-STSCODE  LoraWifiMesh::addMSGToQueue(SEND_Packet _msg){   
-   byte slot = 0;
-   for (slot=0; slot < LORA_MESH_MSG_QUEUE_SIZE; slot++) {
-       if (sentQueue[slot].sts == LORA_MESH_QUEUE_FREE) break;
-   }
+void LoraWifiMesh::breakRoutes(uint8_t from, uint8_t to, uint8_t dest, uint8_t via, bool rediscover){
+    long _now = millis();
 
-   if (slot >= LORA_MESH_MSG_QUEUE_SIZE){
-       if ((DebugLevel <=  1) && (DebugLevel >0)) {
-           Serial.print(F("SENT queue is full"));
-       }
-       return MSG_QUEUE_FULL;
-   }
-  
-   memcpy(sentQueue[slot]._pkt._bmsg,_msg._bmsg,sizeof(SEND_Packet)); 
-   sentQueue[slot].sts = LORA_MESH_QUEUE_USED;
-   sentQueue[slot].retryCount = 1;
-   sentQueue[slot].timeStamp = millis();
+    for (uint16_t i = 0; i < routingTable.size(); i++) {
+        ROUTING_TABLE *r = &routingTable[i];
+        if ((r->sts != LORA_MESH_QUEUE_USED) || (r->type == ROUTE_STATIC)) continue;
 
-   return STS_OK;
- }
+        bool broken = (r->destNode == dest) && (nextHop(r->path) == (char)via);
+        for (byte k = 0; !broken && (to != 0x00) && (k + 1 < r->path.len); k++) {
+            broken = (r->path.node[k] == (char)from) && (r->path.node[k + 1] == (char)to);
+        }
+        if (!broken) continue;
 
+        if (rediscover && (_now - r->lastUsed < RouteTtl)) {
+            routingTable.setSts(r, STS_ROUTE_MISSING);
+            r->timeStamp = _now;
+        }
+        else routingTable.remove(r);
+    }
+}
 
-bool LoraWifiMesh::findRREQ(byte uniqueId){
-    for(byte slot = 0; slot<LORA_MESH_RREQ_QUEUE_SIZE; slot++) {
-       if (( sentRREQ[slot].sts == LORA_MESH_QUEUE_USED ) && (sentRREQ[slot].uniqueId == uniqueId  )){
-        return true;
-       }
+// the messages to dest take the new route when it comes: their resolved path is forgotten
+void LoraWifiMesh::rerouteMsgs(uint8_t dest){
+    for (uint8_t i = 0; i < txQueue.size(); i++) {
+        TX_ENTRY &e = txQueue[i];
+        if ((e.sts != LORA_MESH_QUEUE_USED) || !(e.flags & LORA_MESH_TX_AWAIT_ACK) || (e.flags & LORA_MESH_TX_SOURCE_ROUTE)) continue;
+        if (e._pkt._msg._send.destinationNode == dest) e._pkt._msg._send.path.len = 0;
     }
-    return false;
- }
- 
- STSCODE  LoraWifiMesh::cleanQueues(byte queueType){
-    byte slot;
-    long _now;
-    STSCODE _retSts = STS_OK;
-    _now = millis();
-    
-    for(slot = 0; slot<LORA_MESH_RREQ_QUEUE_SIZE; slot++) {
-            if (( sentRREQ[slot].sts == LORA_MESH_QUEUE_USED ) && (_now - sentRREQ[slot].timeStamp >  LORA_MESH_RREQ_QUEUE_TIMEOUT )){
-              sentRREQ[slot].sts = LORA_MESH_QUEUE_FREE;
-            }
+    for (byte slot = 0; slot < LORA_MESH_FRAG_TX_SIZE; slot++) {
+        FRAG_TX &t = fragTx[slot];
+        if ((t.sts != LORA_MESH_QUEUE_USED) || t.sourceRoute || (t.destNode != dest)) continue;
+        t.path.len = 0;
+        t.next = t.count;
     }
+}
 
-    for(slot = 0; slot<LORA_MESH_MSG_QUEUE_SIZE; slot++) {
-            if (( sentQueue[slot].sts == LORA_MESH_QUEUE_USED ) && (_now - sentQueue[slot].timeStamp > LORA_MESH_MSG_QUEUE_TIMEOUT)){
-                 if (sentQueue[slot].retryCount < LORA_MESH_SEND_MSG_RETRY_COUNT ) {
-                      sentQueue[slot].retryCount++;
-                      sentQueue[slot].timeStamp = _now;
-                      totalRetry++;
-                      
-                    
-                    if ((DebugLevel <=  1 ) && (DebugLevel >0)) { 
-                          Serial.print (F("RETRY MSG Id : "));
-                          Serial.print(sentQueue[slot]._pkt._msg._send.uniqueId);
-                          Serial.print(F(" \""));
-                          Serial.print(sentQueue[slot]._pkt._msg._send.msg);
-                          Serial.print(F("\" using PATH: \""));
-                          Serial.print( sentQueue[slot]._pkt._msg._send.path );
-                          Serial.print(F("\" retryCount: "));
-                          Serial.println(sentQueue[slot].retryCount);
-                     }
-
-                      sendMsg(sentQueue[slot]._pkt._msg._send.destinationNode,sentQueue[slot]._pkt._msg._send.msg,sentQueue[slot]._pkt._msg._send.path, sentQueue[slot]._pkt._msg._send.uniqueId);               
-                 }
-                 else {
-                     for(byte slot0 = 0; slot0<LORA_MESH_RECEIVED_QUEUE_SIZE; slot0++) {
-                         if (receivedQueue[slot0].sts == LORA_MESH_QUEUE_FREE) {
-                            receivedQueue[slot0].sts = LORA_MESH_QUEUE_USED;
-                            receivedQueue[slot0]._pkt._pkt.msgId = sentQueue[slot]._pkt._msg._send.uniqueId;
-                            receivedQueue[slot0]._pkt._pkt.sts = STS_TIMEOUT;
-                            memcpy(receivedQueue[slot0]._pkt._pkt.msg,sentQueue[slot]._pkt._msg._send.msg,LORA_MESH_MAX_MSG_SIZE);
-                            break;
-                         }
-                     }
-                     sentQueue[slot].sts = LORA_MESH_QUEUE_FREE;
-                  }
-            }   
-       }
+// a route to dest was learned: what was waiting for it goes now instead of at its next retry
+void LoraWifiMesh::kickMsgs(uint8_t dest){
+    long _now = millis();
 
-// -- reset routing queues, start fresh----
-   
-       if ((millis() - _lastReset > ResetInterval))
-          {
-            _lastReset = millis();   
+    for (uint8_t i = 0; i < txQueue.size(); i++) {
+        TX_ENTRY &e = txQueue[i];
+        if (e.sts != LORA_MESH_QUEUE_USED) continue;
+        if (e.flags & LORA_MESH_TX_REPAIR) {
+            if (((BODY_MSG *)(e._pkt._bmsg + sizeof(HDR_MSG)))->destinationNode == dest) txQueue.schedule(&e, _now, _now);
+        }
+        else if ((e.flags & LORA_MESH_TX_AWAIT_ACK) && !(e.flags & LORA_MESH_TX_HOP_WATCH) && (e.retryCount > 0)
+                 && (e._pkt._msg._send.destinationNode == dest) && (e._pkt._msg._send.path.len == 0)) {
+            txQueue.schedule(&e, _now + txJitter(), _now);
+        }
+    }
+    for (byte slot = 0; slot < LORA_MESH_FRAG_TX_SIZE; slot++) {
+        FRAG_TX &t = fragTx[slot];
+        if ((t.sts == LORA_MESH_QUEUE_USED) && (t.destNode == dest) && (t.path.len == 0) && (t.next >= t.count)) t.deadline = _now;
+    }
+}
 
-            for(byte slot = 0; slot<LORA_MESH_MAX_ROUTING_TABLE_SIZE; slot++) {
-                routingTable[slot].sts = LORA_MESH_QUEUE_FREE;
-                routingTable[slot].destNode = 0;
-              }      
+/*!
+    @brief  RREQ duplicate suppression.
+            True when (originator, uniqueId) was handled in the last LORA_MESH_RREQ_SEEN_TIMEOUT ms,
+            otherwise the pair is recorded (overwriting the oldest entry of the ring) and false is returned.
+            Kept apart from the transmit queue so a full queue never turns the suppression off.
+*/
 
-            for(byte slot = 0; slot<LORA_MESH_MAX_ROUTING_TABLE_SIZE; slot++) {
-                routingTable[slot].sts = LORA_MESH_QUEUE_FREE;
-                routingTable[slot].destNode = 0;
-              }      
+bool LoraWifiMesh::checkSeenRREQ(uint8_t originator, MSG_ID uniqueId){
+    long _now = millis();
 
-          
-          }
-          
-       return _retSts;
+    for(byte slot = 0; slot<LORA_MESH_RREQ_SEEN_SIZE; slot++) {
+       RREQ_SEEN &e = seenRREQ[slot];
+       if (( e.sts == LORA_MESH_QUEUE_USED ) && (e.originator == originator) && (e.uniqueId == uniqueId)){
+           if (_now - e.timeStamp < LORA_MESH_RREQ_SEEN_TIMEOUT) return true;
+           e.timeStamp = _now;
+           e.copies = 1;
+           return false;
+       }
+    }
+
+    RREQ_SEEN &e = seenRREQ[_seenHead];
+    e.originator = originator;
+    e.uniqueId = uniqueId;
+    e.timeStamp = _now;
+    e.copies = 1;
+    e.sts = LORA_MESH_QUEUE_USED;
+    _seenHead = (_seenHead + 1 == LORA_MESH_RREQ_SEEN_SIZE) ? 0 : _seenHead + 1;
+    return false;
+ }
+
+/*!
+    @brief  Counter based flood suppression: one more copy of a RREQ heard, its relay still waiting in the scheduler
+            is dropped once rreqCounter copies came in (the neighbourhood is covered already).
+*/
+
+void LoraWifiMesh::countRREQCopy(uint8_t originator, MSG_ID uniqueId){
+    byte slot = 0;
+    while ((slot < LORA_MESH_RREQ_SEEN_SIZE) && ((seenRREQ[slot].sts != LORA_MESH_QUEUE_USED) ||
+           (seenRREQ[slot].originator != originator) || (seenRREQ[slot].uniqueId != uniqueId))) slot++;
+    if (slot == LORA_MESH_RREQ_SEEN_SIZE) return;
+    RREQ_SEEN &s = seenRREQ[slot];
+    if (s.copies < 0xFF) s.copies++;
+    if ((s.copies < RreqCounter) || (originator == LocalAddress)) return;
+
+    for (uint8_t i = 0; i < txQueue.size(); i++) {
+        TX_ENTRY &e = txQueue[i];
+        if ((e.sts != LORA_MESH_QUEUE_USED) || !(e.flags & LORA_MESH_TX_RAW)) continue;
+        HDR_MSG *hdr = (HDR_MSG *)e._pkt._bmsg;
+        BODY_MSG *body = (BODY_MSG *)(e._pkt._bmsg + sizeof(HDR_MSG));
+        if ((hdr->hdrType != LORA_MESH_MSG_RREQ) || (body->sourceNode != originator) || (body->uniqueId != uniqueId)) continue;
+        txQueue.release(&e);
+        stats.rreqRelayed--;                // counted when queued, it never went on the air
+        stats.rreqSuppressed++;
+        return;
+    }
+ }
+ 
+ // age a few routing entries per call instead of wiping the table, and the stale fragment slots
+ STSCODE  LoraWifiMesh::cleanQueues(){
+    ageRoutes();
+    ageFragments();
+    return STS_OK;
  }
 
 
@@ -1534,7 +3398,7 @@ void LoraWifiMesh::dumpSendTo(SEND_Packet pkt){
 }
 
 /*!
-    @brief  byte LoraWifiMesh::sendMsg(uint8_t destination, char *msg, char *_path, byte _uni, byte _ret)
+    @brief  MSG_ID LoraWifiMesh::sendMsg(uint8_t destination, char *msg, char *_path, MSG_ID _uni, byte _ret)
     
             Mais user function to send messages
             
@@ -1552,7 +3416,7 @@ void LoraWifiMesh::dumpSendTo(SEND_Packet pkt){
     
     @param  char *_path
     
-    @param  byte _uni
+    @param  MSG_ID _uni
     
     @param  byte byte _ret
     
@@ -1560,123 +3424,63 @@ void LoraWifiMesh::dumpSendTo(SEND_Packet pkt){
     @return msgId;
     
             The unique messageId, which will allows for later confirm that it was received or timeout.
+            An error code when MESH_ID_ERROR(msgId), (STSCODE)msgId tells which one.
 
     @note   
 */
 
     
-byte LoraWifiMesh::sendMsg(uint8_t destination, char *msg, char *_path, byte _uni, byte _ret){
-
-    SEND_Packet pkt;
-    char path[LORA_MESH_MAX_ROUTING_PATH_SIZE] ;
-    uint8_t node1=0;
-    uint8_t node2=0;
-
-    if ( destination == LocalAddress ) return ERR_CANNOT_SEND_TO_SELF;
-    memset(&pkt, 0, sizeof(SEND_Packet));
-    memset(&path, 0,LORA_MESH_MAX_ROUTING_PATH_SIZE);
-
-    if (_path[0] == 0x00) {
-      bool found = findRoute(destination,path);
-      if (!found){
-          bool requestExist = false;
-          for(byte slot = 0; slot<LORA_MESH_MAX_ROUTING_TABLE_SIZE; slot++) {
-              if ((( routingTable[slot].sts == STS_ROUTE_MISSING) || ( routingTable[slot].sts == STS_ROUTE_WAITING))){
-                if (routingTable[slot].sts == STS_ROUTE_WAITING) routingTable[slot].sts = STS_ROUTE_MISSING;
-                requestExist = true;
-               break;
-              }
-          }   
-          if (!requestExist) {
-              for(byte slot = 0; slot<LORA_MESH_MAX_ROUTING_TABLE_SIZE; slot++) {
-                  if (( routingTable[slot].sts == LORA_MESH_QUEUE_FREE)){
-                        routingTable[slot].sts = STS_ROUTE_MISSING;
-                        routingTable[slot].destNode = destination;
-                        routingTable[slot].timeStamp = millis();
-                   break;
-                  }
-              }      
-          }        
-      }
-      else { 
-
-        }
-    } else {
-       strncpy(path,_path,LORA_MESH_MAX_ROUTING_PATH_SIZE);
-    }
+MSG_ID LoraWifiMesh::sendMsg(uint8_t destination, char *msg, char *_path, MSG_ID _uni, byte _ret){
+    return sendMsg(destination, (const uint8_t *)msg, strnlen(msg, LORA_MESH_MAX_MSG_SIZE), _path, _uni);
+}
 
-  
-    for (int i = 0; i < LORA_MESH_MAX_ROUTING_PATH_SIZE-1; i++) {
-         node1 = path[i];
-         node2 = path[i+1];
-         if (node1 == LocalAddress) break;
-    }
-  
-    strncpy(pkt._msg._send.path,path,LORA_MESH_MAX_ROUTING_PATH_SIZE);
-    strncpy(pkt._msg._send.msg,msg,LORA_MESH_MAX_MSG_SIZE);
+/*!
+    @brief  Binary version of sendMsg: exactly len bytes (zeros included) are sent, retried and
+            handed back with their length in RECEIVED_MSG.len at the destination.
+            Longer messages go with sendLongMsg.
 
-    if((node1 == 0x00) && (node2 == 0x00) ) node2 = 0xFF;
-    pkt._msg._hdr.sourceNode = LocalAddress;
-    pkt._msg._hdr.destinationNode = node2;
-    pkt._msg._hdr.hdrType = LORA_MESH_MSG_SENDTO; 
+    @return msgId, MSG_TOO_BIG when len is over LORA_MESH_MAX_MSG_SIZE
+*/
 
-    if (_uni == 0xff) {
-      pkt._msg._hdr.msgId = _uniqMsgId;
-    }
-    else {
-      pkt._msg._hdr.msgId = _uni;
-    }
-    
-    pkt._msg._send.sourceNode = LocalAddress;
-    pkt._msg._send.destinationNode = destination;
-    pkt._msg._send.type = LORA_MESH_MSG_SENDTO;
-    
-    if (_uni == 0xff) {
-      pkt._msg._send.uniqueId = _uniqMsgId++;
-    }
-    else {
-       pkt._msg._send.uniqueId = _uni;
-    }
+MSG_ID LoraWifiMesh::sendMsg(uint8_t destination, const uint8_t *data, size_t len, const char *_path, MSG_ID _uni){
 
-    if (_uni == 0xff) addMSGToQueue (pkt);    
-    pkt._msg._hdr.len = sizeof(SEND_Packet);
-    pkt._msg._hdr._crc = getCRC(pkt._bmsg,sizeof(SEND_Packet)); 
+    if ( destination == LocalAddress ) return (MSG_ID)ERR_CANNOT_SEND_TO_SELF;
+    if ( len > LORA_MESH_MAX_MSG_SIZE ) return (MSG_ID)MSG_TOO_BIG;
 
-    if (( DebugLevel <=  1) && (DebugLevel >0)) LWMesh.dumpHDR(pkt._msg._hdr);
+    MESH_PATH path;
+    pathFromString(path, _path);
 
-    _send (pkt._bmsg, sizeof(SEND_Packet));
-    if (( DebugLevel <=  2) && (DebugLevel >0)) LWMesh.dumpMSGTable();
+    MSG_ID _id = queueMsg(destination, (const char *)data, len, &path, LORA_MESH_PRIO_DATA, _uni);
+    if (( DebugLevel <=  2) && (DebugLevel >0)) dumpMSGTable();
 
-    
-    return pkt._msg._hdr.msgId;
+    return _id;
 }
 
 
-byte LoraWifiMesh::getRREQ(uint8_t destinationAddress){
+MSG_ID LoraWifiMesh::getRREQ(uint8_t destinationAddress){
 
     RREQ_Packet pkt;
-    char path[LORA_MESH_MAX_ROUTING_PATH_SIZE];
+    RREQ_Packet wire;
 
-    if ( destinationAddress == LocalAddress ) return ERR_CANNOT_ROUTE_TO_SELF;
+    if ( destinationAddress == LocalAddress ) return (MSG_ID)ERR_CANNOT_ROUTE_TO_SELF;
   
     memset(&pkt, 0, sizeof(RREQ_Packet));
-    memset(&path, 0, LORA_MESH_MAX_ROUTING_PATH_SIZE);
     
     pkt._msg._hdr.sourceNode = LocalAddress;
     pkt._msg._hdr.destinationNode = LORA_MESH_BROADCAST_ADDRESS;
     pkt._msg._hdr.hdrType = LORA_MESH_MSG_RREQ; 
-    pkt._msg._hdr.msgId = _uniqMsgId++;
+    pkt._msg._hdr.msgId = nextMsgId();
     
     pkt._msg._rreq.sourceNode = LocalAddress;
     pkt._msg._rreq.destinationNode = destinationAddress;
     pkt._msg._rreq.uniqueId  = _uniqRReqId++;
     pkt._msg._rreq.type  = LORA_MESH_MSG_RREQ;    
-    sprintf(pkt._msg._rreq.path,"%c\0",LocalAddress);
+    pkt._msg._rreq.path.len = 1;
+    pkt._msg._rreq.path.node[0] = LocalAddress;
 
-    pkt._msg._hdr.len = sizeof(RREQ_Packet);
-    pkt._msg._hdr._crc = getCRC(pkt._bmsg,sizeof(RREQ_Packet));
-
-    _send (pkt._bmsg, sizeof(SEND_Packet));
+    stats.rreqSent++;
+    checkSeenRREQ(LocalAddress, pkt._msg._rreq.uniqueId);
+    queueFrame(wire._bmsg, encodeDatagram(pkt._bmsg, 0, wire._bmsg), LORA_MESH_PRIO_CONTROL);
   
     if ((DebugLevel <=  2) && (DebugLevel >0)) dumpRREQ(pkt._msg._rreq);
     
@@ -1686,28 +3490,43 @@ byte LoraWifiMesh::getRREQ(uint8_t destinationAddress){
 
 void LoraWifiMesh::dumpRTable(){
     Serial.println (F("---- ROUTING TABLE -----"));
-    Serial.println(F("Node  Path "));
-    for (int i = 0;i<LORA_MESH_MAX_ROUTING_TABLE_SIZE;i++){
-      if((LWMesh.routingTable[i].sts == LORA_MESH_QUEUE_USED) ||(LWMesh.routingTable[i].sts == STS_ROUTE_WAITING) ||(LWMesh.routingTable[i].sts == STS_ROUTE_MISSING)){
+    Serial.println(F("Node  Path  Type Hops RSSI SNR Ack/Sent Cost"));
+    for (uint16_t i = 0;i<routingTable.size();i++){
+      ROUTING_TABLE &r = routingTable[i];
+      if((r.sts == LORA_MESH_QUEUE_USED) ||(r.sts == STS_ROUTE_WAITING) ||(r.sts == STS_ROUTE_MISSING)){
         Serial.print (F(" "));
-        Serial.print(LWMesh.routingTable[i].destNode);   
+        Serial.print(r.destNode);   
         Serial.print (" => ");
-        Serial.println(LWMesh.routingTable[i].path);           
+        for (byte k = 0; k < r.path.len; k++) Serial.print(r.path.node[k]);           
+        Serial.print (F(" "));
+        Serial.print((r.type == ROUTE_STATIC) ? 'S' : 'D');
+        Serial.print (F(" "));
+        Serial.print(r.hops);
+        Serial.print (F(" "));
+        Serial.print(r.rssi);
+        Serial.print (F(" "));
+        Serial.print(r.snr);
+        Serial.print (F(" "));
+        Serial.print(r.ackOk);
+        Serial.print (F("/"));
+        Serial.print(r.ackSent);
+        Serial.print (F(" "));
+        Serial.println(routeCost(r.hops, r.rssi, r.snr, r.ackSent, r.ackOk));
     }
     }
 };
 
 void LoraWifiMesh::dumpRREQTable(){
-    Serial.println (F("---- RREQ QUEUE ----"));
-    Serial.println(F("UniqueId  DeliveredSts timeStamp"));
-    for (int i = 0;i<LORA_MESH_RREQ_QUEUE_SIZE;i++){
-      if ((LWMesh.sentRREQ[i].sts == LORA_MESH_QUEUE_USED) ) {
+    Serial.println (F("---- RREQ SEEN ----"));
+    Serial.println(F("Originator UniqueId timeStamp"));
+    for (int i = 0;i<LORA_MESH_RREQ_SEEN_SIZE;i++){
+      if ((seenRREQ[i].sts == LORA_MESH_QUEUE_USED) ) {
         Serial.print (F("   "));
-        Serial.print(LWMesh.sentRREQ[i].uniqueId);   
+        Serial.print((char)seenRREQ[i].originator);   
         Serial.print(F("   "));           
-        Serial.print(LWMesh.sentRREQ[i]._deliveredStatus);   
+        Serial.print(seenRREQ[i].uniqueId);   
         Serial.print(F("   "));           
-        Serial.println(LWMesh.sentRREQ[i].timeStamp);           
+        Serial.println(seenRREQ[i].timeStamp);           
         }
     }
 };
@@ -1715,19 +3534,22 @@ void LoraWifiMesh::dumpRREQTable(){
 
 void LoraWifiMesh::dumpMSGTable(){
     Serial.println (F("---- SENT Queue ----"));
-    Serial.println(F("UniqueId  Retry TimeStamp  sourceNode destNode"));
-    for (int i = 0;i<LORA_MESH_MSG_QUEUE_SIZE;i++){
-      if (LWMesh.sentQueue[i].sts == LORA_MESH_QUEUE_USED) {
+    Serial.println(F("UniqueId  Retry TimeStamp  Prio sourceNode destNode"));
+    for (int i = 0;i<txQueue.size();i++){
+      TX_ENTRY &e = txQueue[i];
+      if (e.sts == LORA_MESH_QUEUE_USED) {
         Serial.print (F(" "));
-        Serial.print(LWMesh.sentQueue[i]._pkt._msg._send.uniqueId);   
+        Serial.print(e.uniqueId);   
+        Serial.print(F("    "));           
+        Serial.print(e.retryCount);           
         Serial.print(F("    "));           
-        Serial.print(LWMesh.sentQueue[i].retryCount);           
+        Serial.print(e.timeStamp);           
         Serial.print(F("    "));           
-        Serial.print(LWMesh.sentQueue[i].timeStamp);           
+        Serial.print(e.priority);           
         Serial.print(F("    "));           
-        Serial.print(LWMesh.sentQueue[i]._pkt._msg._send.sourceNode);           
+        Serial.print(e._pkt._msg._hdr.sourceNode);           
         Serial.print(F("    "));           
-        Serial.println(LWMesh.sentQueue[i]._pkt._msg._send.destinationNode);           
+        Serial.println((e.flags & LORA_MESH_TX_RAW) ? e._pkt._msg._hdr.destinationNode : e._pkt._msg._send.destinationNode);           
       
         }
     }
@@ -1743,7 +3565,7 @@ void LoraWifiMesh::dumpRREQ(RREQ_MSG msg){
    Serial.print (F(" type:"));
    Serial.print(msg.type);   
    Serial.print(F(" path:["));
-   Serial.print( msg.path);
+   for (byte i = 0; i < msg.path.len; i++) Serial.print(msg.path.node[i]);
    Serial.println(F("]"));        
 };
 
@@ -1757,10 +3579,25 @@ void LoraWifiMesh::dumpRREP(RREP_MSG msg){
    Serial.print (F(" type:"));
    Serial.print(msg.type);   
    Serial.print(F(" path:["));
-   Serial.print( msg.path);
+   for (byte i = 0; i < msg.path.len; i++) Serial.print(msg.path.node[i]);
    Serial.println(F("]"));                    
 };
 
+void LoraWifiMesh::dumpView(MSG_VIEW &v){
+   Serial.print (F(" Dump MSG sNode:"));
+   Serial.print((char)v.body->sourceNode);   
+   Serial.print (F(" dNode:"));
+   Serial.print((char)v.body->destinationNode); 
+   Serial.print (F(" uniquw:"));
+   Serial.print(v.body->uniqueId);   
+   Serial.print (F(" type:"));
+   Serial.print(v.body->type);   
+   Serial.print(F(" path:["));
+   for (byte i = 0; i < v.pathLen; i++) Serial.print(v.path[i]);
+   Serial.print(F("] msgLen:"));
+   Serial.println(v.msgLen);
+};
+
 void LoraWifiMesh::dumpHDR(HDR_MSG msg){
    Serial.print (F("Dump HDR  sNode:"));
    Serial.print((char)msg.sourceNode);   
@@ -1780,7 +3617,7 @@ void LoraWifiMesh::dumpNetwork(){
             Serial.print("Node Id:");
             Serial.print( meshNetwork[slot].nodeId);
             Serial.print(" Path:[");
-            Serial.print(meshNetwork[slot].path);
+            for (byte k = 0; k < meshNetwork[slot].path.len; k++) Serial.print(meshNetwork[slot].path.node[k]);
             Serial.print( "] Status [");
             Serial.print(meshNetwork[slot].sts);
             Serial.print("] RSSI[");
@@ -1797,33 +3634,33 @@ void LoraWifiMesh::dumpNetwork(){
     }
 }
 
-bool LoraWifiMesh::checkCRC (char *buff, byte len, char *msg){
-    byte _crc1, _crc0;
+bool LoraWifiMesh::checkCRC (char *buff, byte len, const char *msg){
+    uint32_t _crc1, _crc0;
+    byte _dataLen = len;
+    HDR_MSG *hdr = (HDR_MSG *)buff;
 
-    Global_Packet pkt;
-    memset(&pkt, 0, sizeof(Global_Packet));
-    memcpy(&pkt, buff, len);
-
-    _crc0 = pkt._send._hdr._crc;
-     pkt._send._hdr._crc = 0xAA;
-    _crc1 = CRC(pkt._bmsg,len);
+    if (CrcMode == LORA_MESH_CRC8) {
+        _crc0 = hdr->_crc;
+    }
+    else {
+        if (len < sizeof(HDR_MSG) + CrcMode) return false;
+        _dataLen = len - CrcMode;
+        _crc0 = 0;
+        for (byte i = 0; i < CrcMode; i++) {
+            _crc0 |= ((uint32_t)(uint8_t)buff[_dataLen + i]) << (8 * i);
+        }
+    }
+    _crc1 = getCRC(buff,_dataLen);
     
     if (_crc1 != _crc0) {
 
-          for(byte slot0 = 0; slot0<LORA_MESH_RECEIVED_QUEUE_SIZE; slot0++) {
-             if (receivedQueue[slot0].sts == LORA_MESH_QUEUE_FREE) {
-                receivedQueue[slot0].sts = LORA_MESH_QUEUE_USED;
-                receivedQueue[slot0]._pkt._pkt.msgId = pkt._send._hdr.msgId;
-                receivedQueue[slot0]._pkt._pkt.sts = ERR_RREQ_CRC_ERR;
-                break;
-             }
-          }
+          queueReceived(hdr->msgId, ERR_RREQ_CRC_ERR, 0, 0);
 
           if ((DebugLevel <= 1) && (DebugLevel >0)){
                 Serial.print(F("Received CRC Error from:" ));
                 Serial.println(msg);
-                Serial.println(pkt._send._hdr._crc,HEX);
-                for (int j=0; j < sizeof(RREQ_Packet); j++) {
+                Serial.println(hdr->_crc,HEX);
+                for (int j=0; j < len; j++) {
                     Serial.print(buff[j],HEX);
                     Serial.print(F(" "));
                  }
@@ -1834,16 +3671,20 @@ bool LoraWifiMesh::checkCRC (char *buff, byte len, char *msg){
           }
     }
             
+    return (_crc1 == _crc0);
 }
 
-byte LoraWifiMesh::getCRC (char *buff, byte len){
-  
-    Global_Packet pkt;
-    memset(&pkt, 0, sizeof(Global_Packet));
-    memcpy(&pkt, buff, len);
-     
-    pkt._send._hdr._crc = 0xAA;
-    byte _crc = CRC(pkt._bmsg,len);    
+/*!
+    @brief  CRC of a datagram computed in place, the header _crc byte is masked with 0xAA while computing
+*/
+
+uint32_t LoraWifiMesh::getCRC (char *buff, byte len){
+    HDR_MSG *hdr = (HDR_MSG *)buff;
+    byte _saved = hdr->_crc;
+
+    hdr->_crc = 0xAA;
+    uint32_t _crc = CRC(buff,len);    
+    hdr->_crc = _saved;
    
     return _crc;
 }
@@ -3,9 +3,15 @@
 
 #ifndef _LORA_WIFI_MESH_H_
 #define _LORA_WIFI_MESH_H_
+
+#if defined(LORA_MESH_HOST)
+#include "LoraWifiMeshHost.h"
+#else
 #include "ArduinoUniqueID.h"
+#endif
 
-#if defined(ESP8266)
+#if defined(LORA_MESH_HOST)
+#elif defined(ESP8266)
 #include <ESP8266WiFi.h>
 extern "C" {
 #include <espnow.h>
@@ -27,7 +33,8 @@ extern "C" {
 #define _HELTEC_ true
 #endif
 
-#if defined ( _HELTEC_)
+#if defined(LORA_MESH_HOST)
+#elif defined ( _HELTEC_)
 #include "heltec.h"
 
 #else
@@ -36,31 +43,70 @@ extern "C" {
 
 #include <string.h>
 #include <stdlib.h>
+#if !defined(LORA_MESH_HOST)
 #include "Arduino.h"
+#endif
+
+#if (!defined(ESP32) || defined(_HELTEC_)) && !defined(LORA_MESH_HOST)
+#define LORA_MESH_HAS_LORA true
+#endif
+#if (defined(ESP8266) || defined(ESP32)) && !defined(LORA_MESH_HOST)
+#define LORA_MESH_HAS_ESPNOW true
+#endif
 
  
 #define VT200  true
 #define WIFI_MAX_MSG_SIZE 200
 
+#include "LoraWifiMeshTransport.h"
+#include "LoraWifiMeshCRC.h"
+
 #define MSG_TYPE byte
 #define DELIVER_STATUS byte
 #define STSCODE byte
 #define QUEUE_STATUS byte
 #define ROUTE_TYPE byte
 
+// message and route request ids, 16 bits unless LORA_MESH_ID_BITS is 8 (the 2020 wire format).
+// Ids wrap: compare them with MESH_ID_NEWER (serial number arithmetic, RFC 1982), never with < or >.
+// New message ids stay below LORA_MESH_ID_LAST, the values above are error codes (negative STSCODE)
+// and LORA_MESH_ID_NEW, "take a new id" for sendMsg.
+#if !defined(LORA_MESH_ID_BITS)
+#define LORA_MESH_ID_BITS 16
+#endif
+#if LORA_MESH_ID_BITS == 8
+#define MSG_ID uint8_t
+#define MSG_ID_DIFF int8_t
+#else
+#define MSG_ID uint16_t
+#define MSG_ID_DIFF int16_t
+#endif
+#define LORA_MESH_ID_NEW ((MSG_ID)~0)
+#define LORA_MESH_ID_LAST ((MSG_ID)-129)
+#define MESH_ID_NEWER(a, b) ((MSG_ID_DIFF)((MSG_ID)(a) - (MSG_ID)(b)) > 0)
+#define MESH_ID_ERROR(id) ((MSG_ID)(id) > LORA_MESH_ID_LAST)
+
+// wire structures are read in place from the receive buffer: no padding, no alignment assumption
+#define LORA_MESH_PACKED __attribute__((packed))
+
 #define LORA_MESH_NODE_TYPE_MASTER 1
 #define LORA_MESH_NODE_TYPE_GENERIC 2
 #define LORA_MESH_NODE_TYPE_END_NODE 4
 #define LORA_MESH_NODE_TYPE_NO_BROADCAST 8
 #define LORA_MESH_NODE_TYPE_NO_ROUTING 16
 
-#define LORA_MESH_MSG_REGISTRATION 1
+#define LORA_MESH_MSG_REGISTRATION 1            // also the body type of a SENDTO carrying a NODE_REGISTRATION
 #define LORA_MESH_MSG_USER 2
 #define LORA_MESH_MSG_RREQ  4
 #define LORA_MESH_MSG_RREP  8
 #define LORA_MESH_MSG_RERR  16
 #define LORA_MESH_MSG_SENDTO  32
 #define LORA_MESH_MSG_ACK 64
+#define LORA_MESH_MSG_PROBE 128
+#define LORA_MESH_MSG_FRAG 3                    // body type of a fragment (hdrType SENDTO) and of its selective ACK (hdrType ACK)
+#define LORA_MESH_MSG_HOP_ACK 5                 // hdrType of a link layer ACK: the header and body of the datagram it confirms
+#define LORA_MESH_MSG_AGGREGATE 6               // hdrType of a frame carrying several datagrams for the same next hop
+#define LORA_MESH_MSG_ACK_LIST 7                // body type of an ACK or SENDTO whose payload ends with end to end ACKs
 
 #define LORA_MESH_MAX_MSG_SIZE 32
 
@@ -71,28 +117,76 @@ extern "C" {
 //---
 #if defined(ARDUINO_ARCH_AVR)
       #define LORA_MESH_MAX_DROPNODES_TABLE_SIZE 4
-      #define LORA_MESH_MAX_ROUTING_PATH_SIZE 8
+      #if !defined(LORA_MESH_MAX_HOPS)
+      #define LORA_MESH_MAX_HOPS 7
+      #endif
+      #if !defined(LORA_MESH_MAX_ROUTING_TABLE_SIZE)
       #define LORA_MESH_MAX_ROUTING_TABLE_SIZE 4
+      #endif
+      #if !defined(LORA_MESH_MSG_QUEUE_SIZE)
       #define LORA_MESH_MSG_QUEUE_SIZE 1
-      #define LORA_MESH_RREQ_QUEUE_SIZE 1
+      #endif
+      #define LORA_MESH_RREQ_SEEN_SIZE 8
+      #define LORA_MESH_HOP_SEEN_SIZE 4
+      #define LORA_MESH_NEIGHBOUR_TABLE_SIZE 4
+      #define LORA_MESH_TX_WHEEL_SIZE 8
+      #define LORA_MESH_RX_RING_SIZE 2
+      #define LORA_MESH_RX_SLOT_SIZE (sizeof(SEND_Packet))
+      #define LORA_MESH_FRAG_SIZE 16
+      #define LORA_MESH_FRAG_TX_SIZE 1
+      #define LORA_MESH_FRAG_RX_SIZE 1
+      #define LORA_MESH_FRAG_BUF_SIZE 128
       #define LORA_MESH_RECEIVED_QUEUE_SIZE 1
+      #define LORA_MESH_DUTY_BUCKETS 6
       #define LORA_MESH_MAX_NETWORK_SIZE 1      
-#elif defined(ESP8266) || defined(ESP32)
+#elif defined(ESP8266) || defined(ESP32) || defined(LORA_MESH_HOST)
       #define LORA_MESH_MAX_DROPNODES_TABLE_SIZE 32
-      #define LORA_MESH_MAX_ROUTING_PATH_SIZE 8
+      #if !defined(LORA_MESH_MAX_HOPS)
+      #define LORA_MESH_MAX_HOPS 15
+      #endif
+      #if !defined(LORA_MESH_MAX_ROUTING_TABLE_SIZE)
       #define LORA_MESH_MAX_ROUTING_TABLE_SIZE 32
+      #endif
+      #if !defined(LORA_MESH_MSG_QUEUE_SIZE)
       #define LORA_MESH_MSG_QUEUE_SIZE 8
-      #define LORA_MESH_RREQ_QUEUE_SIZE 8
+      #endif
+      #define LORA_MESH_RREQ_SEEN_SIZE 32
+      #define LORA_MESH_HOP_SEEN_SIZE 16
+      #define LORA_MESH_NEIGHBOUR_TABLE_SIZE 16
+      #define LORA_MESH_TX_WHEEL_SIZE 64
+      #define LORA_MESH_RX_RING_SIZE 8
+      #define LORA_MESH_RX_SLOT_SIZE WIFI_MAX_MSG_SIZE
+      #define LORA_MESH_FRAG_SIZE 128
+      #define LORA_MESH_FRAG_TX_SIZE 2
+      #define LORA_MESH_FRAG_RX_SIZE 2
+      #define LORA_MESH_FRAG_BUF_SIZE 4096
       #define LORA_MESH_RECEIVED_QUEUE_SIZE 8
+      #define LORA_MESH_DUTY_BUCKETS 12
       #define LORA_MESH_MAX_NETWORK_SIZE 32
 #endif 
 
+// a path holds the originator, the relays and the destination: LORA_MESH_MAX_HOPS + 1 node ids (at most 254)
+#define LORA_MESH_MAX_PATH_NODES (LORA_MESH_MAX_HOPS + 1)
+// size of a path given as a string by the user ("942"), with its terminator
+#define LORA_MESH_MAX_ROUTING_PATH_SIZE (LORA_MESH_MAX_PATH_NODES + 1)
+#if LORA_MESH_MAX_HOPS > 126
+#error "LORA_MESH_MAX_HOPS must be <= 126"
+#endif
+
+// how this node routes the datagrams it originates, LORA_MESH_ROUTING_SOURCE: the whole path in every
+// datagram, LORA_MESH_ROUTING_NEXT_HOP: only a TTL, every relay looks the next hop up in its routing table
+// (AODV like, routes learned from the RREQ / RREP going through). Relays handle both kinds whatever their mode.
+#define LORA_MESH_ROUTING_SOURCE 1
+#define LORA_MESH_ROUTING_NEXT_HOP 2
+#define LORA_MESH_NEXT_HOP_TTL LORA_MESH_MAX_HOPS
+
 #define    LORA_MESH_NODE_UNKOWN 1
 #define    LORA_MESH_NODE_REGISTERED 2
 #define    LORA_MESH_NODE_ALIVE 4
 
 #define    LORA_MESH_QUEUE_FREE  1
 #define    LORA_MESH_QUEUE_USED  2
+#define    LORA_MESH_QUEUE_DELETED  4
 #define    STS_ROUTE_WAITING  32
 #define    STS_ROUTE_MISSING  64
 #define    STS_ROUTE_UPDATED  128
@@ -101,10 +195,147 @@ extern "C" {
 #define LORA_MESH_QUEUE_TYPE_MSG 2
 #define LORA_MESH_QUEUE_TYPE_REQ 4
 
-#define LORA_MESH_RREQ_QUEUE_TIMEOUT 6000
+// route cost = hops * HOP + weak signal penalty + lost ACK penalty, lower wins
+#define LORA_MESH_ROUTE_COST_HOP 16
+#define LORA_MESH_ROUTE_COST_RSSI_FLOOR -100
+#define LORA_MESH_ROUTE_COST_SNR_FLOOR 0
+#define LORA_MESH_ROUTE_COST_LOSS 48
+
+#define LORA_MESH_RREQ_SEEN_TIMEOUT 6000
 #define LORA_MESH_MSG_QUEUE_TIMEOUT 10000
+
+// transmit scheduler: priority classes (lower is served first), timer wheel resolution and retry backoff
+// retry n waits retryInterval << min(n - 1, backoffShiftMax) plus random(0, retryJitter)
+#define LORA_MESH_PRIO_CONTROL 0
+#define LORA_MESH_PRIO_REGISTRATION 1
+#define LORA_MESH_PRIO_DATA 2
+#define LORA_MESH_PRIO_CLASSES 3
+#define LORA_MESH_TX_WHEEL_TICK 16
+#define LORA_MESH_TX_BACKOFF_SHIFT_MAX 2
+#define LORA_MESH_TX_RETRY_JITTER 500
+#define LORA_MESH_TX_PER_YIELD 4
+
+#define LORA_MESH_TX_AWAIT_ACK 1           // user message: retried until its ACK, then reported
+#define LORA_MESH_TX_RAW 2                 // frame already encoded, sent once as is
+#define LORA_MESH_TX_SOURCE_ROUTE 4        // path given by the user: source routed whatever the routing mode
+#define LORA_MESH_TX_HOP_WATCH 8           // sent, waiting to hear hopNode pass it on
+#define LORA_MESH_TX_HOP_HEARD 16          // something was heard from hopNode meanwhile, it is alive
+#define LORA_MESH_TX_REPAIR 32             // relayed datagram held until a route to its destination shows up
+
+// route failure: a datagram sent to a next hop is kept until that node is heard passing it on (relaying it, or
+// the destination's ACK). Nothing heard from it after LORA_MESH_HOP_RETRIES more sends LORA_MESH_HOP_ACK_TIMEOUT
+// apart and the link is broken: the routes through it are dropped and a relay sends a RERR back to the originator,
+// with next hop routing it first tries a local route request for up to LORA_MESH_LOCAL_REPAIR_TIMEOUT, when the
+// destination is at most LORA_MESH_LOCAL_REPAIR_MAX_HOPS away (further, the originator's rediscovery is cheaper).
+#define LORA_MESH_HOP_ACK_TIMEOUT 1000
+#define LORA_MESH_HOP_RETRIES 1
+#define LORA_MESH_LOCAL_REPAIR_TIMEOUT 3000
+#define LORA_MESH_LOCAL_REPAIR_MAX_HOPS 3
+#define LORA_MESH_RERR_INTERVAL 1000       // at most one RERR per (originator, destination) in that time
+
+// hop ACKs (hopAck, must match on every node): the next hop answers a datagram (or an end to end ACK) with a
+// LORA_MESH_MSG_HOP_ACK right away, so the watch above becomes a link layer retransmission. Its timer is the
+// neighbour's round trip estimate srtt + 4 * rttvar, at least LORA_MESH_HOP_RTO_MIN over srtt (the answer may
+// wait behind a frame of the neighbour) and at most hopAckTimeout, which is also the timer before the first
+// sample. Over a weak link (RSSI or SNR less than LORA_MESH_HOP_WEAK_MARGIN above the route cost floors) a
+// missing hop ACK is more likely a lost frame than a dead node: LORA_MESH_HOP_ACK_RETRIES_WEAK tries, the timer
+// doubled each time. Copies heard again within retryInterval / 2 are answered but not relayed or delivered twice.
+#define LORA_MESH_HOP_ACK_RETRIES 3
+#define LORA_MESH_HOP_ACK_RETRIES_WEAK 5
+#define LORA_MESH_HOP_RTO_MIN 50
+#define LORA_MESH_HOP_WEAK_MARGIN 10
+
+// aggregation (aggDelay > 0): a unicast frame waits aggDelay ms in the scheduler, then goes on the air together
+// with every other datagram due for the same next hop within that budget: one HDR_MSG of hdrType
+// LORA_MESH_MSG_AGGREGATE, then the datagrams back to back (each one starts with its own HDR_MSG, len included),
+// one preamble and one CRC for all of them, LORA_MESH_AGG_MAX_SIZE bytes at most.
+// Every node splits the aggregates it receives, whatever its own aggDelay.
+#define LORA_MESH_AGG_DELAY 50                  // suggested aggDelay for LoRa (ms)
+#define LORA_MESH_AGG_MAX_SIZE LORA_MESH_RX_SLOT_SIZE
+
+// delayed ACKs (ackDelay > 0): the destination holds its end to end ACK ackDelay ms. A message of the same
+// originator arriving meanwhile adds its id to the ACK still waiting (cumulative ACK), a message this node sends
+// to the originator meanwhile takes them all along (piggy-backed) and the ACK frame is dropped. Either datagram
+// gets body type LORA_MESH_MSG_ACK_LIST, its payload ends with MSG_ID ids[n] | status | n (a cumulative ACK
+// no longer carries the copy of the message). Keep ackDelay well under hopAckTimeout.
+#define LORA_MESH_ACK_LIST_MAX ((LORA_MESH_MAX_MSG_SIZE - 3) / sizeof(MSG_ID))
+
+// duty cycle (dutyCycle per-mille > 0, LoRa only): every frame's time on air is computed from the modem parameters
+// (nc.modem) and its length, and summed over a rolling window of dutyCycleWindow ms (LORA_MESH_DUTY_BUCKETS buckets).
+// Before a frame goes on the air the transmit governor checks it fits in the budget, window * dutyCycle / 1000:
+// control frames (ACK, RREP, RERR, hop ACK) may use all of it, registration and data only LORA_MESH_DUTY_LOW_SHARE
+// percent, so the low priority traffic is deferred first and the answers still get through. A deferred frame waits
+// in the scheduler until enough airtime leaves the window, it isn't dropped and its retries aren't spent.
+#define LORA_MESH_DUTY_WINDOW 3600000           // ETSI EN 300 220: one hour
+#define LORA_MESH_DUTY_LOW_SHARE 90
+
+// adaptive data rate (adr, LoRa with hopAck): a hop ACK ends with LORA_MESH_ADR_REPORT_SIZE bytes, the SNR the
+// datagram was received with and the spreading factors the answering node listens on (bit sf - 6, 0: only the
+// one of its modem, a SX127x listens on one SF). A unicast frame then goes to that neighbour at the lowest SF it
+// listens on and the lowest power (txPowerMin..txPower) keeping the SNR predicted from the report
+// LORA_MESH_ADR_MARGIN dB over the demodulation floor of the SF, plus an extra margin of the link: raised
+// LORA_MESH_ADR_STEP dB by each missing hop ACK while the delivery ratio to that neighbour is under adrTarget
+// percent, lowered 1 dB after LORA_MESH_ADR_GOOD_RUN hop ACKs in a row. Broadcasts, hop retransmissions and
+// neighbours without a report get the configured modem at txPower. Every node reads the reports.
+// The destination of a datagram (answered by its end to end ACK) sends a hop ACK for the report alone when the
+// previous hop never got one, the last one is LORA_MESH_ADR_REPORT_INTERVAL old or the SNR moved
+// LORA_MESH_ADR_REPORT_DELTA dB since.
+#define LORA_MESH_ADR_REPORT_SIZE 2
+#define LORA_MESH_ADR_REPORT_INTERVAL 600000
+#define LORA_MESH_ADR_REPORT_DELTA 3
+#define LORA_MESH_ADR_MARGIN 3
+#define LORA_MESH_ADR_STEP 3
+#define LORA_MESH_ADR_MARGIN_MAX 15
+#define LORA_MESH_ADR_GOOD_RUN 8
+#define LORA_MESH_ADR_TARGET 90
+#define LORA_MESH_TX_POWER 17                   // dBm, the LoRa library default
+#define LORA_MESH_TX_POWER_MIN 2
+
+// listen before talk (csma): before a frame goes on the air the transport checks the channel (LoRa: channel activity
+// detection), a busy channel puts the frame back in the scheduler for a random number of slots (csmaSlot ms, 0: the
+// airtime of a LORA_MESH_WIRE_FIXED_SIZE frame) out of a window of LORA_MESH_CSMA_CW_MIN slots per neighbour heard
+// in the last LORA_MESH_CSMA_NEIGHBOUR_AGE ms, doubled by each busy check up to LORA_MESH_CSMA_CW_MAX. After
+// LORA_MESH_CSMA_MAX_BACKOFFS the frame goes anyway. Broadcasts (RREQ floods and their rebroadcasts) first wait
+// 0..LORA_MESH_CSMA_FLOOD_SLOTS slots per neighbour, so the neighbours relaying the same flood spread out.
+#define LORA_MESH_CSMA_CW_MIN 2
+#define LORA_MESH_CSMA_CW_MAX 64
+#define LORA_MESH_CSMA_MAX_BACKOFFS 6
+#define LORA_MESH_CSMA_FLOOD_SLOTS 4
+#define LORA_MESH_CSMA_NEIGHBOUR_AGE 600000
+
+// RREQ flood suppression: a relayed RREQ waits a random time of the assessment window (rreqWindow ms, 0:
+// LORA_MESH_RREQ_WINDOW_SLOTS backoff slots) and is dropped when rreqCounter copies of it were heard meanwhile
+// (counter based). With rreqDistance the wait grows with the RSSI of the copy received first, over
+// LORA_MESH_RREQ_RSSI_SPAN dB above LORA_MESH_ROUTE_COST_RSSI_FLOOR: the farthest nodes rebroadcast first and
+// cover the most new ground. rreqGossip relays a RREQ with that probability (%) once it walked
+// LORA_MESH_RREQ_GOSSIP_HOPS hops, so the flood doesn't die out next to the originator.
+#define LORA_MESH_RREQ_WINDOW_SLOTS 8
+#define LORA_MESH_RREQ_RSSI_SPAN 60
+#define LORA_MESH_RREQ_GOSSIP_HOPS 1
+
+// deferred sends (ms) replacing the old delay() calls: RREP, ACK and its repeated copy
+#define LORA_MESH_RREP_DELAY 2
+#define LORA_MESH_ACK_DELAY 1
+#define LORA_MESH_ACK_REPEAT_DELAY 2
+
+// fragmentation: a long message is cut in at most LORA_MESH_FRAG_MAX fragments of LORA_MESH_FRAG_SIZE bytes,
+// sent in rounds of the fragments not yet confirmed, the last one of a round asks for a selective ACK (bitmap
+// of the fragments received). LORA_MESH_FRAG_RX_SIZE reassembly buffers of LORA_MESH_FRAG_BUF_SIZE bytes.
+#define LORA_MESH_FRAG_MAX 32
+#define LORA_MESH_FRAG_HDR_SIZE 6
+#define LORA_MESH_FRAG_ACK_REQ 1
+#define LORA_MESH_FRAG_PER_YIELD 1
+#define LORA_MESH_FRAG_RX_TIMEOUT 60000
+#define LORA_MESH_FRAG_RX_STALE 5000         // ms without progress before a newer transfer of the same originator takes the buffer
+
+// received frames processed per yield() out of the receive ring
+#define LORA_MESH_RX_PER_YIELD 4
 #define LORA_MESH_KEEP_ALIVE_INTERVAL 30000
-#define LORA_MESH_QUEUE_INTERVAL_RESET 120000
+// a learned route lives LORA_MESH_ROUTE_TTL after its last confirmation (RREP or ACK), it is probed
+// LORA_MESH_ROUTE_REFRESH before that when it's in use; LORA_MESH_ROUTE_AGING_STEP entries are aged per yield()
+#define LORA_MESH_ROUTE_TTL 120000
+#define LORA_MESH_ROUTE_REFRESH 20000
+#define LORA_MESH_ROUTE_AGING_STEP 4
 
 #define ERR_MSG_NOT_FOR_ME -1
 #define ERR_DROP_DUE_TO_RULES -2
@@ -135,6 +366,7 @@ extern "C" {
 #define      STS_MSG_ACK_RECEIVED  41
 
 #define      STS_MSG_ACK_REGISTRATION_DONE 42
+#define      STS_LONG_MSG_RECEIVED 43
 
       /* error codes */      
 #define      CRC_ERR  -1
@@ -143,6 +375,7 @@ extern "C" {
 #define      RREQ_QUEUE_FULL  -52
 #define      MSG_QUEUE_FULL  -53
 #define      NETWORK_QUEUE_FULL -54
+#define      MSG_TOO_BIG -55
 
 #define      ERR_NO_MSG  -70
 #define      ERR_MSG_NOT_FOR_ME  -71
@@ -150,6 +383,7 @@ extern "C" {
 #define      ERR_DUP_RREQ  -73
 #define      ERR_DROP_ROUTING  -74
 #define      ERR_RREQ_CRC_ERR  -75
+#define      ERR_DUP_MSG  -76
 
 #define      DROP_MSG_DUE_TO_FILTER_RULES  -90
 
@@ -159,26 +393,32 @@ extern "C" {
 #define ROUTE_DYNAMIC  1
 #define ROUTE_STATIC  2
 
-#define STS_RR_TO_BE_SENT 1
-#define STS_RR_SENT 2
 #define STS_NONE 0
 
 #define LORA_MESH_SEND_MSG_RETRY_COUNT 8
 
+// hop list: the number of nodes then their ids, the same bytes as pathLen | path on the wire.
+// Any node id but 0x00 (no node) can be in a path, it isn't a string.
+typedef struct MESH_PATH {
+        uint8_t len;
+        char node[LORA_MESH_MAX_PATH_NODES];
+};
+
 typedef struct NODES {
         uint8_t nodeId ; //= 0x00;
         uint8_t macAddress[6] ; //= {0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
         long lastKeepAlive;
         long RSSI;
         STSCODE sts ; //= 0x00;
-        char path[LORA_MESH_MAX_ROUTING_PATH_SIZE];
+        MESH_PATH path;
 };
 
 
 typedef struct RECEIVED_MSG {
-        uint8_t msgId;
+        MSG_ID msgId;
         
         STSCODE sts;
+        uint8_t len;                  // bytes of msg in use, msg is binary (not NUL terminated when full)
         char msg[LORA_MESH_MAX_MSG_SIZE];
 };
 
@@ -191,32 +431,70 @@ typedef struct RECEIVED_TABLE {
       QUEUE_STATUS sts = LORA_MESH_QUEUE_FREE;
       RECEIVED_Packet _pkt;
       };
+
+// first bytes of the payload of a LORA_MESH_MSG_FRAG datagram, the fragment data follows
+typedef struct FRAG_HDR {
+      uint8_t index;
+      uint8_t count;
+      uint8_t fragSize;             // data bytes per fragment, the last one can be shorter
+      uint8_t flags;                // LORA_MESH_FRAG_ACK_REQ
+      uint16_t totalLen;
+      };
+
+// a long message being sent, the data stays in the caller buffer until the completion event
+typedef struct FRAG_TX {
+      const uint8_t *data;
+      uint16_t len;
+      uint8_t destNode;
+      MSG_ID uniqueId;
+      uint8_t count;
+      uint32_t acked;               // bit i: fragment i confirmed by a selective ACK
+      uint8_t next;                 // next fragment of the current round, count when the round is over
+      uint8_t retryCount;
+      long deadline;                // new round when no selective ACK came back by then
+      MESH_PATH path;
+      bool sourceRoute;             // path given by the user
+      QUEUE_STATUS sts = LORA_MESH_QUEUE_FREE;
+      };
+
+// a long message being reassembled, or complete and waiting for readLongMsg()
+typedef struct FRAG_RX {
+      uint8_t sourceNode;
+      MSG_ID uniqueId;
+      uint16_t len;
+      uint8_t count;
+      uint32_t received;
+      bool done;
+      long timeStamp;
+      uint8_t buf[LORA_MESH_FRAG_BUF_SIZE];
+      QUEUE_STATUS sts = LORA_MESH_QUEUE_FREE;
+      };
       
 typedef struct HDR_MSG {
       MSG_TYPE hdrType;
       uint8_t len;
       uint8_t sourceNode;   
       uint8_t destinationNode; 
-      uint8_t msgId;
+      MSG_ID msgId;
         byte _crc;
         
-      };
+      } LORA_MESH_PACKED;
 
 typedef struct RREQ_MSG {
       uint8_t sourceNode;   
       uint8_t destinationNode; 
-      uint8_t uniqueId;   
+      MSG_ID uniqueId;   
       MSG_TYPE type;
-      char path[LORA_MESH_MAX_ROUTING_PATH_SIZE];
+      MESH_PATH path;
       char msg[LORA_MESH_MAX_MSG_SIZE];
       };
 
 typedef struct RREP_MSG {
       uint8_t sourceNode;   
       uint8_t destinationNode; 
-      uint8_t uniqueId;   
+      MSG_ID uniqueId;   
       MSG_TYPE type;
-      char path[LORA_MESH_MAX_ROUTING_PATH_SIZE];
+      MESH_PATH path;
       char msg[LORA_MESH_MAX_MSG_SIZE];
     };
 
@@ -230,9 +508,9 @@ typedef struct HI_MSG {
 typedef struct SENDTO_MSG {
       uint8_t sourceNode;   
       uint8_t destinationNode; 
-      uint8_t uniqueId;   
+      MSG_ID uniqueId;   
       MSG_TYPE type;
-      char path[LORA_MESH_MAX_ROUTING_PATH_SIZE];   
+      MESH_PATH path;   
       char msg[LORA_MESH_MAX_MSG_SIZE];
       };
       
@@ -254,38 +532,110 @@ typedef struct SENDTO_MSG {
 
 typedef union SEND_Packet{
       SEND_DATAGRAM _msg;
-      char _bmsg[sizeof(SEND_DATAGRAM)];
+      char _bmsg[sizeof(SEND_DATAGRAM) + LORA_MESH_CRC_MAX_SIZE];
      };
      
-typedef struct QUEUE_MSG {
-      SEND_Packet _pkt;
-      uint8_t retryCount;
-      long timeStamp;
-      QUEUE_STATUS sts = LORA_MESH_QUEUE_FREE;
-      };
-    
 typedef union RREQ_Packet{
       RREQ_DATAGRAM _msg;
-      char  _bmsg[sizeof(RREQ_DATAGRAM)];
+      char  _bmsg[sizeof(RREQ_DATAGRAM) + LORA_MESH_CRC_MAX_SIZE];
       };
 
 typedef union RREP_Packet{
       RREP_DATAGRAM _msg;
-      char _bmsg[sizeof(RREQ_DATAGRAM)];
+      char _bmsg[sizeof(RREP_DATAGRAM) + LORA_MESH_CRC_MAX_SIZE];
       };
 
-typedef union RR_Packet{
-      RREQ_DATAGRAM _rreq;
-      RREP_DATAGRAM _rrep;
-      char _bmsg[sizeof(SEND_DATAGRAM)];
-     };
+// body prefix shared by RREQ / RREP / ACK / SENDTO
+typedef struct BODY_MSG {
+      uint8_t sourceNode;   
+      uint8_t destinationNode; 
+      MSG_ID uniqueId;   
+      MSG_TYPE type;
+      } LORA_MESH_PACKED;
+
+// compact wire layout: HDR_MSG | BODY_MSG | route | path[pathLen] | msg[HDR_MSG.len - LORA_MESH_WIRE_FIXED_SIZE - pathLen]
+// route is the number of nodes of the source route that follows, or LORA_MESH_ROUTE_NEXT_HOP | TTL
+// for a datagram forwarded by the routing tables of the relays (no path on the wire)
+#define LORA_MESH_WIRE_FIXED_SIZE (sizeof(HDR_MSG) + sizeof(BODY_MSG) + 1)
+#define LORA_MESH_ROUTE_NEXT_HOP 0x80
+#define LORA_MESH_ROUTE_TTL_MASK 0x7F
+
+// view over a received datagram: pointers into the receive buffer
+typedef struct MSG_VIEW {
+      HDR_MSG *hdr;
+      BODY_MSG *body;
+      uint8_t *route;               // the route byte on the wire
+      byte pathLen;                 // nodes in path, 0 for a next hop datagram
+      char *path;
+      char *msg;
+      byte msgLen;
+      };
      
-typedef struct RREQ_TABLE {
-      RR_Packet _rr;
-      uint8_t uniqueId;
-      uint8_t retryCount;
+// one datagram waiting in the transmit scheduler (see LoraWifiMeshScheduler.h)
+typedef struct TX_ENTRY {
+      SEND_Packet _pkt;             // LORA_MESH_TX_RAW: the wire frame, otherwise the datagram in the fixed structs
+      byte len;                     // wire frame size (RAW) or payload size
+      byte ackLen;                  // ACK list after the payload (LORA_MESH_MSG_ACK_LIST), not RAW
+      MSG_ID uniqueId;
+      uint8_t priority;
+      uint8_t flags;
+      uint8_t retryCount;           // transmissions done
+      long deadline;
+      long timeStamp;               // first transmission
+      long retryAt;                 // end to end retry of a user message while its next hop is watched
+      uint8_t hopNode;              // next hop of LORA_MESH_TX_HOP_WATCH
+      uint8_t hopTries;             // sends to hopNode so far
+      long hopAt;                   // last send to hopNode, round trip sample of its hop ACK
+      uint8_t backoffs;             // busy channel checks of the current send
+      uint8_t next;                 // scheduler links
+      uint8_t prev;
+      uint8_t hashNext;
+      uint8_t where;
+      QUEUE_STATUS sts = LORA_MESH_QUEUE_FREE;
+      } ;
+
+#include "LoraWifiMeshScheduler.h"
+#include "LoraWifiMeshRing.h"
+#include "LoraWifiMeshAirtime.h"
+
+// route requests already handled, (originator, uniqueId) pairs in a ring, oldest overwritten first
+typedef struct RREQ_SEEN {
+      uint8_t originator;
+      MSG_ID uniqueId;
+      long timeStamp;
+      uint8_t copies;               // heard so far, rreqCounter
+      QUEUE_STATUS sts = LORA_MESH_QUEUE_FREE;
+      } ;
+
+// datagrams this node answered with a hop ACK: (originator, uniqueId, hdrType) in a ring, oldest overwritten first
+typedef struct HOP_SEEN {
+      uint8_t originator;
+      MSG_ID uniqueId;
+      uint8_t hdrType;
       long timeStamp;
-      DELIVER_STATUS _deliveredStatus = STS_NONE;
+      QUEUE_STATUS sts = LORA_MESH_QUEUE_FREE;
+      } ;
+
+// nodes heard directly: link quality and hop ACK round trip estimate (ms, srtt 0 until the first sample)
+typedef struct NEIGHBOUR {
+      uint8_t node;
+      long lastHeard;
+      int16_t rssi;                 // dBm, 0 = unknown
+      int8_t snr;
+      uint16_t srtt;
+      uint16_t rttvar;
+      uint8_t txSf;                 // adaptive data rate: SF and power of the last frame sent to it ...
+      int8_t txPower;
+      uint8_t rptSf;                // ... the ones of the frame its last report is about (0: no report yet)
+      int8_t rptPower;
+      int8_t rptSnr;                // SNR it reported (dB)
+      uint8_t rxSfMask;             // spreading factors it listens on, bit sf - 6 (0: only our modem's)
+      uint8_t pdr;                  // hop ACK delivery ratio (%, average over about 8 frames)
+      uint8_t adrMargin;            // extra dB of the link
+      uint8_t goodRun;              // hop ACKs in a row
+      bool reported;                // a report was sent to it ...
+      long reportAt;                // ... then, with that SNR
+      int8_t reportSnr;
       QUEUE_STATUS sts = LORA_MESH_QUEUE_FREE;
       } ;
 
@@ -294,13 +644,25 @@ typedef struct ROUTING_TABLE {
       long timeStamp; 
       ROUTE_TYPE type;
       QUEUE_STATUS sts = LORA_MESH_QUEUE_FREE;
-      char path[LORA_MESH_MAX_ROUTING_PATH_SIZE];
+      MESH_PATH path;
+      uint8_t hops;                 // path length - 1
+      long lastUsed;                // last time a message was sent over the route
+      int16_t rssi;                 // last RSSI heard from the route next hop (dBm, 0 = unknown)
+      int8_t snr;                   // last SNR heard from the route next hop (dB)
+      uint8_t ackSent;              // messages sent over the route ...
+      uint8_t ackOk;                // ... and acknowledged (both halved when ackSent saturates)
+      long probeAt;                 // last refresh probe sent over the route
+      MSG_ID seqNo;                 // sequence number of destNode the route was learned with (seqValid)
+      bool seqValid;
       } ;
+
+#include "LoraWifiMeshRoutes.h"
+
 typedef union Global_Packet{
       SEND_DATAGRAM _send;
       RREQ_DATAGRAM _rreq;
       RREP_DATAGRAM _rrep;
-      char _bmsg[sizeof(SEND_DATAGRAM)];
+      char _bmsg[sizeof(SEND_DATAGRAM) + LORA_MESH_CRC_MAX_SIZE];
      };
 typedef struct  NODE_FILTER {
     uint8_t _sourceAddr;   
@@ -315,7 +677,6 @@ typedef struct NODE_REGISTRATION {
         long lastKeepAlive;
         byte RSSI;
         STSCODE sts;
-        char path[LORA_MESH_MAX_ROUTING_PATH_SIZE];
 };
 
 
@@ -339,12 +700,35 @@ typedef struct NODE_CONFIGURATION {
         long      band                = 433E6;
         uint8_t   maxMsgRetry         = LORA_MESH_SEND_MSG_RETRY_COUNT;
         long      retryInterval       = LORA_MESH_MSG_QUEUE_TIMEOUT;
+        uint8_t   backoffShiftMax     = LORA_MESH_TX_BACKOFF_SHIFT_MAX;
+        long      retryJitter         = LORA_MESH_TX_RETRY_JITTER;
         bool      keepAlive           = true;
         long      keepAliveInterval   = LORA_MESH_KEEP_ALIVE_INTERVAL;
         uint8_t   debugLevel         = 0;
         char      pathToMaster[LORA_MESH_MAX_ROUTING_PATH_SIZE];
         uint8_t   blockNodes[LORA_MESH_MAX_BLOCK_NODES]  = {0x00, 0x00, 0x00, 0x00, 0x00,0x00, 0x00, 0x00};
         uint8_t   blockBroadcast[LORA_MESH_MAX_BLOCK_NODES] =  {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};     
+        uint8_t   crcMode             = LORA_MESH_CRC8;      // LORA_MESH_CRC8 | LORA_MESH_CRC16 | LORA_MESH_CRC32, must match on every node
+        uint8_t   routingMode         = LORA_MESH_ROUTING_SOURCE;   // LORA_MESH_ROUTING_SOURCE | LORA_MESH_ROUTING_NEXT_HOP
+        long      hopAckTimeout       = LORA_MESH_HOP_ACK_TIMEOUT;  // 0: next hops are not watched, no RERR
+        bool      localRepair         = true;
+        bool      hopAck              = false;                      // link layer hop ACKs, must match on every node
+        long      aggDelay            = 0;                          // ms a frame may wait for others to the same next hop, 0: no aggregation
+        long      ackDelay            = 0;                          // ms an end to end ACK waits for others or for data going back, 0: right away
+        LORA_MODEM modem              = {7, 125000, 5, 8, false};  // as set on the LoRa radio, for the airtime (sf 0: these defaults)
+        uint16_t  dutyCycle           = 0;                          // per-mille of dutyCycleWindow on the air (10: 1%), 0: no limit
+        long      dutyCycleWindow     = LORA_MESH_DUTY_WINDOW;      // ms
+        bool      adr                 = false;                      // adaptive SF and power per neighbour (LoRa, hopAck)
+        int8_t    txPower             = LORA_MESH_TX_POWER;         // dBm, broadcasts and the adr ceiling
+        int8_t    txPowerMin          = LORA_MESH_TX_POWER_MIN;     // dBm, adr floor
+        uint8_t   adrTarget           = LORA_MESH_ADR_TARGET;       // % of hop ACKs a link should get
+        bool      rxInterrupt         = false;                      // LoRa: DIO0 interrupt fills the receive ring, no more LoRa.parsePacket()
+        bool      csma                = false;                      // listen before talk, random backoff on a busy channel
+        long      csmaSlot            = 0;                          // ms, 0: airtime of a header-only frame (LoRa), 1 ms (ESP_NOW)
+        uint8_t   rreqCounter         = 0;                          // a RREQ relay is dropped once that many copies were heard, 0: always relayed
+        uint8_t   rreqGossip          = 0;                          // % of the RREQs relayed past the first hops, 0: all
+        bool      rreqDistance        = false;                      // RREQ relays wait longer the stronger the signal, far nodes first
+        long      rreqWindow          = 0;                          // ms a RREQ relay may wait, 0: LORA_MESH_RREQ_WINDOW_SLOTS backoff slots
 };
 
  typedef struct netInfo {
@@ -353,6 +737,40 @@ typedef struct NODE_CONFIGURATION {
           char path[4];
    };
 
+typedef struct LORA_MESH_STATS {
+        unsigned long rreqSent;           // route requests originated
+        unsigned long rreqRelayed;        // route requests re-broadcast
+        unsigned long rreqDuplicates;     // route requests dropped by the seen set
+        unsigned long rreqSuppressed;     // route requests not re-broadcast: enough copies heard, or gossip
+        unsigned long routesLearned;      // routes added or replaced from a RREP
+        unsigned long routesRefreshed;    // routes confirmed again by an ACK or a probe ACK
+        unsigned long routesExpired;      // routes evicted or sent to rediscovery by the aging
+        unsigned long probesSent;
+        unsigned long probesAcked;
+        unsigned long rxDropped;          // frames lost because the receive ring was full
+        unsigned long forwardDrops;       // next hop datagrams a relay had no route for, or whose TTL ran out
+        unsigned long hopRetries;         // datagrams sent again to a next hop that wasn't heard passing them on
+        unsigned long linkBreaks;         // next hops found silent, their routes dropped
+        unsigned long rerrSent;
+        unsigned long rerrReceived;       // at the originator
+        unsigned long localRepairs;       // held datagrams forwarded again after a local route request
+        unsigned long hopAcksSent;
+        unsigned long hopAcksReceived;    // hop ACKs that confirmed a watched datagram
+        unsigned long hopDuplicates;      // copies of an answered datagram, acknowledged again and dropped
+        unsigned long aggFramesSent;      // aggregates sent ...
+        unsigned long aggDatagrams;       // ... and the datagrams they carried
+        unsigned long aggReceived;        // aggregates addressed to this node
+        unsigned long acksCoalesced;      // end to end ACKs added to an ACK still waiting
+        unsigned long acksPiggybacked;    // end to end ACKs sent along with data to their originator
+        unsigned long airtime;            // ms on the air (LoRa), since start
+        unsigned long txDeferred;         // frames put back in the scheduler by the duty cycle governor
+        unsigned long dutyDrops;          // frames dropped: no room in the scheduler and no airtime left
+        unsigned long adrFrames;          // unicast frames sent at a lower SF or power than the configured ones
+        unsigned long adrReports;         // link reports received in hop ACKs
+        unsigned long txBackoffs;         // frames put back in the scheduler: the channel was busy
+        unsigned long csmaForced;         // frames sent on a busy channel after LORA_MESH_CSMA_MAX_BACKOFFS
+};
+
 typedef union NET {
   netInfo meshNetwork[LORA_MESH_MAX_NETWORK_SIZE];
   char _bmsg[sizeof(netInfo)*LORA_MESH_MAX_NETWORK_SIZE];
@@ -364,6 +782,7 @@ class LoraWifiMesh {
   public:  
     int totalRetry = 0;
     int totalCRC = 0;
+    LORA_MESH_STATS stats = {};
     bool netUpdate = false;
     byte Protocol = MESH_PROTOCOL_LORA;
     long Band = 433E6;
@@ -379,15 +798,17 @@ class LoraWifiMesh {
     ~LoraWifiMesh();
 
     
-    byte getRREQ(uint8_t destinationAddress);
+    MSG_ID getRREQ(uint8_t destinationAddress);
     bool hasMsg( RECEIVED_Packet *rec, int packetSize = 0);
-    byte sendMsg(uint8_t destAddr, char *, char *path = "\0", byte uni = 0xFF, byte ret = 0xFF);
+    MSG_ID sendMsg(uint8_t destAddr, char *, char *path = "\0", MSG_ID uni = LORA_MESH_ID_NEW, byte ret = 0xFF);
+    MSG_ID sendMsg(uint8_t destAddr, const uint8_t *data, size_t len, const char *path = "\0", MSG_ID uni = LORA_MESH_ID_NEW);
 
     void setupNode(byte protocol, long band = 0);
     void stringSts(uint8_t sts);
     void dumpHDR(HDR_MSG msg);
     void dumpRREQ(RREQ_MSG msg);
     void dumpRREP(RREP_MSG msg);
+    void dumpView(MSG_VIEW &v);
     void dumpRTable();
     void dumpRREQTable();
     void dumpMSGTable();
@@ -397,54 +818,192 @@ class LoraWifiMesh {
 
 
     STSCODE setConfig(NODE_CONFIGURATION nc);
-    STSCODE registerNode(USER_PACKET up);
-    STSCODE doMsg(RREP_Packet *ack);    
+    STSCODE registerNode(USER_PACKET up, const MESH_PATH &path);
+    STSCODE doMsg(char *msg, const MESH_PATH &path);    
     STSCODE init(byte protocol);
     STSCODE setProtocol(byte protocol);
     STSCODE initAddress(uint8_t locAdd);
     STSCODE yield();  
     STSCODE processMsg(int packetSize, uint8_t *msg = 0x00);
+    bool pushFrame(const uint8_t *data, int len, int16_t rssi = 0, int8_t snr = 0);
+    MSG_ID sendLongMsg(uint8_t destination, const uint8_t *data, uint16_t len, const char *path = "\0");
+    uint16_t readLongMsg(RECEIVED_Packet *rec, uint8_t *buf, uint16_t maxLen);
     STSCODE addStaticRoute (uint8_t destAddr, char * path );
     STSCODE dropBroadcastNode (uint8_t sourceAddr, uint8_t destAddr = 0x00);
     STSCODE dropSourceNode (uint8_t sourceAddr);
     STSCODE setDebugLevel(byte DebugLevel = 0);
     STSCODE addNodeToNetwork(uint8_t nodeId, char *mac,byte protocol);
+    STSCODE setTransport(LoraWifiMeshTransport *transport);
+    unsigned long airtimeUsed();
+    unsigned long airtimeBudget();
+    bool linkParams(uint8_t node, uint8_t &sf, int8_t &power);
   
   private:
     byte DebugLevel = 0;
     bool KeepAlive = true;
     long RetryInterval = LORA_MESH_MSG_QUEUE_TIMEOUT;
     long _lastKeepAlive;
-    long _lastReset;
-    long ResetInterval = LORA_MESH_QUEUE_INTERVAL_RESET;
+    long RouteTtl = LORA_MESH_ROUTE_TTL;
+    uint16_t _agingCursor = 0;
     uint8_t NodeType = LORA_MESH_NODE_TYPE_GENERIC;
     uint8_t MasterNode;
     uint8_t MaxMsgRetry = LORA_MESH_SEND_MSG_RETRY_COUNT;
-
-    uint8_t _uniqRReqId = 0x00;
-    uint8_t _uniqMsgId = 0x00;
+    uint8_t BackoffShiftMax = LORA_MESH_TX_BACKOFF_SHIFT_MAX;
+    long RetryJitter = LORA_MESH_TX_RETRY_JITTER;
+    uint8_t CrcMode = LORA_MESH_CRC8;
+    uint8_t RoutingMode = LORA_MESH_ROUTING_SOURCE;
+    long HopAckTimeout = LORA_MESH_HOP_ACK_TIMEOUT;
+    bool LocalRepair = true;
+    bool HopAck = false;
+    long AggDelay = 0;
+    long AckDelay = 0;
+    LORA_MODEM Modem = {7, 125000, 5, 8, false};
+    uint16_t DutyCycle = 0;
+    long DutyCycleWindow = LORA_MESH_DUTY_WINDOW;
+    MeshDutyCycle<> dutyWindow;
+    unsigned long _airtimeUs = 0;         // remainder of stats.airtime under one ms
+    bool Adr = false;
+    int8_t TxPower = LORA_MESH_TX_POWER;
+    int8_t TxPowerMin = LORA_MESH_TX_POWER_MIN;
+    uint8_t AdrTarget = LORA_MESH_ADR_TARGET;
+    bool _txRobust = false;               // next _send is a retransmission: configured modem, txPower
+    bool RxInterrupt = false;
+    bool _rxInterrupt = false;            // the transport took it: frames only come through pushFrame
+    bool Csma = false;
+    long CsmaSlot = 0;
+    uint8_t RreqCounter = 0;
+    uint8_t RreqGossip = 0;
+    bool RreqDistance = false;
+    long RreqWindow = 0;
+    uint8_t _fragBackoffs = 0;            // busy channel checks of the next fragment ...
+    long _fragHold = 0;                   // ... waiting until then
+    int16_t _rxRssi = 0;                  // link quality of the frame being processed
+    int8_t _rxSnr = 0;
+    uint8_t _rerrSource = 0;
+    uint8_t _rerrDest = 0;
+    long _rerrAt = 0;
+    LoraWifiMeshTransport *Transport = 0;
+
+    MSG_ID _uniqRReqId = 0x00;
+    MSG_ID _uniqMsgId = 0x00;
     uint8_t Mac[6] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
     uint8_t BlockNodes[LORA_MESH_MAX_BLOCK_NODES]  = {0x00, 0x00, 0x00, 0x00, 0x00,0x00, 0x00, 0x00};
     uint8_t BlockBroadcast[LORA_MESH_MAX_BLOCK_NODES] =  {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};   
         
     NODE_FILTER  dropNodes[LORA_MESH_MAX_DROPNODES_TABLE_SIZE];
-    ROUTING_TABLE routingTable[LORA_MESH_MAX_ROUTING_TABLE_SIZE];
-    QUEUE_MSG sentQueue[LORA_MESH_MSG_QUEUE_SIZE];
-    RREQ_TABLE sentRREQ[LORA_MESH_RREQ_QUEUE_SIZE];
+    MeshRoutingTable<> routingTable;
+    MeshTxScheduler<> txQueue;
+    // frames pushed by the radio callback, room for a relay to add one hop and its CRC in place
+    MeshRxRing<LORA_MESH_RX_RING_SIZE, LORA_MESH_RX_SLOT_SIZE + 1 + LORA_MESH_CRC_MAX_SIZE> rxRing;
+    uint16_t _rxDropped = 0;              // rxRing.dropped() already counted in stats.rxDropped
+    RREQ_SEEN seenRREQ[LORA_MESH_RREQ_SEEN_SIZE];
+    byte _seenHead = 0;
+    HOP_SEEN seenHop[LORA_MESH_HOP_SEEN_SIZE];
+    byte _seenHopHead = 0;
+    NEIGHBOUR neighbours[LORA_MESH_NEIGHBOUR_TABLE_SIZE];
     RECEIVED_TABLE receivedQueue[LORA_MESH_RECEIVED_QUEUE_SIZE];
+    FRAG_TX fragTx[LORA_MESH_FRAG_TX_SIZE];
+    FRAG_RX fragRx[LORA_MESH_FRAG_RX_SIZE];
    
-    STSCODE addRREQToQueue(uint8_t uniqueId);
-    STSCODE addMSGToQueue(SEND_Packet msg);
-    STSCODE removeMSGfromQueue(uint8_t uniqueId, char *_msg);
-    STSCODE addRoute(uint8_t destination,char *path);
-    STSCODE cleanQueues( byte queueType = LORA_MESH_QUEUE_TYPE_ANY );
-    STSCODE addRRToQueue(RR_Packet rr, uint8_t uniqueId);
+    MSG_ID queueMsg(uint8_t destination, const char *msg, byte msgLen, const MESH_PATH *path, uint8_t priority, MSG_ID uniqueId = LORA_MESH_ID_NEW);
+    MSG_ID nextMsgId();
+    STSCODE queueFrame(const char *frame, byte len, uint8_t priority, long delay = 0);
+    void serviceTxQueue();
+    void serviceRxRing();
+    void setRxInterrupt(LoraWifiMeshTransport *transport, bool on);
+    void serviceFragments();
+    void sendFragment(FRAG_TX &t, uint8_t index, bool ackReq);
+    void ageFragments();
+    void queueReceived(MSG_ID msgId, STSCODE sts, const char *msg, byte len);
+    void transmit(TX_ENTRY *e, bool account = true);
+    byte encodeEntry(TX_ENTRY *e, char *wire);
+    void afterSend(TX_ENTRY *e, long now);
+    uint8_t entryHop(TX_ENTRY *e);
+    bool sendAggregate(TX_ENTRY *first, long now);
+    bool aggCopy(const char *agg, uint16_t len, const char *frame);
+    long aggWait(uint8_t destination);
+    bool holdAck(const MSG_VIEW &v, uint8_t sts);
+    void piggybackAcks(TX_ENTRY *data);
+    bool pendingAck(TX_ENTRY *e, uint8_t originator);
+    bool addAckId(TX_ENTRY *e, MSG_ID uniqueId, uint8_t sts);
+    void takeAckList(MSG_VIEW &v, uint8_t peer);
+    bool inAckList(const MSG_VIEW &v, uint8_t originator, MSG_ID uniqueId);
+    long dutyWait(uint16_t len, uint8_t priority, long now, uint8_t hop);
+    LORA_MODEM txModem(uint8_t hop, int8_t &power, bool robust = false);
+    uint8_t listenMask(const NEIGHBOUR *n);
+    void adrReport(const MSG_VIEW &v);
+    void adrResult(uint8_t node, bool acked);
+    bool adrReportDue(uint8_t node);
+    bool dutyDefer(TX_ENTRY *e, long now);
+    bool channelDefer(TX_ENTRY *e, long now);
+    long channelWait(uint8_t &backoffs);
+    long csmaSlot();
+    uint8_t neighbourCount();
+    long floodWait(uint8_t destination);
+    long rreqWait();
+    void countRREQCopy(uint8_t originator, MSG_ID uniqueId);
+    uint16_t entryWireSize(TX_ENTRY *e);
+    STSCODE queueRelay(MSG_VIEW &v);
+    bool queueWatched(MSG_VIEW &v, uint8_t priority, long delay);
+    TX_ENTRY *holdFrame(const MSG_VIEW &v, uint8_t flags);
+    bool holdForRepair(MSG_VIEW &v);
+    bool startRepair(TX_ENTRY *e);
+    void serviceRepair(TX_ENTRY *e);
+    bool watchHop(TX_ENTRY *e, uint8_t node);
+    void hearHop(const MSG_VIEW &v);
+    void hopExpired(TX_ENTRY *e);
+    void sendHopAck(const MSG_VIEW &v);
+    bool checkSeenHop(const MSG_VIEW &v);
+    NEIGHBOUR *findNeighbour(uint8_t node);
+    void hearNeighbour(uint8_t node);
+    void sampleHopRtt(uint8_t node, long rtt);
+    long hopTimeout(uint8_t node, uint8_t tries);
+    uint8_t hopRetries(uint8_t node);
+    bool weakNeighbour(const NEIGHBOUR *n);
+    void sendRERR(char *frame, byte len, uint8_t deadHop);
+    void breakRoutes(uint8_t from, uint8_t to, uint8_t dest, uint8_t via, bool rediscover);
+    void rerouteMsgs(uint8_t dest);
+    void kickMsgs(uint8_t dest);
+    long retryDelay(uint8_t retryCount);
+    long txJitter();
+    bool resolveRoute(uint8_t destination, MESH_PATH &path);
+    bool findRoute(uint8_t destNode, MESH_PATH &path);
+    STSCODE removeMSGfromQueue(MSG_ID uniqueId, char *_msg, byte len);
+    STSCODE addRoute(uint8_t destination, const MESH_PATH &path, ROUTE_TYPE type = ROUTE_DYNAMIC, const MSG_ID *seqNo = 0);
+    void learnRoute(const MSG_VIEW &v, uint8_t node);
+    bool spendTtl(MSG_VIEW &v);
+    void resetTtl(MSG_VIEW &v);
+    uint16_t routeCost(uint8_t hops, int16_t rssi, int8_t snr, uint8_t ackSent, uint8_t ackOk);
+    void updateRouteLink(uint8_t destNode, bool acked);
+    void ageRoutes();
+    STSCODE sendProbe(ROUTING_TABLE *r);
+    STSCODE cleanQueues();
     STSCODE _send(char *bmsg, byte len);
+    LoraWifiMeshTransport *getTransport();
+    STSCODE dispatchMsg(MSG_VIEW &v);
+    STSCODE onAggregate(char *frame, byte len);
+    STSCODE onRREQ(MSG_VIEW &v);
+    STSCODE onRREP(MSG_VIEW &v);
+    STSCODE onACK(MSG_VIEW &v);
+    STSCODE onRERR(MSG_VIEW &v);
+    STSCODE onSENDTO(MSG_VIEW &v);
+    STSCODE onFragment(MSG_VIEW &v);
+    STSCODE onFragAck(MSG_VIEW &v);
+    byte encodeDatagram(const char *datagram, byte msgLen, char *wire, uint8_t ttl = 0);
+    bool parseView(char *frame, byte len, MSG_VIEW &v);
+    void setPayload(MSG_VIEW &v, const char *data, byte len);
+    char prevHop(const MSG_VIEW &v);
+    char nextHop(const MSG_VIEW &v);
+    bool appendHop(MSG_VIEW &v);
+    void copyPath(const MSG_VIEW &v, MESH_PATH &path);
+    char nextHop(const MESH_PATH &path);
+    void pathFromString(MESH_PATH &path, const char *str);
+    void pathToString(const MESH_PATH &path, char *str);
     void dumpSendTo(SEND_Packet pkt);
-    bool findRREQ(byte uniqueId);
-    byte CRC(const char *data, byte len);
-    bool checkCRC( char*,byte len,char *msg = "");
-    byte getCRC( char*,byte len);
+    bool checkSeenRREQ(uint8_t originator, MSG_ID uniqueId);
+    uint32_t CRC(const char *data, byte len);
+    bool checkCRC( char*,byte len,const char *msg = "");
+    uint32_t getCRC( char*,byte len);
 
 };
 
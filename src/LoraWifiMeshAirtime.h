@@ -0,0 +1,132 @@
+// Copyright © 2020 by antónio montez . All rights reserved.
+// Licensed under the MIT license.
+
+#ifndef _LORA_WIFI_MESH_AIRTIME_H_
+#define _LORA_WIFI_MESH_AIRTIME_H_
+
+#include <stdint.h>
+
+/*!
+    @brief  LoRa modem parameters, the ones given to the radio (setSpreadingFactor, setSignalBandwidth,
+            setCodingRate4, setPreambleLength, enableCrc / disableCrc). Explicit header always.
+*/
+
+struct LORA_MODEM {
+      uint8_t sf;                   // spreading factor 6..12
+      long bw;                      // bandwidth (Hz)
+      uint8_t cr;                   // coding rate denominator 5..8 (4/5 .. 4/8)
+      uint16_t preamble;            // preamble symbols, the radio adds 4.25
+      bool crc;                     // PHY payload CRC
+      };
+
+/*!
+    @brief  Time on air of a len bytes LoRa packet (us), Semtech SX1276 datasheet 4.1.1.6:
+            Tsym = 2^SF / BW, preamble + 4.25 symbols, then
+            8 + max(ceil((8 PL - 4 SF + 28 + 16 CRC) / (4 (SF - 2 DE))) CR, 0) symbols of header and payload,
+            DE (low data rate optimisation) on when a symbol lasts more than 16 ms, like the radio library does.
+            Counted in quarter symbols so the 4.25 stays exact.
+*/
+
+inline unsigned long meshLoraAirtime(const LORA_MODEM &m, uint16_t len) {
+    uint8_t sf = m.sf;
+    if ((sf < 6) || (sf > 12) || (m.bw <= 0)) return 0;
+
+    bool de = (((uint64_t)1000000 << sf) / (uint64_t)m.bw) > 16000;
+    long num = 8L * len - 4L * sf + 28 + (m.crc ? 16 : 0);
+    long den = 4L * (sf - (de ? 2 : 0));
+    long payload = 8 + ((num > 0) ? ((num + den - 1) / den) * m.cr : 0);
+    uint32_t quarters = 4UL * m.preamble + 17 + 4UL * payload;
+
+    return (unsigned long)(((uint64_t)quarters << sf) * 1000000ULL / (4ULL * (uint64_t)m.bw));
+}
+
+// lowest SNR (dB, rounded towards 0) a SX127x demodulates at a spreading factor: -7.5 dB at SF7, 2.5 dB less per step
+inline int8_t meshLoraSnrFloor(uint8_t sf) {
+    return (int8_t)(-(15 + 5 * ((int)sf - 7)) / 2);
+}
+
+/*!
+    @brief  Airtime spent over a rolling window (duty cycle), in us.
+
+            N buckets of window / (N - 1) ms each, the current one included: used() covers at least the last
+            window ms (at most one bucket more), so keeping used() under the budget keeps every window of that
+            length under it too. add() and used() only rotate the buckets of the time elapsed, O(N) at worst.
+*/
+
+template <uint8_t N = LORA_MESH_DUTY_BUCKETS>
+class MeshDutyCycle {
+  public:
+    MeshDutyCycle() { setWindow(LORA_MESH_DUTY_WINDOW); };
+
+    void setWindow(long ms) {
+        _width = (ms > 0) ? (ms + N - 2) / (N - 1) : 1;            // rounded up, (N - 1) buckets never cover less
+        clear();
+    };
+
+    void clear() {
+        for (uint8_t i = 0; i < N; i++) _b[i] = 0;
+        _cur = 0;
+        _start = 0;
+        _valid = false;
+    };
+
+    void add(long now, unsigned long us) {
+        advance(now);
+        _b[_cur] += us;
+    };
+
+    unsigned long used(long now) {
+        unsigned long sum = 0;
+        advance(now);
+        for (uint8_t i = 0; i < N; i++) sum += _b[i];
+        return sum;
+    };
+
+    /*!
+        @brief  first time (ms, now at the earliest) need us more keep used() within budget,
+                a need bigger than the whole budget waits for an empty window
+    */
+    long freeAt(long now, unsigned long need, unsigned long budget) {
+        unsigned long sum = used(now);
+        if (need > budget) need = budget;
+        if (sum + need <= budget) return now;
+
+        for (uint8_t k = 1; k < N; k++) {
+            sum -= _b[(uint8_t)(_cur + k) % N];
+            if (sum + need <= budget) return _start + (long)k * _width;
+        }
+        return _start + (long)N * _width;
+    };
+
+  private:
+    unsigned long _b[N];
+    uint8_t _cur;
+    long _start;                    // start of the current bucket
+    long _width;
+    bool _valid;
+
+    void advance(long now) {
+        if (!_valid) {
+            _start = now;
+            _valid = true;
+            return;
+        }
+        long steps = (now - _start) / _width;
+        if (steps <= 0) return;
+        if (steps >= N) {
+            for (uint8_t i = 0; i < N; i++) _b[i] = 0;
+            _cur = 0;
+        }
+        else {
+            for (long s = 0; s < steps; s++) {
+                _cur = (uint8_t)(_cur + 1) % N;
+                _b[_cur] = 0;
+            }
+        }
+        _start += steps * _width;
+    };
+
+    static_assert(N >= 2, "MeshDutyCycle needs at least 2 buckets");
+};
+
+#endif
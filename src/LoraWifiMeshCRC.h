@@ -0,0 +1,93 @@
+// Copyright © 2020 by antónio montez . All rights reserved.
+// Licensed under the MIT license.
+
+#ifndef _LORA_WIFI_MESH_CRC_H_
+#define _LORA_WIFI_MESH_CRC_H_
+
+/*!
+    @brief  Table driven CRC engine.
+
+            The 256 entry lookup tables are generated by the compiler (constexpr), there's no runtime
+            initialisation and on AVR they live in flash (PROGMEM) instead of the 2K of RAM.
+            One table lookup per byte replaces the 8 shift/xor steps of the bit-serial version.
+
+            LORA_MESH_CRC8   Dallas/Maxim, reflected poly 0x8C, init 0x00 (same values as the original LoraWifiMesh::CRC)
+            LORA_MESH_CRC16  CRC-16/KERMIT, reflected poly 0x8408, init 0x0000
+            LORA_MESH_CRC32  CRC-32 (IEEE 802.3), reflected poly 0xEDB88320, init/xorout 0xFFFFFFFF
+
+            The mode value is also the number of CRC bytes carried by a datagram.
+*/
+
+#include <stdint.h>
+
+#if defined(ARDUINO_ARCH_AVR)
+#include <avr/pgmspace.h>
+#define LORA_MESH_CRC_PROGMEM PROGMEM
+#else
+#define LORA_MESH_CRC_PROGMEM
+#endif
+
+#define LORA_MESH_CRC8  1
+#define LORA_MESH_CRC16 2
+#define LORA_MESH_CRC32 4
+
+#define LORA_MESH_CRC_MAX_SIZE 4
+
+template <unsigned... Is> struct MeshCrcSeq {};
+template <unsigned N, unsigned... Is> struct MeshCrcMakeSeq : MeshCrcMakeSeq<N - 1, N - 1, Is...> {};
+template <unsigned... Is> struct MeshCrcMakeSeq<0, Is...> { typedef MeshCrcSeq<Is...> type; };
+
+// table entry of a reflected CRC: the index shifted through the polynomial 8 times
+template <typename T>
+constexpr T meshCrcEntry(T poly, T crc, int bits) {
+    return (bits == 0) ? crc : meshCrcEntry<T>(poly, (crc & 1) ? (T)((crc >> 1) ^ poly) : (T)(crc >> 1), bits - 1);
+}
+
+template <typename T, T Poly, typename Seq = typename MeshCrcMakeSeq<256>::type> struct MeshCrcTable;
+
+template <typename T, T Poly, unsigned... Is>
+struct MeshCrcTable<T, Poly, MeshCrcSeq<Is...> > {
+    static const T table[256];
+};
+
+template <typename T, T Poly, unsigned... Is>
+const T MeshCrcTable<T, Poly, MeshCrcSeq<Is...> >::table[256] LORA_MESH_CRC_PROGMEM = { meshCrcEntry<T>(Poly, (T)Is, 8)... };
+
+#if defined(ARDUINO_ARCH_AVR)
+inline uint8_t  meshCrcRead(const uint8_t *p)  { return pgm_read_byte(p); }
+inline uint16_t meshCrcRead(const uint16_t *p) { return pgm_read_word(p); }
+inline uint32_t meshCrcRead(const uint32_t *p) { return pgm_read_dword(p); }
+#else
+template <typename T> inline T meshCrcRead(const T *p) { return *p; }
+#endif
+
+template <typename T, T Poly>
+inline T meshCrcUpdate(T crc, const uint8_t *data, uint16_t len) {
+    const T *table = MeshCrcTable<T, Poly>::table;
+    while (len--) {
+        crc = (T)((crc >> 8) ^ meshCrcRead(&table[(uint8_t)(crc ^ *data++)]));
+    }
+    return crc;
+}
+
+inline uint8_t meshCrc8(const uint8_t *data, uint16_t len) {
+    return meshCrcUpdate<uint8_t, 0x8C>(0x00, data, len);
+}
+
+inline uint16_t meshCrc16(const uint8_t *data, uint16_t len) {
+    return meshCrcUpdate<uint16_t, 0x8408>(0x0000, data, len);
+}
+
+inline uint32_t meshCrc32(const uint8_t *data, uint16_t len) {
+    return ~meshCrcUpdate<uint32_t, 0xEDB88320UL>(0xFFFFFFFFUL, data, len);
+}
+
+inline uint32_t meshCrc(uint8_t mode, const uint8_t *data, uint16_t len) {
+    switch (mode) {
+      case LORA_MESH_CRC16 : return meshCrc16(data, len);
+      case LORA_MESH_CRC32 : return meshCrc32(data, len);
+      default              : return meshCrc8(data, len);
+    }
+}
+
+#endif
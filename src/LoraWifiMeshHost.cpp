@@ -0,0 +1,84 @@
+// Copyright © 2020 by antónio montez . All rights reserved.
+// Licensed under the MIT license.
+
+#if defined(LORA_MESH_HOST)
+
+#include "LoraWifiMeshHost.h"
+
+static unsigned long _hostClock = 0;
+static uint32_t _hostSeed = 0x2545F491;
+
+unsigned long millis(){
+    return _hostClock;
+}
+
+void delay(unsigned long ms){
+    _hostClock += ms;
+}
+
+void meshHostSetClock(unsigned long ms){
+    _hostClock = ms;
+}
+
+void meshHostAdvance(unsigned long ms){
+    _hostClock += ms;
+}
+
+void randomSeed(unsigned long seed){
+    _hostSeed = seed ? (uint32_t)seed : 0x2545F491;
+}
+
+long random(long howbig){
+    if (howbig <= 0) return 0;
+    // xorshift32, deterministic for a given seed
+    _hostSeed ^= _hostSeed << 13;
+    _hostSeed ^= _hostSeed >> 17;
+    _hostSeed ^= _hostSeed << 5;
+    return (long)(_hostSeed % (uint32_t)howbig);
+}
+
+long random(long howsmall, long howbig){
+    if (howsmall >= howbig) return howsmall;
+    return howsmall + random(howbig - howsmall);
+}
+
+HostSerial Serial;
+
+size_t HostSerial::print(const char *s){
+    if (!enabled) return 0;
+    return fputs(s, stdout) < 0 ? 0 : strlen(s);
+}
+
+size_t HostSerial::print(char c){
+    if (!enabled) return 0;
+    fputc(c, stdout);
+    return 1;
+}
+
+size_t HostSerial::print(unsigned long n, int base){
+    if (!enabled) return 0;
+    return printf(base == HEX ? "%lX" : "%lu", n);
+}
+
+size_t HostSerial::print(long n, int base){
+    if (base == HEX) return print((unsigned long)n, base);
+    if (!enabled) return 0;
+    return printf("%ld", n);
+}
+
+size_t HostSerial::print(unsigned char n, int base){ return print((unsigned long)n, base); }
+size_t HostSerial::print(unsigned int n, int base){ return print((unsigned long)n, base); }
+size_t HostSerial::print(int n, int base){ return print((long)n, base); }
+
+size_t HostSerial::print(double n, int digits){
+    if (!enabled) return 0;
+    return printf("%.*f", digits, n);
+}
+
+size_t HostSerial::println(){
+    if (!enabled) return 0;
+    fputc('\n', stdout);
+    return 1;
+}
+
+#endif
@@ -0,0 +1,57 @@
+// Copyright © 2020 by antónio montez . All rights reserved.
+// Licensed under the MIT license.
+
+#ifndef _LORA_WIFI_MESH_HOST_H_
+#define _LORA_WIFI_MESH_HOST_H_
+
+/*!
+    @brief  Minimal stand-in for the Arduino core, used when the library is compiled on a POSIX host
+            with -DLORA_MESH_HOST (simulator, benchmarks).
+
+            Time is virtual: millis() only moves when delay() or meshHostAdvance() are called,
+            which lets the simulator run many nodes against one deterministic clock.
+            Serial writes to stdout and can be silenced with Serial.enabled = false
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+typedef uint8_t byte;
+
+#define F(s) (s)
+#define DEC 10
+#define HEX 16
+
+unsigned long millis();
+void delay(unsigned long ms);
+long random(long howbig);
+long random(long howsmall, long howbig);
+void randomSeed(unsigned long seed);
+
+void meshHostSetClock(unsigned long ms);
+void meshHostAdvance(unsigned long ms);
+
+class HostSerial {
+  public:
+    bool enabled = true;
+
+    void begin(unsigned long /* baud */) {};
+    size_t print(const char *s);
+    size_t print(char c);
+    size_t print(unsigned char n, int base = DEC);
+    size_t print(int n, int base = DEC);
+    size_t print(unsigned int n, int base = DEC);
+    size_t print(long n, int base = DEC);
+    size_t print(unsigned long n, int base = DEC);
+    size_t print(double n, int digits = 2);
+    size_t println();
+    template <typename T> size_t println(T v) { size_t n = print(v); return n + println(); };
+    template <typename T> size_t println(T v, int base) { size_t n = print(v, base); return n + println(); };
+};
+
+extern HostSerial Serial;
+
+#endif
@@ -0,0 +1,117 @@
+// Copyright © 2020 by antónio montez . All rights reserved.
+// Licensed under the MIT license.
+
+#ifndef _LORA_WIFI_MESH_RING_H_
+#define _LORA_WIFI_MESH_RING_H_
+
+#include <stdint.h>
+#include <string.h>
+#ifdef __AVR__
+#include <util/atomic.h>
+#endif
+
+/*!
+    @brief  Lock-free single producer / single consumer ring of received frames.
+
+            The producer is the radio callback (esp_now receive callback, DIO0 interrupt), it only
+            copies the frame in the next free slot: no lock, no heap, no Serial, bounded time.
+            The consumer is LoraWifiMesh::yield(), it processes the frame in place with front()
+            and gives the slot back with pop().
+
+            _head and _tail are free running 8 bit counters, each one written by one side only and
+            published with release / read with acquire (GCC __atomic builtins), N must be a power of 2 <= 128.
+            S is the size of a slot, the link quality (rssi / snr) the radio gave the frame travels with it.
+            A frame that does not fit, or arrives when the ring is full, is counted in dropped() and discarded.
+            That counter is a plain volatile 16 bit one (free running, it wraps): only the producer writes it,
+            and on AVR, where __atomic on more than a byte needs libcalls avr-libc does not have, dropped()
+            reads it with interrupts masked.
+*/
+
+template <uint8_t N, uint16_t S>
+class MeshRxRing {
+  public:
+    MeshRxRing() { clear(); };
+
+    // consumer side only, the producer must be stopped
+    void clear() {
+        _head = 0;
+        _tail = 0;
+        _dropped = 0;
+    };
+
+    // producer: copy one frame, false when it was dropped
+    bool push(const uint8_t *data, int len, int16_t rssi = 0, int8_t snr = 0) {
+        uint8_t t = __atomic_load_n(&_tail, __ATOMIC_RELAXED);
+        uint8_t h = __atomic_load_n(&_head, __ATOMIC_ACQUIRE);
+
+        if ((len <= 0) || (len > S) || ((uint8_t)(t - h) >= N)) {
+            _dropped = _dropped + 1;
+            return false;
+        }
+        SLOT &s = _slot[t & (N - 1)];
+        memcpy(s.buf, data, len);
+        s.len = len;
+        s.rssi = rssi;
+        s.snr = snr;
+        __atomic_store_n(&_tail, (uint8_t)(t + 1), __ATOMIC_RELEASE);
+        return true;
+    };
+
+    // consumer: oldest frame (writable, S bytes) and its size, 0 when the ring is empty
+    uint8_t *front(int &len) {
+        uint8_t h = __atomic_load_n(&_head, __ATOMIC_RELAXED);
+        if (h == __atomic_load_n(&_tail, __ATOMIC_ACQUIRE)) return 0;
+
+        SLOT &s = _slot[h & (N - 1)];
+        len = s.len;
+        return s.buf;
+    };
+
+    // consumer: front() with the link quality it was pushed with
+    uint8_t *front(int &len, int16_t &rssi, int8_t &snr) {
+        uint8_t *buf = front(len);
+        if (buf == 0) return 0;
+
+        SLOT &s = _slot[__atomic_load_n(&_head, __ATOMIC_RELAXED) & (N - 1)];
+        rssi = s.rssi;
+        snr = s.snr;
+        return buf;
+    };
+
+    // consumer: give the slot of front() back to the producer
+    void pop() {
+        uint8_t h = __atomic_load_n(&_head, __ATOMIC_RELAXED);
+        __atomic_store_n(&_head, (uint8_t)(h + 1), __ATOMIC_RELEASE);
+    };
+
+    uint8_t count() const {
+        return (uint8_t)(__atomic_load_n(&_tail, __ATOMIC_ACQUIRE) - __atomic_load_n(&_head, __ATOMIC_ACQUIRE));
+    };
+    uint16_t dropped() const {
+#ifdef __AVR__
+        uint16_t d;
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) { d = _dropped; }
+        return d;
+#else
+        return _dropped;
+#endif
+    };
+    uint8_t size() const { return N; };
+
+  private:
+    typedef struct SLOT {
+        uint16_t len;
+        int16_t rssi;
+        int8_t snr;
+        uint8_t buf[S];
+    } SLOT;
+
+    SLOT _slot[N];
+    uint8_t _head;                   // written by the consumer
+    uint8_t _tail;                   // written by the producer
+    volatile uint16_t _dropped;      // written by the producer
+
+    static_assert((N & (N - 1)) == 0 && N <= 128, "MeshRxRing size must be a power of 2 <= 128");
+};
+
+#endif
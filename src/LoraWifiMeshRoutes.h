@@ -0,0 +1,164 @@
+// Copyright © 2020 by antónio montez . All rights reserved.
+// Licensed under the MIT license.
+
+#ifndef _LORA_WIFI_MESH_ROUTES_H_
+#define _LORA_WIFI_MESH_ROUTES_H_
+
+/*!
+    @brief  Routing table indexed by destination node.
+
+            Open addressing (linear probing) on the destination id, so find/insert cost
+            one probe in the common case instead of a scan of the whole table.
+            Removed entries are left as LORA_MESH_QUEUE_DELETED so the probe chains stay intact,
+            insert() reuses them. One that ends a chain (the next slot is free) goes back to FREE at once,
+            with the ones just before it. The others pile up under route churn (aging, broken links) until
+            no slot is FREE and every lookup miss probes the whole table: when they leave less than a quarter
+            of the table free, insert() first rebuilds the chains in place (rehash()).
+            So entries only move in insert(): a pointer from find() is good until the next insert().
+            N is the number of entries (LORA_MESH_MAX_ROUTING_TABLE_SIZE by default).
+
+            Included by LoraWifiMesh.h after ROUTING_TABLE.
+*/
+
+template <uint16_t N = LORA_MESH_MAX_ROUTING_TABLE_SIZE>
+class MeshRoutingTable {
+  public:
+    MeshRoutingTable() { clear(); };
+
+    /*!
+        @brief  entry of destNode in any state (USED, MISSING, WAITING), 0 when there's none
+    */
+    ROUTING_TABLE *find(uint8_t destNode) {
+        uint16_t i = home(destNode);
+        for (uint16_t n = 0; n < N; n++) {
+            ROUTING_TABLE &e = _e[i];
+            if (e.sts == LORA_MESH_QUEUE_FREE) return 0;
+            if ((e.sts != LORA_MESH_QUEUE_DELETED) && (e.destNode == destNode)) return &e;
+            i = next(i);
+        }
+        return 0;
+    };
+
+    /*!
+        @brief  entry of destNode, a new one (sts LORA_MESH_QUEUE_USED, empty path, no metrics)
+                when there's none, 0 when the table is full
+    */
+    ROUTING_TABLE *insert(uint8_t destNode) {
+        if ((_deleted > 0) && (N - _count - _deleted <= N / 4)) rehash();
+
+        uint16_t i = home(destNode);
+        ROUTING_TABLE *hole = 0;
+        for (uint16_t n = 0; n < N; n++) {
+            ROUTING_TABLE &e = _e[i];
+            if (e.sts == LORA_MESH_QUEUE_FREE) {
+                if (hole == 0) hole = &e;
+                break;
+            }
+            if (e.sts == LORA_MESH_QUEUE_DELETED) {
+                if (hole == 0) hole = &e;
+            }
+            else if (e.destNode == destNode) return &e;
+            i = next(i);
+        }
+        if (hole == 0) return 0;
+
+        if (hole->sts == LORA_MESH_QUEUE_DELETED) _deleted--;
+        *hole = ROUTING_TABLE();
+        hole->destNode = destNode;
+        hole->sts = LORA_MESH_QUEUE_USED;
+        hole->type = ROUTE_DYNAMIC;
+        hole->timeStamp = millis();
+        hole->lastUsed = hole->timeStamp;
+        _count++;
+        return hole;
+    };
+
+    void remove(ROUTING_TABLE *e) {
+        if ((e == 0) || (e->sts == LORA_MESH_QUEUE_FREE) || (e->sts == LORA_MESH_QUEUE_DELETED)) return;
+        setSts(e, LORA_MESH_QUEUE_DELETED);
+        e->destNode = 0;
+        _count--;
+        _deleted++;
+
+        uint16_t i = (uint16_t)(e - _e);
+        if (_e[next(i)].sts != LORA_MESH_QUEUE_FREE) return;
+        for (uint16_t n = 0; (n < N) && (_e[i].sts == LORA_MESH_QUEUE_DELETED); n++) {
+            _e[i].sts = LORA_MESH_QUEUE_FREE;
+            _deleted--;
+            i = prev(i);
+        }
+    };
+
+    void clear() {
+        for (uint16_t i = 0; i < N; i++) {
+            _e[i].sts = LORA_MESH_QUEUE_FREE;
+            _e[i].destNode = 0;
+        }
+        _count = 0;
+        _deleted = 0;
+        _missing = 0;
+    };
+
+    /*!
+        @brief  every status change goes through here so nextMissing() knows when there's nothing to look for
+    */
+    void setSts(ROUTING_TABLE *e, QUEUE_STATUS sts) {
+        if (e->sts == STS_ROUTE_MISSING) _missing--;
+        if (sts == STS_ROUTE_MISSING) _missing++;
+        e->sts = sts;
+    };
+
+    /*!
+        @brief  first entry waiting for a route request (STS_ROUTE_MISSING), 0 without a scan when there's none
+    */
+    ROUTING_TABLE *nextMissing() {
+        if (_missing == 0) return 0;
+        for (uint16_t i = 0; i < N; i++) {
+            if (_e[i].sts == STS_ROUTE_MISSING) return &_e[i];
+        }
+        return 0;
+    };
+
+    ROUTING_TABLE &operator[](uint16_t i) { return _e[i]; };
+    uint16_t size() const { return N; };
+    uint16_t count() const { return _count; };
+
+  private:
+    ROUTING_TABLE _e[N];
+    uint16_t _count;
+    uint16_t _deleted;
+    uint16_t _missing;
+
+    /*!
+        @brief  every deleted slot back to FREE, then each entry moves to the first free slot of its chain until
+                none can: each one is then reached from its home slot before any free slot. No extra memory,
+                a few passes over the table.
+    */
+    void rehash() {
+        for (uint16_t i = 0; i < N; i++) {
+            if (_e[i].sts == LORA_MESH_QUEUE_DELETED) _e[i].sts = LORA_MESH_QUEUE_FREE;
+        }
+        _deleted = 0;
+
+        bool moved = true;
+        for (uint16_t pass = 0; moved && (pass < N); pass++) {
+            moved = false;
+            for (uint16_t i = 0; i < N; i++) {
+                if (_e[i].sts == LORA_MESH_QUEUE_FREE) continue;
+                uint16_t j = home(_e[i].destNode);
+                while ((j != i) && (_e[j].sts != LORA_MESH_QUEUE_FREE)) j = next(j);
+                if (j == i) continue;
+                _e[j] = _e[i];
+                _e[i].sts = LORA_MESH_QUEUE_FREE;
+                _e[i].destNode = 0;
+                moved = true;
+            }
+        }
+    };
+
+    static uint16_t home(uint8_t destNode) { return destNode % N; };
+    static uint16_t next(uint16_t i) { return (i + 1 == N) ? 0 : i + 1; };
+    static uint16_t prev(uint16_t i) { return (i == 0) ? N - 1 : i - 1; };
+};
+
+#endif
@@ -0,0 +1,154 @@
+// Copyright © 2020 by antónio montez . All rights reserved.
+// Licensed under the MIT license.
+
+#ifndef _LORA_WIFI_MESH_SX127X_H_
+#define _LORA_WIFI_MESH_SX127X_H_
+
+#include <stdint.h>
+
+// SX127x LoRa registers used by MeshSX127xFifo (datasheet 6.4)
+#define SX127X_REG_FIFO                 0x00
+#define SX127X_REG_OP_MODE              0x01
+#define SX127X_REG_FIFO_ADDR_PTR        0x0D        // 0x0D .. 0x13 are read in one burst
+#define SX127X_REG_FIFO_RX_CURRENT_ADDR 0x10
+#define SX127X_REG_IRQ_FLAGS            0x12
+#define SX127X_REG_RX_NB_BYTES          0x13
+#define SX127X_REG_MODEM_CONFIG_1       0x1D        // bandwidth in bits 7-4
+#define SX127X_REG_MODEM_CONFIG_2       0x1E        // spreading factor in bits 7-4
+#define SX127X_REG_PAYLOAD_LENGTH       0x22
+
+#define SX127X_MODE_LONG_RANGE          0x80
+#define SX127X_MODE_MASK                0x07
+#define SX127X_MODE_STDBY               0x01
+#define SX127X_MODE_CAD                 0x07
+
+#define SX127X_IRQ_CAD_DETECTED         0x01
+#define SX127X_IRQ_CAD_DONE             0x04
+#define SX127X_SPI_WRITE                0x80
+
+// a CAD takes about 2 symbols, cad() gives up after that many
+#define SX127X_CAD_SYMBOLS              4
+
+/*!
+    @brief  Burst access to the SX127x FIFO: a whole datagram is moved in one SPI transaction
+            (address byte, then the FIFO auto-increments) instead of one transaction per byte.
+
+            readPacket() takes the datagram the radio library parsed (LoRa.parsePacket() points FIFO_ADDR_PTR
+            at FIFO_RX_CURRENT_ADDR and idles the radio), reading the length from RX_NB_BYTES first:
+            a datagram bigger than maxLen is skipped at once (-1) instead of being drained byte by byte.
+            Reading it moves FIFO_ADDR_PTR past it, so the same datagram is never returned twice and
+            nothing is pending once the radio is receiving or transmitting again.
+            readReceived() takes the len bytes datagram the DIO0 interrupt of the LoRa library pointed the FIFO at
+            (continuous receive, LoRa.onReceive), -1 when it is bigger than maxLen.
+            writePacket() fills the FIFO after LoRa.beginPacket() and sets PAYLOAD_LENGTH, LoRa.endPacket() sends it.
+            cadStart() starts a channel activity detection, cadDone() is true once it is over (the radio is back
+            in standby) and tells whether a preamble was detected. The DIO0 mapping is left alone: the end is polled.
+            cad() runs a whole detection and polls its end on the spot: nothing may touch the radio between
+            cadStart() and cadDone(), LoRa.parsePacket() clears every IRQ flag and puts the radio in RX_SINGLE.
+
+            BUS is the SPI access: select() / deselect() around a transaction, uint8_t transfer(uint8_t),
+            read(uint8_t *, uint8_t) and write(const uint8_t *, uint8_t) for the burst
+            (the Arduino SPIClass on the nodes, a mock radio on the host).
+*/
+
+template <class BUS>
+class MeshSX127xFifo {
+  public:
+    MeshSX127xFifo(BUS &bus) : _bus(bus) {};
+
+    int readPacket(uint8_t *buff, int maxLen) {
+        uint8_t r[SX127X_REG_RX_NB_BYTES - SX127X_REG_FIFO_ADDR_PTR + 1];
+
+        if ((readReg(SX127X_REG_OP_MODE) & SX127X_MODE_MASK) != SX127X_MODE_STDBY) return 0;
+
+        readRegs(SX127X_REG_FIFO_ADDR_PTR, r, sizeof(r));
+        uint8_t ptr = r[0];
+        uint8_t cur = r[SX127X_REG_FIFO_RX_CURRENT_ADDR - SX127X_REG_FIFO_ADDR_PTR];
+        uint8_t nb = r[SX127X_REG_RX_NB_BYTES - SX127X_REG_FIFO_ADDR_PTR];
+        if ((ptr != cur) || (nb == 0)) return 0;                    // nothing parsed, or already read
+
+        if (nb > maxLen) {
+            writeReg(SX127X_REG_FIFO_ADDR_PTR, (uint8_t)(cur + nb));
+            return -1;
+        }
+        readRegs(SX127X_REG_FIFO, buff, nb);
+        return nb;
+    };
+
+    int readReceived(uint8_t *buff, int len, int maxLen) {
+        if ((len <= 0) || (len > maxLen)) return -1;
+        readRegs(SX127X_REG_FIFO, buff, (uint8_t)len);
+        return len;
+    };
+
+    void writePacket(const uint8_t *buff, uint8_t len) {
+        _bus.select();
+        _bus.transfer(SX127X_REG_FIFO | SX127X_SPI_WRITE);
+        _bus.write(buff, len);
+        _bus.deselect();
+        writeReg(SX127X_REG_PAYLOAD_LENGTH, len);
+    };
+
+    void cadStart() {
+        writeReg(SX127X_REG_IRQ_FLAGS, SX127X_IRQ_CAD_DONE | SX127X_IRQ_CAD_DETECTED);
+        writeReg(SX127X_REG_OP_MODE, SX127X_MODE_LONG_RANGE | SX127X_MODE_CAD);
+    };
+
+    bool cadDone(bool &detected) {
+        uint8_t flags = readReg(SX127X_REG_IRQ_FLAGS);
+        if (!(flags & SX127X_IRQ_CAD_DONE)) return false;
+        detected = (flags & SX127X_IRQ_CAD_DETECTED) != 0;
+        writeReg(SX127X_REG_IRQ_FLAGS, SX127X_IRQ_CAD_DONE | SX127X_IRQ_CAD_DETECTED);
+        return true;
+    };
+
+    // false when the radio said nothing after SX127X_CAD_SYMBOLS symbols, clock() gives milliseconds
+    template <class CLOCK>
+    bool cad(bool &detected, CLOCK clock) {
+        unsigned long timeout = cadTimeout();
+        detected = false;
+        cadStart();
+        unsigned long start = clock();
+        while (!cadDone(detected)) {
+            if (clock() - start > timeout) return false;
+        }
+        return true;
+    };
+
+    // ms of SX127X_CAD_SYMBOLS symbols at the spreading factor and bandwidth the radio is set to
+    unsigned long cadTimeout() {
+        static const uint16_t bandwidth[] = {78, 104, 156, 208, 312, 417, 625, 1250, 2500, 5000};     // 100 Hz
+        uint8_t sf = readReg(SX127X_REG_MODEM_CONFIG_2) >> 4;
+        uint8_t bw = readReg(SX127X_REG_MODEM_CONFIG_1) >> 4;
+        if ((sf < 6) || (sf > 12)) sf = 12;
+        if (bw > 9) bw = 0;
+        return (SX127X_CAD_SYMBOLS * (1UL << sf) * 10UL) / bandwidth[bw] + 1;
+    };
+
+  private:
+    BUS &_bus;
+
+    uint8_t readReg(uint8_t reg) {
+        _bus.select();
+        _bus.transfer(reg);
+        uint8_t v = _bus.transfer(0x00);
+        _bus.deselect();
+        return v;
+    };
+
+    void readRegs(uint8_t reg, uint8_t *buff, uint8_t len) {
+        _bus.select();
+        _bus.transfer(reg);
+        _bus.read(buff, len);
+        _bus.deselect();
+    };
+
+    void writeReg(uint8_t reg, uint8_t v) {
+        _bus.select();
+        _bus.transfer(reg | SX127X_SPI_WRITE);
+        _bus.transfer(v);
+        _bus.deselect();
+    };
+};
+
+#endif
@@ -0,0 +1,211 @@
+// Copyright © 2020 by antónio montez . All rights reserved.
+// Licensed under the MIT license.
+
+#ifndef _LORA_WIFI_MESH_SCHEDULER_H_
+#define _LORA_WIFI_MESH_SCHEDULER_H_
+
+/*!
+    @brief  Transmit scheduler: every datagram waiting to go on the air (new messages, retries, deferred
+            control frames) is a TX_ENTRY of a fixed pool of N.
+
+            free list     unused entries, alloc/release are O(1)
+            timer wheel   W buckets of LORA_MESH_TX_WHEEL_TICK ms, an entry waits in the bucket of its deadline
+                          (hashed wheel: deadlines further than one turn just stay there for the next turns)
+            ready lists   one FIFO per priority class, entries whose deadline has passed
+
+            nextReady() only visits the buckets of the ticks elapsed since the previous call and pops the head
+            of the highest priority ready list, so the cost of a yield() doesn't grow with the queue depth.
+            Entries waiting for an ACK are also chained in a small hash on uniqueId for find().
+
+            Indexes are uint8_t, LORA_MESH_TX_NIL marks the end of a list (N <= 254).
+            Included by LoraWifiMesh.h after TX_ENTRY.
+*/
+
+#define LORA_MESH_TX_NIL 0xFF
+
+template <uint8_t N = LORA_MESH_MSG_QUEUE_SIZE, uint8_t W = LORA_MESH_TX_WHEEL_SIZE>
+class MeshTxScheduler {
+  public:
+    MeshTxScheduler() { clear(); };
+
+    void clear() {
+        for (uint8_t i = 0; i < N; i++) {
+            _e[i].sts = LORA_MESH_QUEUE_FREE;
+            _e[i].where = LORA_MESH_TX_NIL;
+            _e[i].hashNext = LORA_MESH_TX_NIL;
+            _e[i].next = (i + 1 < N) ? i + 1 : LORA_MESH_TX_NIL;
+        }
+        _free = (N > 0) ? 0 : LORA_MESH_TX_NIL;
+        for (uint8_t b = 0; b < W; b++) _wheel[b] = LORA_MESH_TX_NIL;
+        for (uint8_t p = 0; p < LORA_MESH_PRIO_CLASSES; p++) _head[p] = _tail[p] = LORA_MESH_TX_NIL;
+        for (uint8_t h = 0; h < N; h++) _hash[h] = LORA_MESH_TX_NIL;
+        _count = 0;
+        _tickValid = false;
+    };
+
+    /*!
+        @brief  a free entry (sts LORA_MESH_QUEUE_USED, not scheduled yet) or 0 when the pool is exhausted
+    */
+    TX_ENTRY *alloc() {
+        if (_free == LORA_MESH_TX_NIL) return 0;
+        TX_ENTRY *e = &_e[_free];
+        _free = e->next;
+        e->sts = LORA_MESH_QUEUE_USED;
+        e->where = LORA_MESH_TX_NIL;
+        e->hashNext = LORA_MESH_TX_NIL;
+        e->next = e->prev = LORA_MESH_TX_NIL;
+        e->backoffs = 0;
+        _count++;
+        return e;
+    };
+
+    void release(TX_ENTRY *e) {
+        if (e->sts != LORA_MESH_QUEUE_USED) return;
+        unlink(e);
+        untrack(e);
+        e->sts = LORA_MESH_QUEUE_FREE;
+        e->next = _free;
+        _free = index(e);
+        _count--;
+    };
+
+    /*!
+        @brief  (re)schedule e at deadline: straight into its ready list when it's already due, otherwise in the wheel
+    */
+    void schedule(TX_ENTRY *e, long deadline, long now) {
+        unlink(e);
+        e->deadline = deadline;
+        if (deadline - now <= 0) {
+            pushReady(e);
+            return;
+        }
+        uint8_t b = bucket(deadline);
+        e->where = b;
+        e->prev = LORA_MESH_TX_NIL;
+        e->next = _wheel[b];
+        if (e->next != LORA_MESH_TX_NIL) _e[e->next].prev = index(e);
+        _wheel[b] = index(e);
+    };
+
+    /*!
+        @brief  advance the wheel to now and take the first due entry of the highest priority class (0 when none).
+                The entry is unlinked: schedule() it again or release() it.
+    */
+    TX_ENTRY *nextReady(long now) {
+        advance(now);
+        for (uint8_t p = 0; p < LORA_MESH_PRIO_CLASSES; p++) {
+            if (_head[p] != LORA_MESH_TX_NIL) {
+                TX_ENTRY *e = &_e[_head[p]];
+                unlink(e);
+                return e;
+            }
+        }
+        return 0;
+    };
+
+    // index e by uniqueId for find()
+    void track(TX_ENTRY *e) {
+        uint8_t h = e->uniqueId % N;
+        e->hashNext = _hash[h];
+        _hash[h] = index(e);
+    };
+
+    TX_ENTRY *find(MSG_ID uniqueId) {
+        for (uint8_t i = _hash[uniqueId % N]; i != LORA_MESH_TX_NIL; i = _e[i].hashNext) {
+            if (_e[i].uniqueId == uniqueId) return &_e[i];
+        }
+        return 0;
+    };
+
+    TX_ENTRY &operator[](uint8_t i) { return _e[i]; };
+    uint8_t size() const { return N; };
+    uint8_t count() const { return _count; };
+
+  private:
+    TX_ENTRY _e[N];
+    uint8_t _free;
+    uint8_t _wheel[W];
+    uint8_t _head[LORA_MESH_PRIO_CLASSES];
+    uint8_t _tail[LORA_MESH_PRIO_CLASSES];
+    uint8_t _hash[N];
+    uint8_t _count;
+    long _tick;
+    bool _tickValid;
+
+    uint8_t index(const TX_ENTRY *e) const { return (uint8_t)(e - _e); };
+    static uint8_t bucket(long t) { return (uint8_t)((unsigned long)(t / LORA_MESH_TX_WHEEL_TICK) % W); };
+
+    void pushReady(TX_ENTRY *e) {
+        uint8_t p = (e->priority < LORA_MESH_PRIO_CLASSES) ? e->priority : LORA_MESH_PRIO_CLASSES - 1;
+        e->where = W + p;
+        e->next = LORA_MESH_TX_NIL;
+        e->prev = _tail[p];
+        if (_tail[p] != LORA_MESH_TX_NIL) _e[_tail[p]].next = index(e);
+        else _head[p] = index(e);
+        _tail[p] = index(e);
+    };
+
+    void unlink(TX_ENTRY *e) {
+        uint8_t w = e->where;
+        if (w == LORA_MESH_TX_NIL) return;
+
+        if (w < W) {
+            if (e->prev != LORA_MESH_TX_NIL) _e[e->prev].next = e->next;
+            else _wheel[w] = e->next;
+            if (e->next != LORA_MESH_TX_NIL) _e[e->next].prev = e->prev;
+        }
+        else {
+            uint8_t p = w - W;
+            if (e->prev != LORA_MESH_TX_NIL) _e[e->prev].next = e->next;
+            else _head[p] = e->next;
+            if (e->next != LORA_MESH_TX_NIL) _e[e->next].prev = e->prev;
+            else _tail[p] = e->prev;
+        }
+        e->next = e->prev = LORA_MESH_TX_NIL;
+        e->where = LORA_MESH_TX_NIL;
+    };
+
+    void untrack(TX_ENTRY *e) {
+        uint8_t *link = &_hash[e->uniqueId % N];
+        uint8_t i = index(e);
+        while (*link != LORA_MESH_TX_NIL) {
+            if (*link == i) {
+                *link = e->hashNext;
+                break;
+            }
+            link = &_e[*link].hashNext;
+        }
+        e->hashNext = LORA_MESH_TX_NIL;
+    };
+
+    // move the due entries of one bucket to the ready lists
+    void expire(uint8_t b, long now) {
+        uint8_t i = _wheel[b];
+        while (i != LORA_MESH_TX_NIL) {
+            TX_ENTRY *e = &_e[i];
+            i = e->next;
+            if (e->deadline - now <= 0) {
+                unlink(e);
+                pushReady(e);
+            }
+        }
+    };
+
+    // visit the buckets of the ticks elapsed since the last call (the current tick is visited again next time)
+    void advance(long now) {
+        long t = now / LORA_MESH_TX_WHEEL_TICK;
+        if (!_tickValid || (t - _tick >= W) || (t - _tick < 0)) {
+            for (uint8_t b = 0; b < W; b++) expire(b, now);
+            _tick = t;
+            _tickValid = true;
+            return;
+        }
+        for (;;) {
+            expire((uint8_t)((unsigned long)_tick % W), now);
+            if (_tick == t) break;
+            _tick++;
+        }
+    };
+};
+
+#endif
@@ -0,0 +1,132 @@
+// Copyright © 2020 by antónio montez . All rights reserved.
+// Licensed under the MIT license.
+
+#include "LoraWifiMesh.h"
+
+#if defined(LORA_MESH_HAS_LORA)
+
+//--- the LoRa library callback has no context: the transport receiving by interrupt, and where it copies the datagram
+static LoRaTransport *_irqTransport = 0;
+static uint8_t _irqFrame[LORA_MESH_RX_SLOT_SIZE];
+
+static void loraOnReceive(int packetSize){
+    if (_irqTransport != 0) _irqTransport->onReceive(packetSize);
+}
+
+bool LoRaTransport::send(const uint8_t *buff, uint8_t len){
+    if (_rxMesh != 0) LoRa.onReceive(0);
+    if (_txSf != 0) {
+        LoRa.setSpreadingFactor(_txSf);
+        LoRa.setTxPower(_txPower);
+    }
+    LoRa.beginPacket();
+    #if LORA_MESH_LORA_SPI_BURST
+    _fifo.writePacket(buff, len);
+    #else
+    for (int i = 0;i<len;i++){
+      LoRa.write(buff[i]);
+    }
+    #endif
+    LoRa.endPacket();
+    //--- the SX127x receives on the SF it was last given
+    if ((_txSf != 0) && (_txSf != _listenSf)) LoRa.setSpreadingFactor(_listenSf);
+    //--- straight back to listening, the sketch doesn't poll
+    if (_rxMesh != 0) {
+        LoRa.onReceive(loraOnReceive);
+        LoRa.receive();
+    }
+    return true;
+}
+
+bool LoRaTransport::receiveInterrupt(LoraWifiMesh *mesh){
+    _rxMesh = mesh;
+    if (mesh == 0) {
+        LoRa.onReceive(0);
+        _irqTransport = 0;
+        LoRa.idle();
+        return true;
+    }
+    _irqTransport = this;
+    LoRa.onReceive(loraOnReceive);
+    LoRa.receive();
+    return true;
+}
+
+// DIO0 interrupt: the LoRa library pointed the FIFO at a datagram of packetSize bytes
+void LoRaTransport::onReceive(int packetSize){
+    int cnt;
+
+    #if LORA_MESH_LORA_SPI_BURST
+    cnt = _fifo.readReceived(_irqFrame, packetSize, sizeof(_irqFrame));
+    #else
+    cnt = ((packetSize > 0) && (packetSize <= (int)sizeof(_irqFrame))) ? packetSize : -1;
+    for (int i = 0; i < cnt; i++) _irqFrame[i] = (uint8_t)LoRa.read();
+    #endif
+    _rxMesh->pushFrame(_irqFrame, cnt, (int16_t)LoRa.packetRssi(), (int8_t)LoRa.packetSnr());
+}
+
+void LoRaTransport::txParams(uint8_t sf, int8_t power, uint8_t listenSf){
+    _txSf = sf;
+    _txPower = power;
+    _listenSf = listenSf;
+}
+
+int LoRaTransport::receive(uint8_t *buff, int maxLen){
+    if (_rxMesh != 0) return 0;     // the datagrams come by interrupt
+    #if LORA_MESH_LORA_SPI_BURST
+    return _fifo.readPacket(buff, maxLen);
+    #else
+    int cnt = 0;
+    while (LoRa.available()) {
+        if (cnt >= maxLen) {
+            while (LoRa.available()) LoRa.read();   // drop the rest of an oversized frame
+            return -1;
+        }
+        buff[cnt++] = (uint8_t)LoRa.read();
+    }
+    return cnt;
+    #endif
+}
+
+// channel activity detection, SX127X_CAD_SYMBOLS symbols at most: the channel is taken as free when the radio says nothing
+uint8_t LoRaTransport::channelState(){
+    bool detected = false;
+
+    if (_rxMesh != 0) LoRa.onReceive(0);
+    if (!_fifo.cad(detected, millis)) LoRa.idle();
+    if (_rxMesh != 0) {
+        LoRa.onReceive(loraOnReceive);
+        LoRa.receive();
+    }
+    return detected ? LORA_MESH_CHANNEL_BUSY : LORA_MESH_CHANNEL_FREE;
+}
+
+int16_t LoRaTransport::lastRssi(){
+    return (int16_t)LoRa.packetRssi();
+}
+
+int8_t LoRaTransport::lastSnr(){
+    return (int8_t)LoRa.packetSnr();
+}
+
+#endif
+
+#if defined(LORA_MESH_HAS_ESPNOW)
+
+bool EspNowTransport::send(const uint8_t *buff, uint8_t len){
+    byte result;
+
+    memcpy(dataToSend,buff,len);
+    result = esp_now_send(broadcastAddress, dataToSend, len);
+    if (result != 0 /*ESP_OK*/) {
+        Serial.println("Error sending the data");
+        return false;
+    }
+    return true;
+}
+
+int EspNowTransport::receive(uint8_t *buff, int maxLen){
+    return 0;    // frames are pushed by the esp_now receive callback with pushFrame
+}
+
+#endif
@@ -0,0 +1,150 @@
+// Copyright © 2020 by antónio montez . All rights reserved.
+// Licensed under the MIT license.
+
+#ifndef _LORA_WIFI_MESH_TRANSPORT_H_
+#define _LORA_WIFI_MESH_TRANSPORT_H_
+
+#include <stdint.h>
+
+class LoraWifiMesh;
+
+// channelState(): listen before talk
+#define LORA_MESH_CHANNEL_FREE 0
+#define LORA_MESH_CHANNEL_BUSY 1
+#define LORA_MESH_CHANNEL_CHECKING 2            // a detection is running, ask again later
+
+/*!
+    @brief  Radio abstraction used by LoraWifiMesh::_send and LoraWifiMesh::processMsg
+
+            send()    puts one complete datagram on the air.
+            receive() copies the next pending datagram into buff and returns its size,
+                      0 when nothing is pending and -1 when the datagram does not fit in maxLen.
+
+            Push style radios (ESP_NOW) hand the frames to LoraWifiMesh::pushFrame from their receive callback
+            and return 0 in receive(). A radio that can do both switches to push with receiveInterrupt().
+            A custom transport (e.g. the host simulator) can be installed with LoraWifiMesh::setTransport
+*/
+
+class LoraWifiMeshTransport {
+  public:
+    virtual ~LoraWifiMeshTransport() {};
+
+    virtual bool send(const uint8_t *buff, uint8_t len) = 0;
+    virtual int receive(uint8_t *buff, int maxLen) = 0;
+
+    // upper bound (ms) of the random delay the transmit scheduler puts before each frame, 0 for none
+    virtual uint8_t txJitter() { return 0; };
+
+    // link quality of the last received datagram, 0 when the radio doesn't report it
+    virtual int16_t lastRssi() { return 0; };
+    virtual int8_t lastSnr() { return 0; };
+
+    // adaptive data rate: spreading factor and power (dBm) of the next send(), listenSf the one to receive on after it
+    virtual void txParams(uint8_t /* sf */, int8_t /* power */, uint8_t /* listenSf */) {};
+    // spreading factors the radio receives on at once (bit sf - 6), 0: only the one it listens on
+    virtual uint8_t rxSfMask() { return 0; };
+
+    // interrupt driven receive: every datagram goes to mesh->pushFrame() with its rssi / snr as soon as it
+    // arrives and the radio listens again right after each send(); 0: back to receive(). false when not supported
+    virtual bool receiveInterrupt(LoraWifiMesh * /* mesh */) { return false; };
+
+    // is somebody on the air: non blocking, LORA_MESH_CHANNEL_CHECKING until the answer is known.
+    // FREE when the radio can't tell (ESP_NOW: the 802.11 MAC does its own carrier sense)
+    virtual uint8_t channelState() { return LORA_MESH_CHANNEL_FREE; };
+};
+
+#if defined(LORA_MESH_HAS_LORA)
+// datagrams go through the SX127x FIFO in one SPI burst (LoraWifiMeshSX127x.h),
+// false: byte by byte with LoRa.read() / LoRa.write()
+#if !defined(LORA_MESH_LORA_SPI_BURST)
+#define LORA_MESH_LORA_SPI_BURST true
+#endif
+// chip select and clock of the radio, the ones given to LoRa.setPins() / LoRa.setSPIFrequency()
+#if !defined(LORA_MESH_LORA_SS) && defined(LORA_DEFAULT_SS_PIN)
+#define LORA_MESH_LORA_SS LORA_DEFAULT_SS_PIN
+#elif !defined(LORA_MESH_LORA_SS)
+#define LORA_MESH_LORA_SS SS
+#endif
+#if !defined(LORA_MESH_LORA_SPI_FREQ)
+#define LORA_MESH_LORA_SPI_FREQ 8E6
+#endif
+#include <SPI.h>
+#include "LoraWifiMeshSX127x.h"
+
+// SPI bus of MeshSX127xFifo, the chip select and transaction order of the LoRa library
+class MeshLoRaSpi {
+  public:
+    MeshLoRaSpi(uint8_t ss, SPIClass &spi, uint32_t freq) : _ss(ss), _spi(spi), _settings(freq, MSBFIRST, SPI_MODE0) {};
+
+    void select() { digitalWrite(_ss, LOW); _spi.beginTransaction(_settings); };
+    void deselect() { _spi.endTransaction(); digitalWrite(_ss, HIGH); };
+    uint8_t transfer(uint8_t b) { return _spi.transfer(b); };
+    void read(uint8_t *buff, uint8_t len) { _spi.transfer(buff, len); };
+    void write(const uint8_t *buff, uint8_t len) {
+        #if defined(ESP32)
+        _spi.writeBytes(buff, len);
+        #else
+        for (uint8_t i = 0; i < len; i++) _spi.transfer(buff[i]);
+        #endif
+    };
+
+  private:
+    uint8_t _ss;
+    SPIClass &_spi;
+    SPISettings _settings;
+};
+
+/*!
+    @brief  LoRa radio (SX127x with the LoRa library). The sketch keeps calling LoRa.parsePacket(),
+            receive() then takes the parsed datagram. A radio on other pins than the library defaults
+            needs its own instance: static LoRaTransport lora(ss, SPI); LWMesh.setTransport(&lora);
+
+            With receiveInterrupt() the radio stays in continuous receive and the LoRa library DIO0 interrupt
+            (LoRa.onReceive) copies each datagram in the receive ring, the sketch must stop calling LoRa.parsePacket().
+            The interrupt is detached while sending: the library would take the TX done of LoRa.endPacket().
+
+            channelState() runs a channel activity detection (CAD, a few symbols looking for a LoRa preamble)
+            and waits for its end on the spot, a LoRa.parsePacket() of the sketch in between would wipe the result.
+            Then the radio goes back to standby (the sketch's LoRa.parsePacket() re-arms it) or to continuous
+            receive in interrupt mode.
+*/
+
+class LoRaTransport : public LoraWifiMeshTransport {
+  public:
+    LoRaTransport(uint8_t ss = LORA_MESH_LORA_SS, SPIClass &spi = SPI, uint32_t freq = LORA_MESH_LORA_SPI_FREQ)
+        : _bus(ss, spi, freq), _fifo(_bus) {};
+
+    bool send(const uint8_t *buff, uint8_t len);
+    int receive(uint8_t *buff, int maxLen);
+    int16_t lastRssi();
+    int8_t lastSnr();
+    void txParams(uint8_t sf, int8_t power, uint8_t listenSf);
+    bool receiveInterrupt(LoraWifiMesh *mesh);
+    void onReceive(int packetSize);
+    uint8_t channelState();
+  private:
+    uint8_t _txSf = 0;              // 0: the radio is left as the sketch set it
+    int8_t _txPower = 0;
+    uint8_t _listenSf = 0;
+    LoraWifiMesh *_rxMesh = 0;
+    MeshLoRaSpi _bus;
+    MeshSX127xFifo<MeshLoRaSpi> _fifo;
+};
+#endif
+
+#if defined(LORA_MESH_HAS_ESPNOW)
+// random spacing of the ESP_NOW frames so neighbours relaying the same broadcast don't collide
+#define LORA_MESH_ESPNOW_TX_JITTER 5
+
+class EspNowTransport : public LoraWifiMeshTransport {
+  public:
+    bool send(const uint8_t *buff, uint8_t len);
+    int receive(uint8_t *buff, int maxLen);
+    uint8_t txJitter() { return LORA_MESH_ESPNOW_TX_JITTER; };
+  private:
+    uint8_t broadcastAddress[6] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+    uint8_t dataToSend[WIFI_MAX_MSG_SIZE];
+};
+#endif
+
+#endif